@@ -6,7 +6,17 @@ ninja
 cd src
 RISCV=~/software/riscv
 
-cat <<EOF | riscv64-linux-gnu-gcc -xc -c -o tmp2.o -
+# RVCC_TARGET=x86-64 ./run.sh 生成 x86-64 代码并在本机运行, 用于和 RISC-V 的结果对照
+RVCC_TARGET=${RVCC_TARGET:-rv64}
+if [ "$RVCC_TARGET" = "x86-64" ]; then
+    CC=gcc
+    RUN=
+else
+    CC=riscv64-linux-gnu-gcc
+    RUN="$RISCV/bin/qemu-riscv64 -L $RISCV/sysroot"
+fi
+
+cat <<EOF | $CC -xc -c -o tmp2.o -
 int ret3() { return 3; }
 int ret5() { return 5; }
 int add(int x, int y) { return x+y; }
@@ -19,9 +29,9 @@ EOF
 assert() {
     expect="$1"
     input="$2"
-    ./rvcc "$input" >tmp.s || exit
-    riscv64-linux-gnu-gcc -static -o tmp tmp.s tmp2.o
-    $RISCV/bin/qemu-riscv64 -L $RISCV/sysroot ./tmp
+    ./rvcc --target $RVCC_TARGET $RVCC_FLAGS "$input" >tmp.s || exit
+    $CC -static -o tmp tmp.s tmp2.o
+    $RUN ./tmp
     actual="$?"
     # 注意 shell 脚本 "[" 和 "]" 用作test 需要空格
     if [ "$actual" = "$expect" ]; then
@@ -192,5 +202,223 @@ assert 8 'int main() { int x[3][4]; return sizeof(**x + 1); }'
 assert 8 'int main() { int x=1; return sizeof(x=2); }'
 assert 1 'int main() { int x=1; sizeof(x=2); return x; }'
 
+# 支持块作用域
+assert 7 'int main() { int x=3; { int x=5; x=x+1; } return x+4; }'
+assert 11 'int main() { int x=3; { int x=5; { int y=x; x=y+1; } x=x+5; return x; } return x; }'
+assert 3 'int main() { int x=3; { int y=4; } { int y=5; } return x; }'
+assert 4 'int f(int x) { { int x=1; } return x; } int main() { return f(4); }'
+./rvcc $'int f(int x) {\n  int x;\n  return x;\n}\nint main() { return f(1); }' 2>redefined.txt && { echo "parameter redefinition not rejected"; exit 1; }
+grep -q 'x is redefined in the same scope' redefined.txt && grep -qx '<input>:2:7' redefined.txt &&
+  grep -qx '   int x;' redefined.txt && grep -qx '       ^' redefined.txt ||
+  { echo "redefinition error has no location"; cat redefined.txt; exit 1; }
+
+# 支持逐个函数流式编译, 生成的代码与完整解析相同 (完整解析时函数按名字的 hash 排列)
+P='int main() { int a[4]; int i; int s=0; for (i=0; i<4; i=i+1) a[i]=i*3; for (i=0; i<4; i=i+1) if (a[i]>2) s=s+a[i]; return s; }'
+for flags in "" "-O1"; do
+  cmp -s <(./rvcc $flags "$P") <(./rvcc $flags --stream "$P") || { echo "--stream $flags output differs"; exit 1; }
+done
+RVCC_FLAGS="--stream"
+assert 18 "$P"
+assert 55 'int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }'
+assert 7 'int add2(int x, int y) { return x+y; } int sub2(int x, int y) { return x-y; } int main() { return add2(sub2(9, 4), 2); }'
+RVCC_FLAGS=
+./rvcc --stream 'int f() { return 1; } int f() { return 2; } int main() { return f(); }' 2>&1 >/dev/null |
+  grep -q 'function f is redefined' || { echo "--stream accepts a redefined function"; exit 1; }
+
+# 支持注释和预处理指令
+assert 5 $'// comment\nint main() { /* c */ return 5; }'
+assert 6 $'#define M(x) x*2\nint main() { return M(3); }'
+assert 9 $'#define A 4\n#define B(x, y) (x + y)\nint main() { return B(A, 5); }'
+assert 3 $'#ifdef A\nint main() { return 2; }\n#else\nint main() { return 3; }\n#endif'
+assert 2 $'#define A 1\n#if defined(A) && A > 0\nint main() { return 2; }\n#endif'
+
+# 支持预编译头文件
+cat <<EOF >prelude.h
+#ifndef PRELUDE_H
+#define PRELUDE_H
+int twice(int x) { return x*2; }
+int sum(int *p, int n) { int s=0; int i; for (i=0; i<n; i=i+1) s=s+p[i]; return s; }
+#endif
+EOF
+./rvcc --emit-pch prelude.h -o prelude.pch || exit
+RVCC_FLAGS="--include-pch prelude.pch"
+assert 8 'int main() { return twice(4); }'
+assert 6 'int main() { int a[3]; a[0]=1; a[1]=2; a[2]=3; return sum(a, 3); }'
+RVCC_FLAGS="--stream --include-pch prelude.pch"
+assert 42 'int main() { return twice(21); }'
+RVCC_FLAGS=
+head -c 200 prelude.pch >bad.pch
+./rvcc --include-pch bad.pch 'int main() { return 0; }' 2>&1 | grep -q 'invalid pch' || { echo "bad.pch not rejected"; exit 1; }
+
+# 支持并发解析顶层函数
+RVCC_FLAGS="-j 4"
+assert 55 'int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }'
+assert 7 'int add2(int x, int y) { return x+y; } int sub2(int x, int y) { return x-y; } int main() { return add2(sub2(9, 4), 2); }'
+RVCC_FLAGS=
+
+# 出错时只打印 文件:行:列, 出错的一行和指向出错位置的 ^
+./rvcc $'int main() {\n  int x=1;\n  return x +;\n}' 2>error.txt && { echo "syntax error not rejected"; exit 1; }
+grep -qx '<input>:3:13' error.txt && grep -qx '   return x +;' error.txt && grep -qx '             ^' error.txt ||
+  { echo "syntax error has no location"; cat error.txt; exit 1; }
+printf 'int twice(int x) {\n  return x*;\n}\n' >bad.h
+./rvcc -I . $'#include "bad.h"\nint main() { return twice(2); }' 2>error.txt && { echo "error in header not rejected"; exit 1; }
+grep -qx '\(.*/\)\?bad\.h:2:12' error.txt && grep -qx '   return x\*;' error.txt && grep -qx '            ^' error.txt ||
+  { echo "error in header has no location"; cat error.txt; exit 1; }
+
+# x86-64 的输出声明不需要可执行的栈, 每个文件一次
+[ "$(./rvcc --target x86-64 'int f() { return 1; } int main() { return f(); }' | grep -c '\.note\.GNU-stack')" = 1 ] ||
+  { echo "x86-64 output has no single .note.GNU-stack section"; exit 1; }
+
+# 支持优化记录, 头文件中的函数在解析结束后仍然可以定位
+RVCC_FLAGS="-I . -fsave-optimization-record=remarks.json"
+assert 10 $'#include "prelude.h"\nint main() { int x=5; return twice(x); }'
+RVCC_FLAGS=
+grep -q '"name": "StackSlot"' remarks.json || { echo "remarks.json has no StackSlot record"; exit 1; }
+grep -q '"file": "[^"]*prelude.h"' remarks.json || { echo "remarks.json has no prelude.h location"; exit 1; }
+
+# 支持生成代码的静态统计
+./rvcc --stats=json 'int main() { int x=1; if (x) x=2; return x; }' 2>stats.json >/dev/null || exit
+grep -q '"name": "main"' stats.json && grep -q '"total"' stats.json || { echo "stats.json is incomplete"; exit 1; }
+
+# 支持按优化级别组织的 pass 流水线
+RVCC_FLAGS="-O2 --time-passes"
+assert 55 'int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }'
+RVCC_FLAGS="-Os -mllvm -opt-bisect-limit=0"
+assert 7 'int main() { int x=3; int y=4; return x+y; }'
+RVCC_FLAGS=
+# -O1 不做强度削弱, -Os 不选择比 li + mul 更长的序列
+P='int f(int x) { return x*10; } int main() { return f(7); }'
+./rvcc -O1 "$P" | grep -q 'mul ' && ! ./rvcc -O2 "$P" | grep -q 'mul ' &&
+  ./rvcc -Os "$P" | grep -q 'mul ' || { echo "-O1 -O2 -Os pipelines are not distinct"; exit 1; }
+[ "$(./rvcc -O1 -mllvm -opt-bisect-limit=1 'int main() { return 0; }' 2>&1 >/dev/null | grep -c '^BISECT: ')" -gt 1 ] ||
+  { echo "-opt-bisect-limit prints no BISECT lines"; exit 1; }
+
+# 支持表达式的中间结果使用寄存器分配
+RVCC_FLAGS="-O1"
+assert 87 'int main() { int x=3; return (x+1)*(x+2)-x/(x+4)*(x*2+1)+(x*(x*(x*(x-1)+1)+1)+1); }'
+assert 20 'int sum6(int a, int b, int c, int d, int e, int f) { return a+b+c+d+e+f; } int main() { return sum6(1, sum6(0,0,0,0,0,2), 3, sum6(1,1,1,0,0,0), 5, 6) + 0*sum6(1,2,3,4,5,6); }'
+assert 55 'int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }'
+RVCC_FLAGS="-O1 -fsave-optimization-record=remarks.json"
+assert 105 'int g(int x) { return x; } int f(int x) { int a=x+1; int b=x+2; int c=x+3; int d=x+4; int e=x+5; int h=x+6; int i=x+7; int j=x+8; int k=x+9; int l=x+10; int m=x+11; int n=x+12; int o=x+13; int p=g(x); return a+b+c+d+e+h+i+j+k+l+m+n+o+p; } int main() { return f(1); }'
+RVCC_FLAGS=
+grep -q '"name": "Spilled"' remarks.json || { echo "remarks.json has no Spilled record"; exit 1; }
+RVCC_FLAGS="-O1 -fsave-optimization-record=remarks.json"
+assert 9 'int main() { int x=3; return 2*3+x*1+0; }'
+RVCC_FLAGS=
+grep -q '"name": "Folded"' remarks.json && grep -q '"name": "Simplified"' remarks.json ||
+  { echo "remarks.json has no Folded or Simplified record"; exit 1; }
+
+# 支持把没有取地址的局部标量提升到寄存器
+RVCC_FLAGS="-O1"
+assert 45 'int main() { int s=0; int i; for (i=0; i<10; i=i+1) s=s+i; return s; }'
+assert 30 'int twice(int x) { return x+x; } int main() { int s=0; int i=0; while (i<6) { s=s+twice(i); i=i+1; } return s; }'
+assert 12 'int main() { int x=3; int y=4; int *p=&y; *p=*p+5; return x+y; }'
+assert 7 'int main() { int a[2]; int i=1; a[0]=3; a[i]=4; return a[0]+a[1]; }'
+assert 8 'int sub2(int x, int y) { int t=x; x=y; y=t; return y-x; } int main() { return sub2(10, 2); }'
+RVCC_FLAGS=
+
+# 支持常量折叠和代数化简
+RVCC_FLAGS="-O1"
+assert 15 'int main() { return 5*(9-6); }'
+assert 17 'int main() { int a[3]; a[2]=5*(9-6); return a[2]+0*a[1]+1*2; }'
+assert 10 'int main() { int x=4; int y=x+1+2+3-5; return - -y+x-x+y*0+y/1; }'
+assert 3 'int three() { return 3; } int main() { int x=0; return x*0+three()*1-(x-x); }'
+assert 1 'int main() { int a[4]; int *p=a; *(p+1+2)=1; return *(p+3)+0; }'
+RVCC_FLAGS=
+
+# 支持乘除以常量的强度削弱
+RVCC_FLAGS="-O2"
+assert 84 'int main() { int x=7; return x*8+x*10+x*-7+x*1+x*0; }'
+assert 14 'int main() { int x=100; return x/7; }'
+assert 28 'int main() { int x=-100; return x/7 + x/-8 + 30; }'
+assert 123 'int main() { int x=123456; return x/1000 + x/1 - x/-1 - x*2; }'
+assert 9 'int main() { int a[4]; int *p=a; int i=3; a[3]=9; return *(p+i); }'
+RVCC_FLAGS="-Os"
+assert 28 'int main() { int x=200; return x/7; }'
+RVCC_FLAGS=
+
+# 支持按规则表选择立即数和基址偏移寻址的指令
+RVCC_FLAGS="-O1"
+assert 5 'int main() { int x=5; return (x<10)+(x<=5)+(x>4)+(x>=6)+(x==5)+(x!=0)+(x-3==1); }'
+assert 2 'int main() { int x=2000; return (x+48>2047)+(x-4000<-2000)+(x<=-2049)+(x>=2000); }'
+assert 12 'int main() { int a[3]; int *p=a; a[0]=1; *(p+1)=4; p[2]=7; return a[0]+*(a+1)+p[2]; }'
+RVCC_FLAGS=
+
+# 支持窥孔优化, --pass-stats 输出每条规则的命中次数
+RVCC_FLAGS="-O1 -fno-regalloc"
+assert 14 'int sub2(int a, int b) { return a-b; } int main() { int x=4; return sub2(x+3*x, 2)+sub2(1, x)+3; }'
+RVCC_FLAGS="-O0 -fpeephole"
+assert 6 'int main() { int x=3; if (x) return x*2; return 0; }'
+RVCC_FLAGS=
+./rvcc -O1 -fno-regalloc --pass-stats 'int main() { int x=1; return x; }' 2>pass_stats.txt >/dev/null || exit
+grep -q '^peephole  *push-pop ' pass_stats.txt || { echo "pass_stats.txt is incomplete"; exit 1; }
+
+# 支持 if for while 的条件直接使用比较跳转指令
+RVCC_FLAGS="-O1"
+assert 55 'int main() { int s=0; int i; for (i=0; i<10; i=i+1) s=s+i; int n=50; while (s<=n) s=s+10; return s; }'
+assert 7 'int main() { int x=3; int y=4; int c=0; if (x==3) c=c+1; if (x!=3) c=c+10; if (x==0) c=c+100; if (x!=0) c=c+2; if (x==y) c=c+20; if (x<y) c=c+4; if (y<=x) c=c+40; return c; }'
+RVCC_FLAGS=
+
+# 支持叶子函数省略保存 ra 和栈帧, prologue 只放在需要栈帧的路径上
+RVCC_FLAGS="-O2"
+assert 14 'int g(int x) { return x+1; } int f(int n) { if (n==0) return 7; int a=g(n); int b=g(a); return a+b; } int main() { return f(0)+f(2); }'
+assert 12 'int h() { int a[2]; a[0]=3; a[1]=4; return a[0]*a[1]; } int main() { return h(); }'
+assert 10 'int g(int x) { return x; } int f(int n) { if (n<0) return 0; int s=0; while (n) { s=s+g(n); n=n-1; } return s; } int main() { return f(4)+f(-1); }'
+RVCC_FLAGS=
+for flags in "-O0" "-O1" "-O2"; do
+  ./rvcc $flags 'int f(int a, int b) { return a; } int main() { return f(3, 4); }' | grep -q 'addi sp, sp, 0$' &&
+    { echo "$flags allocates an empty frame"; exit 1; }
+done
+
+# 支持调用参数直接计算到参数寄存器
+RVCC_FLAGS="-O1"
+assert 15 'int plus(int x, int y) { return x+y; } int main() { int a=3; return plus(plus(a, 1), plus(2, a+plus(a, a))); }'
+assert 21 'int sum6(int a, int b, int c, int d, int e, int f) { return a+b+c+d+e+f; } int main() { int x=1; int *p=&x; return sum6(x, 2, x+2, sum6(1, 1, 1, 1, 0, 0), *p+4, 6); }'
+assert 7 'int first(int *p, int n) { return *p+n; } int main() { int a[2]; a[0]=5; return first(a, 2); }'
+RVCC_FLAGS="-O1 -fno-ssa"
+assert 15 'int plus(int x, int y) { return x+y; } int main() { int a=3; return plus(plus(a, 1), plus(2, a+plus(a, a))); }'
+assert 12 'int g(int *p) { *p=9; return 1; } int f(int a, int b) { return a*10+b; } int main() { int y=2; return f(g(&y), y); }'
+RVCC_FLAGS="-O1 -fno-regalloc"
+assert 15 'int plus(int x, int y) { return x+y; } int main() { int a=3; return plus(plus(a, 1), plus(2, a+plus(a, a))); }'
+RVCC_FLAGS=
+P='int f(int a, int b) { return a+b; } int main() { return f(3, 4); }'
+cmp -s <(./rvcc -O1 "$P") <(./rvcc -O1 -fno-reg-args "$P") && { echo "-fno-reg-args has no effect at -O1"; exit 1; }
+
+# 支持 SSA IR, --emit-ir 输出的文本可以由 --from-ir 读回
+RVCC_FLAGS="-O1"
+assert 4 'int main() { int x=1; int y=2; int i; for (i=0; i<5; i=i+1) { int t=x; x=y; y=t; } return x+y*0+i-3; }'
+assert 25 'int f(int n) { int s=0; while (n>0) { if (n/2*2==n) s=s+n; else s=s-1; n=n-1; } return s; } int main() { return f(10); }'
+RVCC_FLAGS="-O1 -fno-ssa"
+assert 25 'int f(int n) { int s=0; while (n>0) { if (n/2*2==n) s=s+n; else s=s-1; n=n-1; } return s; } int main() { return f(10); }'
+RVCC_FLAGS="-O1 --from-ir"
+assert 7 $'func @main {\nbb0:\n  %0 = const i64 3\n  %1 = const i64 4\n  %2 = add i64 %0, %1\n  ret %2\n}'
+RVCC_FLAGS=
+./rvcc -O1 --emit-ir 'int main() { int s=0; int i; int j; for (i=0; i<3; i=i+1) for (j=0; j<i; j=j+1) s=s+j; return s; }' >ir.txt || exit
+grep -q 'loop bb[0-9]* depth 2' ir.txt || { echo "ir.txt has no nested loop"; exit 1; }
+./rvcc --from-ir --emit-ir "$(cat ir.txt)" | cmp -s - ir.txt || { echo "ir.txt does not round-trip"; exit 1; }
+./rvcc -O1 --from-ir $'func @m {\nbb0:\n  %0 = param i64 7\n  ret %0\n}' 2>&1 | grep -q 'reads parameter 7' || { echo "param 7 not rejected"; exit 1; }
+./rvcc -O1 --from-ir $'func @m {\nbb0:\n  %0 = param i64 0\n  %1 = load i64 %0\n  ret %1\n}' 2>&1 | grep -q 'has operands of type i64' || { echo "load of i64 not rejected"; exit 1; }
+./rvcc -O1 'int f(int a, int b) { return a; } int main() { return f(3, 4); }' | grep -q 'mv t0, a0' &&
+  { echo "parameter and call result copied only to be returned"; exit 1; }
+
+# 删除死代码, 死 store 和不可达的块
+RVCC_FLAGS="-O1"
+assert 3 'int main() { int x=3; { return x; x=4; } return 5; }'
+assert 8 'int main() { int a[2]; int x; int *p=&x; x=1; x=2; a[0]=5; a[1]=6; if (0) x=9; return *p+a[1]; }'
+assert 2 'int g(int *p) { return *p; } int main() { int x=1; int y=g(&x); x=2; return x; }'
+RVCC_FLAGS=
+./rvcc -O1 --emit-ir 'int main() { int a[2]; int x=1; x=2; a[0]=3; if (0) return 1; return x; x=5; }' >ir.txt || exit
+grep -qE 'store|alloca|br ' ir.txt && { echo "ir.txt has dead code"; exit 1; }
+
+# 支持全局值编号, 复用冗余的计算和 load
+RVCC_FLAGS="-O2"
+assert 6 'int main() { int a[3][4]; int b[3][4]; int i=1; int j=2; a[i][j]=1; b[i][j]=2; a[i][j]=a[i][j]+b[i][j]; return a[i][j]*2; }'
+assert 5 'int main() { int a[4]; int i=1; int j=1; a[i]=3; a[j]=5; return a[i]; }'
+assert 10 'int set(int *p) { *p=9; return 0; } int main() { int x=1; int *q=&x; int a=*q; set(q); return a+*q; }'
+assert 2 'int f(int *p, int *q) { *p=1; *q=2; return *p; } int main() { int x; return f(&x, &x); }'
+RVCC_FLAGS=
+./rvcc -O2 --emit-ir 'int main() { int a[3][4]; int i=1; int j=2; a[i][j]=a[i][j]+1; return a[i][j]; }' >ir.txt || exit
+[ "$(grep -c 'load' ir.txt)" = 1 ] || { echo "ir.txt has redundant loads"; exit 1; }
+
 # 如果运行正常未提前退出，程序将显示OK
 echo OK
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "ast.h"
+#include "callargs.h"
 #include "codegen.h"
+#include "context.h"
+#include "isel.h"
 #include "logger.h"
 #include "type.h"
 #include "utils.h"
@@ -19,8 +22,6 @@ namespace rvcc {
 
 std::atomic_int Expr::g_id = 0;
 
-const char* global_func_name = nullptr;
-
 const char* Expr::kind_names[static_cast<int>(ExprKind::NODE_COUNT)] {
   // 叶子节点
   "NODE_NUM",
@@ -54,10 +55,15 @@ Var::Var() {
   name_ = nullptr;
   name_len_ = 0;
   value_ = 0;
+  scope_depth_ = 0;
+  live_begin_ = 0;
+  live_end_ = -1;
+  promoted_ = false;
 }
 
 Var::Var(char* name, int len, int value, Type* type): 
-  name_(name), name_len_(len), value_(value), type_(type) {}
+  name_(name), name_len_(len), value_(value), type_(type),
+  scope_depth_(0), live_begin_(0), live_end_(-1), promoted_(false) {}
 
 std::size_t& Var::name_len() {
   return name_len_;
@@ -83,13 +89,29 @@ Type*& Var::type() {
   return type_;
 }
 
-Expr::Expr() {
+int& Var::scope_depth() {
+  return scope_depth_;
+}
+
+int& Var::live_begin() {
+  return live_begin_;
+}
+
+int& Var::live_end() {
+  return live_end_;
+}
+
+bool& Var::promoted() {
+  return promoted_;
+}
+
+Expr::Expr(): loc_(nullptr) {
   kind_ = ExprKind::NODE_ILLEGAL;
   id_ = g_id;
   g_id++;
 }
 
-Expr::Expr(ExprKind kind):kind_(kind) {
+Expr::Expr(ExprKind kind):kind_(kind), loc_(nullptr) {
   id_ = g_id;
   g_id++;
 }
@@ -142,6 +164,10 @@ ExprKind& Expr::kind() {
   return kind_;
 }
 
+const char*& Expr::loc() {
+  return loc_;
+}
+
 const char* Expr::kindName() const {
   return kind_names[static_cast<int>(kind_)];
 }
@@ -189,48 +215,30 @@ Type*& BinaryExpr::type() {
 void BinaryExpr::codegen() {
   int offset = 0;
   switch (kind()) {
-  case ExprKind::NODE_ADD:
-    add_("a0", "a0", "a1");
-    break;
-  case ExprKind::NODE_SUB:
-    sub_("a0", "a0", "a1");
-    break;
-  case ExprKind::NODE_MUL:
-    mul_("a0", "a0", "a1");
-    break;
-  case ExprKind::NODE_DIV:
-    div_("a0", "a0", "a1");
-    break;
-  case ExprKind::NODE_EQ:
-    xor_("a0", "a0", "a1");
-    seqz_("a0", "a0");
-    break;
-  case ExprKind::NODE_NE:
-    xor_("a0", "a0", "a1");
-    snez_("a0", "a0");
-    break;
-  case ExprKind::NODE_LT:
-    slt_("a0", "a0", "a1");
-    break;
-  case ExprKind::NODE_LE:
-    slt_("a0", "a1", "a0");
-    xori_("a0", "a0", 1);
-    break;
   case ExprKind::NODE_ASSIGN:
     if (getLeft()->kind() == ExprKind::NODE_ID) {
       walkRightImpl(getRight(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-      offset = -(dynamic_cast<IdentityExpr*>(getLeft())->var()->offset() + type()->size());
-      sd_("a0", "fp", offset);
+      Var* var = dynamic_cast<IdentityExpr*>(getLeft())->var();
+      if (var->promoted()) {
+        mv_(promotedReg(var), REG_ACC);
+        break;
+      }
+      offset = -(var->offset() + type()->size());
+      sd_(REG_ACC, REG_FP, offset);
     } else if (getLeft()->kind() == ExprKind::NODE_DEREF) {
-      genAddr(getLeft());
-      push_("a0");
+      offset = selectAddress(getLeft()->getLeft());
+      save_(REG_ACC);
       walkRightImpl(getRight(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-      pop_("a1");
-      sd_("a0", "a1", 0);
+      restore_(REG_TMP);
+      sd_(REG_ACC, REG_TMP, offset);
     }
     break;
   default:
-    FATAL("binary expr cant support current kind: %s", kindName());
+    // 运算符由指令选择按规则表生成
+    if (!selectExpr(this)) {
+      FATAL("binary expr cant support current kind: %s", kindName());
+    }
+    break;
   }
 }
 
@@ -284,18 +292,17 @@ void UnaryExpr::codegen() {
   switch (kind()) {
   case ExprKind::NODE_NEG:
     walkRightImpl(getLeft(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-    neg_("a0", "a0");
+    neg_(REG_ACC, REG_ACC);
     break;
   case ExprKind::NODE_RETURN:
     walkRightImpl(getLeft(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-    goto_return_label_(global_func_name);
+    goto_return_label_(CompilerContext::current().funcName());
     break;
   case ExprKind::NODE_ADDR:
     genAddr(getLeft());
     break;
   case ExprKind::NODE_DEREF:
-    walkRightImpl(getLeft(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-    load(type());
+    selectExpr(this);
     break;
   default:
     ERROR("unary expr cant support current kind: %s", kindName());
@@ -335,7 +342,7 @@ Type*& NumExpr::type() {
 }
 
 void NumExpr::codegen() {
-  li_("a0", value());
+  li_(REG_ACC, value());
 }
 
 int& NumExpr::value() {
@@ -370,6 +377,10 @@ Type*& IdentityExpr::type() {
 }
 
 void IdentityExpr::codegen() {
+  if (var()->promoted()) {
+    mv_(REG_ACC, promotedReg(var()));
+    return;
+  }
   genAddr(this);
   if (type()->kind() == TypeKind::TYPE_ARRAY) {
     return;
@@ -416,14 +427,14 @@ const std::string CallExpr::getFuncName() {
 }
 
 void CallExpr::codegen() {
-  for (int i = args_.size() - 1; i >= 0; --i) {
-    walkRightImpl(args_[i], codegen_prev_func, codegen_mid_func, codegen_post_func);
-    push_("a0");
-  }
-  for (std::size_t i = 0; i < args_.size(); i++) {
-    std::string str("a");
-    str = str + std::to_string(i);
-    pop_(str.c_str());
+  if (!genCallArgs(args_)) {
+    for (int i = args_.size() - 1; i >= 0; --i) {
+      walkRightImpl(args_[i], codegen_prev_func, codegen_mid_func, codegen_post_func);
+      save_(REG_ACC);
+    }
+    for (std::size_t i = 0; i < args_.size(); i++) {
+      restore_(REG_ARG0 + i);
+    }
   }
   std::string func_name(func_name_, name_len_);
   call_(func_name.c_str());
@@ -582,12 +593,13 @@ Expr*& IfExpr::els() {
 
 void IfExpr::codegen() {
   std::uint32_t unique_id = uniqueId();
-  printf("\n# =====分支语句%d==============\n", unique_id);
+  comment_("\n# =====分支语句%d==============\n", unique_id);
     // 生成条件内语句
-  printf("\n# Cond表达式%d\n", unique_id);
-  walkRightImpl(getCond(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-  goto_else_label_("a0", unique_id);
-  printf("\n# Then语句%d\n", unique_id);
+  comment_("\n# Cond表达式%d\n", unique_id);
+  selectBranch(getCond(), [&](MOpcode op, int reg1, int reg2) {
+    goto_else_label_(op, reg1, reg2, unique_id);
+  });
+  comment_("\n# Then语句%d\n", unique_id);
   getThen()->codegen();
   goto_end_label_(unique_id);
   else_label_(unique_id);
@@ -672,23 +684,24 @@ int& ForExpr::value() {
 
 void ForExpr::codegen() {
   std::uint32_t unique_id = uniqueId();
-  printf("\n# =====循环语句%d===============\n", unique_id);
+  comment_("\n# =====循环语句%d===============\n", unique_id);
   if (getInit()) {
-    printf("\n# Init语句%d\n", unique_id);
+    comment_("\n# Init语句%d\n", unique_id);
     walkRightImpl( getInit(), codegen_prev_func, codegen_mid_func, codegen_post_func);
   }
   loop_begin_label_(unique_id);
   if (getCond()) {
-    printf("# Cond表达式%d\n", unique_id);
-    walkRightImpl(getCond(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-    goto_loop_end_label_("a0", unique_id);
+    comment_("# Cond表达式%d\n", unique_id);
+    selectBranch(getCond(), [&](MOpcode op, int reg1, int reg2) {
+      goto_loop_end_label_(op, reg1, reg2, unique_id);
+    });
   }
   if (getStmts()) {
-    printf("\n# 循环 body 语句%d\n", unique_id);
+    comment_("\n# 循环 body 语句%d\n", unique_id);
     getStmts()->codegen();
   }
   if (getInc()) {
-    printf("\n# Inc语句%d\n", unique_id);
+    comment_("\n# Inc语句%d\n", unique_id);
     walkRightImpl(getInc(), codegen_prev_func, codegen_mid_func, codegen_post_func);
   }
   goto_loop_begin_label_(unique_id);
@@ -753,15 +766,16 @@ int& WhileExpr::value() {
 
 void WhileExpr::codegen() {
   std::uint32_t unique_id = uniqueId();
-  printf("\n# =====循环语句%d===============\n", unique_id);
+  comment_("\n# =====循环语句%d===============\n", unique_id);
   loop_begin_label_(unique_id);
   if (getCond()) {
-    printf("# Cond表达式%d\n", unique_id);
-    walkRightImpl( getCond(), codegen_prev_func, codegen_mid_func, codegen_post_func);
-    goto_loop_end_label_("a0", unique_id);
+    comment_("# Cond表达式%d\n", unique_id);
+    selectBranch(getCond(), [&](MOpcode op, int reg1, int reg2) {
+      goto_loop_end_label_(op, reg1, reg2, unique_id);
+    });
   }
   if (getStmts()) {
-    printf("\n# 循环 body 语句%d\n", unique_id);
+    comment_("\n# 循环 body 语句%d\n", unique_id);
     getStmts()->codegen();
   }
   goto_loop_begin_label_(unique_id);
@@ -789,7 +803,7 @@ void WhileExpr::visualize(std::ostringstream& oss, int& ident_num) {
 
 Function::Function() {
   body_ = nullptr;
-  var_maps_.clear();
+  vars_.clear();
 }
 
 Expr*& Function::body() {
@@ -808,12 +822,12 @@ std::size_t& Function::name_len() {
   return name_len_;
 }
 
-std::map<std::size_t, Var*>& Function::var_maps() {
-  return var_maps_;
+std::vector<Var*>& Function::vars() {
+  return vars_;
 }
 
-Function::Function(Expr* body, std::map<std::size_t,
-  Var*>&& var_maps):body_(body), var_maps_(std::move(var_maps)) {}
+Function::Function(Expr* body, std::vector<Var*>&& vars):
+  body_(body), vars_(std::move(vars)) {}
 
 
 Function::~Function() {}
@@ -839,7 +853,7 @@ void Function::visualize(std::ostringstream& oss, int& ident_num) {
   };
 }
 
-std::map<std::size_t, Var*>& Function::parameters() {
+std::vector<Var*>& Function::parameters() {
   return parameters_;
 }
 
@@ -865,6 +879,13 @@ void Ast::insert(std::pair<std::size_t, Function*> elem) {
   CHECK(functions_.insert(elem).second);
 }
 
+void Ast::erase(std::size_t hash, Function* func) {
+  auto iter = functions_.find(hash);
+  if (iter != functions_.end() && iter->second == func) {
+    functions_.erase(iter);
+  }
+}
+
 Ast::~Ast() {}
 
 Function* Ast::entry_function() {
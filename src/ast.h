@@ -18,8 +18,6 @@
 
 namespace rvcc {
 
-extern const char* global_func_name;
-
 enum class ExprKind:int{
   //叶子节点
   NODE_NUM = 0,         // number
@@ -60,6 +58,10 @@ class Var: public Object{
     Type*& type();
     const char* getName();
     std::size_t& name_len();
+    int& scope_depth();
+    int& live_begin();
+    int& live_end();
+    bool& promoted();
   private:
     const char* name_; // name 共享 输入buffer 制作， 不需要释放
     std::size_t name_len_;
@@ -67,6 +69,10 @@ class Var: public Object{
     int index_;
     int offset_; // codegen 再栈中的相对栈帧的偏移
     Type* type_;
+    int scope_depth_; // 声明所在的块作用域深度
+    int live_begin_;  // 声明时的序号, 见 SymbolTable
+    int live_end_;    // 离开作用域时的序号
+    bool promoted_;   // 只保存在虚拟寄存器中, 没有栈空间, 见 PromotePass
 };
 
 class Expr: public Object {
@@ -90,9 +96,12 @@ class Expr: public Object {
     int& id();
     ExprKind& kind();
     const char* kindName() const;
+    // 对应的 token 在输入中的位置, 用于 remark 等诊断信息, 编译器生成的节点为空
+    const char*& loc();
   private:
     int id_;
     ExprKind kind_;
+    const char* loc_;
     static std::atomic_int g_id;
     static const char* kind_names[static_cast<int>(ExprKind::NODE_COUNT)];
 
@@ -288,24 +297,24 @@ class WhileExpr: public NextExpr {
 class Function: public Object {
   public:
     Function();
-    Function(Expr* body, std::map<std::size_t, Var*>&& var_maps);
+    Function(Expr* body, std::vector<Var*>&& vars);
     ~Function();
-    std::map<std::size_t, Var*>& var_maps();
+    std::vector<Var*>& vars();
     void visualize(std::ostringstream& oss, int& ident_num);
     void codegen();
     Expr*& body();
     Type*& type();
     const char*& name();
     std::size_t& name_len();
-    std::map<std::size_t, Var*>& parameters();
+    std::vector<Var*>& parameters();
   private:
     void freeNode(Expr* curr);
     Expr* body_;
     Type* type_;
     const char* name_;
     std::size_t name_len_;
-    std::map<std::size_t, Var*> parameters_;
-    std::map<std::size_t, Var*> var_maps_;
+    std::vector<Var*> parameters_;  // 按声明顺序排列
+    std::vector<Var*> vars_;        // 所有局部变量, 包含函数参数
 };
 
 class Ast: public Object{
@@ -314,6 +323,8 @@ class Ast: public Object{
     ~Ast();
     Function* entry_function();
     void insert(std::pair<std::size_t, Function*> elem);
+    // 删除 func, 只有 hash 对应的函数确实是 func 时才删除
+    void erase(std::size_t hash, Function* func);
     void codegen();
     int visualization(std::string filename);
     void set_entry_point(std::size_t entry_point);
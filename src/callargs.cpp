@@ -0,0 +1,121 @@
+#include "callargs.h"
+#include "codegen.h"
+#include "context.h"
+#include "instructions.h"
+#include "mir.h"
+#include "type.h"
+#include "utils.h"
+
+namespace rvcc {
+
+namespace {
+
+// 只改写目标寄存器就能得到值的参数
+bool isSimpleArg(Expr* arg) {
+  return arg->kind() == ExprKind::NODE_NUM || arg->kind() == ExprKind::NODE_ID;
+}
+
+// 计算 arg 时可能修改 var: 对 var 赋值, 或者通过指针写入和调用修改没有提升到寄存器的变量
+bool mayModify(Expr* arg, Var* var) {
+  bool modified = false;
+  forEachNode(arg, [&](Expr* node) {
+    if (node->kind() == ExprKind::NODE_ASSIGN) {
+      Expr* left = node->getLeft();
+      modified = modified || (left->kind() == ExprKind::NODE_ID ?
+        static_cast<IdentityExpr*>(left)->var() == var : !var->promoted());
+    } else if (node->kind() == ExprKind::NODE_CALL) {
+      modified = modified || !var->promoted();
+    }
+  });
+  return modified;
+}
+
+// 简单参数可以在复杂参数之后直接放入参数寄存器, 但是它左边的参数 (按从右向左的顺序
+// 在它之后计算) 可能修改它的值时, 仍然在原来的位置读取
+bool isLateArg(const std::vector<Expr*>& args, std::size_t i) {
+  if (!isSimpleArg(args[i])) {
+    return false;
+  }
+  if (args[i]->kind() == ExprKind::NODE_NUM) {
+    return true;
+  }
+  Var* var = static_cast<IdentityExpr*>(args[i])->var();
+  for (std::size_t j = 0; j < i; j++) {
+    if (!isSimpleArg(args[j]) && mayModify(args[j], var)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void genSimpleArg(Expr* arg, int reg) {
+  if (arg->kind() == ExprKind::NODE_NUM) {
+    li_(reg, arg->value());
+    return;
+  }
+  Var* var = static_cast<IdentityExpr*>(arg)->var();
+  if (var->promoted()) {
+    mv_(reg, promotedReg(var));
+    return;
+  }
+  int offset = -(var->offset() + var->type()->size());
+  if (var->type()->kind() == TypeKind::TYPE_ARRAY) {
+    addi_(reg, REG_FP, offset);
+    return;
+  }
+  ld_(reg, REG_FP, offset);
+}
+
+} // namespace
+
+const char* CallArgsPass::name() const {
+  return "reg-args";
+}
+
+PassKind CallArgsPass::kind() const {
+  return PassKind::PASS_LOWERING;
+}
+
+const Pass* callArgsPass() {
+  static const CallArgsPass pass;
+  return &pass;
+}
+
+bool genCallArgs(const std::vector<Expr*>& args) {
+  if (!CompilerContext::current().passes().lowering(callArgsPass())) {
+    return false;
+  }
+  // 与之前一样从右向左计算, 最左边的复杂参数最后计算, 留在 REG_ACC 中
+  // 可以推迟的简单参数 (见 isLateArg) 的值不受计算顺序影响, 最后直接放入参数寄存器
+  std::vector<bool> late(args.size());
+  for (std::size_t i = 0; i < args.size(); i++) {
+    late[i] = isLateArg(args, i);
+  }
+  int last = -1;
+  for (int i = args.size() - 1; i >= 0; --i) {
+    if (late[i]) {
+      continue;
+    }
+    if (last >= 0) {
+      save_(REG_ACC);
+    }
+    walkRightImpl(args[i], codegen_prev_func, codegen_mid_func, codegen_post_func);
+    last = i;
+  }
+  if (last >= 0) {
+    mv_(REG_ARG0 + last, REG_ACC);
+  }
+  for (std::size_t i = last + 1; i < args.size(); i++) {
+    if (!late[i]) {
+      restore_(REG_ARG0 + i);
+    }
+  }
+  for (std::size_t i = 0; i < args.size(); i++) {
+    if (late[i]) {
+      genSimpleArg(args[i], REG_ARG0 + i);
+    }
+  }
+  return true;
+}
+
+} // namespace rvcc
@@ -0,0 +1,31 @@
+#ifndef __CALLARGS_H
+#define __CALLARGS_H
+
+#include "ast.h"
+#include "pass_manager.h"
+#include <vector>
+
+namespace rvcc {
+
+/*
+调用参数直接计算到参数寄存器
+  常量和变量直接 li / mv / ld 到参数寄存器, 不经过 REG_ACC 也不需要保存
+  其余参数 (可能包含嵌套调用) 先计算并保存, 最后计算的一个留在 REG_ACC 中直接 mv
+  仍然按从右向左的顺序求值: 左边的参数可能修改的变量在原来的位置读取
+  SSA IR 的参数已经是计算好的值, 启用时常量和地址直接生成到参数寄存器, 否则先生成到虚拟寄存器
+  作为表达式的操作数时, 调用的结果不再额外保存和取回一次
+*/
+class CallArgsPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+};
+
+const Pass* callArgsPass();
+
+// 把 args 放入 REG_ARG0 ~ REG_ARG5, pass 关闭时返回 false
+bool genCallArgs(const std::vector<Expr*>& args);
+
+} // namespace rvcc
+
+#endif
@@ -2,8 +2,16 @@
 #include "type.h"
 #include "utils.h"
 #include "codegen.h"
+#include "context.h"
 #include "ast.h"
+#include "callargs.h"
 #include "instructions.h"
+#include "ir_builder.h"
+#include "ir_lower.h"
+#include "isel.h"
+#include "regalloc.h"
+#include "target.h"
+#include "verifier.h"
 #include <cstddef>
 #include <map>
 #include <string>
@@ -14,9 +22,9 @@ Ast*& Codegen::ast() {
   return ast_;
 }
 
-const char* Codegen::arg_regs[6] = {
-  "a0", "a1", "a2", "a3", "a4", "a5"
-};
+bool& Codegen::emitIr() {
+  return emit_ir_;
+}
 
 /*
 当前实现比较low 参数会先把 a1 - a6的值压栈作为local变量来使用
@@ -35,51 +43,129 @@ const char* Codegen::arg_regs[6] = {
 
 void Codegen::codegen() {
   for (auto& elem: ast_->functions()) {
-    std::string func_name(elem.second->name(), elem.second->name_len());
-    CHECK(elem.second->parameters().size() <= 6);
-    std::size_t stack_size = 0;
-    // var_maps 包含函数参数
-    for (auto& var: elem.second->var_maps()) {
-      stack_size += var.second->type()->size();
+    codegen(elem.second);
+  }
+}
+
+// 记录每个变量放在栈上或者提升到寄存器的原因
+static void remarkFrame(Function* func, const std::string& func_name,
+                        std::size_t stack_size) {
+  Remarks& remarks = CompilerContext::current().remarks();
+  std::set<Var*> address_taken = addressTakenVars(func);
+  for (auto& var: func->vars()) {
+    std::string name(var->getName(), var->name_len());
+    if (var->promoted()) {
+      remarks.add(RemarkKind::REMARK_PASSED, "promote", "Promoted", func_name,
+                  var->getName(), func->name(),
+                  "'" + name + "' promoted to a register", {{"var", name}});
+      continue;
     }
-    stack_size = (stack_size + 16 - 1) / 16 * 16;
-    start_(func_name.c_str());
-    global_func_name = func_name.c_str();
-    // 栈布局
-    //-------------------------------// sp
-    //              ra
-    //-------------------------------// ra = sp-8
-    //              fp
-    //-------------------------------// fp = sp-16
-    //             变量
-    //-------------------------------// sp = sp-16-StackSize
-    //           表达式计算
-    //-------------------------------//
-
-    // Prologue, 前言
-    // 将ra寄存器压栈,保存ra的值
-    push_("ra");
-    push_("fp");
-    mv_("fp", "sp");
-    printf("  # sp 配分StackSize大小的栈空间\n");
-    addi_("sp", "sp", -stack_size);
-    printf("\n# ====== 将参数当作局部变量保存在栈空间中=====\n");
-    for (auto& param: elem.second->parameters()) {
-      int offset = param.second->offset() + param.second->type()->size();
-      sd_(arg_regs[param.second->index()], "fp", -offset);
+    int offset = -(var->offset() + var->type()->size());
+    std::string slot = "fp" + std::to_string(offset);
+    RemarkKind kind = RemarkKind::REMARK_ANALYSIS;
+    std::string reason;
+    if (var->type()->kind() == TypeKind::TYPE_ARRAY) {
+      reason = "it is an array";
+    } else if (address_taken.count(var)) {
+      reason = "its address is taken";
+    } else {
+      kind = RemarkKind::REMARK_MISSED;
+      reason = "register promotion is not enabled";
     }
-    printf("\n# =====程序主体=====\n");
-    elem.second->codegen();
-    if (depth != 2) {
-      FATAL("depth should be 2 for space ra, fp"
-            "but got %d", depth.load());
+    remarks.add(kind, "frame", "StackSlot", func_name, var->getName(), func->name(),
+                "'" + name + "' kept in stack slot " + slot + ": " + reason,
+                {{"var", name}, {"offset", std::to_string(offset)},
+                 {"size", std::to_string(var->type()->size())}, {"reason", reason}});
+  }
+  remarks.add(RemarkKind::REMARK_ANALYSIS, "frame", "StackFrame", func_name,
+              func->name(), nullptr,
+              std::to_string(stack_size) + " bytes of stack for " +
+              std::to_string(func->vars().size()) + " variables",
+              {{"stack_size", std::to_string(stack_size)},
+               {"vars", std::to_string(func->vars().size())}});
+}
+
+void Codegen::codegen(Function* func) {
+  std::string func_name(func->name(), func->name_len());
+  CHECK(func->parameters().size() <= static_cast<std::size_t>(kArgRegCount));
+  CompilerContext& context = CompilerContext::current();
+  context.passes().runAst(func, func_name);
+  context.passes().beginFunction(func_name);
+  std::size_t stack_size = 0;
+  // vars 包含函数参数, 提升到寄存器的变量不占用栈空间
+  for (auto& var: func->vars()) {
+    if (!var->promoted()) {
+      stack_size += var->type()->size();
     }
-    return_label_(func_name.c_str());
-    mv_("sp", "fp");
-    pop_("fp");
-    pop_("ra");
-    ret_();
   }
+  stack_size = (stack_size + 16 - 1) / 16 * 16;
+  if (context.remarks().enabled()) {
+    remarkFrame(func, func_name, stack_size);
+  }
+  if (emit_ir_ || (context.passes().lowering(ssaPass()) &&
+                   context.passes().enabled(regAllocPass()))) {
+    IrFunction ir(func_name);
+    buildIr(func, ir);
+    std::string error;
+    if (context.passes().verify() && !verifyIrFunction(ir, error)) {
+      FATAL("invalid SSA IR for function %s: %s", func_name.c_str(), error.c_str());
+    }
+    codegen(ir, func->name());
+    return;
+  }
+  MFunction mfunc(func_name, stack_size);
+  mfunc.loc = func->name();
+  mfunc.virtual_regs = context.passes().enabled(regAllocPass());
+  // 变量的虚拟寄存器按 index 编号, 中间结果的编号排在之后
+  mfunc.next_vreg += func->vars().size();
+  context.funcName() = mfunc.name.c_str();
+  context.mfunction() = &mfunc;
+  // prologue/epilogue (保存 ra fp, 开辟栈空间) 由 Target 生成
+  comment_("\n# ====== 将参数当作局部变量保存在栈空间中=====\n");
+  for (auto& param: func->parameters()) {
+    if (param->promoted()) {
+      CHECK(mfunc.virtual_regs);
+      mv_(promotedReg(param), REG_ARG0 + param->index());
+      continue;
+    }
+    int offset = param->offset() + param->type()->size();
+    sd_(REG_ARG0 + param->index(), REG_FP, -offset);
+  }
+  comment_("\n# =====程序主体=====\n");
+  func->codegen();
+  if (context.depth() != 0) {
+    FATAL("depth should be 0 at the end of function body, "
+          "but got %d", context.depth());
+  }
+  return_label_(mfunc.name.c_str());
+  context.mfunction() = nullptr;
+  context.passes().runMachine(mfunc);
+  context.target()->render(mfunc);
+}
+
+void Codegen::codegen(IrFunction& func, const char* loc) {
+  CompilerContext& context = CompilerContext::current();
+  context.passes().runIr(func);
+  if (emit_ir_) {
+    std::string text;
+    printIr(func, text);
+    emit("%s", text.c_str());
+    return;
+  }
+  if (!context.passes().enabled(regAllocPass())) {
+    FATAL("generating code from SSA IR needs regalloc, use -O1 or -fregalloc");
+  }
+  // 栈空间由 lowerIr 按 alloca 分配
+  MFunction mfunc(func.name(), 0);
+  mfunc.loc = loc;
+  mfunc.virtual_regs = true;
+  context.funcName() = mfunc.name.c_str();
+  context.mfunction() = &mfunc;
+  lowerIr(func, mfunc);
+  return_label_(mfunc.name.c_str());
+  context.mfunction() = nullptr;
+  context.passes().runMachine(mfunc);
+  context.target()->render(mfunc);
 }
 
 bool codegen_prev_func(Expr* curr_node) {
@@ -93,16 +179,25 @@ bool codegen_prev_func(Expr* curr_node) {
     curr_node->codegen();
     return false;
   }
+  // 调用没有操作数, 不需要 mid 和 post 保存和取回 REG_ACC
+  if (curr_node->kind() == ExprKind::NODE_CALL &&
+      CompilerContext::current().passes().lowering(callArgsPass())) {
+    curr_node->codegen();
+    return false;
+  }
+  if (selectExpr(curr_node)) {
+    return false;
+  }
   return true;
 }
 
 bool codegen_mid_func(Expr* curr_node) {
-  push_("a0");
+  save_(REG_ACC);
   return true;
 }
 
 bool codegen_post_func(Expr* curr_node) {
-  pop_("a1");
+  restore_(REG_TMP);
   curr_node->codegen();
   return true;
 }
@@ -112,7 +207,7 @@ void genAddr(Expr* curr_node) {
   switch (curr_node->kind()) {
     case ExprKind::NODE_ID:
       offset =  -(dynamic_cast<IdentityExpr*>(curr_node)->var()->offset() + curr_node->getType()->size());
-      addi_("a0", "fp", offset);
+      addi_(REG_ACC, REG_FP, offset);
       break;
     case ExprKind::NODE_DEREF:
       walkRightImpl(curr_node->getLeft(), codegen_prev_func, codegen_mid_func, codegen_post_func);
@@ -126,7 +221,23 @@ void load(Type* type) {
   if (type->kind() == TypeKind::TYPE_ARRAY) {
     return;
   }
-  ld_("a0", "a0", 0);
+  ld_(REG_ACC, REG_ACC, 0);
+}
+
+int promotedReg(Var* var) {
+  CHECK(var->promoted());
+  return kFirstVirtualReg + var->index();
 }
 
-}
\ No newline at end of file
+std::set<Var*> addressTakenVars(Function* func) {
+  std::set<Var*> vars;
+  forEachNode(func->body(), [&](Expr* node) {
+    if (node->kind() == ExprKind::NODE_ADDR &&
+        node->getLeft()->kind() == ExprKind::NODE_ID) {
+      vars.insert(static_cast<IdentityExpr*>(node->getLeft())->var());
+    }
+  });
+  return vars;
+}
+
+}
@@ -2,19 +2,27 @@
 #define __CODEGEN_H
 
 #include "ast.h"
+#include "ir.h"
 #include "object.h"
+#include <set>
 
 namespace rvcc {
 
 
 class Codegen: public Object{
   public:
-    explicit Codegen(Ast* ast): ast_(ast) {}
+    explicit Codegen(Ast* ast = nullptr): ast_(ast), emit_ir_(false) {}
     Ast*& ast();
+    // 输出 SSA IR 的文本而不是汇编
+    bool& emitIr();
     void codegen();
+    void codegen(Function* func);
+    // 运行 PASS_IR, 然后输出 IR 或者 lowering 为汇编
+    // loc 为函数名在输入中的位置, 用于优化记录
+    void codegen(IrFunction& func, const char* loc = nullptr);
   private:
     Ast* ast_;
-    static const char* arg_regs[6];
+    bool emit_ir_;
 };
 
 bool codegen_prev_func(Expr* curr_node);
@@ -22,6 +30,10 @@ bool codegen_mid_func(Expr* curr_node);
 bool codegen_post_func(Expr* curr_node);
 void genAddr(Expr* curr_node);
 void load(Type* type);
+// 被 & 取地址的变量, 只能放在栈上
+std::set<Var*> addressTakenVars(Function* func);
+// 提升到寄存器的变量对应的虚拟寄存器, 按变量的 index 编号
+int promotedReg(Var* var);
 
 } // end namespace rvcc
 
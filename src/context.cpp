@@ -0,0 +1,176 @@
+#include "context.h"
+#include "codegen.h"
+#include "logger.h"
+#include "parallel_parser.h"
+#include "parser.h"
+#include "target.h"
+
+namespace rvcc {
+
+thread_local CompilerContext* CompilerContext::current_ = nullptr;
+
+ObjectManager& ObjectManager::getInst() {
+  return CompilerContext::current().objects();
+}
+
+CompilerContext::Activation::Activation(CompilerContext* context, std::string* sink):
+  prev_(current_), prev_sink_(Logger::sink()) {
+  current_ = context;
+  Logger::sink() = sink;
+}
+
+CompilerContext::Activation::~Activation() {
+  current_ = prev_;
+  Logger::sink() = prev_sink_;
+}
+
+CompilerContext::CompilerContext(): CompilerContext(nullptr) {}
+
+CompilerContext::CompilerContext(FILE* file):
+  file_(file), depth_(0), func_name_(nullptr), unique_id_(0),
+  target_(Target::defaultTarget()), emitted_bytes_(0), mfunction_(nullptr) {}
+
+CompilerContext::~CompilerContext() {}
+
+CompilerContext& CompilerContext::current() {
+  static CompilerContext default_context(stdout);
+  return current_ ? *current_ : default_context;
+}
+
+ObjectManager& CompilerContext::objects() {
+  return objects_;
+}
+
+SourceManager& CompilerContext::sources() {
+  return sources_;
+}
+
+int& CompilerContext::depth() {
+  return depth_;
+}
+
+const char*& CompilerContext::funcName() {
+  return func_name_;
+}
+
+std::uint32_t CompilerContext::uniqueId() {
+  unique_id_ += 1;
+  return unique_id_;
+}
+
+const Target*& CompilerContext::target() {
+  return target_;
+}
+
+Remarks& CompilerContext::remarks() {
+  return remarks_;
+}
+
+CodegenStats& CompilerContext::stats() {
+  return stats_;
+}
+
+PassManager& CompilerContext::passes() {
+  return passes_;
+}
+
+std::size_t CompilerContext::emittedBytes() const {
+  return emitted_bytes_;
+}
+
+MFunction*& CompilerContext::mfunction() {
+  return mfunction_;
+}
+
+void CompilerContext::emit(const char* format, va_list args) {
+  if (file_) {
+    int size = vfprintf(file_, format, args);
+    emitted_bytes_ += size > 0 ? size : 0;
+    return;
+  }
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int need_size = vsnprintf(nullptr, 0, format, args_copy);
+  va_end(args_copy);
+  if (need_size <= 0) {
+    return;
+  }
+  emitted_bytes_ += need_size;
+  std::size_t old_size = buffer_.size();
+  buffer_.resize(old_size + need_size + 1);
+  vsnprintf(&buffer_[old_size], need_size + 1, format, args);
+  buffer_.resize(old_size + need_size);
+}
+
+void CompilerContext::reset() {
+  objects_.release(0);
+  sources_.clear();
+  depth_ = 0;
+  func_name_ = nullptr;
+  unique_id_ = 0;
+  target_ = Target::defaultTarget();
+  remarks_.clear();
+  remarks_.enabled() = false;
+  stats_.clear();
+  stats_.enabled() = false;
+  passes_.reset();
+  emitted_bytes_ = 0;
+  mfunction_ = nullptr;
+}
+
+bool CompilerContext::run(const std::function<void()>& fn,
+                          std::string& diagnostics) {
+  Activation activation(this, &diagnostics);
+  try {
+    fn();
+  } catch (const CompileError&) {
+    return false;
+  }
+  return true;
+}
+
+CompileResult CompilerContext::compile(const char* source,
+                                       const CompileOptions& options) {
+  CompileResult result{true, "", ""};
+  result.ok = run([&]() {
+    if (options.target) {
+      target_ = options.target;
+    }
+    remarks_.enabled() = options.save_remarks;
+    stats_.enabled() = options.stats;
+    for (auto& flag: options.opt_flags) {
+      if (!passes_.parseFlag(flag)) {
+        FATAL("unknown optimization option %s", flag.c_str());
+      }
+    }
+    if (options.stream) {
+      Parser parser(source, options.include_dirs);
+      Codegen codegen;
+      for (;;) {
+        std::size_t mark = objects_.mark();
+        Function* func = parser.parser_next_function();
+        if (!func) {
+          break;
+        }
+        parser.defineFunction(func);
+        codegen.codegen(func);
+        objects_.release(mark);
+      }
+    } else {
+      Codegen codegen(parseParallel(source, options.include_dirs, options.jobs));
+      codegen.codegen();
+    }
+  }, result.diagnostics);
+  if (options.save_remarks) {
+    result.remarks = remarks_.toJson();
+  }
+  if (options.stats) {
+    result.stats = stats_.toJson();
+  }
+  result.asm_buffer.swap(buffer_);
+  buffer_.clear();
+  reset();
+  return result;
+}
+
+} // namespace rvcc
@@ -0,0 +1,107 @@
+#ifndef __CONTEXT_H
+#define __CONTEXT_H
+
+#include "object_manager.h"
+#include "pass_manager.h"
+#include "remarks.h"
+#include "source.h"
+#include "stats.h"
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+class Target;
+struct MFunction;
+
+struct CompileOptions {
+  std::vector<std::string> include_dirs;
+  bool stream = false;      // 逐个函数解析 codegen 并释放
+  unsigned jobs = 1;        // 并发解析顶层函数的线程数
+  const Target* target = nullptr; // 为空时使用 Target::defaultTarget()
+  bool save_remarks = false;      // 记录优化决定, 结果在 CompileResult::remarks
+  bool stats = false;             // 统计生成的代码, 结果在 CompileResult::stats
+  std::vector<std::string> opt_flags; // -O2 -fno-<pass> 等, 见 PassManager::parseFlag
+};
+
+struct CompileResult {
+  bool ok;
+  std::string asm_buffer;
+  std::string diagnostics;
+  std::string remarks;      // JSON, 见 Remarks::toJson
+  std::string stats;        // JSON, 见 CodegenStats::toJson
+};
+
+/*
+一次编译所需的全部可变状态
+  ObjectManager 申请的 node type var, 源码 buffer, 汇编输出, 栈深度, 当前函数名, label 编号,
+  目标平台, 优化 pass 的设置以及正在生成的机器指令
+ObjectManager::getInst() 等接口都转发到当前线程的 context,
+没有设置时使用一个写入 stdout 的进程级默认 context (命令行使用)
+不同线程上的 context 互不影响, 可以并发编译
+*/
+class CompilerContext {
+  public:
+    // 输出写入内部 buffer
+    CompilerContext();
+    // 输出直接写入 file
+    explicit CompilerContext(FILE* file);
+    CompilerContext(const CompilerContext&) = delete;
+    CompilerContext& operator=(const CompilerContext&) = delete;
+    ~CompilerContext();
+    // 编译 source, 不会退出进程也不会写 stdout/stderr
+    // 错误时 ok 为 false, 诊断信息在 diagnostics 中
+    CompileResult compile(const char* source, const CompileOptions& options = {});
+    // 在当前线程以该 context 运行 fn, 诊断信息写入 diagnostics
+    // fn 中出现 FATAL 时返回 false
+    bool run(const std::function<void()>& fn, std::string& diagnostics);
+    static CompilerContext& current();
+    ObjectManager& objects();
+    // 输入和头文件的 buffer, token 的 loc 指向其中, 需要存活到编译结束
+    SourceManager& sources();
+    int& depth();
+    const char*& funcName();
+    std::uint32_t uniqueId();
+    const Target*& target();
+    Remarks& remarks();
+    CodegenStats& stats();
+    PassManager& passes();
+    // 已经输出的汇编字节数
+    std::size_t emittedBytes() const;
+    // 正在 codegen 的函数, instructions.h 中的接口向其追加指令
+    MFunction*& mfunction();
+    void emit(const char* format, va_list args);
+  private:
+    // 在作用域内将 context 和诊断信息输出设置为当前线程的
+    class Activation {
+      public:
+        Activation(CompilerContext* context, std::string* sink);
+        ~Activation();
+      private:
+        CompilerContext* prev_;
+        std::string* prev_sink_;
+    };
+    void reset();
+    SourceManager sources_;
+    ObjectManager objects_;
+    FILE* file_;
+    std::string buffer_;
+    int depth_;
+    const char* func_name_;
+    std::uint32_t unique_id_;
+    const Target* target_;
+    Remarks remarks_;
+    CodegenStats stats_;
+    PassManager passes_;
+    std::size_t emitted_bytes_;
+    MFunction* mfunction_;
+    static thread_local CompilerContext* current_;
+};
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,251 @@
+#include "dce.h"
+#include "context.h"
+#include "ir.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+// 条件为常量的 br 改为 jmp, 另一个目标块的 phi 中删除来自该块的值, 返回改写的个数
+std::size_t foldConstantBranches(IrFunction& func) {
+  std::size_t folded = 0;
+  for (auto block: func.blocks()) {
+    IrInst* term = block->terminator();
+    if (!term || term->op != IrOpcode::IR_BR || term->ops[0]->op != IrOpcode::IR_CONST) {
+      continue;
+    }
+    IrBlock* taken = term->ops[0]->imm ? term->blocks[0] : term->blocks[1];
+    IrBlock* dropped = term->ops[0]->imm ? term->blocks[1] : term->blocks[0];
+    if (dropped != taken) {
+      for (auto inst: dropped->insts) {
+        if (inst->op != IrOpcode::IR_PHI) {
+          break;
+        }
+        auto it = std::find(inst->blocks.begin(), inst->blocks.end(), block);
+        inst->ops.erase(inst->ops.begin() + (it - inst->blocks.begin()));
+        inst->blocks.erase(it);
+      }
+    }
+    term->op = IrOpcode::IR_JMP;
+    term->ops.clear();
+    term->blocks = {taken};
+    folded++;
+  }
+  if (folded) {
+    func.computeCfg();
+  }
+  return folded;
+}
+
+// 以 jmp 结束的块与唯一前驱为它的后继块合并, 返回合并的个数
+std::size_t mergeBlocks(IrFunction& func) {
+  std::size_t merged = 0;
+  std::vector<IrBlock*>& blocks = func.blocks();
+  for (std::size_t i = 0; i < blocks.size(); i++) {
+    IrBlock* block = blocks[i];
+    IrInst* term = block->terminator();
+    while (term && term->op == IrOpcode::IR_JMP) {
+      IrBlock* succ = term->blocks[0];
+      if (succ == block || succ == func.entry() || succ->preds.size() != 1 ||
+          succ->insts.front()->op == IrOpcode::IR_PHI) {
+        break;
+      }
+      // 后继块中 phi 的来源块改为合并之后的块
+      for (auto next: succ->succs()) {
+        std::replace(next->preds.begin(), next->preds.end(), succ, block);
+        for (auto inst: next->insts) {
+          if (inst->op != IrOpcode::IR_PHI) {
+            break;
+          }
+          std::replace(inst->blocks.begin(), inst->blocks.end(), succ, block);
+        }
+      }
+      func.erase(term);
+      for (auto inst: succ->insts) {
+        inst->block = block;
+        block->insts.push_back(inst);
+      }
+      succ->insts.clear();
+      blocks.erase(std::find(blocks.begin(), blocks.end(), succ));
+      i = std::find(blocks.begin(), blocks.end(), block) - blocks.begin();
+      term = block->terminator();
+      merged++;
+    }
+  }
+  if (merged) {
+    func.computeCfg();
+  }
+  return merged;
+}
+
+/*
+按 alloca 的活跃性删除死 store, 返回删除的个数
+  只作为 load 的地址或 store 的地址使用的 alloca 不会逃逸, 只能被直接读取;
+  其余的 alloca (数组, 被取地址的变量) 还可能被其他地址的 load 和 call 读取
+  load store 都是 8 字节, 直接访问 alloca 的总是同一个位置, 所以 store alloca 覆盖之前的值
+  返回之后 alloca 都不再存在, 所以 ret 处没有活跃的 alloca
+*/
+std::size_t removeDeadStores(IrFunction& func) {
+  std::unordered_map<IrInst*, std::size_t> slots;
+  for (auto inst: func.entry()->insts) {
+    if (inst->op == IrOpcode::IR_ALLOCA) {
+      slots.emplace(inst, slots.size());
+    }
+  }
+  if (slots.empty()) {
+    return 0;
+  }
+  std::vector<bool> escaped(slots.size(), false);
+  for (auto block: func.blocks()) {
+    for (auto inst: block->insts) {
+      for (std::size_t i = 0; i < inst->ops.size(); i++) {
+        auto it = slots.find(inst->ops[i]);
+        bool direct = (inst->op == IrOpcode::IR_LOAD && i == 0) ||
+                      (inst->op == IrOpcode::IR_STORE && i == 1);
+        if (it != slots.end() && !direct) {
+          escaped[it->second] = true;
+        }
+      }
+    }
+  }
+  auto slotOf = [&](IrInst* addr) -> int {
+    auto it = slots.find(addr);
+    return it == slots.end() ? -1 : static_cast<int>(it->second);
+  };
+  // 逆序经过 inst, live 为之后可能被读取的 alloca
+  auto step = [&](IrInst* inst, std::vector<bool>& live) {
+    if (inst->op == IrOpcode::IR_LOAD) {
+      int slot = slotOf(inst->ops[0]);
+      if (slot >= 0) {
+        live[slot] = true;
+      }
+    }
+    if ((inst->op == IrOpcode::IR_LOAD && slotOf(inst->ops[0]) < 0) ||
+        inst->op == IrOpcode::IR_CALL) {
+      for (std::size_t i = 0; i < escaped.size(); i++) {
+        live[i] = live[i] || escaped[i];
+      }
+    }
+    if (inst->op == IrOpcode::IR_STORE && slotOf(inst->ops[1]) >= 0) {
+      live[slotOf(inst->ops[1])] = false;
+    }
+  };
+  std::vector<IrBlock*>& blocks = func.blocks();
+  std::vector<std::vector<bool>> live_in(blocks.size(), std::vector<bool>(slots.size(), false));
+  auto liveOut = [&](IrBlock* block) {
+    std::vector<bool> live(slots.size(), false);
+    for (auto succ: block->succs()) {
+      for (std::size_t i = 0; i < live.size(); i++) {
+        live[i] = live[i] || live_in[succ->id][i];
+      }
+    }
+    return live;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (std::size_t b = blocks.size(); b-- > 0;) {
+      std::vector<bool> live = liveOut(blocks[b]);
+      for (auto it = blocks[b]->insts.rbegin(); it != blocks[b]->insts.rend(); ++it) {
+        step(*it, live);
+      }
+      if (live != live_in[b]) {
+        live_in[b].swap(live);
+        changed = true;
+      }
+    }
+  }
+  std::vector<IrInst*> dead;
+  for (auto block: blocks) {
+    std::vector<bool> live = liveOut(block);
+    for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it) {
+      IrInst* inst = *it;
+      if (inst->op == IrOpcode::IR_STORE && slotOf(inst->ops[1]) >= 0 &&
+          !live[slotOf(inst->ops[1])]) {
+        dead.push_back(inst);
+      }
+      step(inst, live);
+    }
+  }
+  for (auto inst: dead) {
+    func.erase(inst);
+  }
+  return dead.size();
+}
+
+// 从有副作用的指令出发标记用到的值, 删除其余指令, 返回删除的个数
+std::size_t removeDeadInsts(IrFunction& func) {
+  std::unordered_set<IrInst*> used;
+  std::vector<IrInst*> work;
+  for (auto block: func.blocks()) {
+    for (auto inst: block->insts) {
+      if (inst->hasSideEffects() && used.insert(inst).second) {
+        work.push_back(inst);
+      }
+    }
+  }
+  while (!work.empty()) {
+    IrInst* inst = work.back();
+    work.pop_back();
+    for (auto op: inst->ops) {
+      if (used.insert(op).second) {
+        work.push_back(op);
+      }
+    }
+  }
+  std::size_t removed = 0;
+  for (auto block: func.blocks()) {
+    std::vector<IrInst*> insts;
+    for (auto inst: block->insts) {
+      if (used.count(inst)) {
+        insts.push_back(inst);
+      } else {
+        inst->block = nullptr;
+        removed++;
+      }
+    }
+    block->insts.swap(insts);
+  }
+  return removed;
+}
+
+} // namespace
+
+const char* DcePass::name() const {
+  return "dce";
+}
+
+PassKind DcePass::kind() const {
+  return PassKind::PASS_IR;
+}
+
+bool DcePass::run(IrFunction& func) const {
+  std::size_t folded = foldConstantBranches(func);
+  std::size_t blocks = func.blocks().size();
+  bool simplified = func.removeUnreachable();
+  std::size_t unreachable = blocks - func.blocks().size();
+  std::size_t merged = mergeBlocks(func);
+  // 先删除不使用的 load, 它们可能使 store 看起来仍然活跃
+  std::size_t dead_insts = removeDeadInsts(func);
+  std::size_t dead_stores = removeDeadStores(func);
+  dead_insts += removeDeadInsts(func);
+  func.computeCfg();
+  PassManager& passes = CompilerContext::current().passes();
+  passes.addStat(this, "folded-branches", folded);
+  passes.addStat(this, "unreachable-blocks", unreachable);
+  passes.addStat(this, "merged-blocks", merged);
+  passes.addStat(this, "dead-stores", dead_stores);
+  passes.addStat(this, "dead-insts", dead_insts);
+  return folded || simplified || merged || dead_stores || dead_insts;
+}
+
+const Pass* dcePass() {
+  static const DcePass pass;
+  return &pass;
+}
+
+} // namespace rvcc
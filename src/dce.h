@@ -0,0 +1,25 @@
+#ifndef __DCE_H
+#define __DCE_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+删除 SSA IR 中的死代码
+  条件为常量的 br 改为 jmp, 之后删除入口不可达的基本块 (if (0) 的分支, return 之后的代码)
+  按 alloca 的活跃性删除之后不会再被读取的 store (被覆盖或者直到返回都没有读取)
+  从 store call 和终结指令出发标记用到的值, 没有标记的指令 (包括不再使用的 alloca) 被删除
+*/
+class DcePass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(IrFunction& func) const override;
+};
+
+const Pass* dcePass();
+
+} // namespace rvcc
+
+#endif
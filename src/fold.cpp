@@ -0,0 +1,347 @@
+#include "fold.h"
+#include "ast.h"
+#include "context.h"
+#include "object_manager.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+
+namespace rvcc {
+
+namespace {
+
+bool isNum(Expr* node) {
+  return node && node->kind() == ExprKind::NODE_NUM;
+}
+
+bool isNum(Expr* node, long value) {
+  return isNum(node) && node->value() == value;
+}
+
+// 按 64 位补码回绕计算, 除数为 0 或者结果超出 int 时返回 false
+bool evaluate(ExprKind kind, long lhs, long rhs, int& result) {
+  std::uint64_t a = static_cast<std::uint64_t>(lhs);
+  std::uint64_t b = static_cast<std::uint64_t>(rhs);
+  std::int64_t value = 0;
+  switch (kind) {
+  case ExprKind::NODE_ADD:
+    value = static_cast<std::int64_t>(a + b);
+    break;
+  case ExprKind::NODE_SUB:
+    value = static_cast<std::int64_t>(a - b);
+    break;
+  case ExprKind::NODE_MUL:
+    value = static_cast<std::int64_t>(a * b);
+    break;
+  case ExprKind::NODE_DIV:
+    if (rhs == 0) {
+      return false;
+    }
+    value = lhs / rhs;
+    break;
+  case ExprKind::NODE_EQ:
+    value = lhs == rhs;
+    break;
+  case ExprKind::NODE_NE:
+    value = lhs != rhs;
+    break;
+  case ExprKind::NODE_LT:
+    value = lhs < rhs;
+    break;
+  case ExprKind::NODE_LE:
+    value = lhs <= rhs;
+    break;
+  default:
+    return false;
+  }
+  if (value < INT_MIN || value > INT_MAX) {
+    return false;
+  }
+  result = static_cast<int>(value);
+  return true;
+}
+
+Expr* newNum(int value, Expr* origin) {
+  NumExpr* num = ObjectManager::getInst().alloc_type<NumExpr>(value);
+  num->loc() = origin->loc();
+  return num;
+}
+
+// 没有函数调用和赋值
+bool isPure(Expr* node) {
+  if (!node) {
+    return true;
+  }
+  switch (node->kind()) {
+  case ExprKind::NODE_NUM:
+  case ExprKind::NODE_ID:
+    return true;
+  case ExprKind::NODE_NEG:
+  case ExprKind::NODE_ADDR:
+  case ExprKind::NODE_DEREF:
+    return isPure(node->getLeft());
+  case ExprKind::NODE_ADD:
+  case ExprKind::NODE_SUB:
+  case ExprKind::NODE_MUL:
+  case ExprKind::NODE_DIV:
+  case ExprKind::NODE_EQ:
+  case ExprKind::NODE_NE:
+  case ExprKind::NODE_LT:
+  case ExprKind::NODE_LE:
+    return isPure(node->getLeft()) && isPure(node->getRight());
+  default:
+    return false;
+  }
+}
+
+// 结构相同的纯表达式, 求值结果一定相同
+bool isSame(Expr* lhs, Expr* rhs) {
+  if (!lhs || !rhs || lhs->kind() != rhs->kind() || !isPure(lhs)) {
+    return false;
+  }
+  switch (lhs->kind()) {
+  case ExprKind::NODE_NUM:
+    return lhs->value() == rhs->value();
+  case ExprKind::NODE_ID:
+    return static_cast<IdentityExpr*>(lhs)->var() == static_cast<IdentityExpr*>(rhs)->var();
+  case ExprKind::NODE_NEG:
+  case ExprKind::NODE_ADDR:
+  case ExprKind::NODE_DEREF:
+    return isSame(lhs->getLeft(), rhs->getLeft());
+  default:
+    return isSame(lhs->getLeft(), rhs->getLeft()) &&
+           isSame(lhs->getRight(), rhs->getRight());
+  }
+}
+
+class Folder {
+  public:
+    explicit Folder(Function* func): func_(func), func_name_(func->name(), func->name_len()) {}
+    bool changed() const {
+      return changed_;
+    }
+    void stmts(Expr* stmt);
+    Expr* expr(Expr* node);
+  private:
+    Expr* binary(BinaryExpr* node);
+    Expr* unary(UnaryExpr* node);
+    // node 被改写为 result, 结果为常量时记为 Folded, 否则为 Simplified
+    Expr* replace(Expr* node, Expr* result) {
+      changed_ = true;
+      Remarks& remarks = CompilerContext::current().remarks();
+      if (!remarks.enabled()) {
+        return result;
+      }
+      std::string op = node->kindName();
+      if (isNum(result)) {
+        std::string value = std::to_string(result->value());
+        remarks.add(RemarkKind::REMARK_PASSED, "constfold", "Folded", func_name_, node->loc(),
+                    func_->name(), op + " folded to " + value, {{"op", op}, {"value", value}});
+      } else {
+        remarks.add(RemarkKind::REMARK_PASSED, "constfold", "Simplified", func_name_, node->loc(),
+                    func_->name(), op + " simplified to " + result->kindName(),
+                    {{"op", op}, {"result", result->kindName()}});
+      }
+      return result;
+    }
+    Function* func_;
+    std::string func_name_;
+    bool changed_ = false;
+};
+
+void Folder::stmts(Expr* stmt) {
+  for (; stmt; stmt = stmt->getNext()) {
+    switch (stmt->kind()) {
+    case ExprKind::NODE_COMPOUND:
+      stmts(static_cast<CompoundStmtExpr*>(stmt)->stmts());
+      break;
+    case ExprKind::NODE_IF: {
+      IfExpr* if_stmt = static_cast<IfExpr*>(stmt);
+      if_stmt->cond() = expr(if_stmt->cond());
+      stmts(if_stmt->then());
+      stmts(if_stmt->els());
+      break;
+    }
+    case ExprKind::NODE_FOR: {
+      ForExpr* for_stmt = static_cast<ForExpr*>(stmt);
+      for_stmt->init() = expr(for_stmt->init());
+      for_stmt->cond() = expr(for_stmt->cond());
+      for_stmt->inc() = expr(for_stmt->inc());
+      stmts(for_stmt->stmts());
+      break;
+    }
+    case ExprKind::NODE_WHILE: {
+      WhileExpr* while_stmt = static_cast<WhileExpr*>(stmt);
+      while_stmt->cond() = expr(while_stmt->cond());
+      stmts(while_stmt->stmts());
+      break;
+    }
+    default: {
+      StmtExpr* expr_stmt = dynamic_cast<StmtExpr*>(stmt);
+      if (expr_stmt) {
+        expr_stmt->left() = expr(expr_stmt->left());
+      }
+      break;
+    }
+    }
+  }
+}
+
+Expr* Folder::expr(Expr* node) {
+  if (!node) {
+    return node;
+  }
+  switch (node->kind()) {
+  case ExprKind::NODE_NEG:
+  case ExprKind::NODE_ADDR:
+  case ExprKind::NODE_DEREF:
+  case ExprKind::NODE_RETURN:
+    return unary(static_cast<UnaryExpr*>(node));
+  case ExprKind::NODE_ADD:
+  case ExprKind::NODE_SUB:
+  case ExprKind::NODE_MUL:
+  case ExprKind::NODE_DIV:
+  case ExprKind::NODE_EQ:
+  case ExprKind::NODE_NE:
+  case ExprKind::NODE_LT:
+  case ExprKind::NODE_LE:
+  case ExprKind::NODE_ASSIGN:
+    return binary(static_cast<BinaryExpr*>(node));
+  case ExprKind::NODE_CALL:
+    for (auto& arg: static_cast<CallExpr*>(node)->args()) {
+      arg = expr(arg);
+    }
+    return node;
+  default:
+    return node;
+  }
+}
+
+Expr* Folder::unary(UnaryExpr* node) {
+  // & 的操作数必须是左值, 只折叠 *p 中的地址
+  if (node->kind() != ExprKind::NODE_ADDR ||
+      node->left()->kind() == ExprKind::NODE_DEREF) {
+    node->left() = expr(node->left());
+  }
+  if (node->kind() != ExprKind::NODE_NEG) {
+    return node;
+  }
+  Expr* left = node->left();
+  if (isNum(left)) {
+    int value;
+    if (evaluate(ExprKind::NODE_SUB, 0, left->value(), value)) {
+      return replace(node, newNum(value, node));
+    }
+  }
+  // - -x => x
+  if (left->kind() == ExprKind::NODE_NEG) {
+    return replace(node, left->getLeft());
+  }
+  return node;
+}
+
+Expr* Folder::binary(BinaryExpr* node) {
+  ExprKind kind = node->kind();
+  if (kind == ExprKind::NODE_ASSIGN) {
+    if (node->left()->kind() == ExprKind::NODE_DEREF) {
+      node->left() = expr(node->left());
+    }
+    node->right() = expr(node->right());
+    return node;
+  }
+  node->left() = expr(node->left());
+  node->right() = expr(node->right());
+  Expr* left = node->left();
+  Expr* right = node->right();
+  int value;
+  if (isNum(left) && isNum(right)) {
+    if (evaluate(kind, left->value(), right->value(), value)) {
+      return replace(node, newNum(value, node));
+    }
+    return node;
+  }
+  bool is_int = node->getType()->kind() == TypeKind::TYPE_INT &&
+                left->getType()->kind() == TypeKind::TYPE_INT &&
+                right->getType()->kind() == TypeKind::TYPE_INT;
+  // 常量放到右边: c + x => x + c, c * x => x * c
+  if ((kind == ExprKind::NODE_ADD || kind == ExprKind::NODE_MUL) &&
+      is_int && isNum(left)) {
+    std::swap(node->left(), node->right());
+    std::swap(left, right);
+    changed_ = true;
+  }
+  switch (kind) {
+  case ExprKind::NODE_ADD:
+  case ExprKind::NODE_SUB: {
+    if (isNum(right, 0)) {
+      return replace(node, left);
+    }
+    if (kind == ExprKind::NODE_SUB && is_int && isSame(left, right)) {
+      return replace(node, newNum(0, node));
+    }
+    // (x +- c1) +- c2 => x +- c3, 内层的类型和外层相同 (指针或者 int)
+    if (!isNum(right) ||
+        (left->kind() != ExprKind::NODE_ADD && left->kind() != ExprKind::NODE_SUB) ||
+        !isNum(left->getRight()) || left->getType() != node->getType()) {
+      return node;
+    }
+    long inner = left->getRight()->value();
+    if (left->kind() == ExprKind::NODE_SUB) {
+      inner = -inner;
+    }
+    long outer = kind == ExprKind::NODE_SUB ? -static_cast<long>(right->value()) : right->value();
+    if (!evaluate(ExprKind::NODE_ADD, inner, outer, value)) {
+      return node;
+    }
+    node->left() = left->getLeft();
+    node->kind() = value < 0 && value != INT_MIN ? ExprKind::NODE_SUB : ExprKind::NODE_ADD;
+    node->right() = newNum(node->kind() == ExprKind::NODE_SUB ? -value : value, right);
+    return replace(node, value == 0 ? node->left() : node);
+  }
+  case ExprKind::NODE_MUL:
+    if (isNum(right, 1)) {
+      return replace(node, left);
+    }
+    if (isNum(right, 0) && isPure(left)) {
+      return replace(node, newNum(0, node));
+    }
+    // (x * c1) * c2 => x * c3
+    if (isNum(right) && left->kind() == ExprKind::NODE_MUL && isNum(left->getRight()) &&
+        evaluate(ExprKind::NODE_MUL, left->getRight()->value(), right->value(), value)) {
+      node->left() = left->getLeft();
+      node->right() = newNum(value, right);
+      return replace(node, node);
+    }
+    return node;
+  case ExprKind::NODE_DIV:
+    if (isNum(right, 1)) {
+      return replace(node, left);
+    }
+    return node;
+  default:
+    return node;
+  }
+}
+
+} // namespace
+
+const char* ConstantFoldPass::name() const {
+  return "constfold";
+}
+
+PassKind ConstantFoldPass::kind() const {
+  return PassKind::PASS_AST;
+}
+
+bool ConstantFoldPass::run(Function* func) const {
+  Folder folder(func);
+  folder.stmts(func->body());
+  return folder.changed();
+}
+
+const Pass* constantFoldPass() {
+  static const ConstantFoldPass pass;
+  return &pass;
+}
+
+} // namespace rvcc
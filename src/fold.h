@@ -0,0 +1,26 @@
+#ifndef __FOLD_H
+#define __FOLD_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+常量折叠和代数化简
+  求值常量子树, 把常量操作数重新结合到一起 ((x + 1) + 2 => x + 3),
+  并化简 x+0 x-0 x*1 x/1 x*0 x-x - -x 等恒等式
+  运算按目标平台的 64 位补码回绕, 结果超出 NumExpr 的 int 范围时不折叠
+  x*0 x-x 只在 x 没有副作用时化简
+*/
+class ConstantFoldPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(Function* func) const override;
+};
+
+const Pass* constantFoldPass();
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,290 @@
+#include "gvn.h"
+#include "context.h"
+#include "ir.h"
+#include "ir_analysis.h"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+// 值编号的 key, 交换律运算的操作数按编号排序, phi 的操作数按来源块排序并带上所在的块
+struct ValueKey {
+  IrOpcode op;
+  IrType type;
+  long imm;
+  std::vector<IrInst*> ops;
+  IrBlock* block;
+  bool operator<(const ValueKey& other) const {
+    return std::tie(op, type, imm, ops, block) <
+           std::tie(other.op, other.type, other.imm, other.ops, other.block);
+  }
+};
+
+// 可以编号的纯运算, 不包括 param (只有一个) 和 alloca (每个都是不同的内存对象)
+bool numbered(const IrInst* inst) {
+  switch (inst->op) {
+  case IrOpcode::IR_CONST:
+  case IrOpcode::IR_ADD:
+  case IrOpcode::IR_SUB:
+  case IrOpcode::IR_MUL:
+  case IrOpcode::IR_DIV:
+  case IrOpcode::IR_EQ:
+  case IrOpcode::IR_NE:
+  case IrOpcode::IR_LT:
+  case IrOpcode::IR_LE:
+  case IrOpcode::IR_NEG:
+  case IrOpcode::IR_PHI:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool commutative(IrOpcode op) {
+  return op == IrOpcode::IR_ADD || op == IrOpcode::IR_MUL ||
+         op == IrOpcode::IR_EQ || op == IrOpcode::IR_NE;
+}
+
+ValueKey keyOf(const IrInst* inst) {
+  ValueKey key{inst->op, inst->type, inst->imm, inst->ops, nullptr};
+  if (commutative(inst->op)) {
+    std::sort(key.ops.begin(), key.ops.end(),
+              [](IrInst* a, IrInst* b) { return a->id < b->id; });
+  }
+  if (inst->op == IrOpcode::IR_PHI) {
+    std::vector<std::pair<int, IrInst*>> incoming;
+    for (std::size_t i = 0; i < inst->ops.size(); i++) {
+      incoming.emplace_back(inst->blocks[i]->id, inst->ops[i]);
+    }
+    std::sort(incoming.begin(), incoming.end());
+    for (std::size_t i = 0; i < incoming.size(); i++) {
+      key.ops[i] = incoming[i].second;
+    }
+    key.block = inst->block;
+  }
+  return key;
+}
+
+/*
+地址的别名分析
+  alloca (+ 偏移) 计算出的地址属于该 alloca, 不同 alloca 的地址不别名 (越界访问是未定义行为),
+  同一 alloca 的两个常量偏移相差至少 8 字节时也不别名
+  地址只用于 load store 和继续计算地址的 alloca 不会逃逸, 其余地址 (从内存读取的指针,
+  参数等) 可能指向任何逃逸的 alloca, call 也可能读写它们
+*/
+class MemoryInfo {
+  public:
+    explicit MemoryInfo(IrFunction& func) {
+      for (auto block: func.blocks()) {
+        for (auto inst: block->insts) {
+          for (std::size_t i = 0; i < inst->ops.size(); i++) {
+            IrInst* base = root(inst->ops[i]);
+            bool address = (inst->op == IrOpcode::IR_LOAD && i == 0) ||
+                           (inst->op == IrOpcode::IR_STORE && i == 1) ||
+                           ((inst->op == IrOpcode::IR_ADD || inst->op == IrOpcode::IR_SUB) &&
+                            root(inst) == base);
+            if (base && !address) {
+              escaped_.insert(base);
+            }
+          }
+        }
+      }
+    }
+
+    // 地址所属的 alloca, 不能确定时为空
+    IrInst* root(IrInst* addr) {
+      auto it = roots_.find(addr);
+      if (it != roots_.end()) {
+        return it->second;
+      }
+      // 先占位, 不可达的块中可能有不经过 phi 的环
+      roots_[addr] = nullptr;
+      IrInst* base = nullptr;
+      if (addr->op == IrOpcode::IR_ALLOCA) {
+        base = addr;
+      } else if (addr->op == IrOpcode::IR_ADD) {
+        IrInst* lhs = root(addr->ops[0]);
+        IrInst* rhs = root(addr->ops[1]);
+        base = lhs && rhs ? nullptr : (lhs ? lhs : rhs);
+      } else if (addr->op == IrOpcode::IR_SUB) {
+        base = root(addr->ops[1]) ? nullptr : root(addr->ops[0]);
+      }
+      roots_[addr] = base;
+      return base;
+    }
+
+    // 可能被 call 或者未知地址的 load store 访问
+    bool clobberedByUnknown(IrInst* addr) {
+      IrInst* base = root(addr);
+      return !base || escaped_.count(base);
+    }
+
+    bool mayAlias(IrInst* a, IrInst* b) {
+      if (a == b) {
+        return true;
+      }
+      IrInst* base_a = root(a);
+      IrInst* base_b = root(b);
+      if (!base_a || !base_b) {
+        return clobberedByUnknown(base_a ? a : b);
+      }
+      if (base_a != base_b) {
+        return false;
+      }
+      long offset_a = 0;
+      long offset_b = 0;
+      if (offsetOf(a, base_a, offset_a) && offsetOf(b, base_b, offset_b)) {
+        return std::labs(offset_a - offset_b) < 8;
+      }
+      return true;
+    }
+
+  private:
+    static bool offsetOf(IrInst* addr, IrInst* base, long& offset) {
+      if (addr == base) {
+        offset = 0;
+        return true;
+      }
+      if (addr->op != IrOpcode::IR_ADD) {
+        return false;
+      }
+      for (int i = 0; i < 2; i++) {
+        if (addr->ops[i] == base && addr->ops[1 - i]->op == IrOpcode::IR_CONST) {
+          offset = addr->ops[1 - i]->imm;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    std::unordered_map<IrInst*, IrInst*> roots_;
+    std::unordered_set<IrInst*> escaped_;
+};
+
+class ValueNumbering {
+  public:
+    explicit ValueNumbering(IrFunction& func): func_(func), dom_(func), memory_(func) {}
+
+    void run() {
+      visit(func_.entry(), {});
+      // 回边上的 phi 操作数在遍历时还没有编号, 最后统一替换
+      for (auto block: func_.blocks()) {
+        for (auto inst: block->insts) {
+          for (auto& op: inst->ops) {
+            op = resolve(op);
+          }
+        }
+      }
+      func_.computeCfg();
+    }
+
+    std::size_t consts = 0;
+    std::size_t values = 0;
+    std::size_t loads = 0;
+
+  private:
+    IrInst* resolve(IrInst* value) const {
+      auto it = leaders_.find(value);
+      return it == leaders_.end() ? value : it->second;
+    }
+
+    void replace(IrInst* inst, IrInst* leader) {
+      leaders_[inst] = leader;
+      inst->block = nullptr;
+    }
+
+    // available 为 block 开始时仍然有效的 load 地址和读到的值
+    void visit(IrBlock* block, std::map<IrInst*, IrInst*> available) {
+      std::vector<ValueKey> scope;
+      for (auto inst: block->insts) {
+        for (auto& op: inst->ops) {
+          op = resolve(op);
+        }
+        if (inst->op == IrOpcode::IR_LOAD) {
+          auto it = available.find(inst->ops[0]);
+          if (it != available.end() && it->second->type == inst->type) {
+            replace(inst, it->second);
+            loads++;
+          } else {
+            available[inst->ops[0]] = inst;
+          }
+          continue;
+        }
+        if (inst->op == IrOpcode::IR_STORE || inst->op == IrOpcode::IR_CALL) {
+          for (auto it = available.begin(); it != available.end();) {
+            bool clobbered = inst->op == IrOpcode::IR_STORE
+                                 ? memory_.mayAlias(inst->ops[1], it->first)
+                                 : memory_.clobberedByUnknown(it->first);
+            it = clobbered ? available.erase(it) : std::next(it);
+          }
+          if (inst->op == IrOpcode::IR_STORE) {
+            available[inst->ops[1]] = inst->ops[0];
+          }
+          continue;
+        }
+        if (!numbered(inst)) {
+          continue;
+        }
+        ValueKey key = keyOf(inst);
+        auto it = table_.find(key);
+        if (it == table_.end()) {
+          table_.emplace(key, inst);
+          scope.push_back(key);
+          continue;
+        }
+        replace(inst, it->second);
+        (inst->op == IrOpcode::IR_CONST ? consts : values)++;
+      }
+      block->insts.erase(std::remove_if(block->insts.begin(), block->insts.end(),
+                                        [](IrInst* inst) { return !inst->block; }),
+                         block->insts.end());
+      for (auto child: dom_.children(block)) {
+        // 唯一前驱为 block 时中间没有其他指令, 之前的 load 仍然有效
+        visit(child, child->preds.size() == 1 ? available : std::map<IrInst*, IrInst*>());
+      }
+      for (auto& key: scope) {
+        table_.erase(key);
+      }
+    }
+
+    IrFunction& func_;
+    DominatorTree dom_;
+    MemoryInfo memory_;
+    std::map<ValueKey, IrInst*> table_;
+    std::unordered_map<IrInst*, IrInst*> leaders_;
+};
+
+} // namespace
+
+const char* GvnPass::name() const {
+  return "gvn";
+}
+
+PassKind GvnPass::kind() const {
+  return PassKind::PASS_IR;
+}
+
+bool GvnPass::run(IrFunction& func) const {
+  ValueNumbering numbering(func);
+  numbering.run();
+  PassManager& passes = CompilerContext::current().passes();
+  passes.addStat(this, "redundant-consts", numbering.consts);
+  passes.addStat(this, "redundant-values", numbering.values);
+  passes.addStat(this, "redundant-loads", numbering.loads);
+  return numbering.consts || numbering.values || numbering.loads;
+}
+
+const Pass* gvnPass() {
+  static const GvnPass pass;
+  return &pass;
+}
+
+} // namespace rvcc
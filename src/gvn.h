@@ -0,0 +1,26 @@
+#ifndef __GVN_H
+#define __GVN_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+基于支配树的全局值编号 (GVN), 删除 SSA IR 中的公共子表达式
+  按支配树先序遍历, 运算符 类型 立即数和操作数都相同的纯运算 (包括常量和同一块中的 phi)
+  在被支配的块中直接使用之前的结果
+  load 只在扩展基本块 (唯一前驱为直接支配者的块链) 中复用, 中间的 store 和 call
+  只有在能证明与之不别名时才保留之前读取 (或 store 写入) 的值
+*/
+class GvnPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(IrFunction& func) const override;
+};
+
+const Pass* gvnPass();
+
+} // namespace rvcc
+
+#endif
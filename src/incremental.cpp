@@ -0,0 +1,247 @@
+#include "incremental.h"
+#include "logger.h"
+#include "parallel_parser.h"
+#include "parser.h"
+#include "utils.h"
+#include <algorithm>
+
+namespace rvcc {
+
+IncrementalParser::IncrementalParser(const std::vector<std::string>& include_dirs):
+  include_dirs_(include_dirs), source_(std::make_shared<std::string>()),
+  whole_(false), conflict_(false), reparsed_(0) {}
+
+IncrementalParser::~IncrementalParser() {}
+
+Ast* IncrementalParser::ast() {
+  return &ast_;
+}
+
+const std::string& IncrementalParser::source() const {
+  return *source_;
+}
+
+std::string IncrementalParser::diagnostics() const {
+  std::string result;
+  for (auto& region: regions_) {
+    result += region.diagnostics;
+    result += region.insert_diagnostics;
+  }
+  return result;
+}
+
+bool IncrementalParser::ok() const {
+  if (conflict_) {
+    return false;
+  }
+  for (auto& region: regions_) {
+    if (!region.ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t IncrementalParser::reparsedRegions() const {
+  return reparsed_;
+}
+
+std::size_t IncrementalParser::regionCount() const {
+  return regions_.size();
+}
+
+// 解析 [first, first + count) 的段, 共用一个 parser, 出错之后重新创建
+void IncrementalParser::parseRegions(std::size_t first, std::size_t count) {
+  const char* buffer = source_->c_str();
+  std::unique_ptr<Parser> parser;
+  for (std::size_t i = first; i < first + count; i++) {
+    Region& region = regions_[i];
+    eraseRegion(region);
+    region.functions.clear();
+    region.diagnostics.clear();
+    region.buffer = source_;
+    region.context.reset(new CompilerContext());
+    region.ok = region.context->run([&]() {
+      if (!parser) {
+        parser.reset(new Parser(buffer, include_dirs_));
+      }
+      if (!whole_) {
+        parser->setRange(buffer + region.begin, buffer + region.end);
+      }
+      while (Function* func = parser->parser_next_function()) {
+        region.functions.push_back(func);
+      }
+    }, region.diagnostics);
+    if (!region.ok) {
+      region.functions.clear();
+      parser.reset();
+    }
+  }
+  reparsed_ += count;
+}
+
+// 插入失败 (函数重名) 时记录诊断信息, 返回 false
+bool IncrementalParser::insertRegion(Region& region) {
+  bool ok = true;
+  region.insert_diagnostics.clear();
+  for (auto func: region.functions) {
+    bool inserted = ast_context_.run([&]() {
+      Parser::insertFunction(&ast_, func);
+    }, region.insert_diagnostics);
+    if (inserted) {
+      region.inserted.push_back(func);
+    }
+    ok = ok && inserted;
+  }
+  return ok;
+}
+
+void IncrementalParser::eraseRegion(Region& region) {
+  for (auto func: region.inserted) {
+    ast_.erase(getstrHash(func->name(), func->name_len()), func);
+  }
+  region.inserted.clear();
+}
+
+// 重名只能按源码顺序判断, 有冲突时按顺序重新插入全部函数
+void IncrementalParser::rebuildAst() {
+  for (auto& region: regions_) {
+    eraseRegion(region);
+  }
+  conflict_ = false;
+  for (auto& region: regions_) {
+    if (!insertRegion(region)) {
+      conflict_ = true;
+    }
+  }
+}
+
+void IncrementalParser::parseAll() {
+  for (auto& region: regions_) {
+    eraseRegion(region);
+  }
+  regions_.clear();
+  reparsed_ = 0;
+  const std::string& source = *source_;
+  std::vector<SourceChunk> chunks = splitTopLevel(source.c_str());
+  whole_ = chunks.empty() && !source.empty();
+  if (whole_) {
+    regions_.emplace_back();
+    regions_.back().begin = 0;
+    regions_.back().end = source.size();
+  }
+  for (auto& chunk: chunks) {
+    regions_.emplace_back();
+    regions_.back().begin = chunk.begin - source.c_str();
+    regions_.back().end = chunk.end - source.c_str();
+  }
+  parseRegions(0, regions_.size());
+  rebuildAst();
+}
+
+Ast* IncrementalParser::parse(const std::string& source) {
+  source_ = std::make_shared<std::string>(source);
+  parseAll();
+  return &ast_;
+}
+
+Ast* IncrementalParser::edit(std::size_t offset, std::size_t removed,
+                             const std::string& text) {
+  const std::string& old_source = *source_;
+  if (offset > old_source.size()) {
+    offset = old_source.size();
+  }
+  removed = std::min(removed, old_source.size() - offset);
+  auto source = std::make_shared<std::string>();
+  source->reserve(old_source.size() - removed + text.size());
+  source->append(old_source, 0, offset);
+  source->append(text);
+  source->append(old_source, offset + removed, std::string::npos);
+  long delta = static_cast<long>(text.size()) - static_cast<long>(removed);
+  source_ = source;
+  if (whole_ || regions_.empty()) {
+    parseAll();
+    return &ast_;
+  }
+
+  // 与修改范围相交或相邻的段: end >= offset 且 begin <= offset + removed
+  std::size_t first = std::lower_bound(
+    regions_.begin(), regions_.end(), offset,
+    [](const Region& region, std::size_t pos) { return region.end < pos; }) - regions_.begin();
+  if (first == regions_.size()) {
+    first--;
+  }
+  std::size_t last = std::upper_bound(
+    regions_.begin(), regions_.end(), offset + removed,
+    [](std::size_t pos, const Region& region) { return pos < region.begin; }) - regions_.begin();
+  last = std::max(last, first + 1);
+
+  // 重新切分 [regions_[first].begin, regions_[last - 1].end + delta)
+  // 切分结果必须恰好在范围末尾结束 (或者到达输入末尾), 否则按 1 2 4 ... 个段向后扩展
+  const char* buffer = source->c_str();
+  std::size_t begin = regions_[first].begin;
+  std::size_t step = 1;
+  std::vector<SourceChunk> chunks;
+  for (;;) {
+    std::size_t end = regions_[last - 1].end + delta;
+    bool at_eof = last == regions_.size();
+    chunks.clear();
+    if (splitTopLevel(buffer + begin, buffer + end, chunks)) {
+      const char* tail = chunks.empty() ? buffer + begin : chunks.back().end;
+      if (tail != buffer + end && at_eof) {
+        chunks.push_back({tail, buffer + end});
+        break;
+      }
+      if (tail == buffer + end) {
+        break;
+      }
+    }
+    if (at_eof) {
+      // 整个剩余部分都无法切分, 交给完整解析报告错误或者退化为一段
+      parseAll();
+      return &ast_;
+    }
+    last = std::min(last + step, regions_.size());
+    step *= 2;
+  }
+
+  bool conflict = conflict_;
+  for (std::size_t i = first; i < last; i++) {
+    eraseRegion(regions_[i]);
+  }
+  for (std::size_t i = last; i < regions_.size(); i++) {
+    regions_[i].begin += delta;
+    regions_[i].end += delta;
+  }
+  std::vector<Region> fresh(chunks.size());
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    fresh[i].begin = chunks[i].begin - buffer;
+    fresh[i].end = chunks[i].end - buffer;
+  }
+  regions_.erase(regions_.begin() + first, regions_.begin() + last);
+  regions_.insert(regions_.begin() + first,
+                  std::make_move_iterator(fresh.begin()),
+                  std::make_move_iterator(fresh.end()));
+  reparsed_ = 0;
+  parseRegions(first, chunks.size());
+  for (std::size_t i = first; i < first + chunks.size(); i++) {
+    if (!insertRegion(regions_[i])) {
+      conflict = true;
+    }
+  }
+  // 出错的段的诊断信息包含行号, 修改之后重新解析以保持行号正确
+  for (std::size_t i = 0; i < regions_.size(); i++) {
+    if (!regions_[i].ok && (i < first || i >= first + chunks.size())) {
+      parseRegions(i, 1);
+      if (!insertRegion(regions_[i])) {
+        conflict = true;
+      }
+    }
+  }
+  if (conflict) {
+    rebuildAst();
+  }
+  return &ast_;
+}
+
+} // namespace rvcc
@@ -0,0 +1,69 @@
+#ifndef __INCREMENTAL_H
+#define __INCREMENTAL_H
+
+#include "ast.h"
+#include "context.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+/*
+增量解析, 供编辑器每次修改后重新检查
+  输入按顶层 '{}' 切分成若干段 (见 splitTopLevel), 每段单独解析,
+  使用自己的 CompilerContext 作为 arena, 段被替换时整体释放
+  修改之后只重新切分和解析与修改范围相交的段, 其余段的 Function 和 Type 原样复用
+  复用的 Function 的名字仍然指向旧的 buffer, 因此段同时持有解析时的 buffer
+  无法安全切分时 (有预处理指令, 括号不匹配) 整个输入作为一段
+*/
+class IncrementalParser {
+  public:
+    explicit IncrementalParser(const std::vector<std::string>& include_dirs = {});
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+    ~IncrementalParser();
+    // 完整解析 source
+    Ast* parse(const std::string& source);
+    // 将 [offset, offset + removed) 替换为 text 之后重新解析受影响的段
+    Ast* edit(std::size_t offset, std::size_t removed, const std::string& text);
+    Ast* ast();
+    const std::string& source() const;
+    // 所有段的诊断信息, 按源码顺序拼接
+    std::string diagnostics() const;
+    bool ok() const;
+    // 上一次 parse/edit 重新解析的段数
+    std::size_t reparsedRegions() const;
+    std::size_t regionCount() const;
+  private:
+    using Buffer = std::shared_ptr<const std::string>;
+    struct Region {
+      std::size_t begin;
+      std::size_t end;
+      Buffer buffer;                  // 解析时的输入, functions 引用其中的名字
+      std::unique_ptr<CompilerContext> context;
+      std::vector<Function*> functions;
+      std::vector<Function*> inserted; // 成功插入 ast 的函数
+      bool ok;
+      std::string diagnostics;
+      std::string insert_diagnostics;  // 函数重名
+    };
+    void parseRegions(std::size_t first, std::size_t count);
+    bool insertRegion(Region& region);
+    void eraseRegion(Region& region);
+    void rebuildAst();
+    void parseAll();
+    std::vector<std::string> include_dirs_;
+    Buffer source_;
+    std::vector<Region> regions_;
+    CompilerContext ast_context_;
+    Ast ast_;
+    bool whole_;        // 无法切分, 整个输入作为一段
+    bool conflict_;     // 存在重名的函数
+    std::size_t reparsed_;
+};
+
+} // namespace rvcc
+
+#endif
@@ -1,149 +1,244 @@
 #include "instructions.h"
+#include "context.h"
+#include "logger.h"
+#include <cstdarg>
+#include <string>
+
+using rvcc::CompilerContext;
+using rvcc::MFunction;
+using rvcc::MInst;
+using rvcc::MOpcode;
+
+void emit(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    CompilerContext::current().emit(format, args);
+    va_end(args);
+}
+
+namespace {
+
+MInst& append(MOpcode op, int rd = rvcc::REG_NONE, int rs1 = rvcc::REG_NONE,
+              int rs2 = rvcc::REG_NONE, long imm = 0) {
+    MFunction* func = CompilerContext::current().mfunction();
+    CHECK(func != nullptr);
+    func->insts.emplace_back(op, rd, rs1, rs2, imm);
+    return func->insts.back();
+}
 
-std::atomic_int depth = 0;
+std::string format(const char* fmt, va_list args) {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int need_size = vsnprintf(nullptr, 0, fmt, args_copy);
+    va_end(args_copy);
+    std::string result(need_size > 0 ? need_size : 0, '\0');
+    if (need_size > 0) {
+        vsnprintf(&result[0], need_size + 1, fmt, args);
+    }
+    return result;
+}
+
+void label_(const std::string& comment, const std::string& label) {
+    append(MOpcode::MOP_COMMENT).comment = comment;
+    append(MOpcode::MOP_LABEL).sym = label;
+}
 
-void mv_(const char* dst, const char* src) {
-    printf("  # 将寄存器 %s 的值赋值给寄存器 %s\n", src, dst);
-    printf("  mv %s, %s\n", dst, src);
+void jump_(MOpcode op, int reg, const std::string& label, const std::string& comment,
+           int reg2 = rvcc::REG_NONE) {
+    MInst& inst = append(op, rvcc::REG_NONE, reg, reg2);
+    inst.sym = label;
+    inst.comment = comment;
+}
+
+std::string id_label(const char* kind, std::uint32_t unique_id) {
+    return std::string(".L.") + kind + "." + std::to_string(unique_id);
+}
+
+std::string block_label(const char* func_name, int block_id) {
+    return std::string(".L.bb.") + func_name + "." + std::to_string(block_id);
+}
+
+} // namespace
+
+void comment_(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    append(MOpcode::MOP_COMMENT).comment = format(fmt, args);
+    va_end(args);
+}
+
+void mv_(int dst, int src) {
+    append(MOpcode::MOP_MV, dst, src);
 };
-void add_(const char* dst, const char* src1, const char* src2) {
-    printf("  # %s + %s，结果写入 %s\n", src1, src2, dst);
-    printf("  add %s, %s, %s\n", dst, src1, src2);
+void add_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_ADD, dst, src1, src2);
 };
-void sub_(const char* dst, const char* src1, const char* src2) {
-    printf("  # %s - %s，结果写入 %s\n", src1, src2, dst);
-    printf("  sub %s, %s, %s\n", dst, src1, src2);
+void sub_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_SUB, dst, src1, src2);
 };
-void addi_(const char* dst, const char* src, int val) {
-    printf("  # %s + %d，结果写入 %s\n", src, val, dst);
-    printf("  addi %s, %s, %d\n", dst, src, val);
+void addi_(int dst, int src, int val) {
+    append(MOpcode::MOP_ADDI, dst, src, rvcc::REG_NONE, val);
 };
-void mul_(const char* dst, const char* src1, const char* src2) {
-    printf("  # %s * %s，结果写入 %s\n", src1, src2, dst);
-    printf("  mul %s, %s, %s\n", dst, src1, src2);
+void mul_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_MUL, dst, src1, src2);
 };
-void div_(const char* dst, const char* src1, const char* src2) {
-    printf("  # %s / %s，结果写入 %s\n", src1, src2, dst);
-    printf("  div %s, %s, %s\n", dst, src1, src2);
+void div_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_DIV, dst, src1, src2);
 };
-void xor_(const char* dst, const char* src1, const char* src2) {
-    printf("  # %s 异或 %s 结果写入 %s\n", src1, src2, dst);
-    printf("  xor %s, %s, %s\n", dst, src1, src2);
+void xor_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_XOR, dst, src1, src2);
 };
-void xori_(const char* dst, const char* src, int val) {
-    printf("  # %s 异或 %d 结果写入 %s\n", src, val, dst);
-    printf("  xori %s, %s, %d\n", dst, src, val);
+void xori_(int dst, int src, int val) {
+    append(MOpcode::MOP_XORI, dst, src, rvcc::REG_NONE, val);
 };
-void seqz_(const char* dst, const char* src) {
-    printf("  # 寄存器 %s 和 0 相等的结果 写入寄存器 %s\n", src, dst);
-    printf("  seqz %s, %s\n", dst, src);
+void seqz_(int dst, int src) {
+    append(MOpcode::MOP_SEQZ, dst, src);
 };
-void snez_(const char* dst, const char* src) {
-    printf("  # 寄存器 %s 和 0 不相等的结果 写入寄存器 %s\n", src, dst);
-    printf("  snez %s, %s\n", dst, src);
+void snez_(int dst, int src) {
+    append(MOpcode::MOP_SNEZ, dst, src);
 };
-void slt_(const char* dst, const char* src1, const char* src2) {
-    printf("  # 寄存器 %s 小于寄存器 %s 的结果 写入寄存器 %s\n", src1,  src2, dst);
-    printf("  slt %s, %s, %s\n", dst, src1, src2);
+void slt_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_SLT, dst, src1, src2);
 };
-void li_(const char* dst, int val) {
-    printf("  # 将%d加载到 %s 中\n", val, dst);
-    printf("  li %s, %d\n", dst, val);
+void slti_(int dst, int src, int val) {
+    append(MOpcode::MOP_SLTI, dst, src, rvcc::REG_NONE, val);
 };
-void sd_(const char* reg, const char* addr, int offset) {
-    printf("  # 将寄存器 %s 保存到 (%d)%s 地址中\n", reg, offset, addr);
-    printf("  sd %s, %d(%s)\n", reg, offset, addr);
+void li_(int dst, long val) {
+    append(MOpcode::MOP_LI, dst, rvcc::REG_NONE, rvcc::REG_NONE, val);
 };
-void ld_(const char* reg, const char* addr, int offset) {
-    printf("  # 将地址 (%d)%s 中的值 加载到寄存器 %s 中\n", offset, addr, reg);
-    printf("  ld %s, %d(%s)\n", reg, offset, addr);
+void sd_(int reg, int addr, int offset) {
+    append(MOpcode::MOP_SD, rvcc::REG_NONE, addr, reg, offset);
 };
-void neg_(const char* dst, const char* src) {
-    printf("  # 对寄存器 %s 值进行取反后写入 寄存器 %s\n", src, dst);
-    printf("  neg %s, %s\n", dst, src);
+void ld_(int reg, int addr, int offset) {
+    append(MOpcode::MOP_LD, reg, addr, rvcc::REG_NONE, offset);
 };
-
-void call_(const char* func_name) {
-    printf("  # 调用函数%s\n", func_name);
-    printf("  call %s\n", func_name);
+void neg_(int dst, int src) {
+    append(MOpcode::MOP_NEG, dst, src);
 };
-
-void ret_() {
-    printf("  # 返回a0值给系统调用\n");
-    printf("  ret\n");
+void slli_(int dst, int src, int shamt) {
+    append(MOpcode::MOP_SLLI, dst, src, rvcc::REG_NONE, shamt);
 };
-
-
-void push_(const char* reg) {
-    depth++;
-    printf("  # 将 %s 值压栈\n", reg);
-    printf("  addi sp, sp, -8\n");
-    printf("  sd %s, 0(sp)\n", reg);
-}; 
-void pop_(const char* reg) {
-    depth--;
-    printf("  # 将 %s 值弹栈\n", reg);
-    printf("  ld %s, 0(sp)\n", reg);
-    printf("  addi sp, sp, 8\n");
+void srai_(int dst, int src, int shamt) {
+    append(MOpcode::MOP_SRAI, dst, src, rvcc::REG_NONE, shamt);
+};
+void srli_(int dst, int src, int shamt) {
+    append(MOpcode::MOP_SRLI, dst, src, rvcc::REG_NONE, shamt);
+};
+void mulh_(int dst, int src1, int src2) {
+    append(MOpcode::MOP_MULH, dst, src1, src2);
+};
+void append_(const MInst& inst) {
+    MFunction* func = CompilerContext::current().mfunction();
+    CHECK(func != nullptr);
+    func->insts.push_back(inst);
 };
 
-void start_(const char* func_name) {
-    printf("# 定义全局 %s 段\n", func_name);
-    printf(".globl %s\n", func_name);
-    printf("\n# =====程序开始===============\n");
-    printf("# %s段标签，也是程序入口段\n", func_name);
-    printf("%s:\n", func_name);
+void call_(const char* func_name) {
+    append(MOpcode::MOP_CALL, rvcc::REG_ACC, rvcc::REG_NONE, rvcc::REG_NONE,
+           CompilerContext::current().depth()).sym = func_name;
+};
+
+void push_(int reg) {
+    CompilerContext::current().depth()++;
+    append(MOpcode::MOP_PUSH, rvcc::REG_NONE, reg);
+};
+void pop_(int reg) {
+    CompilerContext::current().depth()--;
+    append(MOpcode::MOP_POP, reg);
+};
+
+void save_(int reg) {
+    MFunction* func = CompilerContext::current().mfunction();
+    CHECK(func != nullptr);
+    if (!func->virtual_regs) {
+        push_(reg);
+        return;
+    }
+    int vreg = func->newVirtualReg();
+    func->saved.push_back(vreg);
+    mv_(vreg, reg);
+};
+void restore_(int reg) {
+    MFunction* func = CompilerContext::current().mfunction();
+    CHECK(func != nullptr);
+    if (!func->virtual_regs) {
+        pop_(reg);
+        return;
+    }
+    CHECK(!func->saved.empty());
+    int vreg = func->saved.back();
+    func->saved.pop_back();
+    mv_(reg, vreg);
 };
 
 void goto_return_label_(const char* func_name) {
-    printf("# 返回语句\n");
-    printf("  # 跳转到.L.return段\n");
-    printf("  j .L.return.%s\n", func_name);
+    comment_("# 返回语句\n");
+    jump_(MOpcode::MOP_J, rvcc::REG_NONE, std::string(".L.return.") + func_name,
+          "跳转到.L.return段");
 }
 
 void return_label_(const char* func_name) {
-    printf("\n# =====程序结束 %s===============\n", func_name);
-    printf("# return段标签\n");
-    printf(".L.return.%s:\n", func_name);
+    std::string name(func_name);
+    label_("\n# =====程序结束 " + name + "===============\n# return段标签\n",
+           ".L.return." + name);
 }
 
-void goto_else_label_(const char* reg, std::uint32_t unique_id) {
-    printf("  # 若a0为0，则跳转到分支%d的.L.else.%d段\n", unique_id, unique_id);
-    printf("  beqz %s, .L.else.%d\n", reg, unique_id);
+void goto_else_label_(MOpcode op, int reg1, int reg2, std::uint32_t unique_id) {
+    std::string id = std::to_string(unique_id);
+    std::string cond = op == MOpcode::MOP_BEQZ ? "若%s为0" : "若条件不成立";
+    jump_(op, reg1, id_label("else", unique_id),
+          cond + "，则跳转到分支" + id + "的.L.else." + id + "段", reg2);
 }
 
 void else_label_(std::uint32_t unique_id) {
-    printf("\n# Else语句%d\n", unique_id);
-    printf("# 分支%d的.L.else.%d段标签\n", unique_id, unique_id);
-    printf(".L.else.%d:\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    label_("\n# Else语句" + id + "\n# 分支" + id + "的.L.else." + id + "段标签\n",
+           id_label("else", unique_id));
 }
 
 void branch_end_label_(std::uint32_t unique_id) {
-    printf("\n# 分支%d的.L.end.%d段标签\n", unique_id, unique_id);
-    printf(".L.end.%d:\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    label_("\n# 分支" + id + "的.L.end." + id + "段标签\n", id_label("end", unique_id));
 }
 
 void loop_end_label_(std::uint32_t unique_id) {
-    printf("\n# 循环%d的.L.end.%d段标签\n", unique_id, unique_id);
-    printf(".L.end.%d:\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    label_("\n# 循环" + id + "的.L.end." + id + "段标签\n", id_label("end", unique_id));
 }
 
 void goto_end_label_(std::uint32_t unique_id) {
-    printf("  # 跳转到分支%d的.L.end.%d段\n", unique_id, unique_id);
-    printf("  j .L.end.%d\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    jump_(MOpcode::MOP_J, rvcc::REG_NONE, id_label("end", unique_id),
+          "跳转到分支" + id + "的.L.end." + id + "段");
 }
 
 void loop_begin_label_(std::uint32_t unique_id) {
-    printf("\n# 循环%d的.L.begin.%d段标签\n", unique_id, unique_id);
-    printf(".L.begin.%d:\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    label_("\n# 循环" + id + "的.L.begin." + id + "段标签\n", id_label("begin", unique_id));
 }
 
 void goto_loop_begin_label_(std::uint32_t unique_id) {
-    printf("  # 跳转到循环%d的.L.begin.%d段\n", unique_id, unique_id);
-    printf("  j .L.begin.%d\n", unique_id);
+    std::string id = std::to_string(unique_id);
+    jump_(MOpcode::MOP_J, rvcc::REG_NONE, id_label("begin", unique_id),
+          "跳转到循环" + id + "的.L.begin." + id + "段");
+}
+
+void goto_loop_end_label_(MOpcode op, int reg1, int reg2, std::uint32_t unique_id) {
+    std::string id = std::to_string(unique_id);
+    std::string cond = op == MOpcode::MOP_BEQZ ? "若 %s 为0" : "若条件不成立";
+    jump_(op, reg1, id_label("end", unique_id),
+          cond + "，则跳转到循环" + id + "的.L.end." + id + "段", reg2);
+}
+
+void block_label_(const char* func_name, int block_id) {
+    std::string id = std::to_string(block_id);
+    label_("\n# 基本块bb" + id + "\n", block_label(func_name, block_id));
 }
 
-void goto_loop_end_label_(const char* reg, std::uint32_t unique_id) {
-    printf("  # 若 %s 为0，则跳转到循环%d的.L.end.%d段\n", reg, unique_id, unique_id);
-    printf("  beqz %s, .L.end.%d\n", reg, unique_id);
+void goto_block_label_(MOpcode op, int reg1, int reg2, const char* func_name, int block_id) {
+    std::string id = std::to_string(block_id);
+    std::string cond = op == MOpcode::MOP_J ? "" :
+                       op == MOpcode::MOP_BEQZ ? "若%s为0，则" :
+                       op == MOpcode::MOP_BNEZ ? "若%s不为0，则" : "若条件成立，则";
+    jump_(op, reg1, block_label(func_name, block_id), cond + "跳转到基本块bb" + id, reg2);
 }
@@ -1,42 +1,61 @@
 #ifndef __INSTRUCTION_H
 #define __INSTRUCTION_H
-#include <atomic>
+#include "mir.h"
 #include <cstdint>
 #include <stdio.h>
 
-extern std::atomic_int depth;
+// 写入当前 CompilerContext 的汇编输出
+void emit(const char* format, ...) __attribute__((format(printf, 1, 2)));
 
-void mv_(const char* dst, const char* src);
-void add_(const char* dst, const char* src1, const char* src2);
-void sub_(const char* dst, const char* src1, const char* src2);
-void addi_(const char* dst, const char* src, int val);
-void mul_(const char* dst, const char* src1, const char* src2);
-void div_(const char* dst, const char* src1, const char* src2);
-void xor_(const char* dst, const char* src1, const char* src2);
-void xori_(const char* dst, const char* src1, int src2);
-void seqz_(const char* dst, const char* src);
-void snez_(const char* dst, const char* src);
-void slt_(const char* dst, const char* src1, const char* src2);
-void li_(const char* dst, int val);
-void sd_(const char* reg, const char* addr, int offset);
-void ld_(const char* reg, const char* addr, int offset);
-void neg_(const char* dst, const char* src);
+// 以下接口向当前函数 (CompilerContext::mfunction) 追加机器指令
+// 寄存器为 rvcc::MReg 中的编号, 由 Target 映射为具体的寄存器
+void comment_(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void mv_(int dst, int src);
+void add_(int dst, int src1, int src2);
+void sub_(int dst, int src1, int src2);
+void addi_(int dst, int src, int val);
+void mul_(int dst, int src1, int src2);
+void div_(int dst, int src1, int src2);
+void xor_(int dst, int src1, int src2);
+void xori_(int dst, int src1, int src2);
+void seqz_(int dst, int src);
+void snez_(int dst, int src);
+void slt_(int dst, int src1, int src2);
+void slti_(int dst, int src, int val);
+void li_(int dst, long val);
+void sd_(int reg, int addr, int offset);
+void ld_(int reg, int addr, int offset);
+void neg_(int dst, int src);
+void slli_(int dst, int src, int shamt);
+void srai_(int dst, int src, int shamt);
+void srli_(int dst, int src, int shamt);
+void mulh_(int dst, int src1, int src2);
+// 追加一条已经构造好的指令
+void append_(const rvcc::MInst& inst);
 void call_(const char* func_name);
-void ret_();
 
-void push_(const char* reg);
-void pop_(const char* reg);
-void start_(const char* func_name);
+void push_(int reg);
+void pop_(int reg);
+// 保存表达式的中间结果: 开启寄存器分配时复制到新的虚拟寄存器, 否则压栈
+void save_(int reg);
+// 取回最近一次 save_ 保存的值
+void restore_(int reg);
 void goto_return_label_(const char* func_name);
 void return_label_(const char* func_name);
 
-void goto_else_label_(const char* reg, std::uint32_t unique_id);
+// op 为条件跳转指令, 条件不成立时跳转, 见 selectBranch
+void goto_else_label_(rvcc::MOpcode op, int reg1, int reg2, std::uint32_t unique_id);
 void else_label_(std::uint32_t unique_id);
 void branch_end_label_(std::uint32_t unique_id);
 void loop_end_label_(std::uint32_t unique_id);
 void goto_end_label_(std::uint32_t unique_id);
 void loop_begin_label_(std::uint32_t unique_id);
 void goto_loop_begin_label_(std::uint32_t unique_id);
-void goto_loop_end_label_(const char* reg, std::uint32_t unique_id);
+void goto_loop_end_label_(rvcc::MOpcode op, int reg1, int reg2, std::uint32_t unique_id);
 
-#endif
\ No newline at end of file
+// SSA IR 的基本块 .L.bb.<函数名>.<块编号>, 见 lowerIr
+void block_label_(const char* func_name, int block_id);
+// op 为 MOP_J 或者条件跳转指令, 条件成立时跳转到基本块
+void goto_block_label_(rvcc::MOpcode op, int reg1, int reg2, const char* func_name, int block_id);
+
+#endif
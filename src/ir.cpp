@@ -0,0 +1,638 @@
+#include "ir.h"
+#include "ir_analysis.h"
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rvcc {
+
+namespace {
+
+const char* kOpcodeNames[] = {
+  "const", "param", "alloca", "add", "sub", "mul", "div",
+  "eq", "ne", "lt", "le", "neg", "load", "store", "call",
+  "phi", "br", "jmp", "ret"
+};
+static_assert(sizeof(kOpcodeNames) / sizeof(kOpcodeNames[0]) ==
+              static_cast<std::size_t>(IrOpcode::IR_OPCODE_COUNT),
+              "opcode name table out of sync");
+
+const char* kTypeNames[] = {"void", "i64", "ptr"};
+
+} // namespace
+
+IrInst::IrInst(IrOpcode op, IrType type):
+  op(op), type(type), id(-1), imm(0), block(nullptr) {}
+
+const char* IrInst::opcodeName() const {
+  return kOpcodeNames[static_cast<int>(op)];
+}
+
+bool IrInst::isTerminator() const {
+  return op == IrOpcode::IR_BR || op == IrOpcode::IR_JMP || op == IrOpcode::IR_RET;
+}
+
+bool IrInst::hasSideEffects() const {
+  return op == IrOpcode::IR_STORE || op == IrOpcode::IR_CALL || isTerminator();
+}
+
+IrBlock::IrBlock(int id): id(id) {}
+
+IrInst* IrBlock::terminator() const {
+  if (insts.empty() || !insts.back()->isTerminator()) {
+    return nullptr;
+  }
+  return insts.back();
+}
+
+std::vector<IrBlock*> IrBlock::succs() const {
+  IrInst* term = terminator();
+  if (!term) {
+    return {};
+  }
+  return term->blocks;
+}
+
+IrFunction::IrFunction(const std::string& name): name_(name) {}
+
+const std::string& IrFunction::name() const {
+  return name_;
+}
+
+std::vector<IrBlock*>& IrFunction::blocks() {
+  return blocks_;
+}
+
+IrBlock* IrFunction::entry() const {
+  return blocks_.empty() ? nullptr : blocks_.front();
+}
+
+IrBlock* IrFunction::newBlock() {
+  block_pool_.emplace_back(new IrBlock(static_cast<int>(block_pool_.size())));
+  blocks_.push_back(block_pool_.back().get());
+  return blocks_.back();
+}
+
+void IrFunction::moveToEnd(IrBlock* block) {
+  blocks_.erase(std::find(blocks_.begin(), blocks_.end(), block));
+  blocks_.push_back(block);
+}
+
+IrInst* IrFunction::newInst(IrOpcode op, IrType type) {
+  inst_pool_.emplace_back(new IrInst(op, type));
+  return inst_pool_.back().get();
+}
+
+IrInst* IrFunction::append(IrBlock* block, IrOpcode op, IrType type,
+                           const std::vector<IrInst*>& ops) {
+  IrInst* inst = newInst(op, type);
+  inst->ops = ops;
+  inst->block = block;
+  block->insts.push_back(inst);
+  return inst;
+}
+
+void IrFunction::erase(IrInst* inst) {
+  if (!inst->block) {
+    return;
+  }
+  std::vector<IrInst*>& insts = inst->block->insts;
+  insts.erase(std::find(insts.begin(), insts.end(), inst));
+  inst->block = nullptr;
+}
+
+void IrFunction::computeCfg() {
+  int value_id = 0;
+  for (std::size_t i = 0; i < blocks_.size(); i++) {
+    blocks_[i]->id = static_cast<int>(i);
+    blocks_[i]->preds.clear();
+    for (auto inst: blocks_[i]->insts) {
+      inst->id = inst->type == IrType::IR_VOID ? -1 : value_id++;
+    }
+  }
+  for (auto block: blocks_) {
+    for (auto succ: block->succs()) {
+      succ->preds.push_back(block);
+    }
+  }
+}
+
+bool IrFunction::removeUnreachable() {
+  if (blocks_.empty()) {
+    return false;
+  }
+  std::unordered_set<IrBlock*> reachable{blocks_.front()};
+  std::vector<IrBlock*> work{blocks_.front()};
+  while (!work.empty()) {
+    IrBlock* block = work.back();
+    work.pop_back();
+    for (auto succ: block->succs()) {
+      if (reachable.insert(succ).second) {
+        work.push_back(succ);
+      }
+    }
+  }
+  bool removed = reachable.size() != blocks_.size();
+  std::vector<IrBlock*> blocks;
+  for (auto block: blocks_) {
+    if (!reachable.count(block)) {
+      for (auto inst: block->insts) {
+        inst->block = nullptr;
+      }
+      block->insts.clear();
+      continue;
+    }
+    blocks.push_back(block);
+    for (auto inst: block->insts) {
+      if (inst->op != IrOpcode::IR_PHI) {
+        break;
+      }
+      for (std::size_t i = inst->blocks.size(); i-- > 0;) {
+        if (!reachable.count(inst->blocks[i])) {
+          inst->blocks.erase(inst->blocks.begin() + i);
+          inst->ops.erase(inst->ops.begin() + i);
+        }
+      }
+    }
+  }
+  blocks_.swap(blocks);
+  // 只剩一个来源值的 phi 替换为该值, 替换之后其他 phi 可能也变成这样
+  // 来自被删除的块或者被删除的边 (见 dce) 的值都会使 phi 变成这样
+  bool changed = true;
+  int simplified = 0;
+  while (changed) {
+    changed = false;
+    for (auto block: blocks_) {
+      for (std::size_t i = 0; i < block->insts.size(); i++) {
+        IrInst* phi = block->insts[i];
+        if (phi->op != IrOpcode::IR_PHI) {
+          break;
+        }
+        IrInst* same = nullptr;
+        bool trivial = true;
+        for (auto op: phi->ops) {
+          if (op != phi && op != same) {
+            trivial = trivial && !same;
+            same = op;
+          }
+        }
+        if (trivial && same) {
+          replaceAllUses(phi, same);
+          erase(phi);
+          changed = true;
+          simplified++;
+          i--;
+        }
+      }
+    }
+  }
+  computeCfg();
+  return removed || simplified > 0;
+}
+
+void IrFunction::replaceAllUses(IrInst* from, IrInst* to) {
+  for (auto block: blocks_) {
+    for (auto inst: block->insts) {
+      std::replace(inst->ops.begin(), inst->ops.end(), from, to);
+    }
+  }
+}
+
+const char* irTypeName(IrType type) {
+  return kTypeNames[static_cast<int>(type)];
+}
+
+namespace {
+
+std::string valueName(const IrInst* inst) {
+  return "%" + std::to_string(inst->id);
+}
+
+std::string blockName(const IrBlock* block) {
+  return "bb" + std::to_string(block->id);
+}
+
+std::string formatInst(const IrInst* inst) {
+  std::string text;
+  if (inst->type != IrType::IR_VOID) {
+    text += valueName(inst) + " = ";
+  }
+  text += inst->opcodeName();
+  if (inst->type != IrType::IR_VOID) {
+    text += " ";
+    text += irTypeName(inst->type);
+  }
+  switch (inst->op) {
+  case IrOpcode::IR_CONST:
+  case IrOpcode::IR_PARAM:
+    text += " " + std::to_string(inst->imm);
+    break;
+  case IrOpcode::IR_ALLOCA:
+    text += " " + std::to_string(inst->imm);
+    if (!inst->sym.empty()) {
+      text += " " + inst->sym;
+    }
+    break;
+  case IrOpcode::IR_CALL:
+    text += " @" + inst->sym + "(";
+    for (std::size_t i = 0; i < inst->ops.size(); i++) {
+      text += (i ? ", " : "") + valueName(inst->ops[i]);
+    }
+    text += ")";
+    break;
+  case IrOpcode::IR_PHI:
+    for (std::size_t i = 0; i < inst->ops.size(); i++) {
+      text += (i ? ", [" : " [") + valueName(inst->ops[i]) + ", " +
+              blockName(inst->blocks[i]) + "]";
+    }
+    break;
+  default:
+    for (std::size_t i = 0; i < inst->ops.size(); i++) {
+      text += (i ? ", " : " ") + valueName(inst->ops[i]);
+    }
+    for (auto block: inst->blocks) {
+      text += (inst->ops.empty() ? " " : ", ") + blockName(block);
+    }
+    break;
+  }
+  return text;
+}
+
+} // namespace
+
+void printIr(IrFunction& func, std::string& out) {
+  DominatorTree dom(func);
+  LoopForest loops(func, dom);
+  out += "func @" + func.name() + " {\n";
+  for (auto block: func.blocks()) {
+    std::string label = blockName(block) + ":";
+    std::string note;
+    if (!block->preds.empty()) {
+      note += "preds";
+      for (auto pred: block->preds) {
+        note += " " + blockName(pred);
+      }
+    }
+    if (dom.idom(block)) {
+      note += ", idom " + blockName(dom.idom(block));
+    }
+    if (IrLoop* loop = loops.loopFor(block)) {
+      note += (note.empty() ? "" : ", ") + std::string("loop ") +
+              blockName(loop->header) + " depth " + std::to_string(loop->depth);
+    }
+    if (!note.empty()) {
+      label.resize(std::max<std::size_t>(label.size() + 1, 30), ' ');
+      label += "; " + note;
+    }
+    out += label + "\n";
+    for (auto inst: block->insts) {
+      out += "  " + formatInst(inst) + "\n";
+    }
+  }
+  out += "}\n";
+}
+
+namespace {
+
+// 按行解析, 每行去掉注释之后切分为记号
+class IrParser {
+  public:
+    IrParser(const std::string& text, std::vector<std::unique_ptr<IrFunction>>& funcs,
+             std::string& error):
+      text_(text), funcs_(funcs), error_(error), line_no_(0), pos_(0) {}
+
+    bool parse() {
+      std::size_t begin = 0;
+      while (begin < text_.size()) {
+        std::size_t end = text_.find('\n', begin);
+        if (end == std::string::npos) {
+          end = text_.size();
+        }
+        line_no_++;
+        if (!tokenize(text_.substr(begin, end - begin)) || !parseLine()) {
+          return false;
+        }
+        begin = end + 1;
+      }
+      if (func_) {
+        return fail("missing '}' at end of func @" + func_->name());
+      }
+      return true;
+    }
+
+  private:
+    bool fail(const std::string& message) {
+      error_ = "line " + std::to_string(line_no_) + ": " + message;
+      return false;
+    }
+
+    bool tokenize(const std::string& line) {
+      tokens_.clear();
+      pos_ = 0;
+      std::size_t i = 0;
+      while (i < line.size() && line[i] != ';') {
+        char c = line[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+          i++;
+          continue;
+        }
+        if (std::string("=,()[]{}:").find(c) != std::string::npos) {
+          tokens_.push_back(std::string(1, c));
+          i++;
+          continue;
+        }
+        std::size_t start = i;
+        if (c == '%' || c == '@' || c == '-') {
+          i++;
+        }
+        while (i < line.size() &&
+               (std::isalnum(static_cast<unsigned char>(line[i])) ||
+                line[i] == '_' || line[i] == '.')) {
+          i++;
+        }
+        if (i == start || (i == start + 1 && !std::isalnum(static_cast<unsigned char>(c)) &&
+                           c != '_' && c != '.')) {
+          return fail(std::string("unexpected character '") + c + "'");
+        }
+        tokens_.push_back(line.substr(start, i - start));
+      }
+      return true;
+    }
+
+    bool atEnd() const {
+      return pos_ == tokens_.size();
+    }
+
+    const std::string& peek() const {
+      static const std::string kEnd;
+      return atEnd() ? kEnd : tokens_[pos_];
+    }
+
+    bool expect(const std::string& token) {
+      if (peek() != token) {
+        return fail("expected '" + token + "' but got '" + peek() + "'");
+      }
+      pos_++;
+      return true;
+    }
+
+    bool number(long& value) {
+      const std::string& token = peek();
+      std::size_t digits = token.size() > 0 && token[0] == '-' ? 1 : 0;
+      if (token.size() == digits ||
+          token.find_first_not_of("0123456789", digits) != std::string::npos) {
+        return fail("expected a number but got '" + token + "'");
+      }
+      value = std::stol(token);
+      pos_++;
+      return true;
+    }
+
+    bool type(IrType& type) {
+      for (int i = 1; i < static_cast<int>(IrType::IR_TYPE_COUNT); i++) {
+        if (peek() == kTypeNames[i]) {
+          type = static_cast<IrType>(i);
+          pos_++;
+          return true;
+        }
+      }
+      return fail("expected a type but got '" + peek() + "'");
+    }
+
+    // 值可以在定义之前使用 (phi), 函数结束时统一解析
+    bool value(IrInst* inst) {
+      const std::string& token = peek();
+      if (token.size() < 2 || token[0] != '%') {
+        return fail("expected a value but got '" + token + "'");
+      }
+      inst->ops.push_back(nullptr);
+      uses_.push_back({inst, inst->ops.size() - 1, token, line_no_});
+      pos_++;
+      return true;
+    }
+
+    bool block(IrBlock*& block) {
+      const std::string& token = peek();
+      if (token.empty() || !(std::isalpha(static_cast<unsigned char>(token[0])) ||
+                             token[0] == '_' || token[0] == '.')) {
+        return fail("expected a block but got '" + token + "'");
+      }
+      block = blockNamed(token);
+      pos_++;
+      return true;
+    }
+
+    IrBlock* blockNamed(const std::string& name) {
+      auto iter = blocks_.find(name);
+      if (iter != blocks_.end()) {
+        return iter->second;
+      }
+      IrBlock* block = func_->newBlock();
+      blocks_[name] = block;
+      return block;
+    }
+
+    bool parseLine() {
+      if (atEnd()) {
+        return true;
+      }
+      if (!func_) {
+        if (!expect("func") || peek().size() < 2 || peek()[0] != '@') {
+          return fail("expected 'func @<name> {'");
+        }
+        func_.reset(new IrFunction(peek().substr(1)));
+        pos_++;
+        return expect("{") && endOfLine();
+      }
+      if (peek() == "}") {
+        pos_++;
+        return endOfLine() && finishFunction();
+      }
+      if (tokens_.size() == 2 && tokens_[1] == ":") {
+        IrBlock* label = blockNamed(tokens_[0]);
+        if (std::find(order_.begin(), order_.end(), label) != order_.end()) {
+          return fail("block " + tokens_[0] + " defined twice");
+        }
+        order_.push_back(label);
+        current_ = label;
+        return true;
+      }
+      if (!current_) {
+        return fail("instruction before the first block label");
+      }
+      return parseInst();
+    }
+
+    bool endOfLine() {
+      if (!atEnd()) {
+        return fail("unexpected '" + peek() + "'");
+      }
+      return true;
+    }
+
+    bool parseInst() {
+      std::string def;
+      if (peek().size() > 1 && peek()[0] == '%') {
+        def = peek();
+        pos_++;
+        if (!expect("=")) {
+          return false;
+        }
+      }
+      int op = 0;
+      while (op < static_cast<int>(IrOpcode::IR_OPCODE_COUNT) && peek() != kOpcodeNames[op]) {
+        op++;
+      }
+      if (op == static_cast<int>(IrOpcode::IR_OPCODE_COUNT)) {
+        return fail("unknown opcode '" + peek() + "'");
+      }
+      pos_++;
+      IrInst* inst = func_->append(current_, static_cast<IrOpcode>(op), IrType::IR_VOID);
+      if (!def.empty()) {
+        if (!type(inst->type)) {
+          return false;
+        }
+        if (!values_.emplace(def, inst).second) {
+          return fail("value " + def + " defined twice");
+        }
+      }
+      if (!operands(inst)) {
+        return false;
+      }
+      if (def.empty() != (inst->op == IrOpcode::IR_STORE || inst->isTerminator())) {
+        return fail(std::string(inst->opcodeName()) +
+                    (def.empty() ? " must define a value" : " does not define a value"));
+      }
+      return endOfLine();
+    }
+
+    bool operands(IrInst* inst) {
+      switch (inst->op) {
+      case IrOpcode::IR_CONST:
+      case IrOpcode::IR_PARAM:
+        return number(inst->imm);
+      case IrOpcode::IR_ALLOCA:
+        if (!number(inst->imm)) {
+          return false;
+        }
+        if (!atEnd()) {
+          inst->sym = peek();
+          pos_++;
+        }
+        return true;
+      case IrOpcode::IR_CALL:
+        if (peek().size() < 2 || peek()[0] != '@') {
+          return fail("expected '@<callee>' but got '" + peek() + "'");
+        }
+        inst->sym = peek().substr(1);
+        pos_++;
+        if (!expect("(")) {
+          return false;
+        }
+        while (peek() != ")") {
+          if ((!inst->ops.empty() && !expect(",")) || !value(inst)) {
+            return false;
+          }
+        }
+        return expect(")");
+      case IrOpcode::IR_PHI:
+        do {
+          IrBlock* from = nullptr;
+          if (!expect("[") || !value(inst) || !expect(",") || !block(from) || !expect("]")) {
+            return false;
+          }
+          inst->blocks.push_back(from);
+        } while (!atEnd() && expect(","));
+        return true;
+      case IrOpcode::IR_JMP: {
+        IrBlock* target = nullptr;
+        if (!block(target)) {
+          return false;
+        }
+        inst->blocks.push_back(target);
+        return true;
+      }
+      case IrOpcode::IR_BR: {
+        IrBlock* then_block = nullptr;
+        IrBlock* else_block = nullptr;
+        if (!value(inst) || !expect(",") || !block(then_block) ||
+            !expect(",") || !block(else_block)) {
+          return false;
+        }
+        inst->blocks = {then_block, else_block};
+        return true;
+      }
+      default:
+        break;
+      }
+      // 其余指令的操作数都是值
+      if (!value(inst)) {
+        return false;
+      }
+      while (!atEnd()) {
+        if (!expect(",") || !value(inst)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool finishFunction() {
+      for (auto& use: uses_) {
+        auto iter = values_.find(use.name);
+        if (iter == values_.end()) {
+          line_no_ = use.line_no;
+          return fail("undefined value " + use.name);
+        }
+        use.inst->ops[use.index] = iter->second;
+      }
+      for (auto& entry: blocks_) {
+        if (std::find(order_.begin(), order_.end(), entry.second) == order_.end()) {
+          return fail("undefined block " + entry.first);
+        }
+      }
+      if (order_.empty()) {
+        return fail("func @" + func_->name() + " has no blocks");
+      }
+      func_->blocks() = order_;
+      func_->computeCfg();
+      funcs_.push_back(std::move(func_));
+      blocks_.clear();
+      values_.clear();
+      uses_.clear();
+      order_.clear();
+      current_ = nullptr;
+      return true;
+    }
+
+    struct Use {
+      IrInst* inst;
+      std::size_t index;
+      std::string name;
+      int line_no;
+    };
+
+    const std::string& text_;
+    std::vector<std::unique_ptr<IrFunction>>& funcs_;
+    std::string& error_;
+    int line_no_;
+    std::vector<std::string> tokens_;
+    std::size_t pos_;
+    std::unique_ptr<IrFunction> func_;
+    IrBlock* current_ = nullptr;
+    std::map<std::string, IrBlock*> blocks_;
+    std::vector<IrBlock*> order_;
+    std::unordered_map<std::string, IrInst*> values_;
+    std::vector<Use> uses_;
+};
+
+} // namespace
+
+bool parseIr(const std::string& text, std::vector<std::unique_ptr<IrFunction>>& funcs,
+             std::string& error) {
+  return IrParser(text, funcs, error).parse();
+}
+
+} // namespace rvcc
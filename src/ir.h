@@ -0,0 +1,131 @@
+#ifndef __IR_H
+#define __IR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+/*
+SSA 形式的中间表示 (IR), 位于 AST 和 MIR 之间
+  函数由基本块组成, 第一个块为入口, 每个块以一条终结指令 (br jmp ret) 结束
+  每条产生值的指令就是一个 SSA 值, 只定义一次; 控制流汇合处的值由 phi 选择
+  没有被取地址的标量变量直接是 SSA 值, 数组和被取地址的变量是 alloca 分配的内存对象,
+  通过 load store 显式访问
+  文本格式由 printIr 输出, parseIr 读回, 例如
+    func @max {
+    bb0:
+      %0 = param i64 0
+      %1 = param i64 1
+      %2 = lt i64 %0, %1
+      br %2, bb1, bb2
+    bb1:                      ; preds bb0, idom bb0
+      jmp bb2
+    bb2:                      ; preds bb0 bb1, idom bb0
+      %3 = phi i64 [%0, bb0], [%1, bb1]
+      ret %3
+    }
+  ; 之后为注释
+*/
+enum class IrType:int {
+  IR_VOID = 0,
+  IR_I64,
+  IR_PTR,
+  IR_TYPE_COUNT
+};
+
+enum class IrOpcode:int {
+  IR_CONST = 0,         // imm
+  IR_PARAM,             // 第 imm 个参数, 只在入口块中
+  IR_ALLOCA,            // imm 字节的栈上内存对象的地址, 只在入口块中, sym 为变量名
+  IR_ADD,               // ops[0] + ops[1]
+  IR_SUB,               // ops[0] - ops[1]
+  IR_MUL,               // ops[0] * ops[1]
+  IR_DIV,               // ops[0] / ops[1]
+  IR_EQ,                // ops[0] == ops[1]
+  IR_NE,                // ops[0] != ops[1]
+  IR_LT,                // ops[0] < ops[1]
+  IR_LE,                // ops[0] <= ops[1]
+  IR_NEG,               // -ops[0]
+  IR_LOAD,              // *ops[0]
+  IR_STORE,             // *ops[1] = ops[0]
+  IR_CALL,              // sym(ops...)
+  IR_PHI,               // 从 blocks[i] 进入时为 ops[i]
+  IR_BR,                // ops[0] 不为 0 时跳转到 blocks[0], 否则跳转到 blocks[1]
+  IR_JMP,               // 跳转到 blocks[0]
+  IR_RET,               // 返回 ops[0]
+  IR_OPCODE_COUNT
+};
+
+struct IrBlock;
+
+struct IrInst {
+  IrOpcode op;
+  IrType type;                    // 值的类型, 不产生值时为 IR_VOID
+  int id;                         // 值的编号, 输出为 %id, 由 IrFunction::computeCfg 分配
+  long imm;
+  std::string sym;
+  std::vector<IrInst*> ops;
+  std::vector<IrBlock*> blocks;   // phi 的来源块, br jmp 的目标块
+  IrBlock* block;                 // 所在的基本块, 被删除之后为空
+  IrInst(IrOpcode op, IrType type);
+  const char* opcodeName() const;
+  bool isTerminator() const;
+  // store call 和终结指令, 结果不被使用时也不能删除
+  bool hasSideEffects() const;
+};
+
+struct IrBlock {
+  int id;                         // 输出为 bb<id>, 由 IrFunction::computeCfg 重新编号
+  std::vector<IrInst*> insts;
+  std::vector<IrBlock*> preds;    // 由 IrFunction::computeCfg 计算, 按块的顺序排列
+  explicit IrBlock(int id);
+  IrInst* terminator() const;     // 最后一条指令不是终结指令时为空
+  std::vector<IrBlock*> succs() const;
+};
+
+// 指令和基本块由 IrFunction 所有, 从块中删除之后仍然有效, 直到 IrFunction 析构
+class IrFunction {
+  public:
+    explicit IrFunction(const std::string& name);
+    const std::string& name() const;
+    // 按输出顺序排列, 第一个为入口
+    std::vector<IrBlock*>& blocks();
+    IrBlock* entry() const;
+    // 新建基本块, 追加到末尾
+    IrBlock* newBlock();
+    // 把 block 移动到末尾
+    void moveToEnd(IrBlock* block);
+    // 新建指令, 不在任何基本块中
+    IrInst* newInst(IrOpcode op, IrType type);
+    // 新建指令并追加到 block 末尾
+    IrInst* append(IrBlock* block, IrOpcode op, IrType type,
+                   const std::vector<IrInst*>& ops = {});
+    // 把 inst 从所在的块中删除
+    void erase(IrInst* inst);
+    // 重新编号基本块和值, 计算 preds
+    void computeCfg();
+    // 删除入口不可达的基本块以及 phi 中来自这些块的值, 返回是否有修改
+    // 之后只剩一个来源值的 phi 被替换为该值, 重新计算 CFG
+    bool removeUnreachable();
+    // 把所有指令中对 from 的使用替换为 to
+    void replaceAllUses(IrInst* from, IrInst* to);
+  private:
+    std::string name_;
+    std::vector<IrBlock*> blocks_;
+    std::vector<std::unique_ptr<IrBlock>> block_pool_;
+    std::vector<std::unique_ptr<IrInst>> inst_pool_;
+};
+
+const char* irTypeName(IrType type);
+// 以文本格式追加到 out, 块的注释中给出前驱, 直接支配者和所在的循环
+void printIr(IrFunction& func, std::string& out);
+// 解析 printIr 输出的一个或多个函数, 出错时返回 false 并在 error 中说明行号和原因
+// 只检查语法, 语义由 verifyIrFunction 检查
+bool parseIr(const std::string& text, std::vector<std::unique_ptr<IrFunction>>& funcs,
+             std::string& error);
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,210 @@
+#include "ir_analysis.h"
+#include <algorithm>
+#include <utility>
+
+namespace rvcc {
+
+DominatorTree::DominatorTree(IrFunction& func) {
+  func.computeCfg();
+  std::size_t count = func.blocks().size();
+  rpo_index_.assign(count, -1);
+  idom_.assign(count, nullptr);
+  children_.assign(count, {});
+  pre_.assign(count, -1);
+  post_.assign(count, -1);
+  if (count == 0) {
+    return;
+  }
+  // 后序遍历, 栈中记录下一个要访问的后继
+  std::vector<bool> visited(count, false);
+  std::vector<std::pair<IrBlock*, std::size_t>> stack{{func.entry(), 0}};
+  visited[func.entry()->id] = true;
+  while (!stack.empty()) {
+    IrBlock* block = stack.back().first;
+    std::vector<IrBlock*> succs = block->succs();
+    if (stack.back().second < succs.size()) {
+      IrBlock* succ = succs[stack.back().second++];
+      if (!visited[succ->id]) {
+        visited[succ->id] = true;
+        stack.push_back({succ, 0});
+      }
+      continue;
+    }
+    rpo_.push_back(block);
+    stack.pop_back();
+  }
+  std::reverse(rpo_.begin(), rpo_.end());
+  for (std::size_t i = 0; i < rpo_.size(); i++) {
+    rpo_index_[rpo_[i]->id] = static_cast<int>(i);
+  }
+  auto intersect = [&](IrBlock* a, IrBlock* b) {
+    while (a != b) {
+      while (rpo_index_[a->id] > rpo_index_[b->id]) {
+        a = idom_[a->id];
+      }
+      while (rpo_index_[b->id] > rpo_index_[a->id]) {
+        b = idom_[b->id];
+      }
+    }
+    return a;
+  };
+  // 迭代时入口的直接支配者暂时为自己
+  idom_[func.entry()->id] = func.entry();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (std::size_t i = 1; i < rpo_.size(); i++) {
+      IrBlock* block = rpo_[i];
+      IrBlock* new_idom = nullptr;
+      for (auto pred: block->preds) {
+        if (!idom_[pred->id]) {
+          continue;
+        }
+        new_idom = new_idom ? intersect(pred, new_idom) : pred;
+      }
+      if (idom_[block->id] != new_idom) {
+        idom_[block->id] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  idom_[func.entry()->id] = nullptr;
+  for (std::size_t i = 1; i < rpo_.size(); i++) {
+    children_[idom_[rpo_[i]->id]->id].push_back(rpo_[i]);
+  }
+  int counter = 0;
+  std::vector<std::pair<IrBlock*, std::size_t>> walk{{func.entry(), 0}};
+  pre_[func.entry()->id] = counter++;
+  while (!walk.empty()) {
+    IrBlock* block = walk.back().first;
+    const std::vector<IrBlock*>& kids = children_[block->id];
+    if (walk.back().second < kids.size()) {
+      IrBlock* child = kids[walk.back().second++];
+      pre_[child->id] = counter++;
+      walk.push_back({child, 0});
+      continue;
+    }
+    post_[block->id] = counter++;
+    walk.pop_back();
+  }
+}
+
+IrBlock* DominatorTree::idom(IrBlock* block) const {
+  return idom_[block->id];
+}
+
+const std::vector<IrBlock*>& DominatorTree::children(IrBlock* block) const {
+  return children_[block->id];
+}
+
+bool DominatorTree::reachable(IrBlock* block) const {
+  return rpo_index_[block->id] >= 0;
+}
+
+bool DominatorTree::dominates(IrBlock* a, IrBlock* b) const {
+  if (!reachable(a) || !reachable(b)) {
+    return false;
+  }
+  return pre_[a->id] <= pre_[b->id] && post_[b->id] <= post_[a->id];
+}
+
+bool DominatorTree::dominates(IrInst* def, IrInst* use, std::size_t operand) const {
+  IrBlock* block = use->block;
+  if (use->op == IrOpcode::IR_PHI) {
+    // 在来源块的末尾使用
+    return dominates(def->block, use->blocks[operand]);
+  }
+  if (def->block != block) {
+    return dominates(def->block, block);
+  }
+  for (auto inst: block->insts) {
+    if (inst == use) {
+      return false;
+    }
+    if (inst == def) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const std::vector<IrBlock*>& DominatorTree::rpo() const {
+  return rpo_;
+}
+
+LoopForest::LoopForest(IrFunction& func, const DominatorTree& dom) {
+  std::size_t count = func.blocks().size();
+  innermost_.assign(count, nullptr);
+  std::vector<std::vector<bool>> members;
+  for (auto header: dom.rpo()) {
+    std::vector<IrBlock*> work;
+    for (auto pred: header->preds) {
+      if (dom.dominates(header, pred)) {
+        work.push_back(pred);
+      }
+    }
+    if (work.empty()) {
+      continue;
+    }
+    loops_.emplace_back(new IrLoop{header, {header}, nullptr, {}, 0});
+    members.emplace_back(count, false);
+    IrLoop* loop = loops_.back().get();
+    std::vector<bool>& in_loop = members.back();
+    in_loop[header->id] = true;
+    while (!work.empty()) {
+      IrBlock* block = work.back();
+      work.pop_back();
+      if (in_loop[block->id] || !dom.reachable(block)) {
+        continue;
+      }
+      in_loop[block->id] = true;
+      loop->blocks.push_back(block);
+      work.insert(work.end(), block->preds.begin(), block->preds.end());
+    }
+  }
+  // 自然循环要么嵌套要么不相交, 包含某个块的循环中最小的就是最内层
+  std::vector<std::size_t> order(loops_.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return loops_[a]->blocks.size() < loops_[b]->blocks.size();
+  });
+  for (std::size_t i = 0; i < order.size(); i++) {
+    IrLoop* loop = loops_[order[i]].get();
+    for (std::size_t j = i + 1; j < order.size() && !loop->parent; j++) {
+      if (members[order[j]][loop->header->id]) {
+        loop->parent = loops_[order[j]].get();
+      }
+    }
+    for (auto block: loop->blocks) {
+      if (!innermost_[block->id]) {
+        innermost_[block->id] = loop;
+      }
+    }
+  }
+  // 外层循环先于内层循环出现在 rpo 中, 按构造顺序计算深度
+  for (auto& loop: loops_) {
+    if (loop->parent) {
+      loop->parent->children.push_back(loop.get());
+      loop->depth = loop->parent->depth + 1;
+    } else {
+      roots_.push_back(loop.get());
+      loop->depth = 1;
+    }
+  }
+}
+
+const std::vector<IrLoop*>& LoopForest::roots() const {
+  return roots_;
+}
+
+IrLoop* LoopForest::loopFor(IrBlock* block) const {
+  return innermost_[block->id];
+}
+
+std::size_t LoopForest::size() const {
+  return loops_.size();
+}
+
+} // namespace rvcc
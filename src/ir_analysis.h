@@ -0,0 +1,68 @@
+#ifndef __IR_ANALYSIS_H
+#define __IR_ANALYSIS_H
+
+#include "ir.h"
+#include <memory>
+#include <vector>
+
+namespace rvcc {
+
+/*
+支配树, Cooper-Harvey-Kennedy 迭代算法 ("A Simple, Fast Dominance Algorithm")
+  按逆后序反复求前驱的直接支配者的交集直到不动点, 再按 DFS 序编号支配树,
+  dominates 只需要比较编号
+  构造时调用 func.computeCfg, 之后修改 CFG 需要重新构造
+*/
+class DominatorTree {
+  public:
+    explicit DominatorTree(IrFunction& func);
+    // 入口和不可达的块返回空
+    IrBlock* idom(IrBlock* block) const;
+    const std::vector<IrBlock*>& children(IrBlock* block) const;
+    bool reachable(IrBlock* block) const;
+    // a 支配 b (包括 a == b), 不可达的块不被支配也不支配其他块
+    bool dominates(IrBlock* a, IrBlock* b) const;
+    // def 的值在 use 处可用, use 为 phi 时检查对应来源块的末尾
+    bool dominates(IrInst* def, IrInst* use, std::size_t operand) const;
+    // 可达的块, 按逆后序排列
+    const std::vector<IrBlock*>& rpo() const;
+  private:
+    std::vector<IrBlock*> rpo_;
+    std::vector<int> rpo_index_;    // 按块的 id, 不可达为 -1
+    std::vector<IrBlock*> idom_;
+    std::vector<std::vector<IrBlock*>> children_;
+    std::vector<int> pre_;          // 支配树的 DFS 进入和离开的序号
+    std::vector<int> post_;
+};
+
+// 自然循环, 头节点相同的回边合并为一个循环
+struct IrLoop {
+  IrBlock* header;
+  std::vector<IrBlock*> blocks;     // 包含头节点和内层循环的块
+  IrLoop* parent;                   // 外层循环, 最外层为空
+  std::vector<IrLoop*> children;
+  int depth;                        // 最外层为 1
+};
+
+/*
+循环森林
+  回边 latch -> header 要求 header 支配 latch (不可规约的环不是循环),
+  从 latch 反向遍历到 header 得到循环体, 再按包含关系嵌套
+*/
+class LoopForest {
+  public:
+    LoopForest(IrFunction& func, const DominatorTree& dom);
+    // 最外层循环
+    const std::vector<IrLoop*>& roots() const;
+    // 包含 block 的最内层循环, 不在循环中时为空
+    IrLoop* loopFor(IrBlock* block) const;
+    std::size_t size() const;
+  private:
+    std::vector<std::unique_ptr<IrLoop>> loops_;
+    std::vector<IrLoop*> roots_;
+    std::vector<IrLoop*> innermost_;  // 按块的 id
+};
+
+} // namespace rvcc
+
+#endif
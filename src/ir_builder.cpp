@@ -0,0 +1,416 @@
+#include "ir_builder.h"
+#include "logger.h"
+#include "type.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+const char* SsaPass::name() const {
+  return "ssa";
+}
+
+PassKind SsaPass::kind() const {
+  return PassKind::PASS_LOWERING;
+}
+
+const Pass* ssaPass() {
+  static const SsaPass pass;
+  return &pass;
+}
+
+namespace {
+
+IrType irType(Type* type) {
+  switch (type->kind()) {
+  case TypeKind::TYPE_PTR:
+  case TypeKind::TYPE_ARRAY:
+    return IrType::IR_PTR;
+  default:
+    return IrType::IR_I64;
+  }
+}
+
+IrOpcode binaryOpcode(Expr* node) {
+  switch (node->kind()) {
+  case ExprKind::NODE_ADD:
+    return IrOpcode::IR_ADD;
+  case ExprKind::NODE_SUB:
+    return IrOpcode::IR_SUB;
+  case ExprKind::NODE_MUL:
+    return IrOpcode::IR_MUL;
+  case ExprKind::NODE_DIV:
+    return IrOpcode::IR_DIV;
+  case ExprKind::NODE_EQ:
+    return IrOpcode::IR_EQ;
+  case ExprKind::NODE_NE:
+    return IrOpcode::IR_NE;
+  case ExprKind::NODE_LT:
+    return IrOpcode::IR_LT;
+  case ExprKind::NODE_LE:
+    return IrOpcode::IR_LE;
+  default:
+    FATAL("binary expr cant support current kind: %s", node->kindName());
+  }
+  return IrOpcode::IR_OPCODE_COUNT;
+}
+
+class IrBuilder {
+  public:
+    IrBuilder(Function* func, IrFunction& ir): func_(func), ir_(ir), block_(nullptr) {}
+
+    void build() {
+      block_ = ir_.newBlock();
+      sealed_.insert(block_);
+      // 栈上变量按 vars 的顺序分配, 与 promote 重新排列的偏移一致
+      for (auto& var: func_->vars()) {
+        if (var->promoted()) {
+          continue;
+        }
+        IrInst* alloca = emit(IrOpcode::IR_ALLOCA, IrType::IR_PTR, {});
+        alloca->imm = var->type()->size();
+        alloca->sym = std::string(var->getName(), var->name_len());
+        allocas_[var] = alloca;
+      }
+      for (auto& param: func_->parameters()) {
+        IrInst* value = emit(IrOpcode::IR_PARAM, irType(param->type()), {});
+        value->imm = param->index();
+        if (param->promoted()) {
+          writeVariable(param, block_, value);
+        } else {
+          emit(IrOpcode::IR_STORE, IrType::IR_VOID, {value, allocas_.at(param)});
+        }
+      }
+      for (Expr* curr = func_->body(); curr; curr = curr->getNext()) {
+        stmt(curr);
+      }
+      // 没有 return 时返回 0, return 之后的死代码块保留, 由 dce 删除
+      emit(IrOpcode::IR_RET, IrType::IR_VOID, {constant(0)});
+      ir_.computeCfg();
+    }
+
+  private:
+    IrInst* emit(IrOpcode op, IrType type, const std::vector<IrInst*>& ops) {
+      return ir_.append(block_, op, type, ops);
+    }
+
+    IrInst* constant(long value) {
+      IrInst* inst = emit(IrOpcode::IR_CONST, IrType::IR_I64, {});
+      inst->imm = value;
+      return inst;
+    }
+
+    void jump(IrBlock* target) {
+      emit(IrOpcode::IR_JMP, IrType::IR_VOID, {})->blocks = {target};
+      preds_[target].push_back(block_);
+    }
+
+    void branch(IrInst* cond, IrBlock* then_block, IrBlock* else_block) {
+      emit(IrOpcode::IR_BR, IrType::IR_VOID, {cond})->blocks = {then_block, else_block};
+      preds_[then_block].push_back(block_);
+      preds_[else_block].push_back(block_);
+    }
+
+    // 块在开始生成时移动到末尾, 输出顺序与源码一致 (循环出口在循环体之后)
+    void startBlock(IrBlock* block) {
+      ir_.moveToEnd(block);
+      block_ = block;
+    }
+
+    // return 之后的语句放在一个没有前驱的块中
+    void startDeadBlock() {
+      block_ = ir_.newBlock();
+      sealed_.insert(block_);
+    }
+
+    void stmt(Expr* node) {
+      switch (node->kind()) {
+      case ExprKind::NODE_STMT:
+        if (node->getLeft()) {
+          expr(node->getLeft());
+        }
+        break;
+      case ExprKind::NODE_COMPOUND:
+        for (Expr* curr = node->getStmts(); curr; curr = curr->getNext()) {
+          stmt(curr);
+        }
+        break;
+      case ExprKind::NODE_IF: {
+        IrInst* cond = expr(node->getCond());
+        IrBlock* then_block = ir_.newBlock();
+        IrBlock* else_block = node->getEls() ? ir_.newBlock() : nullptr;
+        IrBlock* end_block = ir_.newBlock();
+        branch(cond, then_block, else_block ? else_block : end_block);
+        seal(then_block);
+        block_ = then_block;
+        stmt(node->getThen());
+        jump(end_block);
+        if (else_block) {
+          seal(else_block);
+          startBlock(else_block);
+          stmt(node->getEls());
+          jump(end_block);
+        }
+        seal(end_block);
+        startBlock(end_block);
+        break;
+      }
+      case ExprKind::NODE_FOR:
+      case ExprKind::NODE_WHILE: {
+        if (node->kind() == ExprKind::NODE_FOR && node->getInit()) {
+          expr(node->getInit());
+        }
+        // 循环头的前驱在回边生成之后才完整
+        IrBlock* header = ir_.newBlock();
+        jump(header);
+        block_ = header;
+        IrBlock* exit_block = nullptr;
+        if (node->getCond()) {
+          IrInst* cond = expr(node->getCond());
+          IrBlock* body = ir_.newBlock();
+          exit_block = ir_.newBlock();
+          branch(cond, body, exit_block);
+          seal(body);
+          block_ = body;
+        } else {
+          exit_block = ir_.newBlock();
+        }
+        if (node->getStmts()) {
+          stmt(node->getStmts());
+        }
+        if (node->kind() == ExprKind::NODE_FOR && node->getInc()) {
+          expr(node->getInc());
+        }
+        jump(header);
+        seal(header);
+        seal(exit_block);
+        startBlock(exit_block);
+        break;
+      }
+      default:
+        expr(node);
+        break;
+      }
+    }
+
+    IrInst* expr(Expr* node) {
+      switch (node->kind()) {
+      case ExprKind::NODE_NUM:
+        return constant(node->value());
+      case ExprKind::NODE_ID: {
+        Var* var = static_cast<IdentityExpr*>(node)->var();
+        if (var->promoted()) {
+          return readVariable(var, block_);
+        }
+        IrInst* addr = allocas_.at(var);
+        if (node->getType()->kind() == TypeKind::TYPE_ARRAY) {
+          return addr;
+        }
+        return emit(IrOpcode::IR_LOAD, irType(node->getType()), {addr});
+      }
+      case ExprKind::NODE_NEG:
+        return emit(IrOpcode::IR_NEG, irType(node->getType()), {expr(node->getLeft())});
+      case ExprKind::NODE_ADDR:
+        return address(node->getLeft());
+      case ExprKind::NODE_DEREF: {
+        IrInst* addr = expr(node->getLeft());
+        if (node->getType()->kind() == TypeKind::TYPE_ARRAY) {
+          return addr;
+        }
+        return emit(IrOpcode::IR_LOAD, irType(node->getType()), {addr});
+      }
+      case ExprKind::NODE_CALL: {
+        std::vector<Expr*>& args = static_cast<CallExpr*>(node)->args();
+        std::vector<IrInst*> values(args.size());
+        for (std::size_t i = args.size(); i-- > 0;) {
+          values[i] = expr(args[i]);
+        }
+        IrInst* call = emit(IrOpcode::IR_CALL, irType(node->getType()), values);
+        call->sym = static_cast<CallExpr*>(node)->getFuncName();
+        return call;
+      }
+      case ExprKind::NODE_RETURN: {
+        IrInst* value = expr(node->getLeft());
+        emit(IrOpcode::IR_RET, IrType::IR_VOID, {value});
+        startDeadBlock();
+        return value;
+      }
+      case ExprKind::NODE_ASSIGN: {
+        Expr* left = node->getLeft();
+        if (left->kind() == ExprKind::NODE_ID &&
+            static_cast<IdentityExpr*>(left)->var()->promoted()) {
+          IrInst* value = expr(node->getRight());
+          writeVariable(static_cast<IdentityExpr*>(left)->var(), block_, value);
+          return value;
+        }
+        // 与 codegen 一致: 变量先求值右边, 解引用先求地址
+        IrInst* addr = left->kind() == ExprKind::NODE_ID ? nullptr : address(left);
+        IrInst* value = expr(node->getRight());
+        if (!addr) {
+          addr = address(left);
+        }
+        emit(IrOpcode::IR_STORE, IrType::IR_VOID, {value, addr});
+        return value;
+      }
+      default: {
+        IrInst* right = expr(node->getRight());
+        IrInst* left = expr(node->getLeft());
+        return emit(binaryOpcode(node), irType(node->getType()), {left, right});
+      }
+      }
+    }
+
+    // 可以取地址的表达式: 栈上的变量或者解引用
+    IrInst* address(Expr* node) {
+      switch (node->kind()) {
+      case ExprKind::NODE_ID: {
+        Var* var = static_cast<IdentityExpr*>(node)->var();
+        CHECK(!var->promoted());
+        return allocas_.at(var);
+      }
+      case ExprKind::NODE_DEREF:
+        return expr(node->getLeft());
+      default:
+        FATAL("node kind:  %s not support get addr", node->kindName());
+      }
+      return nullptr;
+    }
+
+    void writeVariable(Var* var, IrBlock* block, IrInst* value) {
+      defs_[block][var] = value;
+    }
+
+    IrInst* readVariable(Var* var, IrBlock* block) {
+      auto& defs = defs_[block];
+      auto iter = defs.find(var);
+      if (iter != defs.end()) {
+        return iter->second;
+      }
+      return readVariableRecursive(var, block);
+    }
+
+    IrInst* readVariableRecursive(Var* var, IrBlock* block) {
+      IrInst* value = nullptr;
+      std::vector<IrBlock*>& preds = preds_[block];
+      if (!sealed_.count(block)) {
+        value = newPhi(var, block);
+        incomplete_[block].emplace_back(var, value);
+      } else if (preds.empty()) {
+        value = undefined(irType(var->type()));
+      } else if (preds.size() == 1) {
+        value = readVariable(var, preds[0]);
+      } else {
+        // 先记录 phi 打破循环中的递归
+        value = newPhi(var, block);
+        writeVariable(var, block, value);
+        value = addPhiOperands(var, value);
+      }
+      writeVariable(var, block, value);
+      return value;
+    }
+
+    IrInst* newPhi(Var* var, IrBlock* block) {
+      IrInst* phi = ir_.newInst(IrOpcode::IR_PHI, irType(var->type()));
+      phi->block = block;
+      block->insts.insert(block->insts.begin(), phi);
+      return phi;
+    }
+
+    // 未初始化的变量读作 0
+    IrInst* undefined(IrType type) {
+      IrInst* inst = ir_.newInst(IrOpcode::IR_CONST, type);
+      IrBlock* entry = ir_.entry();
+      inst->block = entry;
+      entry->insts.insert(entry->insts.begin(), inst);
+      return inst;
+    }
+
+    IrInst* addPhiOperands(Var* var, IrInst* phi) {
+      filling_.insert(phi);
+      for (auto pred: preds_[phi->block]) {
+        IrInst* value = readVariable(var, pred);
+        phi->ops.push_back(value);
+        phi->blocks.push_back(pred);
+      }
+      filling_.erase(phi);
+      return tryRemoveTrivialPhi(phi);
+    }
+
+    // 只引用自己和另一个值的 phi 替换为那个值, 然后检查使用它的 phi
+    IrInst* tryRemoveTrivialPhi(IrInst* phi) {
+      IrInst* same = nullptr;
+      for (auto op: phi->ops) {
+        if (op == same || op == phi) {
+          continue;
+        }
+        if (same) {
+          return phi;
+        }
+        same = op;
+      }
+      if (!same) {
+        same = undefined(phi->type);
+      }
+      std::vector<IrInst*> users;
+      for (auto block: ir_.blocks()) {
+        for (auto inst: block->insts) {
+          if (inst != phi && inst->op == IrOpcode::IR_PHI &&
+              std::find(inst->ops.begin(), inst->ops.end(), phi) != inst->ops.end()) {
+            users.push_back(inst);
+          }
+        }
+      }
+      ir_.replaceAllUses(phi, same);
+      for (auto& defs: defs_) {
+        for (auto& def: defs.second) {
+          if (def.second == phi) {
+            def.second = same;
+          }
+        }
+      }
+      ir_.erase(phi);
+      replaced_[phi] = same;
+      for (auto user: users) {
+        if (user->block && !filling_.count(user)) {
+          tryRemoveTrivialPhi(user);
+        }
+      }
+      // same 本身可能在递归中被删除
+      while (replaced_.count(same)) {
+        same = replaced_[same];
+      }
+      return same;
+    }
+
+    void seal(IrBlock* block) {
+      for (auto& entry: incomplete_[block]) {
+        addPhiOperands(entry.first, entry.second);
+      }
+      incomplete_.erase(block);
+      sealed_.insert(block);
+    }
+
+    Function* func_;
+    IrFunction& ir_;
+    IrBlock* block_;
+    std::unordered_map<Var*, IrInst*> allocas_;
+    // 构造过程中的前驱, 按边加入的顺序
+    std::unordered_map<IrBlock*, std::vector<IrBlock*>> preds_;
+    // 每个块结束时变量的值
+    std::unordered_map<IrBlock*, std::unordered_map<Var*, IrInst*>> defs_;
+    std::unordered_set<IrBlock*> sealed_;
+    std::unordered_map<IrBlock*, std::vector<std::pair<Var*, IrInst*>>> incomplete_;
+    std::unordered_set<IrInst*> filling_;
+    std::unordered_map<IrInst*, IrInst*> replaced_;
+};
+
+} // namespace
+
+void buildIr(Function* func, IrFunction& ir) {
+  IrBuilder(func, ir).build();
+}
+
+} // namespace rvcc
@@ -0,0 +1,33 @@
+#ifndef __IR_BUILDER_H
+#define __IR_BUILDER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+从 AST 构造 SSA IR, 再由 IR lowering 到机器指令, 代替 Expr::codegen
+  提升到寄存器的变量 (见 promote) 直接构造为 SSA 值, 其余变量为入口块中的 alloca
+  需要虚拟寄存器, 只在 regalloc 开启时生效
+*/
+class SsaPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+};
+
+const Pass* ssaPass();
+
+/*
+按 Braun 等 "Simple and Efficient Construction of Static Single Assignment Form"
+在遍历 AST 时直接构造 SSA: 每个块记录变量的当前值, 读取时沿前驱查找,
+前驱还不完整的块 (循环头) 先放置不完整的 phi, 块封闭时补全, 平凡的 phi 被删除
+  求值顺序与 Expr::codegen 一致: 二元运算先右后左, 调用参数从右往左
+*/
+void buildIr(Function* func, IrFunction& ir);
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,464 @@
+#include "ir_lower.h"
+#include "callargs.h"
+#include "context.h"
+#include "instructions.h"
+#include "isel.h"
+#include "logger.h"
+#include "strength.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+bool fitsImm12(long value) {
+  return value >= -2048 && value < 2048;
+}
+
+bool isConst(const IrInst* value) {
+  return value->op == IrOpcode::IR_CONST;
+}
+
+bool isCompare(const IrInst* inst) {
+  switch (inst->op) {
+  case IrOpcode::IR_EQ:
+  case IrOpcode::IR_NE:
+  case IrOpcode::IR_LT:
+  case IrOpcode::IR_LE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+class IrLowering {
+  public:
+    IrLowering(IrFunction& ir, MFunction& func): ir_(ir), func_(func) {
+      PassManager& passes = CompilerContext::current().passes();
+      imm_ = passes.lowering(instructionSelectPass());
+      fuse_ = passes.lowering(fuseBranchPass());
+      strength_ = passes.lowering(strengthReducePass());
+      reg_args_ = passes.lowering(callArgsPass());
+    }
+
+    void run() {
+      CHECK(func_.virtual_regs);
+      splitCriticalEdges();
+      assignFrame();
+      analyzeUses();
+      for (auto block: ir_.blocks()) {
+        for (auto inst: block->insts) {
+          if (inst->type != IrType::IR_VOID && !isConst(inst) &&
+              inst->op != IrOpcode::IR_ALLOCA && !fused_.count(inst)) {
+            regs_[inst] = func_.newVirtualReg();
+          }
+        }
+      }
+      std::vector<IrBlock*>& blocks = ir_.blocks();
+      for (std::size_t i = 0; i < blocks.size(); i++) {
+        lowerBlock(blocks[i], i + 1 < blocks.size() ? blocks[i + 1] : nullptr);
+      }
+    }
+
+  private:
+    // 条件跳转到有 phi 的块时, 在边上插入一个只有 jmp 的块, 用于放置 phi 的复制
+    void splitCriticalEdges() {
+      std::vector<IrBlock*> order;
+      std::vector<IrBlock*> blocks(ir_.blocks());
+      for (auto block: blocks) {
+        order.push_back(block);
+        IrInst* term = block->terminator();
+        if (!term || term->op != IrOpcode::IR_BR) {
+          continue;
+        }
+        for (auto& target: term->blocks) {
+          if (target->insts.empty() || target->insts.front()->op != IrOpcode::IR_PHI) {
+            continue;
+          }
+          IrBlock* edge = ir_.newBlock();
+          ir_.append(edge, IrOpcode::IR_JMP, IrType::IR_VOID)->blocks = {target};
+          for (auto phi: target->insts) {
+            if (phi->op != IrOpcode::IR_PHI) {
+              break;
+            }
+            *std::find(phi->blocks.begin(), phi->blocks.end(), block) = edge;
+          }
+          target = edge;
+          order.push_back(edge);
+        }
+      }
+      ir_.blocks() = order;
+      ir_.computeCfg();
+    }
+
+    // 与 codegen 相同, 按顺序排列, 总大小按 16 字节对齐
+    void assignFrame() {
+      long offset = 0;
+      for (auto inst: ir_.entry()->insts) {
+        if (inst->op == IrOpcode::IR_ALLOCA) {
+          offset += inst->imm;
+          slots_[inst] = -offset;
+        }
+      }
+      func_.stack_size = (offset + 16 - 1) / 16 * 16;
+    }
+
+    // 只被同一个块的 br 使用的比较直接生成条件跳转,
+    // 只被 load/store 使用的 地址 + 常量 合并到访存指令的偏移中
+    void analyzeUses() {
+      std::unordered_map<IrInst*, int> uses;
+      for (auto block: ir_.blocks()) {
+        for (auto inst: block->insts) {
+          for (auto op: inst->ops) {
+            uses[op]++;
+          }
+        }
+      }
+      for (auto block: ir_.blocks()) {
+        for (auto inst: block->insts) {
+          if (inst->op == IrOpcode::IR_BR && fuse_) {
+            IrInst* cond = inst->ops[0];
+            if (isCompare(cond) && cond->block == block && uses[cond] == 1) {
+              fused_.insert(cond);
+            }
+          }
+          if ((inst->op == IrOpcode::IR_LOAD || inst->op == IrOpcode::IR_STORE) && imm_) {
+            IrInst* addr = inst->ops.back();
+            if (addr->op == IrOpcode::IR_ADD && uses[addr] == 1 &&
+                isConst(addr->ops[1]) && !isConst(addr->ops[0])) {
+              long offset = addr->ops[1]->imm;
+              if (addr->ops[0]->op == IrOpcode::IR_ALLOCA) {
+                offset += slots_.at(addr->ops[0]);
+              }
+              if (fitsImm12(offset)) {
+                fused_.insert(addr);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // 值所在的寄存器, 常量和 alloca 的地址生成到新的虚拟寄存器中
+    int use(IrInst* value) {
+      if (isConst(value) || value->op == IrOpcode::IR_ALLOCA) {
+        int reg = func_.newVirtualReg();
+        materialize(reg, value);
+        return reg;
+      }
+      return regs_.at(value);
+    }
+
+    void materialize(int reg, IrInst* value) {
+      if (isConst(value)) {
+        li_(reg, value->imm);
+      } else if (value->op == IrOpcode::IR_ALLOCA) {
+        addi_(reg, REG_FP, slots_.at(value));
+      } else {
+        mv_(reg, regs_.at(value));
+      }
+    }
+
+    // 访存的基址寄存器, 偏移写入 offset
+    int address(IrInst* addr, long& offset) {
+      offset = 0;
+      if (fused_.count(addr)) {
+        offset = addr->ops[1]->imm;
+        addr = addr->ops[0];
+      }
+      if (addr->op == IrOpcode::IR_ALLOCA) {
+        offset += slots_.at(addr);
+        return REG_FP;
+      }
+      return use(addr);
+    }
+
+    void lowerBlock(IrBlock* block, IrBlock* next) {
+      const char* name = func_.name.c_str();
+      if (block != ir_.entry()) {
+        block_label_(name, block->id);
+      } else {
+        // 参数寄存器可能被其他指令覆盖, 最先读取
+        for (auto inst: block->insts) {
+          if (inst->op == IrOpcode::IR_PARAM) {
+            mv_(regs_.at(inst), REG_ARG0 + static_cast<int>(inst->imm));
+          }
+        }
+      }
+      for (auto inst: block->insts) {
+        if (!inst->isTerminator()) {
+          lowerInst(inst);
+        }
+      }
+      IrInst* term = block->terminator();
+      switch (term->op) {
+      case IrOpcode::IR_RET:
+        materialize(REG_ACC, term->ops[0]);
+        goto_return_label_(name);
+        break;
+      case IrOpcode::IR_JMP:
+        copyPhis(block, term->blocks[0]);
+        if (term->blocks[0] != next) {
+          goto_block_label_(MOpcode::MOP_J, REG_NONE, REG_NONE, name, term->blocks[0]->id);
+        }
+        break;
+      case IrOpcode::IR_BR:
+        if (term->blocks[1] == next) {
+          branch(term->ops[0], true, term->blocks[0]);
+        } else if (term->blocks[0] == next) {
+          branch(term->ops[0], false, term->blocks[1]);
+        } else {
+          branch(term->ops[0], true, term->blocks[0]);
+          goto_block_label_(MOpcode::MOP_J, REG_NONE, REG_NONE, name, term->blocks[1]->id);
+        }
+        break;
+      default:
+        FATAL("ir opcode %s is not a terminator", term->opcodeName());
+      }
+    }
+
+    // cond 的值为 when 时跳转到 target
+    void branch(IrInst* cond, bool when, IrBlock* target) {
+      const char* name = func_.name.c_str();
+      if (!fused_.count(cond)) {
+        int reg = use(cond);
+        goto_block_label_(when ? MOpcode::MOP_BNEZ : MOpcode::MOP_BEQZ, reg, REG_NONE,
+                          name, target->id);
+        return;
+      }
+      IrInst* lhs = cond->ops[0];
+      IrInst* rhs = cond->ops[1];
+      MOpcode op = MOpcode::MOP_COUNT;
+      switch (cond->op) {
+      case IrOpcode::IR_EQ:
+      case IrOpcode::IR_NE: {
+        bool equal = (cond->op == IrOpcode::IR_EQ) == when;
+        if (isConst(lhs) && lhs->imm == 0) {
+          std::swap(lhs, rhs);
+        }
+        if (isConst(rhs) && rhs->imm == 0) {
+          goto_block_label_(equal ? MOpcode::MOP_BEQZ : MOpcode::MOP_BNEZ, use(lhs),
+                            REG_NONE, name, target->id);
+          return;
+        }
+        op = equal ? MOpcode::MOP_BEQ : MOpcode::MOP_BNE;
+        break;
+      }
+      case IrOpcode::IR_LT:
+        op = when ? MOpcode::MOP_BLT : MOpcode::MOP_BGE;
+        break;
+      case IrOpcode::IR_LE:
+        // a <= b 即 !(b < a)
+        std::swap(lhs, rhs);
+        op = when ? MOpcode::MOP_BGE : MOpcode::MOP_BLT;
+        break;
+      default:
+        FATAL("ir opcode %s is not a comparison", cond->opcodeName());
+      }
+      int reg1 = use(lhs);
+      int reg2 = use(rhs);
+      goto_block_label_(op, reg1, reg2, name, target->id);
+    }
+
+    // 并行复制 from 进入 to 时 phi 的值, 目标也是源时先复制到临时寄存器
+    void copyPhis(IrBlock* from, IrBlock* to) {
+      std::vector<std::pair<int, IrInst*>> copies;
+      std::unordered_set<int> sources;
+      for (auto phi: to->insts) {
+        if (phi->op != IrOpcode::IR_PHI) {
+          break;
+        }
+        std::size_t i = std::find(phi->blocks.begin(), phi->blocks.end(), from) -
+                        phi->blocks.begin();
+        CHECK(i < phi->ops.size());
+        IrInst* value = phi->ops[i];
+        copies.emplace_back(regs_.at(phi), value);
+        if (regs_.count(value)) {
+          sources.insert(regs_.at(value));
+        }
+      }
+      bool overlap = false;
+      for (auto& copy: copies) {
+        overlap = overlap || (sources.count(copy.first) &&
+                              !(regs_.count(copy.second) && regs_.at(copy.second) == copy.first));
+      }
+      if (!overlap) {
+        for (auto& copy: copies) {
+          if (!regs_.count(copy.second) || regs_.at(copy.second) != copy.first) {
+            materialize(copy.first, copy.second);
+          }
+        }
+        return;
+      }
+      std::vector<int> temps;
+      for (auto& copy: copies) {
+        temps.push_back(func_.newVirtualReg());
+        materialize(temps.back(), copy.second);
+      }
+      for (std::size_t i = 0; i < copies.size(); i++) {
+        mv_(copies[i].first, temps[i]);
+      }
+    }
+
+    void lowerInst(IrInst* inst) {
+      if (fused_.count(inst)) {
+        return;
+      }
+      IrInst* lhs = inst->ops.size() > 0 ? inst->ops[0] : nullptr;
+      IrInst* rhs = inst->ops.size() > 1 ? inst->ops[1] : nullptr;
+      switch (inst->op) {
+      case IrOpcode::IR_CONST:
+      case IrOpcode::IR_PARAM:
+      case IrOpcode::IR_ALLOCA:
+      case IrOpcode::IR_PHI:
+        break;
+      case IrOpcode::IR_ADD:
+        if (imm_ && isConst(lhs) && !isConst(rhs)) {
+          std::swap(lhs, rhs);
+        }
+        if (imm_ && isConst(rhs) && fitsImm12(rhs->imm)) {
+          addi_(regs_.at(inst), use(lhs), rhs->imm);
+        } else {
+          int reg1 = use(lhs);
+          add_(regs_.at(inst), reg1, use(rhs));
+        }
+        break;
+      case IrOpcode::IR_SUB:
+        if (imm_ && isConst(rhs) && fitsImm12(-rhs->imm)) {
+          addi_(regs_.at(inst), use(lhs), -rhs->imm);
+        } else {
+          int reg1 = use(lhs);
+          sub_(regs_.at(inst), reg1, use(rhs));
+        }
+        break;
+      case IrOpcode::IR_MUL:
+      case IrOpcode::IR_DIV:
+        if (inst->op == IrOpcode::IR_MUL && isConst(lhs) && !isConst(rhs)) {
+          std::swap(lhs, rhs);
+        }
+        if (strength_ && isConst(rhs) && !isConst(lhs)) {
+          mv_(REG_ACC, use(lhs));
+          genMulDivByConst(inst->op == IrOpcode::IR_MUL ? ExprKind::NODE_MUL : ExprKind::NODE_DIV,
+                           rhs->imm);
+          mv_(regs_.at(inst), REG_ACC);
+        } else {
+          int reg1 = use(lhs);
+          int reg2 = use(rhs);
+          if (inst->op == IrOpcode::IR_MUL) {
+            mul_(regs_.at(inst), reg1, reg2);
+          } else {
+            div_(regs_.at(inst), reg1, reg2);
+          }
+        }
+        break;
+      case IrOpcode::IR_EQ:
+      case IrOpcode::IR_NE:
+      case IrOpcode::IR_LT:
+      case IrOpcode::IR_LE:
+        lowerCompare(inst, lhs, rhs);
+        break;
+      case IrOpcode::IR_NEG:
+        neg_(regs_.at(inst), use(lhs));
+        break;
+      case IrOpcode::IR_LOAD: {
+        long offset = 0;
+        int base = address(lhs, offset);
+        ld_(regs_.at(inst), base, offset);
+        break;
+      }
+      case IrOpcode::IR_STORE: {
+        int value = use(lhs);
+        long offset = 0;
+        int base = address(rhs, offset);
+        sd_(value, base, offset);
+        break;
+      }
+      case IrOpcode::IR_CALL:
+        for (std::size_t i = 0; i < inst->ops.size(); i++) {
+          int reg = REG_ARG0 + static_cast<int>(i);
+          if (reg_args_) {
+            materialize(reg, inst->ops[i]);
+          } else {
+            mv_(reg, use(inst->ops[i]));
+          }
+        }
+        call_(inst->sym.c_str());
+        mv_(regs_.at(inst), REG_ACC);
+        break;
+      default:
+        FATAL("ir opcode %s can not be lowered", inst->opcodeName());
+      }
+    }
+
+    void lowerCompare(IrInst* inst, IrInst* lhs, IrInst* rhs) {
+      int rd = regs_.at(inst);
+      switch (inst->op) {
+      case IrOpcode::IR_EQ:
+      case IrOpcode::IR_NE: {
+        if (isConst(lhs) && !isConst(rhs)) {
+          std::swap(lhs, rhs);
+        }
+        int reg = 0;
+        if (isConst(rhs) && rhs->imm == 0) {
+          reg = use(lhs);
+        } else if (imm_ && isConst(rhs) && fitsImm12(rhs->imm)) {
+          reg = func_.newVirtualReg();
+          xori_(reg, use(lhs), rhs->imm);
+        } else {
+          reg = func_.newVirtualReg();
+          int reg1 = use(lhs);
+          xor_(reg, reg1, use(rhs));
+        }
+        if (inst->op == IrOpcode::IR_EQ) {
+          seqz_(rd, reg);
+        } else {
+          snez_(rd, reg);
+        }
+        break;
+      }
+      case IrOpcode::IR_LT:
+        if (imm_ && isConst(rhs) && fitsImm12(rhs->imm)) {
+          slti_(rd, use(lhs), rhs->imm);
+        } else {
+          int reg1 = use(lhs);
+          slt_(rd, reg1, use(rhs));
+        }
+        break;
+      case IrOpcode::IR_LE:
+        if (imm_ && isConst(rhs) && fitsImm12(rhs->imm + 1)) {
+          slti_(rd, use(lhs), rhs->imm + 1);
+        } else {
+          // a <= b 即 !(b < a)
+          int reg = func_.newVirtualReg();
+          int reg1 = use(rhs);
+          slt_(reg, reg1, use(lhs));
+          xori_(rd, reg, 1);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+
+    IrFunction& ir_;
+    MFunction& func_;
+    bool imm_;
+    bool fuse_;
+    bool strength_;
+    bool reg_args_;
+    std::unordered_map<IrInst*, int> regs_;
+    std::unordered_map<IrInst*, long> slots_;
+    std::unordered_set<IrInst*> fused_;
+};
+
+} // namespace
+
+void lowerIr(IrFunction& ir, MFunction& func) {
+  IrLowering(ir, func).run();
+}
+
+} // namespace rvcc
@@ -0,0 +1,21 @@
+#ifndef __IR_LOWER_H
+#define __IR_LOWER_H
+
+#include "ir.h"
+#include "mir.h"
+
+namespace rvcc {
+
+/*
+把 SSA IR lowering 为机器指令, 追加到 func (CompilerContext::mfunction) 中, 不包括 return 段
+  每个 SSA 值一个虚拟寄存器, 常量和 alloca 的地址在使用处重新生成
+  alloca 按顺序分配栈上的偏移, load/store alloca (+ 常量) 直接使用 fp 寻址
+  phi 在前驱的末尾复制, 之前先拆分关键边; 按 isel fuse-branch strength-reduce
+  是否启用选择立即数形式, 比较直接跳转和乘除常量的指令序列
+  需要虚拟寄存器 (func.virtual_regs), 会修改 ir 的 CFG
+*/
+void lowerIr(IrFunction& ir, MFunction& func);
+
+} // namespace rvcc
+
+#endif
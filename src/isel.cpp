@@ -0,0 +1,416 @@
+#include "isel.h"
+#include "codegen.h"
+#include "context.h"
+#include "instructions.h"
+#include "logger.h"
+#include "mir.h"
+#include "strength.h"
+#include "type.h"
+#include "utils.h"
+#include <climits>
+#include <unordered_map>
+
+namespace rvcc {
+
+namespace {
+
+enum class NonTerm:int {
+  NT_REG = 0,           // 值在 REG_ACC 中
+  NT_ADDR,              // 地址为 REG_ACC + 常量偏移
+  NT_IMM,               // 常量 c, c 可以作为 12 位立即数
+  NT_IMM_INC,           // 常量 c, c + 1 可以作为 12 位立即数
+  NT_IMM_NEG,           // 常量 c, -c 可以作为 12 位立即数
+  NT_ZERO,              // 常量 0
+  NT_BRANCH,            // 条件不成立时跳转, 见 selectBranch
+  NT_NONE,              // 没有这个操作数
+  NT_COUNT
+};
+
+const long kInfinite = LONG_MAX / 4;
+
+/*
+规则 result <- kind(left, right), kind 为 NODE_ILLEGAL 时为链规则 result <- left
+  两个操作数都是 NT_REG 时先计算右操作数并保存, 再计算左操作数, 右操作数取回到 REG_TMP
+  emit 的参数为操作数归约的结果: 常量的值, 地址的偏移, 寄存器为 0
+  没有 emit 的规则不生成指令, 归约的结果为操作数之和 (地址的偏移)
+*/
+struct Rule {
+  const char* name;
+  NonTerm result;
+  ExprKind kind;
+  NonTerm left;
+  NonTerm right;
+  int cost;
+  const Pass* pass;     // 启用该规则的 PASS_LOWERING, 为空时总是使用
+  void (*emit)(Expr* node, long left, long right);
+};
+
+// 当前 selectBranch 输出跳转指令的回调
+thread_local const BranchEmitter* current_branch = nullptr;
+
+void emitAdd(Expr*, long, long) {
+  add_(REG_ACC, REG_ACC, REG_TMP);
+}
+
+void emitAddImm(Expr*, long, long right) {
+  addi_(REG_ACC, REG_ACC, right);
+}
+
+void emitSub(Expr*, long, long) {
+  sub_(REG_ACC, REG_ACC, REG_TMP);
+}
+
+void emitSubImm(Expr*, long, long right) {
+  addi_(REG_ACC, REG_ACC, -right);
+}
+
+void emitMul(Expr*, long, long) {
+  mul_(REG_ACC, REG_ACC, REG_TMP);
+}
+
+void emitDiv(Expr*, long, long) {
+  div_(REG_ACC, REG_ACC, REG_TMP);
+}
+
+void emitEq(Expr*, long, long) {
+  xor_(REG_ACC, REG_ACC, REG_TMP);
+  seqz_(REG_ACC, REG_ACC);
+}
+
+void emitEqZero(Expr*, long, long) {
+  seqz_(REG_ACC, REG_ACC);
+}
+
+void emitEqImm(Expr*, long, long right) {
+  xori_(REG_ACC, REG_ACC, right);
+  seqz_(REG_ACC, REG_ACC);
+}
+
+void emitNe(Expr*, long, long) {
+  xor_(REG_ACC, REG_ACC, REG_TMP);
+  snez_(REG_ACC, REG_ACC);
+}
+
+void emitNeZero(Expr*, long, long) {
+  snez_(REG_ACC, REG_ACC);
+}
+
+void emitNeImm(Expr*, long, long right) {
+  xori_(REG_ACC, REG_ACC, right);
+  snez_(REG_ACC, REG_ACC);
+}
+
+void emitLt(Expr*, long, long) {
+  slt_(REG_ACC, REG_ACC, REG_TMP);
+}
+
+void emitLtImm(Expr*, long, long right) {
+  slti_(REG_ACC, REG_ACC, right);
+}
+
+// c < x 即 !(x < c + 1)
+void emitGtImm(Expr*, long left, long) {
+  slti_(REG_ACC, REG_ACC, left + 1);
+  xori_(REG_ACC, REG_ACC, 1);
+}
+
+void emitLe(Expr*, long, long) {
+  slt_(REG_ACC, REG_TMP, REG_ACC);
+  xori_(REG_ACC, REG_ACC, 1);
+}
+
+// x <= c 即 x < c + 1
+void emitLeImm(Expr*, long, long right) {
+  slti_(REG_ACC, REG_ACC, right + 1);
+}
+
+// c <= x 即 !(x < c)
+void emitGeImm(Expr*, long left, long) {
+  slti_(REG_ACC, REG_ACC, left);
+  xori_(REG_ACC, REG_ACC, 1);
+}
+
+// 数组类型的解引用只计算地址
+void emitLoad(Expr* node, long offset, long) {
+  if (node->getType()->kind() == TypeKind::TYPE_ARRAY) {
+    if (offset != 0) {
+      addi_(REG_ACC, REG_ACC, offset);
+    }
+    return;
+  }
+  ld_(REG_ACC, REG_ACC, offset);
+}
+
+void emitBranchZero(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BEQZ, REG_ACC, REG_NONE);
+}
+
+// 条件跳转到不成立的分支, 因此比较取反: !(a < b) 即 a >= b
+void emitBranchLt(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BGE, REG_ACC, REG_TMP);
+}
+
+// !(a <= b) 即 b < a
+void emitBranchLe(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BLT, REG_TMP, REG_ACC);
+}
+
+void emitBranchEq(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BNE, REG_ACC, REG_TMP);
+}
+
+void emitBranchEqZero(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BNEZ, REG_ACC, REG_NONE);
+}
+
+void emitBranchEqImm(Expr*, long, long right) {
+  xori_(REG_ACC, REG_ACC, right);
+  (*current_branch)(MOpcode::MOP_BNEZ, REG_ACC, REG_NONE);
+}
+
+void emitBranchNe(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BEQ, REG_ACC, REG_TMP);
+}
+
+void emitBranchNeZero(Expr*, long, long) {
+  (*current_branch)(MOpcode::MOP_BEQZ, REG_ACC, REG_NONE);
+}
+
+void emitBranchNeImm(Expr*, long, long right) {
+  xori_(REG_ACC, REG_ACC, right);
+  (*current_branch)(MOpcode::MOP_BEQZ, REG_ACC, REG_NONE);
+}
+
+using K = ExprKind;
+using N = NonTerm;
+
+// 寄存器-寄存器规则的代价包含保存和取回右操作数的两条指令
+const Pass* const kIsel = instructionSelectPass();
+const Pass* const kFuse = fuseBranchPass();
+const Rule kRules[] = {
+  {"add",     N::NT_REG,    K::NODE_ADD,     N::NT_REG,     N::NT_REG,     3,  nullptr, emitAdd},
+  {"addi",    N::NT_REG,    K::NODE_ADD,     N::NT_REG,     N::NT_IMM,     1,  kIsel,   emitAddImm},
+  {"sub",     N::NT_REG,    K::NODE_SUB,     N::NT_REG,     N::NT_REG,     3,  nullptr, emitSub},
+  {"subi",    N::NT_REG,    K::NODE_SUB,     N::NT_REG,     N::NT_IMM_NEG, 1,  kIsel,   emitSubImm},
+  {"mul",     N::NT_REG,    K::NODE_MUL,     N::NT_REG,     N::NT_REG,     5,  nullptr, emitMul},
+  {"div",     N::NT_REG,    K::NODE_DIV,     N::NT_REG,     N::NT_REG,     36, nullptr, emitDiv},
+  {"eq",      N::NT_REG,    K::NODE_EQ,      N::NT_REG,     N::NT_REG,     4,  nullptr, emitEq},
+  {"eqz",     N::NT_REG,    K::NODE_EQ,      N::NT_REG,     N::NT_ZERO,    1,  kIsel,   emitEqZero},
+  {"eqi",     N::NT_REG,    K::NODE_EQ,      N::NT_REG,     N::NT_IMM,     2,  kIsel,   emitEqImm},
+  {"ne",      N::NT_REG,    K::NODE_NE,      N::NT_REG,     N::NT_REG,     4,  nullptr, emitNe},
+  {"nez",     N::NT_REG,    K::NODE_NE,      N::NT_REG,     N::NT_ZERO,    1,  kIsel,   emitNeZero},
+  {"nei",     N::NT_REG,    K::NODE_NE,      N::NT_REG,     N::NT_IMM,     2,  kIsel,   emitNeImm},
+  {"lt",      N::NT_REG,    K::NODE_LT,      N::NT_REG,     N::NT_REG,     3,  nullptr, emitLt},
+  {"lti",     N::NT_REG,    K::NODE_LT,      N::NT_REG,     N::NT_IMM,     1,  kIsel,   emitLtImm},
+  {"gti",     N::NT_REG,    K::NODE_LT,      N::NT_IMM_INC, N::NT_REG,     2,  kIsel,   emitGtImm},
+  {"le",      N::NT_REG,    K::NODE_LE,      N::NT_REG,     N::NT_REG,     4,  nullptr, emitLe},
+  {"lei",     N::NT_REG,    K::NODE_LE,      N::NT_REG,     N::NT_IMM_INC, 1,  kIsel,   emitLeImm},
+  {"gei",     N::NT_REG,    K::NODE_LE,      N::NT_IMM,     N::NT_REG,     2,  kIsel,   emitGeImm},
+  {"load",    N::NT_REG,    K::NODE_DEREF,   N::NT_ADDR,    N::NT_NONE,    1,  nullptr, emitLoad},
+  {"offset",  N::NT_ADDR,   K::NODE_ADD,     N::NT_REG,     N::NT_IMM,     0,  kIsel,   nullptr},
+  {"base",    N::NT_ADDR,   K::NODE_ILLEGAL, N::NT_REG,     N::NT_NONE,    0,  nullptr, nullptr},
+  {"bge",     N::NT_BRANCH, K::NODE_LT,      N::NT_REG,     N::NT_REG,     3,  kFuse,   emitBranchLt},
+  {"blt",     N::NT_BRANCH, K::NODE_LE,      N::NT_REG,     N::NT_REG,     3,  kFuse,   emitBranchLe},
+  {"bne",     N::NT_BRANCH, K::NODE_EQ,      N::NT_REG,     N::NT_REG,     3,  kFuse,   emitBranchEq},
+  {"bnez",    N::NT_BRANCH, K::NODE_EQ,      N::NT_REG,     N::NT_ZERO,    1,  kFuse,   emitBranchEqZero},
+  {"bnei",    N::NT_BRANCH, K::NODE_EQ,      N::NT_REG,     N::NT_IMM,     2,  kFuse,   emitBranchEqImm},
+  {"beq",     N::NT_BRANCH, K::NODE_NE,      N::NT_REG,     N::NT_REG,     3,  kFuse,   emitBranchNe},
+  {"beqz",    N::NT_BRANCH, K::NODE_NE,      N::NT_REG,     N::NT_ZERO,    1,  kFuse,   emitBranchNeZero},
+  {"beqi",    N::NT_BRANCH, K::NODE_NE,      N::NT_REG,     N::NT_IMM,     2,  kFuse,   emitBranchNeImm},
+  {"test",    N::NT_BRANCH, K::NODE_ILLEGAL, N::NT_REG,     N::NT_NONE,    1,  nullptr, emitBranchZero},
+};
+
+const std::size_t kRuleCount = sizeof(kRules) / sizeof(kRules[0]);
+
+bool fitsImm12(long value) {
+  return value >= -2048 && value < 2048;
+}
+
+bool inTable(ExprKind kind) {
+  for (auto& rule: kRules) {
+    if (rule.kind == kind) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct Label {
+  long cost[static_cast<int>(NonTerm::NT_COUNT)];
+  const Rule* rule[static_cast<int>(NonTerm::NT_COUNT)];
+};
+
+class Selector {
+  public:
+    Selector();
+    const Label& label(Expr* node);
+    long reduce(Expr* node, NonTerm nt);
+  private:
+    long cost(Expr* node, NonTerm nt);
+    long operand(Expr* node, NonTerm nt);
+    bool usable(const Rule& rule) const;
+    bool usable_[kRuleCount];
+    std::unordered_map<Expr*, Label> labels_;
+};
+
+Selector::Selector() {
+  PassManager& passes = CompilerContext::current().passes();
+  for (std::size_t i = 0; i < kRuleCount; i++) {
+    usable_[i] = !kRules[i].pass || passes.lowering(kRules[i].pass);
+  }
+}
+
+bool Selector::usable(const Rule& rule) const {
+  return usable_[&rule - kRules];
+}
+
+long Selector::cost(Expr* node, NonTerm nt) {
+  if (nt == NonTerm::NT_NONE) {
+    return 0;
+  }
+  return label(node).cost[static_cast<int>(nt)];
+}
+
+// 自底向上计算 node 归约到各非终结符的最小代价
+const Label& Selector::label(Expr* node) {
+  auto iter = labels_.find(node);
+  if (iter != labels_.end()) {
+    return iter->second;
+  }
+  Label label;
+  for (int i = 0; i < static_cast<int>(NonTerm::NT_COUNT); i++) {
+    label.cost[i] = kInfinite;
+    label.rule[i] = nullptr;
+  }
+  auto update = [&](NonTerm nt, long cost, const Rule* rule) {
+    if (cost < label.cost[static_cast<int>(nt)]) {
+      label.cost[static_cast<int>(nt)] = cost;
+      label.rule[static_cast<int>(nt)] = rule;
+    }
+  };
+  if (node->kind() == ExprKind::NODE_NUM) {
+    long value = node->value();
+    if (fitsImm12(value)) {
+      update(NonTerm::NT_IMM, 0, nullptr);
+    }
+    if (fitsImm12(value + 1)) {
+      update(NonTerm::NT_IMM_INC, 0, nullptr);
+    }
+    if (fitsImm12(-value)) {
+      update(NonTerm::NT_IMM_NEG, 0, nullptr);
+    }
+    if (value == 0) {
+      update(NonTerm::NT_ZERO, 0, nullptr);
+    }
+  }
+  if (!inTable(node->kind())) {
+    // 由节点自己的 codegen 计算到寄存器
+    update(NonTerm::NT_REG, 1, nullptr);
+  }
+  for (auto& rule: kRules) {
+    if (rule.kind == node->kind() && usable(rule)) {
+      update(rule.result, rule.cost + cost(node->getLeft(), rule.left) +
+                          cost(node->getRight(), rule.right), &rule);
+    }
+  }
+  for (auto& rule: kRules) {
+    if (rule.kind == ExprKind::NODE_ILLEGAL && usable(rule)) {
+      update(rule.result, rule.cost + label.cost[static_cast<int>(rule.left)], &rule);
+    }
+  }
+  return labels_[node] = label;
+}
+
+long Selector::operand(Expr* node, NonTerm nt) {
+  if (nt == NonTerm::NT_NONE) {
+    return 0;
+  }
+  return reduce(node, nt);
+}
+
+// 按 label 选中的规则自顶向下输出指令
+long Selector::reduce(Expr* node, NonTerm nt) {
+  const Label& label = this->label(node);
+  const Rule* rule = label.rule[static_cast<int>(nt)];
+  CHECK(label.cost[static_cast<int>(nt)] < kInfinite);
+  if (!rule) {
+    if (nt != NonTerm::NT_REG) {
+      return node->value();
+    }
+    walkRightImpl(node, codegen_prev_func, codegen_mid_func, codegen_post_func);
+    return 0;
+  }
+  if (nt == NonTerm::NT_REG && genMulDivByConst(node)) {
+    return 0;
+  }
+  long left = 0;
+  long right = 0;
+  if (rule->kind == ExprKind::NODE_ILLEGAL) {
+    left = reduce(node, rule->left);
+  } else if (rule->left == NonTerm::NT_REG && rule->right == NonTerm::NT_REG) {
+    right = reduce(node->getRight(), NonTerm::NT_REG);
+    save_(REG_ACC);
+    left = reduce(node->getLeft(), NonTerm::NT_REG);
+    restore_(REG_TMP);
+  } else {
+    left = operand(node->getLeft(), rule->left);
+    right = operand(node->getRight(), rule->right);
+  }
+  if (!rule->emit) {
+    return left + right;
+  }
+  rule->emit(node, left, right);
+  return 0;
+}
+
+} // namespace
+
+const char* InstructionSelectPass::name() const {
+  return "isel";
+}
+
+PassKind InstructionSelectPass::kind() const {
+  return PassKind::PASS_LOWERING;
+}
+
+const Pass* instructionSelectPass() {
+  static const InstructionSelectPass pass;
+  return &pass;
+}
+
+const char* FuseBranchPass::name() const {
+  return "fuse-branch";
+}
+
+PassKind FuseBranchPass::kind() const {
+  return PassKind::PASS_LOWERING;
+}
+
+const Pass* fuseBranchPass() {
+  static const FuseBranchPass pass;
+  return &pass;
+}
+
+bool selectExpr(Expr* node) {
+  if (!inTable(node->kind())) {
+    return false;
+  }
+  Selector selector;
+  selector.reduce(node, NonTerm::NT_REG);
+  return true;
+}
+
+long selectAddress(Expr* node) {
+  Selector selector;
+  return selector.reduce(node, NonTerm::NT_ADDR);
+}
+
+void selectBranch(Expr* cond, const BranchEmitter& branch) {
+  const BranchEmitter* prev = current_branch;
+  current_branch = &branch;
+  Selector selector;
+  selector.reduce(cond, NonTerm::NT_BRANCH);
+  current_branch = prev;
+}
+
+} // namespace rvcc
@@ -0,0 +1,55 @@
+#ifndef __ISEL_H
+#define __ISEL_H
+
+#include "ast.h"
+#include "mir.h"
+#include "pass_manager.h"
+#include <functional>
+
+namespace rvcc {
+
+/*
+表格驱动的树模式指令选择 (BURS)
+  规则表中每条规则描述一个树模式 (运算符 + 操作数的非终结符) 和代价,
+  自底向上为每个节点计算各非终结符的最小代价, 再自顶向下按选中的规则输出指令
+  非终结符除了寄存器, 还有各种能放进 12 位立即数的常量, 以及 基址 + 偏移 的地址,
+  因此 x + 1 选择 addi, x < 10 选择 slti, *(p + 8) 选择 ld 8(p)
+  关闭 isel 时 (-O0) 只使用寄存器-寄存器的规则, 输出与之前的实现相同
+*/
+class InstructionSelectPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+};
+
+const Pass* instructionSelectPass();
+
+/*
+if for while 的条件直接选择比较跳转指令 (blt bge beq bne bnez)
+  比较取反之后跳转到条件不成立的分支, 条件成立时顺序执行
+  没有对应的规则时 (例如条件是函数调用) 计算到寄存器之后 beqz
+*/
+class FuseBranchPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+};
+
+const Pass* fuseBranchPass();
+
+// 输出跳转指令 op rs1, rs2
+using BranchEmitter = std::function<void(MOpcode op, int rs1, int rs2)>;
+
+// 为 node 为根的表达式选择并输出指令, 结果在 REG_ACC
+// node 不是规则表中的运算符时返回 false
+bool selectExpr(Expr* node);
+
+// 计算地址 node, 基址在 REG_ACC, 返回可以折叠进访存指令的偏移
+long selectAddress(Expr* node);
+
+// 计算条件 cond, 条件不成立时跳转, 跳转指令由 branch 输出
+void selectBranch(Expr* cond, const BranchEmitter& branch);
+
+} // namespace rvcc
+
+#endif
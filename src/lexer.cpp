@@ -1,27 +1,40 @@
 #include "lexer.h"
+#include "logger.h"
 #include "token.h"
 #include <cctype>
 #include <cstdlib>
 
 namespace rvcc {
 
-const char* keywords[] {
-  "return",
-  "if",
-  "else",
-  "for",
-  "while",
-  "int",
-  "sizeof",
-  nullptr
+struct KeywordEntry {
+  const char* name;
+  std::size_t len;
+  KeywordKind kind;
+};
+
+const KeywordEntry keywords[] {
+  {"return", 6, KeywordKind::KEYWORD_RETURN},
+  {"if", 2, KeywordKind::KEYWORD_IF},
+  {"else", 4, KeywordKind::KEYWORD_ELSE},
+  {"for", 3, KeywordKind::KEYWORD_FOR},
+  {"while", 5, KeywordKind::KEYWORD_WHILE},
+  {"int", 3, KeywordKind::KEYWORD_INT},
+  {"sizeof", 6, KeywordKind::KEYWORD_SIZEOF},
+  {nullptr, 0, KeywordKind::KEYWORD_COUNT}
 };
 
 Token Lexer::getNextToken() {
+  return lexToken();
+}
+
+Token Lexer::lexToken() {
   Token new_token;
   if (curr_pos_) {
     skipSpace();
     new_token.loc() = curr_pos_;
-    if (*curr_pos_ == '\0') {
+    new_token.bol() = at_bol_;
+    at_bol_ = false;
+    if (*curr_pos_ == '\0' || (end_ && curr_pos_ >= end_)) {
       new_token.kind() = TokenKind::TOKEN_EOF;
     } else if (std::isdigit(*curr_pos_)) {
       char* tmp = curr_pos_;
@@ -35,31 +48,32 @@ Token Lexer::getNextToken() {
       }
       new_token.kind() = TokenKind::TOKEN_ID;
       new_token.len() = curr_pos_ - new_token.loc();
-      int i = 0;
-      while(keywords[i] != nullptr) {
-        if (startWith(new_token.loc(), keywords[i]) && 
-            new_token.len() == strlen(keywords[i])) {
-          new_token.kind() = TokenKind::TOKEN_KEYWORD;
-          break;
-        }
-        i++;
+      if (readKeyword(new_token.loc(), new_token.len(), new_token.keyword())) {
+        new_token.kind() = TokenKind::TOKEN_KEYWORD;
       }
-    } else if (new_token.len() = readPunct(curr_pos_),
+    } else if (new_token.len() = readPunct(curr_pos_, new_token.punct()),
                new_token.len()) {
         new_token.kind() = TokenKind::TOKEN_PUNCT;
         curr_pos_ += new_token.len();
     } else {
         new_token.kind() = TokenKind::TOKEN_ILLEGAL;
-        std::cout << "current token is illegal" << curr_pos_ << std::endl;
-        exit(1);
+        SourceLocation location = locate(curr_pos_);
+        FATAL("current token is illegal '%c' at %s:%d:%d", *curr_pos_,
+              location.name, location.line, location.column);
     }
   } else {
-    std::cout << "ERROR input is empty!" << std::endl;
-    exit(1);
+    FATAL("input is empty!");
   }
   return new_token;
 }
 
+SourceLocation Lexer::locate(const char* loc) {
+  if (!file_.lines.built()) {
+    file_.size = strlen(buffer_);
+  }
+  return SourceManager::locate(&file_, loc);
+}
+
 void Lexer::init() {
   if (curr_pos_ == nullptr) {
     return;
@@ -71,17 +85,87 @@ bool Lexer::startWith(const char* str, const char* sub_str) {
   return std::strncmp(str, sub_str, strlen(sub_str)) == 0;
 }
 
-int Lexer::readPunct(const char* str) {
-  if (startWith(str, "==") || startWith(str, "!=") ||
-      startWith(str, ">=") || startWith(str, "<=")) {
-    return 2;
-  } 
-  return ispunct(*str) ? 1 : 0;
+// 关键字只在识别 identifier 时比较一次, 先比较长度再比较内容
+bool Lexer::readKeyword(const char* str, std::size_t len, KeywordKind& keyword) {
+  for (int i = 0; keywords[i].name != nullptr; i++) {
+    if (keywords[i].len == len &&
+        std::strncmp(str, keywords[i].name, len) == 0) {
+      keyword = keywords[i].kind;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 返回标点符号的长度, 同时通过 punct 返回标点符号的种类
+int Lexer::readPunct(const char* str, PunctKind& punct) {
+  bool next_is_eq = str[0] != '\0' && str[1] == '=';
+  switch (*str) {
+  case '=':
+    punct = next_is_eq ? PunctKind::PUNCT_EQ : PunctKind::PUNCT_ASSIGN;
+    return next_is_eq ? 2 : 1;
+  case '!':
+    punct = next_is_eq ? PunctKind::PUNCT_NE : PunctKind::PUNCT_NOT;
+    return next_is_eq ? 2 : 1;
+  case '<':
+    punct = next_is_eq ? PunctKind::PUNCT_LE : PunctKind::PUNCT_LT;
+    return next_is_eq ? 2 : 1;
+  case '>':
+    punct = next_is_eq ? PunctKind::PUNCT_GE : PunctKind::PUNCT_GT;
+    return next_is_eq ? 2 : 1;
+  case '+': punct = PunctKind::PUNCT_PLUS; return 1;
+  case '-': punct = PunctKind::PUNCT_MINUS; return 1;
+  case '*': punct = PunctKind::PUNCT_STAR; return 1;
+  case '/': punct = PunctKind::PUNCT_SLASH; return 1;
+  case '&':
+    punct = str[1] == '&' ? PunctKind::PUNCT_AND_AND : PunctKind::PUNCT_AMP;
+    return str[1] == '&' ? 2 : 1;
+  case '|':
+    punct = str[1] == '|' ? PunctKind::PUNCT_OR_OR : PunctKind::PUNCT_OTHER;
+    return str[1] == '|' ? 2 : 1;
+  case '#': punct = PunctKind::PUNCT_HASH; return 1;
+  case '(': punct = PunctKind::PUNCT_LPAREN; return 1;
+  case ')': punct = PunctKind::PUNCT_RPAREN; return 1;
+  case '{': punct = PunctKind::PUNCT_LBRACE; return 1;
+  case '}': punct = PunctKind::PUNCT_RBRACE; return 1;
+  case '[': punct = PunctKind::PUNCT_LBRACKET; return 1;
+  case ']': punct = PunctKind::PUNCT_RBRACKET; return 1;
+  case ',': punct = PunctKind::PUNCT_COMMA; return 1;
+  case ';': punct = PunctKind::PUNCT_SEMI; return 1;
+  default:
+    punct = PunctKind::PUNCT_OTHER;
+    return ispunct(*str) ? 1 : 0;
+  }
 }
 
+// 跳过空白和注释, 跨过换行时记录下一个 token 位于行首
 void Lexer::skipSpace() {
-  while(std::isspace(*curr_pos_)) {
-    curr_pos_++;
+  for (;;) {
+    if (std::isspace(*curr_pos_)) {
+      if (*curr_pos_ == '\n') {
+        at_bol_ = true;
+      }
+      curr_pos_++;
+    } else if (curr_pos_[0] == '/' && curr_pos_[1] == '/') {
+      while (*curr_pos_ != '\n' && *curr_pos_ != '\0') {
+        curr_pos_++;
+      }
+    } else if (curr_pos_[0] == '/' && curr_pos_[1] == '*') {
+      char* end = std::strstr(curr_pos_ + 2, "*/");
+      if (!end) {
+        SourceLocation location = locate(curr_pos_);
+        FATAL("unclosed block comment at %s:%d:%d",
+              location.name, location.line, location.column);
+      }
+      for (; curr_pos_ < end; curr_pos_++) {
+        if (*curr_pos_ == '\n') {
+          at_bol_ = true;
+        }
+      }
+      curr_pos_ = end + 2;
+    } else {
+      return;
+    }
   }
 }
 
@@ -1,6 +1,7 @@
 #ifndef __LEXER_H
 #define __LEXER_H
 
+#include "source.h"
 #include "token.h"
 #include <cctype>
 #include <cstdlib>
@@ -9,27 +10,46 @@
 namespace rvcc {
   class Lexer {
     public:
-      Lexer(const char* buffer):buffer_(buffer) {
+      Lexer(const char* buffer, const char* name = "<input>"):
+        buffer_(buffer), file_{name, "", buffer, 0, false, false} {
         curr_pos_ = const_cast<char*>(buffer_);
+        end_ = nullptr;
+        at_bol_ = true;
       }
+      virtual ~Lexer() {}
       void init();
+      // 只对 [begin, end) 做词法分析, loc 仍然指向 buffer, 错误信息与完整分析时一致
+      void setRange(const char* begin, const char* end) {
+        curr_pos_ = const_cast<char*>(begin);
+        end_ = end;
+      }
       void consumerToken() {
         curr_ = getNextToken();
       }
-      Token getCurrToken() {
+      Token& getCurrToken() {
         return curr_;
       }
       const char* getBuf() {
         return buffer_;
       }
+      // 返回 loc 所在的文件 行号 列号, 用于打印错误信息
+      virtual SourceLocation locate(const char* loc);
       static bool startWith(const char* str, const char* sub_str);
-      static int readPunct(const char* str);
+      static int readPunct(const char* str, PunctKind& punct);
+      static bool readKeyword(const char* str, std::size_t len, KeywordKind& keyword);
+    protected:
+      // 子类 (Preprocessor) 可以替换 token 的来源
+      virtual Token getNextToken();
+      // 直接从 buffer 中切分出下一个 token, 不做预处理
+      Token lexToken();
     private:
-      Token getNextToken();
       void skipSpace();
       Token curr_;
       char* curr_pos_;
+      const char* end_;
+      bool at_bol_;
       const char* const buffer_;
+      SourceFile file_;
   };
 }
 #endif
\ No newline at end of file
@@ -19,6 +19,28 @@ Logger& Logger::getInst() {
   return logger;
 }
 
+std::string*& Logger::sink() {
+  static thread_local std::string* sink = nullptr;
+  return sink;
+}
+
+void Logger::forward(const std::string& messages, bool fatal) {
+  if (sink()) {
+    sink()->append(messages);
+    if (fatal) {
+      throw CompileError(messages);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::cerr << messages << std::flush;
+  }
+  if (fatal) {
+    exit(-1);
+  }
+}
+
 Logger::LogLevel& Logger::level() {
   return level_;
 }
@@ -29,9 +51,10 @@ void Logger::log(LogLevel level, const char* filename, int line, const char* for
   }
   char timestamp[32]{0};
   time_t ticks = time(NULL);
-  tm* ptm = localtime(&ticks);
+  tm local_tm;
+  localtime_r(&ticks, &local_tm);
   memset(timestamp, 0, sizeof(timestamp));
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", ptm);
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local_tm);
   int need_size = snprintf(nullptr, 0, "[%s] %s %s:%d ", level_names[static_cast<int>(level)], timestamp, filename,  line); 
   assert(need_size > 0);
   char* title =  new char[need_size+1];
@@ -45,9 +68,19 @@ void Logger::log(LogLevel level, const char* filename, int line, const char* for
   va_start(arg_ptr, format);
   need_size = vsnprintf(content, need_size+1, format, arg_ptr);
   va_end(arg_ptr);
+  std::string message = std::string(title) + " " + content;
+  delete[] title;
+  delete[] content;
+  if (sink()) {
+    sink()->append(message).push_back('\n');
+    if (level == LogLevel::FATAL) {
+      throw CompileError(message);
+    }
+    return;
+  }
   {
     std::lock_guard<std::mutex> lock(mtx_);
-    std::cerr << title << " " << content << std::endl;
+    std::cerr << message << std::endl;
   }
   if (level == LogLevel::FATAL) {
     exit(-1);
@@ -3,7 +3,14 @@
 
 
 #include <mutex>
+#include <stdexcept>
+#include <string>
 
+// 设置了 Logger::sink() 时, FATAL 抛出该异常而不是退出进程
+class CompileError: public std::runtime_error {
+  public:
+    explicit CompileError(const std::string& what): std::runtime_error(what) {}
+};
 
 class Logger {
   public:
@@ -22,6 +29,10 @@ class Logger {
     static Logger& getInst();
     LogLevel& level();
     void log(LogLevel level, const char* filename, int line, const char* format, ...);
+    // 当前线程的诊断信息输出, 为空时写入 stderr
+    static std::string*& sink();
+    // 输出在其他线程记录下的诊断信息, fatal 为 true 时按 FATAL 处理
+    void forward(const std::string& messages, bool fatal);
   private:
     Logger() { level_ = LogLevel::DEBUG;}
     std::mutex mtx_;
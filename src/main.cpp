@@ -1,24 +1,266 @@
 #include "ast.h"
 #include "codegen.h"
+#include "context.h"
+#include "ir.h"
 #include "logger.h"
+#include "object_manager.h"
+#include "parallel_parser.h"
 #include "parser.h"
+#include "pch.h"
+#include "target.h"
+#include "verifier.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 
 using namespace rvcc;
 
+static void usage() {
+  fprintf(stderr, "usage: rvcc [--stream] [-j jobs] [-I dir]... [--include-pch file] [--target name]\n"
+                  "            [-O0|-O1|-O2|-Os] [-f[no-]<pass>]... [-mllvm -opt-bisect-limit=N]\n"
+                  "            [--time-passes] [--pass-stats] [-fsave-optimization-record[=file]]\n"
+                  "            [--stats[=json]] [--emit-ir] [--from-ir]\n"
+                  "            [-o out] <source>\n"
+                  "       rvcc --list-passes\n"
+                  "       rvcc [-I dir]... --emit-pch <header> -o <out.pch>\n"
+                  "  --stream            parse, codegen and release one function at a time\n"
+                  "  -j jobs             parse top-level functions on jobs threads\n"
+                  "  -I dir              add dir to the #include search path\n"
+                  "  --emit-pch header   parse header and save its functions as a pch\n"
+                  "  --include-pch file  load the functions of a pch before compiling\n"
+                  "  --target name       generate code for name (%s), default rv64\n"
+                  "  -fsave-optimization-record[=file]\n"
+                  "                      save optimization remarks as JSON to file\n"
+                  "                      (default remarks.json)\n"
+                  "  --stats[=json]      print per-function code statistics to stderr\n"
+                  "  --emit-ir           print the SSA IR of each function instead of assembly\n"
+                  "  --from-ir           read source as SSA IR (the --emit-ir format) instead of C\n"
+                  "  -O<level>           select the optimization pipeline, default -O0\n"
+                  "  -f<pass> -fno-<pass>\n"
+                  "                      enable or disable one pass, see --list-passes\n"
+                  "  -mllvm -opt-bisect-limit=N\n"
+                  "                      run only the first N passes, log each decision to stderr\n"
+                  "  --time-passes       print the time spent in each pass to stderr\n"
+                  "  --pass-stats        print the counters of each pass (e.g. peephole rule hits)\n"
+                  "                      to stderr\n"
+                  "  --list-passes       list the passes and the levels that enable them\n"
+                  "  -o out              write output to out instead of stdout\n",
+                  Target::names());
+}
+
+// 解析头文件并把其中的函数序列化为 pch, 头文件所在目录加入 include 搜索路径
+static bool emitPch(const char* header, const char* output,
+                    std::vector<std::string> include_dirs) {
+  std::ifstream in(header, std::ios::binary);
+  if (!in) {
+    FATAL("can't open %s", header);
+  }
+  std::ostringstream oss;
+  oss << in.rdbuf();
+  std::string source = oss.str();
+  std::string path(header);
+  std::size_t slash = path.rfind('/');
+  include_dirs.insert(include_dirs.begin(),
+                      slash == std::string::npos ? "." : path.substr(0, slash));
+  Parser parser(source.c_str(), include_dirs);
+  Ast* ast = parser.parser_program();
+  PchWriter writer;
+  return writer.write(ast, output);
+}
+
+static void listPasses() {
+  static const char* levels[] = {"O0", "O1", "O2", "Os"};
+  for (auto& info: PassManager::registry()) {
+    std::string enabled;
+    for (int i = 0; i < static_cast<int>(OptLevel::OPT_COUNT); i++) {
+      if (info.levels & levelMask(static_cast<OptLevel>(i))) {
+        enabled += enabled.empty() ? "" : ",";
+        enabled += levels[i];
+      }
+    }
+    printf("%-24s %-12s %s\n", info.pass->name(), enabled.c_str(), info.description);
+  }
+}
+
+// 流式编译: 解析一个函数 -> 生成汇编并刷新输出 -> 释放该函数的 node type var
+// 峰值内存由最大的函数决定, 而不是整个输入
+static void compileStream(const char* source,
+                          const std::vector<std::string>& include_dirs,
+                          PchReader* pch, bool emit_ir) {
+  Parser parser(source, include_dirs);
+  Codegen codegen;
+  codegen.emitIr() = emit_ir;
+  if (pch) {
+    for (auto func: pch->functions()) {
+      parser.defineFunction(func);
+      codegen.codegen(func);
+    }
+  }
+  for (;;) {
+    std::size_t mark = ObjectManager::getInst().mark();
+    Function* func = parser.parser_next_function();
+    if (!func) {
+      break;
+    }
+    parser.defineFunction(func);
+    codegen.codegen(func);
+    fflush(stdout);
+    ObjectManager::getInst().release(mark);
+  }
+}
+
+// 解析并检查 --emit-ir 格式的函数, 逐个输出 IR 或者生成汇编
+static void compileIr(const char* source, bool emit_ir) {
+  std::vector<std::unique_ptr<IrFunction>> funcs;
+  std::string error;
+  if (!parseIr(source, funcs, error)) {
+    FATAL("invalid SSA IR: %s", error.c_str());
+  }
+  Codegen codegen;
+  codegen.emitIr() = emit_ir;
+  for (auto& func: funcs) {
+    if (!verifyIrFunction(*func, error)) {
+      FATAL("invalid SSA IR for function %s: %s", func->name().c_str(), error.c_str());
+    }
+    CompilerContext::current().passes().beginFunction(func->name());
+    codegen.codegen(*func);
+  }
+}
+
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    fprintf(stderr, "args num should be two");
+  const char* source = nullptr;
+  const char* output = nullptr;
+  const char* emit_pch = nullptr;
+  const char* include_pch = nullptr;
+  const char* remarks_file = nullptr;
+  const char* stats = nullptr;
+  bool stream = false;
+  bool emit_ir = false;
+  bool from_ir = false;
+  bool time_passes = false;
+  bool pass_stats = false;
+  unsigned jobs = 1;
+  PassManager& passes = CompilerContext::current().passes();
+  std::vector<std::string> include_dirs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stream") == 0) {
+      stream = true;
+    } else if (strcmp(argv[i], "--emit-pch") == 0 && i + 1 < argc) {
+      emit_pch = argv[++i];
+    } else if (strcmp(argv[i], "--include-pch") == 0 && i + 1 < argc) {
+      include_pch = argv[++i];
+    } else if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+      const Target* target = Target::get(argv[++i]);
+      if (!target) {
+        FATAL("unknown target %s, supported: %s", argv[i], Target::names());
+      }
+      CompilerContext::current().target() = target;
+    } else if (strcmp(argv[i], "-fsave-optimization-record") == 0) {
+      remarks_file = "remarks.json";
+    } else if (strncmp(argv[i], "-fsave-optimization-record=", 27) == 0) {
+      remarks_file = argv[i] + 27;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = "table";
+    } else if (strcmp(argv[i], "--stats=json") == 0) {
+      stats = "json";
+    } else if (strcmp(argv[i], "--emit-ir") == 0) {
+      emit_ir = true;
+    } else if (strcmp(argv[i], "--from-ir") == 0) {
+      from_ir = true;
+    } else if (strcmp(argv[i], "--time-passes") == 0) {
+      time_passes = true;
+    } else if (strcmp(argv[i], "--pass-stats") == 0) {
+      pass_stats = true;
+    } else if (strcmp(argv[i], "--list-passes") == 0) {
+      listPasses();
+      return 0;
+    } else if (strcmp(argv[i], "-mllvm") == 0 && i + 1 < argc) {
+      if (!passes.parseFlag(argv[++i])) {
+        FATAL("unknown option -mllvm %s", argv[i]);
+      }
+    } else if (strncmp(argv[i], "-O", 2) == 0 || strncmp(argv[i], "-f", 2) == 0) {
+      if (!passes.parseFlag(argv[i])) {
+        FATAL("unknown optimization option %s", argv[i]);
+      }
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      jobs = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+      include_dirs.push_back(argv[++i]);
+    } else if (strncmp(argv[i], "-I", 2) == 0 && argv[i][2] != '\0') {
+      include_dirs.push_back(argv[i] + 2);
+    } else if (!source) {
+      source = argv[i];
+    } else {
+      usage();
+      return -1;
+    }
+  }
+  if (emit_pch) {
+    if (source || !output) {
+      usage();
+      return -1;
+    }
+    if (!emitPch(emit_pch, output, include_dirs)) {
+      FATAL("can't write pch %s", output);
+    }
+    return 0;
+  }
+  if (!source) {
+    usage();
     return -1;
   }
   Logger::getInst().level() = Logger::LogLevel::DEBUG;
+  if (output && !freopen(output, "w", stdout)) {
+    FATAL("can't open %s", output);
+  }
 
+  Remarks& remarks = CompilerContext::current().remarks();
+  remarks.enabled() = remarks_file != nullptr;
+  CodegenStats& codegen_stats = CompilerContext::current().stats();
+  codegen_stats.enabled() = stats != nullptr;
+  passes.timePasses() = time_passes;
 
-  Parser parser(argv[1]);
-  Ast* ast = parser.parser_program();
-  ast->visualization("graph.dot");
-  Codegen codegen(ast);
-  codegen.codegen();
+  // pch 中的名字直接引用 mmap 的内存, reader 需要存活到 codegen 结束
+  PchReader pch;
+  if (include_pch && !pch.load(include_pch)) {
+    FATAL("invalid pch %s", include_pch);
+  }
 
+  if (from_ir) {
+    compileIr(source, emit_ir);
+  } else if (stream) {
+    compileStream(source, include_dirs, include_pch ? &pch : nullptr, emit_ir);
+  } else {
+    Ast* ast = parseParallel(source, include_dirs, jobs);
+    if (include_pch) {
+      pch.insertInto(ast);
+    }
+    ast->visualization("graph.dot");
+    Codegen codegen(ast);
+    codegen.emitIr() = emit_ir;
+    codegen.codegen();
+  }
+
+  if (remarks_file && !remarks.save(remarks_file)) {
+    FATAL("can't write %s", remarks_file);
+  }
+  if (stats) {
+    std::string report = strcmp(stats, "json") == 0 ?
+      codegen_stats.toJson() : codegen_stats.table();
+    fputs(report.c_str(), stderr);
+  }
+  if (time_passes) {
+    fputs(passes.timingReport().c_str(), stderr);
+  }
+  if (pass_stats) {
+    fputs(passes.statsReport().c_str(), stderr);
+  }
   return 0;
-}
\ No newline at end of file
+}
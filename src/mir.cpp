@@ -0,0 +1,104 @@
+#include "mir.h"
+
+namespace rvcc {
+
+namespace {
+
+const char* opcode_names[static_cast<int>(MOpcode::MOP_COUNT)] = {
+  "li", "mv", "add", "sub", "mul", "div", "addi", "xor", "xori",
+  "seqz", "snez", "slt", "neg", "slli", "srai", "srli", "mulh", "slti",
+  "ld", "sd", "push", "pop", "call",
+  "j", "beqz", "bnez", "beq", "bne", "blt", "bge", "label", "comment", "ret"
+};
+
+} // namespace
+
+MInst::MInst(MOpcode op, int rd, int rs1, int rs2, long imm):
+  op(op), rd(rd), rs1(rs1), rs2(rs2), imm(imm) {}
+
+const char* MInst::opcodeName() const {
+  return opcode_names[static_cast<int>(op)];
+}
+
+bool MInst::isBranch() const {
+  switch (op) {
+  case MOpcode::MOP_J:
+  case MOpcode::MOP_BEQZ:
+  case MOpcode::MOP_BNEZ:
+  case MOpcode::MOP_BEQ:
+  case MOpcode::MOP_BNE:
+  case MOpcode::MOP_BLT:
+  case MOpcode::MOP_BGE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int MInst::def() const {
+  switch (op) {
+  case MOpcode::MOP_SD:
+  case MOpcode::MOP_PUSH:
+  case MOpcode::MOP_J:
+  case MOpcode::MOP_BEQZ:
+  case MOpcode::MOP_BNEZ:
+  case MOpcode::MOP_BEQ:
+  case MOpcode::MOP_BNE:
+  case MOpcode::MOP_BLT:
+  case MOpcode::MOP_BGE:
+  case MOpcode::MOP_LABEL:
+  case MOpcode::MOP_COMMENT:
+  case MOpcode::MOP_RET:
+    return REG_NONE;
+  default:
+    return rd;
+  }
+}
+
+std::size_t MInst::uses(int regs[2]) const {
+  switch (op) {
+  case MOpcode::MOP_MV:
+  case MOpcode::MOP_ADDI:
+  case MOpcode::MOP_XORI:
+  case MOpcode::MOP_SEQZ:
+  case MOpcode::MOP_SNEZ:
+  case MOpcode::MOP_NEG:
+  case MOpcode::MOP_SLLI:
+  case MOpcode::MOP_SRAI:
+  case MOpcode::MOP_SRLI:
+  case MOpcode::MOP_SLTI:
+  case MOpcode::MOP_LD:
+  case MOpcode::MOP_PUSH:
+  case MOpcode::MOP_BEQZ:
+  case MOpcode::MOP_BNEZ:
+    regs[0] = rs1;
+    return 1;
+  case MOpcode::MOP_ADD:
+  case MOpcode::MOP_SUB:
+  case MOpcode::MOP_MUL:
+  case MOpcode::MOP_DIV:
+  case MOpcode::MOP_XOR:
+  case MOpcode::MOP_SLT:
+  case MOpcode::MOP_MULH:
+  case MOpcode::MOP_SD:
+  case MOpcode::MOP_BEQ:
+  case MOpcode::MOP_BNE:
+  case MOpcode::MOP_BLT:
+  case MOpcode::MOP_BGE:
+    regs[0] = rs1;
+    regs[1] = rs2;
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+MFunction::MFunction(const std::string& name, std::size_t stack_size):
+  name(name), loc(nullptr), stack_size(stack_size), virtual_regs(false), frame(true),
+  save_ra(true), prologue_pos(0), next_vreg(kFirstVirtualReg) {}
+
+int MFunction::newVirtualReg() {
+  return next_vreg++;
+}
+
+} // namespace rvcc
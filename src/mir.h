@@ -0,0 +1,139 @@
+#ifndef __MIR_H
+#define __MIR_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+/*
+机器指令层 (machine IR)
+  codegen 不再直接输出汇编, 而是为每个函数生成一个 MInst 列表,
+  最后交给 Target 翻译成具体平台的汇编
+  寄存器使用和平台无关的编号, 由 Target 映射为具体的寄存器名
+*/
+enum MReg:int {
+  REG_NONE = -1,
+  REG_ACC = 0,          // 表达式结果 / 返回值
+  REG_TMP,              // 二元运算的左操作数
+  REG_ARG0,             // 参数寄存器 REG_ARG0 ~ REG_ARG5
+  REG_ARG1,
+  REG_ARG2,
+  REG_ARG3,
+  REG_ARG4,
+  REG_ARG5,
+  REG_FP,               // 栈帧
+  REG_SP,               // 栈顶
+  REG_RA,               // 返回地址
+  REG_T0,               // 由寄存器分配使用, 调用者保存 REG_T0 ~ REG_T8
+  REG_T1,
+  REG_T2,
+  REG_T3,
+  REG_T4,
+  REG_T5,
+  REG_T6,
+  REG_T7,
+  REG_T8,
+  REG_S1,               // 由寄存器分配使用, 被调用者保存 REG_S1 ~ REG_S11
+  REG_S2,
+  REG_S3,
+  REG_S4,
+  REG_S5,
+  REG_S6,
+  REG_S7,
+  REG_S8,
+  REG_S9,
+  REG_S10,
+  REG_S11,
+  REG_COUNT
+};
+
+constexpr int kArgRegCount = REG_ARG5 - REG_ARG0 + 1;
+// 虚拟寄存器的编号从 kFirstVirtualReg 开始, 由 regalloc 替换为 REG_T0 ~ REG_S11
+constexpr int kFirstVirtualReg = 64;
+
+inline bool isVirtualReg(int reg) {
+  return reg >= kFirstVirtualReg;
+}
+
+inline bool isCalleeSavedReg(int reg) {
+  return reg >= REG_S1 && reg <= REG_S11;
+}
+
+enum class MOpcode:int {
+  MOP_LI = 0,           // rd = imm
+  MOP_MV,               // rd = rs1
+  MOP_ADD,              // rd = rs1 + rs2
+  MOP_SUB,              // rd = rs1 - rs2
+  MOP_MUL,              // rd = rs1 * rs2
+  MOP_DIV,              // rd = rs1 / rs2
+  MOP_ADDI,             // rd = rs1 + imm
+  MOP_XOR,              // rd = rs1 ^ rs2
+  MOP_XORI,             // rd = rs1 ^ imm
+  MOP_SEQZ,             // rd = rs1 == 0
+  MOP_SNEZ,             // rd = rs1 != 0
+  MOP_SLT,              // rd = rs1 < rs2
+  MOP_NEG,              // rd = -rs1
+  MOP_SLLI,             // rd = rs1 << imm
+  MOP_SRAI,             // rd = rs1 >> imm, 算术右移
+  MOP_SRLI,             // rd = rs1 >> imm, 逻辑右移
+  MOP_MULH,             // rd = (rs1 * rs2) >> 64, 有符号
+  MOP_SLTI,             // rd = rs1 < imm
+  MOP_LD,               // rd = *(rs1 + imm)
+  MOP_SD,               // *(rs1 + imm) = rs2
+  MOP_PUSH,             // 压栈 rs1
+  MOP_POP,              // 弹栈到 rd
+  MOP_CALL,             // 调用 sym, imm 为调用时表达式栈的深度
+  MOP_J,                // 跳转到 sym
+  MOP_BEQZ,             // rs1 为 0 时跳转到 sym
+  MOP_BNEZ,             // rs1 不为 0 时跳转到 sym
+  MOP_BEQ,              // rs1 == rs2 时跳转到 sym
+  MOP_BNE,              // rs1 != rs2 时跳转到 sym
+  MOP_BLT,              // rs1 < rs2 时跳转到 sym
+  MOP_BGE,              // rs1 >= rs2 时跳转到 sym
+  MOP_LABEL,            // 标签 sym
+  MOP_COMMENT,          // 原样输出 comment
+  MOP_RET,              // 返回调用者
+  MOP_COUNT
+};
+
+struct MInst {
+  MOpcode op;
+  int rd;
+  int rs1;
+  int rs2;
+  long imm;
+  std::string sym;      // 标签或者函数名
+  std::string comment;  // 为空时由 Target 根据指令生成, 其中的 %s 替换为 rs1 的寄存器名
+  MInst(MOpcode op, int rd = REG_NONE, int rs1 = REG_NONE,
+        int rs2 = REG_NONE, long imm = 0);
+  const char* opcodeName() const;
+  bool isBranch() const;  // J BEQZ
+  // 写入的寄存器, 没有时为 REG_NONE
+  int def() const;
+  // 读取的寄存器写入 regs, 返回个数 (不包含 call ret 隐式使用的寄存器)
+  std::size_t uses(int regs[2]) const;
+};
+
+struct MFunction {
+  std::string name;
+  const char* loc;          // 函数名在输入中的位置, 用于优化记录, 从 IR 文本读入时为空
+  std::size_t stack_size;   // 局部变量 (包含参数) 占用的栈空间
+  std::vector<MInst> insts; // 函数体, 不包含 prologue/epilogue
+  bool virtual_regs;        // 表达式的中间结果保存在虚拟寄存器中, 而不是压栈
+  bool frame;               // 需要 prologue/epilogue 建立栈帧, 为 false 时直接 ret
+  bool save_ra;             // prologue 保存 ra, 不调用其他函数时不需要
+  std::size_t prologue_pos; // prologue 插入在 insts 中的位置, 见 shrink-wrap
+  // 被调用者保存的寄存器和保存的位置 (相对 fp), 由 prologue 保存, epilogue 恢复
+  std::vector<std::pair<int, long>> callee_saved;
+  int next_vreg;
+  std::vector<int> saved;   // save_ 保存的中间结果, 后进先出
+  MFunction(const std::string& name, std::size_t stack_size);
+  int newVirtualReg();
+};
+
+} // namespace rvcc
+
+#endif
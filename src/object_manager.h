@@ -1,17 +1,18 @@
 #ifndef __OBJECT_MAMAGER_H
 #define __OBJECT_MAMAGER_H
 #include "object.h"
+#include <cstddef>
 #include <utility>
 #include <vector>
 
 namespace rvcc {
 
+class CompilerContext;
+
 class ObjectManager {
   public:
-    static ObjectManager& getInst() {
-      static ObjectManager inst;
-      return inst;
-    }
+    // 当前线程 CompilerContext 的 ObjectManager
+    static ObjectManager& getInst();
     template<typename T, typename ...Args>
     T* alloc_type(Args... args) {
       T* object = new T(std::forward<Args>(args)...);
@@ -19,6 +20,29 @@ class ObjectManager {
       return object;
     }
 
+    // 流式编译时, 每个函数编译前记录 mark, codegen 完成后
+    // release(mark) 释放该函数解析过程中申请的 node type var
+    std::size_t mark() const {
+      return objects_.size();
+    }
+
+    void release(std::size_t mark) {
+      while (objects_.size() > mark) {
+        delete objects_.back();
+        objects_.pop_back();
+      }
+    }
+
+    // 接管 other 申请的全部对象, 用于合并并行解析时各线程的对象
+    void adopt(ObjectManager& other) {
+      objects_.insert(objects_.end(), other.objects_.begin(), other.objects_.end());
+      other.objects_.clear();
+    }
+
+    std::size_t size() const {
+      return objects_.size();
+    }
+
     ~ObjectManager() {
       for(auto object: objects_) {
         delete object;
@@ -26,6 +50,7 @@ class ObjectManager {
     }
 
   private:
+    friend class CompilerContext;
     ObjectManager() = default;
     ObjectManager(const ObjectManager&) = delete;
     ObjectManager& operator=(const ObjectManager&) = delete;
@@ -0,0 +1,156 @@
+#include "parallel_parser.h"
+#include "context.h"
+#include "logger.h"
+#include "object_manager.h"
+#include "parser.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace rvcc {
+
+bool splitTopLevel(const char* begin, const char* end,
+                   std::vector<SourceChunk>& chunks) {
+  const char* chunk_begin = begin;
+  const char* pos = begin;
+  int depth = 0;
+  while (pos < end) {
+    if (pos[0] == '/' && pos + 1 < end && pos[1] == '/') {
+      while (pos < end && *pos != '\n') {
+        pos++;
+      }
+      continue;
+    }
+    if (pos[0] == '/' && pos + 1 < end && pos[1] == '*') {
+      pos += 2;
+      while (pos + 1 < end && !(pos[0] == '*' && pos[1] == '/')) {
+        pos++;
+      }
+      if (pos + 1 >= end) {
+        return false;
+      }
+      pos += 2;
+      continue;
+    }
+    switch (*pos) {
+    case '#':
+      return false;
+    case '{':
+      depth++;
+      break;
+    case '}':
+      if (--depth < 0) {
+        return false;
+      }
+      if (depth == 0) {
+        chunks.push_back({chunk_begin, pos + 1});
+        chunk_begin = pos + 1;
+      }
+      break;
+    default:
+      break;
+    }
+    pos++;
+  }
+  return depth == 0;
+}
+
+std::vector<SourceChunk> splitTopLevel(const char* source) {
+  std::vector<SourceChunk> chunks;
+  const char* end = source + strlen(source);
+  if (!splitTopLevel(source, end, chunks)) {
+    return {};
+  }
+  // 最后一个 '}' 之后的内容单独成段, 只有空白时解析结果为空
+  const char* tail = chunks.empty() ? source : chunks.back().end;
+  if (tail != end) {
+    chunks.push_back({tail, end});
+  }
+  return chunks;
+}
+
+namespace {
+
+struct ChunkResult {
+  bool ok;
+  std::string diagnostics;
+  std::vector<Function*> functions;
+};
+
+} // namespace
+
+Ast* parseParallel(const char* source,
+                   const std::vector<std::string>& include_dirs,
+                   unsigned jobs) {
+  std::vector<SourceChunk> chunks;
+  if (jobs > 1) {
+    chunks = splitTopLevel(source);
+  }
+  if (chunks.size() <= 1) {
+    Parser parser(source, include_dirs);
+    return parser.parser_program();
+  }
+  std::size_t num_threads = std::min<std::size_t>(jobs, chunks.size());
+  std::vector<std::unique_ptr<CompilerContext>> contexts;
+  for (std::size_t i = 0; i < num_threads; i++) {
+    contexts.emplace_back(new CompilerContext());
+  }
+  std::vector<ChunkResult> results(chunks.size());
+  std::atomic<std::size_t> next_chunk{0};
+  // 最靠前的出错的段, 之后的段不需要再解析
+  std::atomic<std::size_t> first_error{chunks.size()};
+  auto worker = [&](CompilerContext* context) {
+    // 每个线程复用一个 parser, 出错之后不会再解析后面的段
+    // parser 在 context 中创建, 输入 buffer 登记在该 context 中
+    std::unique_ptr<Parser> parser;
+    for (;;) {
+      std::size_t i = next_chunk++;
+      if (i >= chunks.size() || i > first_error) {
+        return;
+      }
+      ChunkResult& result = results[i];
+      result.ok = context->run([&]() {
+        if (!parser) {
+          parser.reset(new Parser(source, include_dirs));
+        }
+        parser->setRange(chunks[i].begin, chunks[i].end);
+        while (Function* func = parser->parser_next_function()) {
+          result.functions.push_back(func);
+        }
+      }, result.diagnostics);
+      if (!result.ok) {
+        std::size_t prev = first_error;
+        while (i < prev && !first_error.compare_exchange_weak(prev, i)) {}
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker, contexts[i].get());
+  }
+  worker(contexts[0].get());
+  for (auto& thread: threads) {
+    thread.join();
+  }
+
+  ObjectManager& objects = ObjectManager::getInst();
+  SourceManager& sources = CompilerContext::current().sources();
+  for (auto& context: contexts) {
+    objects.adopt(context->objects());
+    sources.adopt(context->sources());
+  }
+  Ast* ast = objects.alloc_type<Ast>();
+  for (auto& result: results) {
+    if (!result.diagnostics.empty() || !result.ok) {
+      Logger::getInst().forward(result.diagnostics, !result.ok);
+    }
+    for (auto func: result.functions) {
+      Parser::insertFunction(ast, func);
+    }
+  }
+  return ast;
+}
+
+} // namespace rvcc
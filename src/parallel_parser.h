@@ -0,0 +1,37 @@
+#ifndef __PARALLEL_PARSER_H
+#define __PARALLEL_PARSER_H
+
+#include "ast.h"
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+// 一段包含若干完整顶层函数定义的输入
+struct SourceChunk {
+  const char* begin;
+  const char* end;
+};
+
+// 在深度回到 0 的 '}' 之后切分 source
+// 含有预处理指令 (宏可能改变括号结构) 或者括号不匹配时无法安全切分, 返回空
+std::vector<SourceChunk> splitTopLevel(const char* source);
+// 切分 [begin, end), 以 '}' 结尾的段追加到 chunks, 最后一个 '}' 之后的内容
+// 由调用者处理. 无法安全切分时返回 false
+bool splitTopLevel(const char* begin, const char* end,
+                   std::vector<SourceChunk>& chunks);
+
+/*
+并发解析
+  每个线程使用自己的 CompilerContext 作为 arena 解析若干段,
+  结束后由调用线程接管全部对象, 并按源码顺序把 Function 插入 Ast
+  出错时只报告源码中最靠前的一段的诊断信息, 与串行解析的输出一致
+  jobs <= 1 或者无法切分时退化为串行解析
+*/
+Ast* parseParallel(const char* source,
+                   const std::vector<std::string>& include_dirs,
+                   unsigned jobs);
+
+} // namespace rvcc
+
+#endif
@@ -104,6 +104,21 @@ Expr* Parser::newSub(Expr *left, Expr *right) {
 
 void Parser::init() {
   lexer_.init();
+  started_ = true;
+}
+
+void Parser::setRange(const char* begin, const char* end) {
+  lexer_.setRange(begin, end);
+  started_ = false;
+}
+
+void Parser::insertFunction(Ast* ast, Function* func) {
+  std::size_t hash_value = getstrHash(func->name(), func->name_len());
+  ast->insert({hash_value, func});
+  std::string name(func->name(), func->name_len());
+  if (name == "main") {
+    ast->set_entry_point(hash_value);
+  }
 }
 
 // program = functionDefinition*
@@ -111,34 +126,52 @@ Ast* Parser::parser_program() {
   init();
   Ast* ast = ObjectManager::getInst().alloc_type<Ast>();
   while(lexer_.getCurrToken().kind() != TokenKind::TOKEN_EOF) {
-    Function* func = parser_function();
-    std::size_t hash_value = getstrHash(func->name(), func->name_len());
-    ast->insert({hash_value, func});
-    std::string name(func->name(), func->name_len());
-    if (name == "main") {
-      ast->set_entry_point(hash_value);
-    }
+    insertFunction(ast, parser_function());
   }
   return ast;
 }
 
+Function* Parser::parser_next_function() {
+  if (!started_) {
+    init();
+  }
+  if (lexer_.getCurrToken().kind() == TokenKind::TOKEN_EOF) {
+    return nullptr;
+  }
+  return parser_function();
+}
+
+void Parser::defineFunction(Function* func) {
+  std::string name(func->name(), func->name_len());
+  if (!function_names_.insert(name).second) {
+    std::string message = "function " + name + " is redefined";
+    printErrorAt(message.c_str(), func->name(), lexer_);
+  }
+}
+
 // functionDefinition = declspec declarator "{" compoundStmt*
 // 将寄存器里保存的参数 保存在栈中， 当局部变量使用
 Function* Parser::parser_function() {
   var_index_ = 0;
   var_offset_ = 0;
+  symbols_.clear();
+  // 函数参数所在的作用域, 函数体最外层的声明也在这里, 与参数同名时为重复定义
+  symbols_.enterScope();
   Function* func = ObjectManager::getInst().alloc_type<Function>();
   Type* base_type = parser_declspec();
   Token id;
   Type* func_type = parser_declarator(base_type, id);
   CHECK(func_type->kind() == TypeKind::TYPE_FUNC);
-  CHECK(startWithStr("{", lexer_));
+  CHECK(isPunct(PunctKind::PUNCT_LBRACE, lexer_));
   lexer_.consumerToken();
   func->name() = id.loc();
   func->name_len() = id.len();
-  func->body() = parser_compound_stmt();
-  func->var_maps().swap(var_maps_);
-  func->parameters().swap(parameter_maps_);
+  func->body() = parser_compound_stmt(false);
+  symbols_.leaveScope();
+  func->vars().swap(vars_);
+  func->parameters().swap(parameters_);
+  vars_.clear();
+  parameters_.clear();
   func->type() = func_type;
   return func;
 }
@@ -146,7 +179,7 @@ Function* Parser::parser_function() {
 // declspec = "int"
 // 返回变量定义时 基本类型 比如 int a 的类型为 int
 Type* Parser::parser_declspec() {
-  if (startWithStr("int", lexer_)) {
+  if (isKeyword(KeywordKind::KEYWORD_INT, lexer_)) {
     lexer_.consumerToken();
     return Type::typeInt;
   }
@@ -157,7 +190,7 @@ Type* Parser::parser_declspec() {
 // declarator = "*"* ident typeSuffix
 Type* Parser::parser_declarator(Type* base_type, Token& id) {
   Type* curr = base_type;
-  while(startWithStr("*", lexer_)) {
+  while(isPunct(PunctKind::PUNCT_STAR, lexer_)) {
     lexer_.consumerToken();
     curr = ObjectManager::getInst().alloc_type<PtrType>(curr);
   }
@@ -167,8 +200,12 @@ Type* Parser::parser_declarator(Type* base_type, Token& id) {
   Type* type = parser_suffix(curr, id);
   if (type->kind() != TypeKind::TYPE_FUNC) {
     Var* var = ObjectManager::getInst().alloc_type<Var>(id.loc(), id.len());
-    std::size_t hash_value = getstrHash(var->getName(), var->name_len());
-    CHECK(var_maps_.insert({hash_value, var}).second);
+    if (!symbols_.declare(var)) {
+      std::string message = "identify: " + std::string(id.loc(), id.len()) +
+                            " is redefined in the same scope";
+      printErrorAt(message.c_str(), id.loc(), lexer_);
+    }
+    vars_.push_back(var);
     var->type() = type;
     var->index() = var_index_;
     var->offset() = var_offset_;
@@ -180,7 +217,7 @@ Type* Parser::parser_declarator(Type* base_type, Token& id) {
 
 // typeSuffix = ("(" parameters? | "[" num "]")?
 Type* Parser::parser_suffix(Type* base_type, Token& id) {
-  if (startWithStr("(", lexer_)) {
+  if (isPunct(PunctKind::PUNCT_LPAREN, lexer_)) {
     lexer_.consumerToken();
     FuncType* func_type = dynamic_cast<FuncType*>(
       ObjectManager::getInst().alloc_type<FuncType>(id.loc(), id.len()));
@@ -188,14 +225,14 @@ Type* Parser::parser_suffix(Type* base_type, Token& id) {
     func_type->ret_type() = base_type;
     parser_parameters(func_type);
     return func_type;
-  } else if (startWithStr("[", lexer_)) {
+  } else if (isPunct(PunctKind::PUNCT_LBRACKET, lexer_)) {
     lexer_.consumerToken();
     CHECK(lexer_.getCurrToken().kind()==TokenKind::TOKEN_NUM);
     std::size_t size = lexer_.getCurrToken().value();
     lexer_.consumerToken();
-    CHECK(startWithStr("]", lexer_));
+    CHECK(isPunct(PunctKind::PUNCT_RBRACKET, lexer_));
     lexer_.consumerToken();
-    if (startWithStr("[", lexer_)) {
+    if (isPunct(PunctKind::PUNCT_LBRACKET, lexer_)) {
       base_type = parser_suffix(base_type, id);
     }
     base_type = ObjectManager::getInst().alloc_type<ArrayType>(base_type, size);
@@ -208,15 +245,15 @@ Type* Parser::parser_suffix(Type* base_type, Token& id) {
 
 // parameters = (parameter ("," parameter)*)? ")"
 void Parser::parser_parameters(FuncType* func_type) {
-  if (!startWithStr(")", lexer_)) {
+  if (!isPunct(PunctKind::PUNCT_RPAREN, lexer_)) {
     parser_parameter(func_type);
   }
-  while (!startWithStr(")", lexer_)) {
-    CHECK(startWithStr(",", lexer_));
+  while (!isPunct(PunctKind::PUNCT_RPAREN, lexer_)) {
+    CHECK(isPunct(PunctKind::PUNCT_COMMA, lexer_));
     lexer_.consumerToken();
     parser_parameter(func_type); 
   }
-  CHECK(startWithStr(")", lexer_));
+  CHECK(isPunct(PunctKind::PUNCT_RPAREN, lexer_));
   lexer_.consumerToken();
 }
 
@@ -225,32 +262,37 @@ void Parser::parser_parameter(FuncType* func_type) {
   Type* base_type = parser_declspec();
   Token id;
   parser_declarator(base_type, id);
-  std::size_t hash_value = getstrHash(id.loc(), id.len());
-  CHECK(var_maps_.count(hash_value) != 0);
-  CHECK(parameter_maps_.insert({hash_value, var_maps_[hash_value]}).second);
-  func_type->parameter_types().push_back(var_maps_[hash_value]->type());
+  Var* var = symbols_.lookup(id.loc(), id.len());
+  CHECK(var != nullptr);
+  parameters_.push_back(var);
+  func_type->parameter_types().push_back(var->type());
 }
 
 // compoundStmt = (declaration | stmt)* "}"
-Expr* Parser::parser_compound_stmt() {
+Expr* Parser::parser_compound_stmt(bool new_scope) {
   CompoundStmtExpr* compound_stmt = ObjectManager::getInst().alloc_type<CompoundStmtExpr>();
-  NextExpr* head = new StmtExpr();
-  NextExpr* curr_stmt = head; 
-  while(!(startWithStr("}", lexer_) ||
+  if (new_scope) {
+    symbols_.enterScope();
+  }
+  // 出错时 FATAL 可能抛出异常, 哨兵节点放在栈上避免泄漏
+  StmtExpr head;
+  NextExpr* curr_stmt = &head;
+  while(!(isPunct(PunctKind::PUNCT_RBRACE, lexer_) ||
           lexer_.getCurrToken().kind() == TokenKind::TOKEN_ILLEGAL ||
           lexer_.getCurrToken().kind() == TokenKind::TOKEN_EOF)) {
-    if (startWithStr("int", lexer_)) {
+    if (isKeyword(KeywordKind::KEYWORD_INT, lexer_)) {
       curr_stmt->next() = parser_declaration();
     } else {
       curr_stmt->next() = parser_stmt();
     }
     curr_stmt = dynamic_cast<NextExpr*>(curr_stmt->getNext());
   }
-  startWithStr("}", "compound", lexer_);
+  expectPunct(PunctKind::PUNCT_RBRACE, "compound", lexer_);
   lexer_.consumerToken();
-  compound_stmt->stmts() = head->getNext();
-  head->next() = nullptr;
-  delete head;
+  if (new_scope) {
+    symbols_.leaveScope();
+  }
+  compound_stmt->stmts() = head.getNext();
   return compound_stmt;
 }
 
@@ -258,22 +300,21 @@ Expr* Parser::parser_compound_stmt() {
 Expr* Parser::parser_declaration() {
   Type* base_type = parser_declspec();
   int count = 0;
-  NextExpr* head = new StmtExpr();
-  NextExpr* curr = head;
-  while (!startWithStr(";", lexer_)) {
+  StmtExpr head;
+  NextExpr* curr = &head;
+  while (!isPunct(PunctKind::PUNCT_SEMI, lexer_)) {
     // 解析 int a, *b, c=5; 跳过第一个 ","
     if (count > 0) {
-      if (startWithStr(",", "declaration", lexer_)) {
+      if (expectPunct(PunctKind::PUNCT_COMMA, "declaration", lexer_)) {
         lexer_.consumerToken();
       }
     }
     count++;
     Token id;
     parser_declarator(base_type, id);
-    std::size_t key = getstrHash(id.loc(), id.len());
-    CHECK(var_maps_.count(key));
-    Var* var = var_maps_[key];
-    if (startWithStr("=", lexer_)) {
+    Var* var = symbols_.lookup(id.loc(), id.len());
+    CHECK(var != nullptr);
+    if (isPunct(PunctKind::PUNCT_ASSIGN, lexer_)) {
       lexer_.consumerToken();
       Expr* left = ObjectManager::getInst().alloc_type<IdentityExpr>(var);
       static_cast<IdentityExpr*>(left)->type() = var->type();
@@ -281,14 +322,14 @@ Expr* Parser::parser_declaration() {
       StmtExpr* tmp = ObjectManager::getInst().alloc_type<StmtExpr>();
       CHECK(left->getType()->equal(right->getType()));
       tmp->left() = binaryOp(left, right, ExprKind::NODE_ASSIGN);
+      left->loc() = id.loc();
+      tmp->getLeft()->loc() = id.loc();
       dynamic_cast<BinaryExpr*>(tmp->getLeft())->type() = left->getType();
       curr->next() = tmp;
       curr = dynamic_cast<NextExpr*>(curr->getNext());
     }
   }
-  CompoundStmtExpr* declare = ObjectManager::getInst().alloc_type<CompoundStmtExpr>(head->getNext());
-  head->next() = nullptr;
-  delete head;
+  CompoundStmtExpr* declare = ObjectManager::getInst().alloc_type<CompoundStmtExpr>(head.getNext());
   return declare;
 }
 
@@ -300,70 +341,86 @@ Expr* Parser::parser_declaration() {
 //        "{" compound_stmt
 Expr* Parser::parser_stmt() {
   Expr* stmt;
-  
-  if (startWithStr("return", lexer_)) {
+  Token& tok = lexer_.getCurrToken();
+  const char* loc = tok.loc();
+  KeywordKind keyword = tok.kind() == TokenKind::TOKEN_KEYWORD ?
+    tok.keyword() : KeywordKind::KEYWORD_COUNT;
+
+  switch (keyword) {
+  case KeywordKind::KEYWORD_RETURN:
     lexer_.consumerToken();
     stmt =  ObjectManager::getInst().alloc_type<StmtExpr>();
     dynamic_cast<StmtExpr*>(stmt)->left() =
       unaryOp(parser_expr(), ExprKind::NODE_RETURN);
+    stmt->getLeft()->loc() = loc;
     static_cast<UnaryExpr*>(stmt->getLeft())->type() = stmt->getLeft()->getLeft()->getType();
-    startWithStr(";", "return", lexer_);
-    lexer_.consumerToken();
-  } else if (startWithStr("{", lexer_)) {
+    expectPunct(PunctKind::PUNCT_SEMI, "return", lexer_);
     lexer_.consumerToken();
-    stmt = parser_compound_stmt();
-  } else if (startWithStr("if", lexer_)) {
+    break;
+  case KeywordKind::KEYWORD_IF: {
     lexer_.consumerToken();
     IfExpr* if_stmt = ObjectManager::getInst().alloc_type<IfExpr>();
-    if (startWithStr("(", "if", lexer_)) {
+    if (expectPunct(PunctKind::PUNCT_LPAREN, "if", lexer_)) {
       lexer_.consumerToken();
       if_stmt->cond() = parser_expr();
-      startWithStr(")", "if", lexer_);
+      expectPunct(PunctKind::PUNCT_RPAREN, "if", lexer_);
       lexer_.consumerToken();
       if_stmt->then() = parser_stmt();
-      if (startWithStr("else", lexer_)) {
+      if (isKeyword(KeywordKind::KEYWORD_ELSE, lexer_)) {
         lexer_.consumerToken();
         if_stmt->els() = parser_stmt();
       }
     }
     stmt = if_stmt;
-  } else if (startWithStr("for", lexer_)) {
+    break;
+  }
+  case KeywordKind::KEYWORD_FOR: {
     lexer_.consumerToken();
     ForExpr* for_stmt = ObjectManager::getInst().alloc_type<ForExpr>();
-    if (startWithStr("(", "for", lexer_)) {
+    if (expectPunct(PunctKind::PUNCT_LPAREN, "for", lexer_)) {
       lexer_.consumerToken();
-      if (!startWithStr(";", lexer_)) {
+      if (!isPunct(PunctKind::PUNCT_SEMI, lexer_)) {
         for_stmt->init() = parser_expr();
       }
-      startWithStr(";", "for", lexer_);
+      expectPunct(PunctKind::PUNCT_SEMI, "for", lexer_);
       lexer_.consumerToken();
-      if (!startWithStr(";", lexer_)) {
+      if (!isPunct(PunctKind::PUNCT_SEMI, lexer_)) {
         for_stmt->cond() = parser_expr();
       }
-      startWithStr(";", "for", lexer_);
+      expectPunct(PunctKind::PUNCT_SEMI, "for", lexer_);
       lexer_.consumerToken();
-      if (!startWithStr(")", lexer_)) {
+      if (!isPunct(PunctKind::PUNCT_RPAREN, lexer_)) {
         for_stmt->inc() = parser_expr();
       }
-      startWithStr(")", "for", lexer_);
+      expectPunct(PunctKind::PUNCT_RPAREN, "for", lexer_);
       lexer_.consumerToken();
       for_stmt->stmts() = parser_stmt();
     }
     stmt = for_stmt;
-  } else if (startWithStr("while", lexer_)) {
+    break;
+  }
+  case KeywordKind::KEYWORD_WHILE: {
     lexer_.consumerToken();
     WhileExpr* while_stmt = ObjectManager::getInst().alloc_type<WhileExpr>();
-    if (startWithStr("(", "while", lexer_)) {
+    if (expectPunct(PunctKind::PUNCT_LPAREN, "while", lexer_)) {
       lexer_.consumerToken();
       while_stmt->cond() = parser_expr();
-      startWithStr(")", "while", lexer_);
+      expectPunct(PunctKind::PUNCT_RPAREN, "while", lexer_);
       lexer_.consumerToken();
       while_stmt->stmts() = parser_stmt();
     }
     stmt = while_stmt;
-  } else {
+    break;
+  }
+  default:
+    if (isPunct(PunctKind::PUNCT_LBRACE, lexer_)) {
+      lexer_.consumerToken();
+      stmt = parser_compound_stmt();
+      stmt->loc() = loc;
+      break;
+    }
     // 空语句的处理逻辑 ;;
-    if (startWithStr(";", lexer_)) {
+    if (isPunct(PunctKind::PUNCT_SEMI, lexer_)) {
       lexer_.consumerToken();
       stmt = ObjectManager::getInst().alloc_type<StmtExpr>();
       return stmt;
@@ -371,9 +428,10 @@ Expr* Parser::parser_stmt() {
     stmt =  ObjectManager::getInst().alloc_type<StmtExpr>();
     stmt->kind() = ExprKind::NODE_STMT;
     dynamic_cast<StmtExpr*>(stmt)->left() = parser_expr();
-    startWithStr(";", "stmt", lexer_);
+    expectPunct(PunctKind::PUNCT_SEMI, "stmt", lexer_);
     lexer_.consumerToken();
   }
+  stmt->loc() = loc;
   return stmt;
 }
 
@@ -385,9 +443,11 @@ Expr* Parser::parser_expr() {
 
 Expr* Parser::parser_assign() {
   Expr* expr = parser_equality();
-  while(startWithStr("=", lexer_) ) {
+  while(isPunct(PunctKind::PUNCT_ASSIGN, lexer_)) {
+    const char* loc = lexer_.getCurrToken().loc();
     lexer_.consumerToken();
     expr = binaryOp(expr, parser_assign(), ExprKind::NODE_ASSIGN);
+    expr->loc() = loc;
     CHECK(expr->getLeft()->getType()->equal(expr->getRight()->getType()));
     static_cast<BinaryExpr*>(expr)->type() = expr->getLeft()->getType();
   }
@@ -397,15 +457,19 @@ Expr* Parser::parser_assign() {
 // assign = equality (= assign)*
 Expr* Parser::parser_equality() {
   Expr* expr = parser_relation();
-  while(startWithStr("==", lexer_) ||
-        startWithStr("!=", lexer_)) {
-    const char* curr_punct = lexer_.getCurrToken().loc();
-    lexer_.consumerToken();
-    if (Lexer::startWith(curr_punct, "==")) {
+  while(lexer_.getCurrToken().kind() == TokenKind::TOKEN_PUNCT) {
+    PunctKind punct = lexer_.getCurrToken().punct();
+    const char* loc = lexer_.getCurrToken().loc();
+    if (punct == PunctKind::PUNCT_EQ) {
+      lexer_.consumerToken();
       expr = binaryOp(expr, parser_relation(), ExprKind::NODE_EQ);
-    } else {
+    } else if (punct == PunctKind::PUNCT_NE) {
+      lexer_.consumerToken();
       expr = binaryOp(expr, parser_relation(), ExprKind::NODE_NE);
+    } else {
+      break;
     }
+    expr->loc() = loc;
     CHECK(expr->getLeft()->getType()->equal(expr->getRight()->getType()));
     static_cast<BinaryExpr*>(expr)->type() = expr->getLeft()->getType();
   }
@@ -415,26 +479,29 @@ Expr* Parser::parser_equality() {
 // relation = add ("<" add | ">" add | "<=" add | ">=" add)*
 Expr* Parser::parser_relation() {
   Expr* expr = parser_add();
-  while(startWithStr("<=", lexer_) ||
-        startWithStr(">=", lexer_) ||
-        startWithStr("<", lexer_) ||
-        startWithStr(">", lexer_)) {
-    const char* curr_punct = lexer_.getCurrToken().loc();
-    int curr_len = lexer_.getCurrToken().len();
-    lexer_.consumerToken();
-    if (curr_len == 1) {
-      if (Lexer::startWith(curr_punct, ">")) {
-        expr = binaryOp(parser_add(), expr, ExprKind::NODE_LT);
-      } else {
-        expr = binaryOp(expr, parser_add(), ExprKind::NODE_LT);
-      }
-    } else {
-      if (Lexer::startWith(curr_punct, ">=")) {
-        expr = binaryOp(parser_add(), expr, ExprKind::NODE_LE);
-      } else {
-        expr = binaryOp(expr, parser_add(), ExprKind::NODE_LE);
-      }
+  while(lexer_.getCurrToken().kind() == TokenKind::TOKEN_PUNCT) {
+    const char* loc = lexer_.getCurrToken().loc();
+    switch (lexer_.getCurrToken().punct()) {
+    case PunctKind::PUNCT_LT:
+      lexer_.consumerToken();
+      expr = binaryOp(expr, parser_add(), ExprKind::NODE_LT);
+      break;
+    case PunctKind::PUNCT_GT:
+      lexer_.consumerToken();
+      expr = binaryOp(parser_add(), expr, ExprKind::NODE_LT);
+      break;
+    case PunctKind::PUNCT_LE:
+      lexer_.consumerToken();
+      expr = binaryOp(expr, parser_add(), ExprKind::NODE_LE);
+      break;
+    case PunctKind::PUNCT_GE:
+      lexer_.consumerToken();
+      expr = binaryOp(parser_add(), expr, ExprKind::NODE_LE);
+      break;
+    default:
+      return expr;
     }
+    expr->loc() = loc;
     CHECK(expr->getLeft()->getType()->equal(expr->getRight()->getType()));
     static_cast<BinaryExpr*>(expr)->type() = expr->getLeft()->getType();
   }
@@ -444,17 +511,21 @@ Expr* Parser::parser_relation() {
 // add = mul ("+" mul | "-" mul)*
 Expr* Parser::parser_add() {
   Expr* expr = parser_mul();
-  while(startWithStr("+", lexer_) || 
-        startWithStr("-", lexer_)) {
-    char punct = *(lexer_.getCurrToken().loc());
-    lexer_.consumerToken();
-    Expr* left = expr;
-    Expr* right = parser_mul();
-    if (punct == '+') {
-      expr = newAdd(left, right);
-    } else {
-      expr = newSub(left, right);
+  while(lexer_.getCurrToken().kind() == TokenKind::TOKEN_PUNCT) {
+    const char* loc = lexer_.getCurrToken().loc();
+    switch (lexer_.getCurrToken().punct()) {
+    case PunctKind::PUNCT_PLUS:
+      lexer_.consumerToken();
+      expr = newAdd(expr, parser_mul());
+      break;
+    case PunctKind::PUNCT_MINUS:
+      lexer_.consumerToken();
+      expr = newSub(expr, parser_mul());
+      break;
+    default:
+      return expr;
     }
+    expr->loc() = loc;
   }
   return expr;
 }
@@ -462,15 +533,21 @@ Expr* Parser::parser_add() {
 // mul = unary ("*" unary | "/" unary)*
 Expr* Parser::parser_mul() {
   Expr* expr = parser_unary();
-  while(startWithStr("*", lexer_) || 
-        startWithStr("/", lexer_)) {
-    char punct = *(lexer_.getCurrToken().loc());
-    lexer_.consumerToken();
-    if (punct == '*') {
+  while(lexer_.getCurrToken().kind() == TokenKind::TOKEN_PUNCT) {
+    const char* loc = lexer_.getCurrToken().loc();
+    switch (lexer_.getCurrToken().punct()) {
+    case PunctKind::PUNCT_STAR:
+      lexer_.consumerToken();
       expr = binaryOp(expr, parser_unary(), ExprKind::NODE_MUL);
-    } else {
+      break;
+    case PunctKind::PUNCT_SLASH:
+      lexer_.consumerToken();
       expr = binaryOp(expr, parser_unary(), ExprKind::NODE_DIV);
+      break;
+    default:
+      return expr;
     }
+    expr->loc() = loc;
     static_cast<BinaryExpr*>(expr)->type() = expr->getLeft()->getType();
   }
   return expr;
@@ -479,32 +556,42 @@ Expr* Parser::parser_mul() {
 // unary = ("+" | "-" | "*" | "&")unary | postfix
 Expr* Parser::parser_unary() {
   Expr* expr;
-  if (startWithStr("+", lexer_) || 
-      startWithStr("-", lexer_) || 
-      startWithStr("*", lexer_) ||
-      startWithStr("&", lexer_)) {
-    char punct = *(lexer_.getCurrToken().loc());
+  if (lexer_.getCurrToken().kind() != TokenKind::TOKEN_PUNCT) {
+    return parser_postfix();
+  }
+  const char* loc = lexer_.getCurrToken().loc();
+  switch (lexer_.getCurrToken().punct()) {
+  case PunctKind::PUNCT_PLUS:
     lexer_.consumerToken();
-    if (punct == '+') {
-      expr = parser_unary();
-    } else if (punct == '-'){
-      expr = unaryOp(parser_unary(), ExprKind::NODE_NEG);
-      static_cast<UnaryExpr*>(expr)->type() = expr->getLeft()->getType();
-    } else if (punct == '*'){
-      expr = unaryOp(parser_unary(), ExprKind::NODE_DEREF);
-      CHECK(expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR ||
-            expr->getLeft()->getType()->kind() == TypeKind::TYPE_ARRAY)
-      static_cast<UnaryExpr*>(expr)->type() = 
-        (expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR?
-         dynamic_cast<PtrType*>(expr->getLeft()->getType())->base_type():
-         dynamic_cast<ArrayType*>(expr->getLeft()->getType())->base_type());
-    } else {
-      expr = unaryOp(parser_unary(), ExprKind::NODE_ADDR);
-      Type* ptr = ObjectManager::getInst().alloc_type<PtrType>(expr->getLeft()->getType());
-      // Type* ptr = new PtrType(expr->getLeft()->getType());
-      static_cast<UnaryExpr*>(expr)->type() = ptr;
-    }
-  } else {
+    expr = parser_unary();
+    break;
+  case PunctKind::PUNCT_MINUS:
+    lexer_.consumerToken();
+    expr = unaryOp(parser_unary(), ExprKind::NODE_NEG);
+    expr->loc() = loc;
+    static_cast<UnaryExpr*>(expr)->type() = expr->getLeft()->getType();
+    break;
+  case PunctKind::PUNCT_STAR:
+    lexer_.consumerToken();
+    expr = unaryOp(parser_unary(), ExprKind::NODE_DEREF);
+    expr->loc() = loc;
+    CHECK(expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR ||
+          expr->getLeft()->getType()->kind() == TypeKind::TYPE_ARRAY)
+    static_cast<UnaryExpr*>(expr)->type() = 
+      (expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR?
+       dynamic_cast<PtrType*>(expr->getLeft()->getType())->base_type():
+       dynamic_cast<ArrayType*>(expr->getLeft()->getType())->base_type());
+    break;
+  case PunctKind::PUNCT_AMP: {
+    lexer_.consumerToken();
+    expr = unaryOp(parser_unary(), ExprKind::NODE_ADDR);
+    expr->loc() = loc;
+    Type* ptr = ObjectManager::getInst().alloc_type<PtrType>(expr->getLeft()->getType());
+    // Type* ptr = new PtrType(expr->getLeft()->getType());
+    static_cast<UnaryExpr*>(expr)->type() = ptr;
+    break;
+  }
+  default:
     expr = parser_postfix();
   }
   return expr;
@@ -513,17 +600,20 @@ Expr* Parser::parser_unary() {
 // postfix = primary ("[" expr "]")*
 Expr* Parser::parser_postfix() {
   Expr* expr = parser_primary();
-  while (startWithStr("[", lexer_)) {
+  while (isPunct(PunctKind::PUNCT_LBRACKET, lexer_)) {
+    const char* loc = lexer_.getCurrToken().loc();
     lexer_.consumerToken();
     Expr* idx = parser_expr();
     expr = ObjectManager::getInst().alloc_type<UnaryExpr>(ExprKind::NODE_DEREF, newAdd(expr, idx));
+    expr->loc() = loc;
+    expr->getLeft()->loc() = loc;
     CHECK(expr->getLeft()->getType()->kind() == TypeKind::TYPE_ARRAY ||
           expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR);
     Type* base_type = expr->getLeft()->getType()->kind() == TypeKind::TYPE_PTR?
        dynamic_cast<PtrType*>(expr->getLeft()->getType())->base_type():
        dynamic_cast<ArrayType*>(expr->getLeft()->getType())->base_type();
     dynamic_cast<UnaryExpr*>(expr)->type() = base_type;
-    CHECK(startWithStr("]", lexer_));
+    CHECK(isPunct(PunctKind::PUNCT_RBRACKET, lexer_));
     lexer_.consumerToken();
   }
   return expr;
@@ -532,45 +622,41 @@ Expr* Parser::parser_postfix() {
 // primary = num | "("expr")" | "sizeof" unary | var | funtioncall
 Expr* Parser::parser_primary() {
   Expr* expr;
+  const char* loc = lexer_.getCurrToken().loc();
   if (lexer_.getCurrToken().kind() == TokenKind::TOKEN_NUM) {
     expr = ObjectManager::getInst().alloc_type<NumExpr>(lexer_.getCurrToken().value());
+    expr->loc() = loc;
     static_cast<NumExpr*>(expr)->type() = Type::typeInt;
     lexer_.consumerToken();
   } else if (lexer_.getCurrToken().kind() == TokenKind::TOKEN_ID) {
     Token id = lexer_.getCurrToken();
     lexer_.consumerToken();
-    if (startWithStr("(", lexer_)) {
+    if (isPunct(PunctKind::PUNCT_LPAREN, lexer_)) {
       lexer_.consumerToken();
       expr = parser_call(id);
     } else {
-      std::size_t hash_value = getstrHash(id.loc(), id.len());
-      Var* var = nullptr;
-      std::string id_name(id.loc(), id.len());
-      if (var_maps_.count(hash_value) == 0 &&
-          parameter_maps_.count(hash_value) == 0) {
+      Var* var = symbols_.lookup(id.loc(), id.len());
+      if (!var) {
+        std::string id_name(id.loc(), id.len());
         FATAL("identify: %s is used before define", id_name.c_str());
-      } else {
-        if (var_maps_.count(hash_value) != 0) {
-          var = var_maps_[hash_value];
-        } else {
-          var = parameter_maps_[hash_value];
-        }
       }
       IdentityExpr* id_expr = ObjectManager::getInst().alloc_type<IdentityExpr>(var);
       id_expr->type() = var->type();
+      id_expr->loc() = loc;
       expr = id_expr;
     }
-  } else if (startWithStr("sizeof", lexer_)) {
+  } else if (isKeyword(KeywordKind::KEYWORD_SIZEOF, lexer_)) {
     lexer_.consumerToken();
     expr = parser_unary();
     expr = ObjectManager::getInst().alloc_type<NumExpr>(expr->getType()->size());
     dynamic_cast<NumExpr*>(expr)->type() = Type::typeInt;
+    expr->loc() = loc;
     return expr;
   } else {
-    startWithStr("(", "parser_primary", lexer_);
+    expectPunct(PunctKind::PUNCT_LPAREN, "parser_primary", lexer_);
     lexer_.consumerToken();
     expr = parser_expr();
-    startWithStr(")", "parser_primary", lexer_);
+    expectPunct(PunctKind::PUNCT_RPAREN, "parser_primary", lexer_);
     lexer_.consumerToken();
   }
   return expr;
@@ -579,11 +665,12 @@ Expr* Parser::parser_primary() {
 // funcall = ident "(" (expr ("," expr)*)? ")"
 Expr* Parser::parser_call(Token& id) {
   CallExpr* expr = ObjectManager::getInst().alloc_type<CallExpr>(id.loc(), id.len());
-  if (!startWithStr(")", lexer_)) {
+  expr->loc() = id.loc();
+  if (!isPunct(PunctKind::PUNCT_RPAREN, lexer_)) {
     expr->args().push_back(parser_expr());
   }
-  while(!startWithStr(")", lexer_)) {
-    CHECK(startWithStr(",", lexer_));
+  while(!isPunct(PunctKind::PUNCT_RPAREN, lexer_)) {
+    CHECK(isPunct(PunctKind::PUNCT_COMMA, lexer_));
     lexer_.consumerToken();
     expr->args().push_back(parser_expr());
   }
@@ -3,15 +3,28 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include "preprocessor.h"
+#include "scope.h"
 #include "token.h"
 #include "type.h"
 #include <cstddef>
+#include <string>
+#include <unordered_set>
 
 namespace rvcc {
   class Parser{
     public:
-      Parser(const char* buffer):lexer_(buffer){}
+      Parser(const char* buffer,
+             const std::vector<std::string>& include_dirs = {}):
+        lexer_(buffer, include_dirs), started_(false){}
+      // 接下来只解析 buffer 的 [begin, end)
+      void setRange(const char* begin, const char* end);
       Ast* parser_program();
+      // 流式解析, 每次解析一个函数, 输入结束时返回 nullptr
+      Function* parser_next_function();
+      // 流式编译不构建 Ast, 在这里记录已经定义的函数名, 与 Ast::insert 一样不允许重名
+      void defineFunction(Function* func);
+      static void insertFunction(Ast* ast, Function* func);
       static Expr* binaryOp(Expr* left, Expr*right, ExprKind kind);
       static Expr* unaryOp(Expr* left, ExprKind kind);
       static Expr* newAdd(Expr* left, Expr* right);
@@ -22,7 +35,8 @@ namespace rvcc {
       Function* parser_function();
       void parser_parameters(FuncType* func_type);
       void parser_parameter(FuncType* func_type);
-      Expr* parser_compound_stmt();
+      // 函数体与参数共用一个作用域, 其他 compound stmt 进入新的作用域
+      Expr* parser_compound_stmt(bool new_scope = true);
       Expr* parser_declaration();
       Type* parser_declarator(Type* base_type, Token& id);
       Type* parser_suffix(Type* base_type, Token& id);
@@ -38,11 +52,15 @@ namespace rvcc {
       Expr* parser_postfix();
       Expr* parser_primary();
       Expr* parser_call(Token& id);
-      Lexer lexer_;
-      std::map<std::size_t, Var*> parameter_maps_;
-      std::map<std::size_t, Var*> var_maps_;
+      // 预处理器本身也是 Lexer, parser 通过它读取展开后的 token
+      Preprocessor lexer_;
+      SymbolTable symbols_;
+      std::vector<Var*> parameters_;
+      std::vector<Var*> vars_;
       int var_index_;
       int var_offset_;
+      bool started_;
+      std::unordered_set<std::string> function_names_;
   };
 }
 #endif
\ No newline at end of file
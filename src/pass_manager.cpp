@@ -0,0 +1,291 @@
+#include "pass_manager.h"
+#include "ast.h"
+#include "callargs.h"
+#include "dce.h"
+#include "fold.h"
+#include "gvn.h"
+#include "ir_builder.h"
+#include "isel.h"
+#include "mir.h"
+#include "logger.h"
+#include "peephole.h"
+#include "promote.h"
+#include "regalloc.h"
+#include "shrinkwrap.h"
+#include "strength.h"
+#include "verifier.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace rvcc {
+
+bool Pass::required() const {
+  return false;
+}
+
+bool Pass::run(Function* func) const {
+  return false;
+}
+
+bool Pass::run(MFunction& func) const {
+  return false;
+}
+
+bool Pass::run(IrFunction& func) const {
+  return false;
+}
+
+namespace {
+
+constexpr unsigned kO1 = levelMask(OptLevel::OPT_O1);
+constexpr unsigned kO2 = levelMask(OptLevel::OPT_O2);
+constexpr unsigned kOs = levelMask(OptLevel::OPT_OS);
+
+bool verifyUnit(Function* func, std::string& error) {
+  return verifyFunction(func, error);
+}
+
+bool verifyUnit(MFunction& func, std::string& error) {
+  return verifyMachineFunction(func, error);
+}
+
+bool verifyUnit(IrFunction& func, std::string& error) {
+  return verifyIrFunction(func, error);
+}
+
+} // namespace
+
+/*
+-O1 只运行便宜并且总是有收益的 pass
+-O2 再加上全局值编号, 强度削弱和 shrink-wrapping
+-Os 与 O2 的 pass 相同, 但强度削弱按指令条数选择序列, 只在更短时替换 (见 strength.h),
+    其余 pass 都不会增大代码
+*/
+const std::vector<PassInfo>& PassManager::registry() {
+  static const std::vector<PassInfo> passes = {
+    {constantFoldPass(), "fold constant subtrees and simplify algebraic identities", kO1 | kO2 | kOs},
+    {promotePass(), "keep local scalars whose address is not taken in registers", kO1 | kO2 | kOs},
+    {ssaPass(), "build SSA IR from the AST and generate machine code from the IR", kO1 | kO2 | kOs},
+    {gvnPass(), "reuse redundant computations and loads by dominator-based value numbering", kO2 | kOs},
+    {dcePass(), "remove unreachable blocks, dead stores and unused side-effect-free values", kO1 | kO2 | kOs},
+    {instructionSelectPass(), "select immediate and addressing-mode instructions by tree-pattern costs", kO1 | kO2 | kOs},
+    {fuseBranchPass(), "branch on comparisons directly in if for while conditions", kO1 | kO2 | kOs},
+    {callArgsPass(), "evaluate call arguments directly into argument registers", kO1 | kO2 | kOs},
+    {strengthReducePass(), "replace multiplication and division by constants with shifts and multiply-high", kO2 | kOs},
+    {regAllocPass(), "linear-scan register allocation of expression temporaries", kO1 | kO2 | kOs},
+    {peepholePass(), "remove and rewrite redundant adjacent instructions", kO1 | kO2 | kOs},
+    {shrinkWrapPass(), "skip the frame in leaf functions and move the prologue to paths that need it", kO2 | kOs},
+  };
+  return passes;
+}
+
+PassManager::PassManager() {
+  reset();
+}
+
+void PassManager::reset() {
+  level_ = OptLevel::OPT_O0;
+  overrides_.assign(registry().size(), -1);
+  bisect_limit_ = -1;
+  bisect_count_ = 0;
+  time_passes_ = false;
+#ifdef NDEBUG
+  verify_ = false;
+#else
+  verify_ = true;
+#endif
+  timings_.assign(registry().size(), Timing{0, 0, 0});
+  lowerings_.assign(registry().size(), false);
+  stats_.assign(registry().size(), {});
+}
+
+OptLevel& PassManager::level() {
+  return level_;
+}
+
+long& PassManager::bisectLimit() {
+  return bisect_limit_;
+}
+
+bool& PassManager::timePasses() {
+  return time_passes_;
+}
+
+bool& PassManager::verify() {
+  return verify_;
+}
+
+bool PassManager::parseFlag(const std::string& flag) {
+  static const char* levels[] = {"-O0", "-O1", "-O2", "-Os"};
+  for (int i = 0; i < static_cast<int>(OptLevel::OPT_COUNT); i++) {
+    if (flag == levels[i]) {
+      level_ = static_cast<OptLevel>(i);
+      return true;
+    }
+  }
+  if (flag == "-O") {
+    level_ = OptLevel::OPT_O1;
+    return true;
+  }
+  const std::string bisect = "-opt-bisect-limit=";
+  if (flag.compare(0, bisect.size(), bisect) == 0) {
+    bisect_limit_ = strtol(flag.c_str() + bisect.size(), nullptr, 10);
+    return true;
+  }
+  if (flag.compare(0, 2, "-f") != 0) {
+    return false;
+  }
+  bool enable = flag.compare(0, 5, "-fno-") != 0;
+  std::string name = flag.substr(enable ? 2 : 5);
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    if (name == passes[i].pass->name()) {
+      overrides_[i] = enable ? 1 : 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PassManager::enabled(const Pass* pass) const {
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].pass == pass) {
+      if (overrides_[i] >= 0) {
+        return overrides_[i] == 1;
+      }
+      return passes[i].levels & levelMask(level_);
+    }
+  }
+  return false;
+}
+
+bool PassManager::shouldRun(const Pass* pass, const std::string& func_name) {
+  if (bisect_limit_ < 0 || pass->required()) {
+    return true;
+  }
+  bisect_count_++;
+  bool run = bisect_count_ <= bisect_limit_;
+  // 与 LLVM 相同的格式, 不加日志前缀; 经过 Logger 写入当前线程的诊断信息
+  Logger::getInst().forward(std::string("BISECT: ") + (run ? "running" : "NOT running") +
+                            " pass (" + std::to_string(bisect_count_) + ") " + pass->name() +
+                            " on function (" + func_name + ")\n", false);
+  return run;
+}
+
+template<typename Unit>
+void PassManager::runPasses(PassKind kind, Unit& unit, const std::string& func_name) {
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    const Pass* pass = passes[i].pass;
+    if (pass->kind() != kind || !enabled(pass) || !shouldRun(pass, func_name)) {
+      continue;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    bool changed = pass->run(unit);
+    if (time_passes_) {
+      auto end = std::chrono::steady_clock::now();
+      timings_[i].seconds += std::chrono::duration<double>(end - begin).count();
+    }
+    timings_[i].runs++;
+    timings_[i].changed += changed;
+    std::string error;
+    if (changed && verify_ && !verifyUnit(unit, error)) {
+      FATAL("pass %s broke function %s: %s", pass->name(), func_name.c_str(),
+            error.c_str());
+    }
+  }
+}
+
+void PassManager::runAst(Function* func, const std::string& func_name) {
+  runPasses(PassKind::PASS_AST, func, func_name);
+}
+
+void PassManager::runMachine(MFunction& func) {
+  runPasses(PassKind::PASS_MACHINE, func, func.name);
+}
+
+void PassManager::runIr(IrFunction& func) {
+  runPasses(PassKind::PASS_IR, func, func.name());
+}
+
+void PassManager::beginFunction(const std::string& func_name) {
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    const Pass* pass = passes[i].pass;
+    lowerings_[i] = pass->kind() == PassKind::PASS_LOWERING && enabled(pass) &&
+                    shouldRun(pass, func_name);
+    timings_[i].runs += lowerings_[i];
+  }
+}
+
+bool PassManager::lowering(const Pass* pass) const {
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].pass == pass) {
+      return lowerings_[i];
+    }
+  }
+  return false;
+}
+
+std::string PassManager::timingReport() const {
+  const std::vector<PassInfo>& passes = registry();
+  double total = 0;
+  for (auto& timing: timings_) {
+    total += timing.seconds;
+  }
+  char line[256];
+  snprintf(line, sizeof(line), "%-24s %8s %8s %12s %7s\n",
+           "pass", "runs", "changed", "time(ms)", "%");
+  std::string out = line;
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    const Timing& timing = timings_[i];
+    if (timing.runs == 0) {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%-24s %8zu %8zu %12.3f %6.1f%%\n",
+             passes[i].pass->name(), timing.runs, timing.changed,
+             timing.seconds * 1000, total > 0 ? timing.seconds * 100 / total : 0.0);
+    out += line;
+  }
+  snprintf(line, sizeof(line), "%-24s %8s %8s %12.3f\n", "total", "", "", total * 1000);
+  out += line;
+  return out;
+}
+
+void PassManager::addStat(const Pass* pass, const std::string& name,
+                          std::size_t count) {
+  const std::vector<PassInfo>& passes = registry();
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].pass != pass) {
+      continue;
+    }
+    for (auto& stat: stats_[i]) {
+      if (stat.first == name) {
+        stat.second += count;
+        return;
+      }
+    }
+    stats_[i].emplace_back(name, count);
+    return;
+  }
+}
+
+std::string PassManager::statsReport() const {
+  const std::vector<PassInfo>& passes = registry();
+  char line[256];
+  snprintf(line, sizeof(line), "%-24s %-24s %8s\n", "pass", "statistic", "count");
+  std::string out = line;
+  for (std::size_t i = 0; i < passes.size(); i++) {
+    for (auto& stat: stats_[i]) {
+      snprintf(line, sizeof(line), "%-24s %-24s %8zu\n", passes[i].pass->name(),
+               stat.first.c_str(), stat.second);
+      out += line;
+    }
+  }
+  return out;
+}
+
+} // namespace rvcc
@@ -0,0 +1,111 @@
+#ifndef __PASS_MANAGER_H
+#define __PASS_MANAGER_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+class Function;
+class IrFunction;
+struct MFunction;
+
+enum class OptLevel:int {
+  OPT_O0 = 0,
+  OPT_O1,
+  OPT_O2,
+  OPT_OS,               // 与 O2 相同, 但不选择会增大代码的指令序列
+  OPT_COUNT
+};
+
+// pass 作用的对象
+enum class PassKind:int {
+  PASS_AST = 0,         // codegen 之前, 作用于 Function
+  PASS_MACHINE,         // codegen 之后 Target 输出之前, 作用于 MFunction
+  PASS_LOWERING,        // codegen 中的指令选择, 不单独运行, 由 codegen 通过 lowering() 查询
+  PASS_IR,              // 生成 SSA IR 之后, lowering 到 MIR 之前, 作用于 IrFunction
+};
+
+/*
+一个优化 pass, 没有可变的成员, 可以被多个线程共享
+run 返回函数是否被修改, 只有修改过的函数才需要重新检查
+*/
+class Pass {
+  public:
+    virtual ~Pass() {}
+    virtual const char* name() const = 0;
+    virtual PassKind kind() const = 0;
+    // 生成正确的代码所必需的 pass, 不受 -opt-bisect-limit 限制
+    virtual bool required() const;
+    virtual bool run(Function* func) const;
+    virtual bool run(MFunction& func) const;
+    virtual bool run(IrFunction& func) const;
+};
+
+struct PassInfo {
+  const Pass* pass;
+  const char* description;
+  unsigned levels;      // 默认启用该 pass 的优化级别, 见 levelMask
+};
+
+constexpr unsigned levelMask(OptLevel level) {
+  return 1u << static_cast<int>(level);
+}
+
+/*
+按优化级别组织的 pass 流水线
+  -O0 -O1 -O2 -Os 选择默认启用的 pass, -f<pass> -fno-<pass> 单独开关
+  -mllvm -opt-bisect-limit=N 只运行前 N 次 pass, 用于二分定位出错的 pass
+  --time-passes 统计每个 pass 的耗时, --pass-stats 输出 pass 内部的计数 (见 addStat)
+  debug 构建 (没有定义 NDEBUG) 时每个修改过函数的 pass 之后运行 verifier
+*/
+class PassManager {
+  public:
+    PassManager();
+    OptLevel& level();
+    // 解析 -O<level> -f<pass> -fno-<pass> -opt-bisect-limit=N, 不认识时返回 false
+    bool parseFlag(const std::string& flag);
+    bool enabled(const Pass* pass) const;
+    long& bisectLimit();        // 小于 0 时不限制
+    bool& timePasses();
+    bool& verify();
+    void runAst(Function* func, const std::string& func_name);
+    void runMachine(MFunction& func);
+    void runIr(IrFunction& func);
+    // 开始 codegen 一个函数, 决定该函数启用哪些 PASS_LOWERING (计入 bisect)
+    void beginFunction(const std::string& func_name);
+    bool lowering(const Pass* pass) const;
+    std::string timingReport() const;
+    // pass 内部的计数, 例如 peephole 每条规则的命中次数, 按第一次出现的顺序输出
+    void addStat(const Pass* pass, const std::string& name, std::size_t count);
+    std::string statsReport() const;
+    // 恢复默认设置, 清空统计
+    void reset();
+    // 全部 pass, 按运行顺序排列
+    static const std::vector<PassInfo>& registry();
+  private:
+    struct Timing {
+      double seconds;
+      std::size_t runs;
+      std::size_t changed;
+    };
+    // 决定是否运行第 bisect_count_ 次 pass
+    bool shouldRun(const Pass* pass, const std::string& func_name);
+    template<typename Unit>
+    void runPasses(PassKind kind, Unit& unit, const std::string& func_name);
+    OptLevel level_;
+    std::vector<int> overrides_;  // 与 registry 对应, -1 未设置, 0 关闭, 1 开启
+    long bisect_limit_;
+    long bisect_count_;
+    bool time_passes_;
+    bool verify_;
+    std::vector<Timing> timings_;
+    std::vector<bool> lowerings_;  // 与 registry 对应, 当前函数启用的 PASS_LOWERING
+    std::vector<std::vector<std::pair<std::string, std::size_t>>> stats_; // 与 registry 对应
+};
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,506 @@
+#include "pch.h"
+#include "logger.h"
+#include "object_manager.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rvcc {
+
+static const char kPchMagic[8] = {'R', 'V', 'C', 'C', 'P', 'C', 'H', '\0'};
+
+std::uint32_t PchWriter::addString(const char* str, std::size_t len) {
+  std::uint32_t off = strings_.size();
+  strings_.append(str, len);
+  strings_.push_back('\0');
+  return off;
+}
+
+std::uint32_t PchWriter::addList(const std::vector<std::int32_t>& list) {
+  std::uint32_t begin = lists_.size();
+  for (auto elem: list) {
+    lists_.push_back(static_cast<std::uint32_t>(elem));
+  }
+  return begin;
+}
+
+// 先写入依赖的类型, 保证加载时按下标顺序构造即可
+std::int32_t PchWriter::typeIndex(Type* type) {
+  if (!type) {
+    return kPchNull;
+  }
+  if (type == Type::typeInt) {
+    return 0;
+  }
+  auto iter = type_ids_.find(type);
+  if (iter != type_ids_.end()) {
+    return iter->second;
+  }
+  PchType record{};
+  record.kind = static_cast<std::uint32_t>(type->kind());
+  record.size = type->size();
+  record.base = kPchNull;
+  switch (type->kind()) {
+  case TypeKind::TYPE_INT:
+    break;
+  case TypeKind::TYPE_PTR:
+    record.base = typeIndex(dynamic_cast<PtrType*>(type)->base_type());
+    break;
+  case TypeKind::TYPE_ARRAY:
+    record.base = typeIndex(dynamic_cast<ArrayType*>(type)->base_type());
+    record.len = dynamic_cast<ArrayType*>(type)->len();
+    break;
+  case TypeKind::TYPE_FUNC: {
+    FuncType* func_type = dynamic_cast<FuncType*>(type);
+    record.base = typeIndex(func_type->ret_type());
+    std::vector<std::int32_t> params;
+    for (auto param: func_type->parameter_types()) {
+      params.push_back(typeIndex(param));
+    }
+    record.list_begin = addList(params);
+    record.list_count = params.size();
+    record.name_off = addString(func_type->name(), func_type->name_len());
+    record.name_len = func_type->name_len();
+    break;
+  }
+  default:
+    FATAL("pch can't serialize type %s", type->kindName());
+  }
+  std::int32_t index = types_.size();
+  types_.push_back(record);
+  type_ids_[type] = index;
+  return index;
+}
+
+std::int32_t PchWriter::varIndex(Var* var) {
+  auto iter = var_ids_.find(var);
+  if (iter != var_ids_.end()) {
+    return iter->second;
+  }
+  PchVar record{};
+  record.name_off = addString(var->getName(), var->name_len());
+  record.name_len = var->name_len();
+  record.type = typeIndex(var->type());
+  record.index = var->index();
+  record.offset = var->offset();
+  record.scope_depth = var->scope_depth();
+  record.live_begin = var->live_begin();
+  record.live_end = var->live_end();
+  std::int32_t index = vars_.size();
+  vars_.push_back(record);
+  var_ids_[var] = index;
+  return index;
+}
+
+std::int32_t PchWriter::nodeIndex(Expr* expr) {
+  if (!expr) {
+    return kPchNull;
+  }
+  std::int32_t index = nodes_.size();
+  nodes_.emplace_back();
+  PchNode record{};
+  record.kind = static_cast<std::uint32_t>(expr->kind());
+  record.type = typeIndex(expr->getType());
+  for (auto& child: record.child) {
+    child = kPchNull;
+  }
+  record.next = kPchNull;
+  switch (expr->kind()) {
+  case ExprKind::NODE_NUM:
+    record.value = expr->value();
+    break;
+  case ExprKind::NODE_ID:
+    record.value = varIndex(dynamic_cast<IdentityExpr*>(expr)->var());
+    break;
+  case ExprKind::NODE_CALL: {
+    CallExpr* call = dynamic_cast<CallExpr*>(expr);
+    std::string name = call->getFuncName();
+    record.name_off = addString(name.c_str(), name.size());
+    record.name_len = name.size();
+    std::vector<std::int32_t> args;
+    for (auto arg: call->args()) {
+      args.push_back(nodeIndex(arg));
+    }
+    record.list_begin = addList(args);
+    record.list_count = args.size();
+    break;
+  }
+  case ExprKind::NODE_STMT:
+    record.child[0] = nodeIndex(expr->getLeft());
+    break;
+  case ExprKind::NODE_COMPOUND:
+    record.child[0] = nodeIndex(expr->getStmts());
+    break;
+  case ExprKind::NODE_IF:
+    record.child[0] = nodeIndex(expr->getCond());
+    record.child[1] = nodeIndex(expr->getThen());
+    record.child[2] = nodeIndex(expr->getEls());
+    break;
+  case ExprKind::NODE_FOR:
+    record.child[0] = nodeIndex(expr->getInit());
+    record.child[1] = nodeIndex(expr->getCond());
+    record.child[2] = nodeIndex(expr->getInc());
+    record.child[3] = nodeIndex(expr->getStmts());
+    break;
+  case ExprKind::NODE_WHILE:
+    record.child[0] = nodeIndex(expr->getCond());
+    record.child[1] = nodeIndex(expr->getStmts());
+    break;
+  default:
+    record.child[0] = nodeIndex(expr->getLeft());
+    record.child[1] = nodeIndex(expr->getRight());
+    break;
+  }
+  record.next = nodeIndex(expr->getNext());
+  nodes_[index] = record;
+  return index;
+}
+
+bool PchWriter::write(Ast* ast, const char* path) {
+  // 下标 0 固定为 int
+  PchType int_type{};
+  int_type.kind = static_cast<std::uint32_t>(TypeKind::TYPE_INT);
+  int_type.size = Type::typeInt->size();
+  int_type.base = kPchNull;
+  types_.push_back(int_type);
+
+  for (auto& elem: ast->functions()) {
+    Function* func = elem.second;
+    PchFunction record{};
+    record.name_off = addString(func->name(), func->name_len());
+    record.name_len = func->name_len();
+    record.type = typeIndex(func->type());
+    std::vector<std::int32_t> vars;
+    for (auto var: func->vars()) {
+      vars.push_back(varIndex(var));
+    }
+    record.vars_begin = addList(vars);
+    record.vars_count = vars.size();
+    std::vector<std::int32_t> params;
+    for (auto param: func->parameters()) {
+      params.push_back(varIndex(param));
+    }
+    record.params_begin = addList(params);
+    record.params_count = params.size();
+    record.body = nodeIndex(func->body());
+    funcs_.push_back(record);
+  }
+
+  auto align = [](std::uint32_t off) {
+    return (off + 7) / 8 * 8;
+  };
+  PchHeader header{};
+  memcpy(header.magic, kPchMagic, sizeof(kPchMagic));
+  header.version = kPchVersion;
+  std::uint32_t off = align(sizeof(PchHeader));
+  header.types_off = off;
+  header.num_types = types_.size();
+  off = align(off + types_.size() * sizeof(PchType));
+  header.vars_off = off;
+  header.num_vars = vars_.size();
+  off = align(off + vars_.size() * sizeof(PchVar));
+  header.nodes_off = off;
+  header.num_nodes = nodes_.size();
+  off = align(off + nodes_.size() * sizeof(PchNode));
+  header.funcs_off = off;
+  header.num_funcs = funcs_.size();
+  off = align(off + funcs_.size() * sizeof(PchFunction));
+  header.lists_off = off;
+  header.num_lists = lists_.size();
+  off = align(off + lists_.size() * sizeof(std::uint32_t));
+  header.strings_off = off;
+  header.strings_size = strings_.size();
+  header.file_size = off + strings_.size();
+
+  std::vector<char> image(header.file_size, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  memcpy(image.data() + header.types_off, types_.data(), types_.size() * sizeof(PchType));
+  memcpy(image.data() + header.vars_off, vars_.data(), vars_.size() * sizeof(PchVar));
+  memcpy(image.data() + header.nodes_off, nodes_.data(), nodes_.size() * sizeof(PchNode));
+  memcpy(image.data() + header.funcs_off, funcs_.data(), funcs_.size() * sizeof(PchFunction));
+  memcpy(image.data() + header.lists_off, lists_.data(), lists_.size() * sizeof(std::uint32_t));
+  memcpy(image.data() + header.strings_off, strings_.data(), strings_.size());
+
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    return false;
+  }
+  bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size();
+  return fclose(fp) == 0 && ok;
+}
+
+PchReader::PchReader(): base_(nullptr), size_(0), header_(nullptr) {}
+
+PchReader::~PchReader() {
+  if (base_) {
+    munmap(const_cast<char*>(base_), size_);
+  }
+}
+
+bool PchReader::load(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(PchHeader)) {
+    close(fd);
+    return false;
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<const char*>(addr);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<const PchHeader*>(base_);
+  if (memcmp(header_->magic, kPchMagic, sizeof(kPchMagic)) != 0 ||
+      header_->version != kPchVersion || header_->file_size != size_ ||
+      header_->num_types == 0 ||
+      !inRange(header_->types_off, header_->num_types, sizeof(PchType)) ||
+      !inRange(header_->vars_off, header_->num_vars, sizeof(PchVar)) ||
+      !inRange(header_->nodes_off, header_->num_nodes, sizeof(PchNode)) ||
+      !inRange(header_->funcs_off, header_->num_funcs, sizeof(PchFunction)) ||
+      !inRange(header_->lists_off, header_->num_lists, sizeof(std::uint32_t)) ||
+      !inRange(header_->strings_off, header_->strings_size, 1)) {
+    return false;
+  }
+  types_.assign(header_->num_types, nullptr);
+  vars_.assign(header_->num_vars, nullptr);
+  types_loading_.assign(header_->num_types, false);
+  nodes_loading_.assign(header_->num_nodes, false);
+  return true;
+}
+
+bool PchReader::inRange(std::uint32_t off, std::uint32_t count, std::size_t record_size) const {
+  // 64 位计算, 不会溢出; 表按记录大小对齐, 保证 mmap 之后的读取是对齐的
+  std::uint64_t end = static_cast<std::uint64_t>(off) +
+                      static_cast<std::uint64_t>(count) * record_size;
+  return off >= sizeof(PchHeader) && off % std::min<std::size_t>(record_size, 4) == 0 &&
+         end <= size_;
+}
+
+const std::uint32_t* PchReader::list(std::uint32_t begin, std::uint32_t count) const {
+  if (static_cast<std::uint64_t>(begin) + count > header_->num_lists) {
+    FATAL("corrupted pch: list [%u, +%u) out of range", begin, count);
+  }
+  return table<std::uint32_t>(header_->lists_off) + begin;
+}
+
+template<typename T>
+const T* PchReader::table(std::uint32_t off) const {
+  return reinterpret_cast<const T*>(base_ + off);
+}
+
+const char* PchReader::string(std::uint32_t off, std::uint32_t len) const {
+  if (static_cast<std::uint64_t>(off) + len >= header_->strings_size) {
+    FATAL("corrupted pch: string [%u, +%u) out of range", off, len);
+  }
+  if (base_[header_->strings_off + off + len] != '\0') {
+    FATAL("corrupted pch: string at %u is not terminated", off);
+  }
+  return base_ + header_->strings_off + off;
+}
+
+Type* PchReader::type(std::int32_t index) {
+  if (index == kPchNull) {
+    return nullptr;
+  }
+  if (index < 0 || static_cast<std::uint32_t>(index) >= header_->num_types) {
+    FATAL("corrupted pch: type index %d out of range", index);
+  }
+  if (index == 0) {
+    return Type::typeInt;
+  }
+  if (types_[index]) {
+    return types_[index];
+  }
+  // 类型只能引用已经构造完成的类型, 正在构造的类型被再次引用说明有环
+  if (types_loading_[index]) {
+    FATAL("corrupted pch: type %d is part of a cycle", index);
+  }
+  types_loading_[index] = true;
+  const PchType& record = table<PchType>(header_->types_off)[index];
+  Type* result = nullptr;
+  switch (static_cast<TypeKind>(record.kind)) {
+  case TypeKind::TYPE_PTR:
+    result = ObjectManager::getInst().alloc_type<PtrType>(type(record.base));
+    break;
+  case TypeKind::TYPE_ARRAY:
+    result = ObjectManager::getInst().alloc_type<ArrayType>(type(record.base),
+                                                          record.len);
+    break;
+  case TypeKind::TYPE_FUNC: {
+    FuncType* func_type = ObjectManager::getInst().alloc_type<FuncType>(
+      string(record.name_off, record.name_len), record.name_len);
+    func_type->ret_type() = type(record.base);
+    const std::uint32_t* params = list(record.list_begin, record.list_count);
+    for (std::uint32_t i = 0; i < record.list_count; i++) {
+      func_type->parameter_types().push_back(type(params[i]));
+    }
+    result = func_type;
+    break;
+  }
+  default:
+    FATAL("corrupted pch: unknown type kind %u", record.kind);
+  }
+  types_loading_[index] = false;
+  types_[index] = result;
+  return result;
+}
+
+Var* PchReader::var(std::int32_t index) {
+  if (index < 0 || static_cast<std::uint32_t>(index) >= header_->num_vars) {
+    FATAL("corrupted pch: var index %d out of range", index);
+  }
+  if (vars_[index]) {
+    return vars_[index];
+  }
+  const PchVar& record = table<PchVar>(header_->vars_off)[index];
+  Var* result = ObjectManager::getInst().alloc_type<Var>(
+    const_cast<char*>(string(record.name_off, record.name_len)), record.name_len);
+  result->type() = type(record.type);
+  result->index() = record.index;
+  result->offset() = record.offset;
+  result->scope_depth() = record.scope_depth;
+  result->live_begin() = record.live_begin;
+  result->live_end() = record.live_end;
+  vars_[index] = result;
+  return result;
+}
+
+Expr* PchReader::node(std::int32_t index) {
+  if (index == kPchNull) {
+    return nullptr;
+  }
+  if (index < 0 || static_cast<std::uint32_t>(index) >= header_->num_nodes) {
+    FATAL("corrupted pch: node index %d out of range", index);
+  }
+  // 节点组成树, 正在构造的节点被再次引用说明有环
+  if (nodes_loading_[index]) {
+    FATAL("corrupted pch: node %d is part of a cycle", index);
+  }
+  nodes_loading_[index] = true;
+  const PchNode& record = table<PchNode>(header_->nodes_off)[index];
+  ExprKind kind = static_cast<ExprKind>(record.kind);
+  ObjectManager& objects = ObjectManager::getInst();
+  Expr* result = nullptr;
+  switch (kind) {
+  case ExprKind::NODE_NUM: {
+    NumExpr* num = objects.alloc_type<NumExpr>(record.value);
+    num->type() = type(record.type);
+    result = num;
+    break;
+  }
+  case ExprKind::NODE_ID: {
+    IdentityExpr* id = objects.alloc_type<IdentityExpr>(var(record.value));
+    id->type() = type(record.type);
+    result = id;
+    break;
+  }
+  case ExprKind::NODE_NEG:
+  case ExprKind::NODE_ADDR:
+  case ExprKind::NODE_DEREF:
+  case ExprKind::NODE_RETURN: {
+    UnaryExpr* unary = objects.alloc_type<UnaryExpr>(kind, node(record.child[0]));
+    unary->type() = type(record.type);
+    result = unary;
+    break;
+  }
+  case ExprKind::NODE_CALL: {
+    CallExpr* call = objects.alloc_type<CallExpr>(string(record.name_off, record.name_len),
+                                                  record.name_len);
+    call->type() = type(record.type);
+    const std::uint32_t* args = list(record.list_begin, record.list_count);
+    for (std::uint32_t i = 0; i < record.list_count; i++) {
+      call->args().push_back(node(args[i]));
+    }
+    result = call;
+    break;
+  }
+  case ExprKind::NODE_ADD:
+  case ExprKind::NODE_SUB:
+  case ExprKind::NODE_MUL:
+  case ExprKind::NODE_DIV:
+  case ExprKind::NODE_EQ:
+  case ExprKind::NODE_NE:
+  case ExprKind::NODE_LT:
+  case ExprKind::NODE_LE:
+  case ExprKind::NODE_ASSIGN: {
+    BinaryExpr* binary = objects.alloc_type<BinaryExpr>(
+      kind, node(record.child[0]), node(record.child[1]));
+    binary->type() = type(record.type);
+    result = binary;
+    break;
+  }
+  case ExprKind::NODE_STMT:
+    result = objects.alloc_type<StmtExpr>(node(record.child[0]));
+    break;
+  case ExprKind::NODE_COMPOUND:
+    result = objects.alloc_type<CompoundStmtExpr>(node(record.child[0]));
+    break;
+  case ExprKind::NODE_IF:
+    result = objects.alloc_type<IfExpr>(node(record.child[0]),
+                                        node(record.child[1]),
+                                        node(record.child[2]));
+    break;
+  case ExprKind::NODE_FOR:
+    result = objects.alloc_type<ForExpr>(node(record.child[0]),
+                                         node(record.child[1]),
+                                         node(record.child[2]),
+                                         node(record.child[3]));
+    break;
+  case ExprKind::NODE_WHILE:
+    result = objects.alloc_type<WhileExpr>(node(record.child[0]),
+                                           node(record.child[1]));
+    break;
+  default:
+    FATAL("corrupted pch: unknown node kind %u", record.kind);
+  }
+  if (record.next != kPchNull) {
+    NextExpr* stmt = dynamic_cast<NextExpr*>(result);
+    if (!stmt) {
+      FATAL("corrupted pch: node %d of kind %u has a next statement", index, record.kind);
+    }
+    stmt->next() = node(record.next);
+  }
+  nodes_loading_[index] = false;
+  return result;
+}
+
+std::vector<Function*> PchReader::functions() {
+  std::vector<Function*> result;
+  const PchFunction* funcs = table<PchFunction>(header_->funcs_off);
+  for (std::uint32_t i = 0; i < header_->num_funcs; i++) {
+    const PchFunction& record = funcs[i];
+    Function* func = ObjectManager::getInst().alloc_type<Function>();
+    func->name() = string(record.name_off, record.name_len);
+    func->name_len() = record.name_len;
+    func->type() = type(record.type);
+    const std::uint32_t* vars = list(record.vars_begin, record.vars_count);
+    for (std::uint32_t j = 0; j < record.vars_count; j++) {
+      func->vars().push_back(var(vars[j]));
+    }
+    const std::uint32_t* params = list(record.params_begin, record.params_count);
+    for (std::uint32_t j = 0; j < record.params_count; j++) {
+      func->parameters().push_back(var(params[j]));
+    }
+    func->body() = node(record.body);
+    result.push_back(func);
+  }
+  return result;
+}
+
+void PchReader::insertInto(Ast* ast) {
+  for (auto func: functions()) {
+    ast->insert({getstrHash(func->name(), func->name_len()), func});
+  }
+}
+
+} // namespace rvcc
@@ -0,0 +1,130 @@
+#ifndef __PCH_H
+#define __PCH_H
+
+#include "ast.h"
+#include "type.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+/*
+预编译头文件 (pch) 格式
+  所有引用都是表内下标或相对文件起始位置的偏移, 与 mmap 的加载地址无关
+  -------------------------------
+  PchHeader
+  PchType[num_types]      类型表, 下标 0 固定为 int
+  PchVar[num_vars]        变量表
+  PchNode[num_nodes]      ast 节点表
+  PchFunction[num_funcs]  函数表
+  uint32_t[num_lists]     变长列表: 函数参数类型 局部变量 函数参数 调用实参
+  char[strings_size]      名字表, 加载后 Var/Function 的名字直接指向这里
+  -------------------------------
+*/
+constexpr std::uint32_t kPchVersion = 1;
+constexpr std::int32_t kPchNull = -1;
+
+struct PchHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t file_size;
+  std::uint32_t types_off, num_types;
+  std::uint32_t vars_off, num_vars;
+  std::uint32_t nodes_off, num_nodes;
+  std::uint32_t funcs_off, num_funcs;
+  std::uint32_t lists_off, num_lists;
+  std::uint32_t strings_off, strings_size;
+};
+
+struct PchType {
+  std::uint32_t kind;
+  std::uint32_t size;
+  std::int32_t base;            // ptr/array 的元素类型, func 的返回值类型
+  std::uint32_t len;            // array 长度
+  std::uint32_t name_off, name_len;
+  std::uint32_t list_begin, list_count;  // func 参数类型
+};
+
+struct PchVar {
+  std::uint32_t name_off, name_len;
+  std::int32_t type;
+  std::int32_t index;
+  std::int32_t offset;
+  std::int32_t scope_depth, live_begin, live_end;
+};
+
+// 不同 kind 的子节点含义与 Expr 的 getLeft/getRight/getCond... 对应
+struct PchNode {
+  std::uint32_t kind;
+  std::int32_t type;
+  std::int32_t value;           // NUM 的值, ID 的变量下标
+  std::int32_t child[4];
+  std::int32_t next;
+  std::uint32_t name_off, name_len;      // CALL 的函数名
+  std::uint32_t list_begin, list_count;  // CALL 的实参
+};
+
+struct PchFunction {
+  std::uint32_t name_off, name_len;
+  std::int32_t type;
+  std::int32_t body;
+  std::uint32_t vars_begin, vars_count;
+  std::uint32_t params_begin, params_count;
+};
+
+class PchWriter {
+  public:
+    bool write(Ast* ast, const char* path);
+  private:
+    std::int32_t typeIndex(Type* type);
+    std::int32_t varIndex(Var* var);
+    std::int32_t nodeIndex(Expr* expr);
+    std::uint32_t addString(const char* str, std::size_t len);
+    std::uint32_t addList(const std::vector<std::int32_t>& list);
+    std::vector<PchType> types_;
+    std::vector<PchVar> vars_;
+    std::vector<PchNode> nodes_;
+    std::vector<PchFunction> funcs_;
+    std::vector<std::uint32_t> lists_;
+    std::string strings_;
+    std::map<Type*, std::int32_t> type_ids_;
+    std::map<Var*, std::int32_t> var_ids_;
+};
+
+class PchReader {
+  public:
+    PchReader();
+    PchReader(const PchReader&) = delete;
+    PchReader& operator=(const PchReader&) = delete;
+    ~PchReader();
+    // mmap pch 文件并校验头部和各个表的范围, 失败时返回 false
+    // 表内的下标, 列表和名字在使用时检查, 越界或者有环时 FATAL
+    bool load(const char* path);
+    // 将 pch 中的函数插入 ast, 名字直接引用 mmap 的名字表
+    void insertInto(Ast* ast);
+    std::vector<Function*> functions();
+  private:
+    template<typename T>
+    const T* table(std::uint32_t off) const;
+    bool inRange(std::uint32_t off, std::uint32_t count, std::size_t record_size) const;
+    const std::uint32_t* list(std::uint32_t begin, std::uint32_t count) const;
+    // 名字以 '\0' 结尾, 范围包括结尾的 '\0'
+    const char* string(std::uint32_t off, std::uint32_t len) const;
+    Type* type(std::int32_t index);
+    Var* var(std::int32_t index);
+    Expr* node(std::int32_t index);
+    const char* base_;
+    std::size_t size_;
+    const PchHeader* header_;
+    std::vector<Type*> types_;
+    std::vector<Var*> vars_;
+    std::vector<bool> types_loading_;
+    std::vector<bool> nodes_loading_;
+};
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,340 @@
+#include "peephole.h"
+#include "context.h"
+#include "mir.h"
+#include "target.h"
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+/*
+window 为匹配的指令条数, rewrite 的参数为末尾 window 条指令
+匹配时把替换的指令写入 out 并返回 true, out 可以为空
+*/
+struct Rule {
+  const char* name;
+  std::size_t window;
+  bool (*rewrite)(const MInst* insts, std::vector<MInst>& out);
+};
+
+// 不同的 MReg 可能映射到同一个寄存器, 例如 RV64 的 REG_ACC 和 REG_ARG0 都是 a0
+bool sameReg(int a, int b) {
+  if (a == b) {
+    return true;
+  }
+  if (a == REG_NONE || b == REG_NONE || isVirtualReg(a) || isVirtualReg(b)) {
+    return false;
+  }
+  const Target* target = CompilerContext::current().target();
+  return strcmp(target->regName(a), target->regName(b)) == 0;
+}
+
+void move(int rd, int rs, std::vector<MInst>& out) {
+  if (!sameReg(rd, rs)) {
+    out.emplace_back(MOpcode::MOP_MV, rd, rs);
+  }
+}
+
+// push r; pop d => mv d, r
+bool pushPop(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_PUSH || insts[1].op != MOpcode::MOP_POP) {
+    return false;
+  }
+  move(insts[1].rd, insts[0].rs1, out);
+  return true;
+}
+
+// push r; x; pop d => mv d, r; x
+// x 不能读写 d, 不能访问栈顶 (sp) 也不能是跳转和调用
+// x86-64 的 idiv 会改写 rdx (REG_ARG2), 因此 x 也不能是除法
+bool pushOpPop(const MInst* insts, std::vector<MInst>& out) {
+  const MInst& op = insts[1];
+  if (insts[0].op != MOpcode::MOP_PUSH || insts[2].op != MOpcode::MOP_POP) {
+    return false;
+  }
+  switch (op.op) {
+  case MOpcode::MOP_PUSH:
+  case MOpcode::MOP_POP:
+  case MOpcode::MOP_CALL:
+  case MOpcode::MOP_DIV:
+  case MOpcode::MOP_LABEL:
+  case MOpcode::MOP_RET:
+    return false;
+  default:
+    break;
+  }
+  int d = insts[2].rd;
+  int regs[2];
+  std::size_t uses = op.uses(regs);
+  for (std::size_t i = 0; i < uses; i++) {
+    if (sameReg(regs[i], d) || sameReg(regs[i], REG_SP)) {
+      return false;
+    }
+  }
+  if (op.isBranch() || sameReg(op.def(), d) || sameReg(op.def(), REG_SP)) {
+    return false;
+  }
+  move(d, insts[0].rs1, out);
+  out.push_back(op);
+  return true;
+}
+
+// sd r, off(b); ld d, off(b) => sd r, off(b); mv d, r
+bool storeLoad(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_SD || insts[1].op != MOpcode::MOP_LD ||
+      !sameReg(insts[0].rs1, insts[1].rs1) || insts[0].imm != insts[1].imm) {
+    return false;
+  }
+  out.push_back(insts[0]);
+  move(insts[1].rd, insts[0].rs2, out);
+  return true;
+}
+
+// addi r, b, c; ld r, off(r) => ld r, c+off(b)
+bool loadAddress(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_ADDI || insts[1].op != MOpcode::MOP_LD ||
+      !sameReg(insts[0].rd, insts[1].rs1) || !sameReg(insts[1].rd, insts[1].rs1)) {
+    return false;
+  }
+  long offset = insts[0].imm + insts[1].imm;
+  if (offset < -2048 || offset >= 2048) {
+    return false;
+  }
+  out.emplace_back(MOpcode::MOP_LD, insts[1].rd, insts[0].rs1, REG_NONE, offset);
+  return true;
+}
+
+// j L; L: => L:
+bool jumpNext(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_J || insts[1].op != MOpcode::MOP_LABEL ||
+      insts[0].sym != insts[1].sym) {
+    return false;
+  }
+  out.push_back(insts[1]);
+  return true;
+}
+
+// j L; M: L: => M: L:
+bool jumpOverLabel(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_J || insts[1].op != MOpcode::MOP_LABEL ||
+      insts[2].op != MOpcode::MOP_LABEL || insts[0].sym != insts[2].sym) {
+    return false;
+  }
+  out.push_back(insts[1]);
+  out.push_back(insts[2]);
+  return true;
+}
+
+// j 或 ret 之后到下一个 label 之前的指令不会执行
+bool unreachable(const MInst* insts, std::vector<MInst>& out) {
+  if ((insts[0].op != MOpcode::MOP_J && insts[0].op != MOpcode::MOP_RET) ||
+      insts[1].op == MOpcode::MOP_LABEL) {
+    return false;
+  }
+  out.push_back(insts[0]);
+  return true;
+}
+
+// mv r, r 以及 addi r, r, 0
+bool nop(const MInst* insts, std::vector<MInst>&) {
+  return (insts[0].op == MOpcode::MOP_MV && sameReg(insts[0].rd, insts[0].rs1)) ||
+         (insts[0].op == MOpcode::MOP_ADDI && sameReg(insts[0].rd, insts[0].rs1) &&
+          insts[0].imm == 0);
+}
+
+// mv a, b; mv b, a => mv a, b
+bool moveBack(const MInst* insts, std::vector<MInst>& out) {
+  if (insts[0].op != MOpcode::MOP_MV || insts[1].op != MOpcode::MOP_MV ||
+      !sameReg(insts[0].rd, insts[1].rs1) || !sameReg(insts[0].rs1, insts[1].rd)) {
+    return false;
+  }
+  out.push_back(insts[0]);
+  return true;
+}
+
+const Rule kRules[] = {
+  {"push-pop",        2, pushPop},
+  {"push-op-pop",     3, pushOpPop},
+  {"store-load",      2, storeLoad},
+  {"load-address",    2, loadAddress},
+  {"jump-next",       2, jumpNext},
+  {"jump-over-label", 3, jumpOverLabel},
+  {"unreachable",     2, unreachable},
+  {"nop",             1, nop},
+  {"move-back",       2, moveBack},
+};
+
+const std::size_t kRuleCount = sizeof(kRules) / sizeof(kRules[0]);
+
+class Peephole {
+  public:
+    explicit Peephole(std::size_t size) {
+      insts_.reserve(size);
+    }
+    // 追加 inst, 然后反复匹配末尾的指令直到没有规则命中
+    void append(const MInst& inst);
+    std::vector<MInst>& insts() {
+      return insts_;
+    }
+    std::size_t hits[kRuleCount] = {};
+  private:
+    bool match();
+    std::vector<MInst> insts_;
+    std::vector<std::size_t> window_;   // 末尾非注释指令的下标
+};
+
+void Peephole::append(const MInst& inst) {
+  insts_.push_back(inst);
+  if (inst.op == MOpcode::MOP_COMMENT) {
+    return;
+  }
+  window_.push_back(insts_.size() - 1);
+  while (match()) {}
+}
+
+bool Peephole::match() {
+  for (std::size_t i = 0; i < kRuleCount; i++) {
+    const Rule& rule = kRules[i];
+    if (window_.size() < rule.window) {
+      continue;
+    }
+    std::size_t first = window_.size() - rule.window;
+    std::vector<MInst> insts;
+    for (std::size_t j = first; j < window_.size(); j++) {
+      insts.push_back(insts_[window_[j]]);
+    }
+    std::vector<MInst> out;
+    if (!rule.rewrite(insts.data(), out)) {
+      continue;
+    }
+    hits[i]++;
+    // 删除窗口中的指令, 其间的注释保留在替换的指令之前
+    for (std::size_t j = rule.window; j-- > 0;) {
+      insts_.erase(insts_.begin() + window_[first + j]);
+    }
+    window_.resize(first);
+    for (auto& inst: out) {
+      insts_.push_back(inst);
+      window_.push_back(insts_.size() - 1);
+    }
+    return true;
+  }
+  return false;
+}
+
+/*
+删除结果不再使用的定义, 返回删除的条数
+  例如 mv t0, a0 只为 ret 准备返回值, 而 move-back 已经删除了之后的 mv a0, t0
+  从函数末尾和跳转到 return 段的 j 向前扫描直线代码, 经过其他跳转 (之后的活跃性未知) 时停止,
+  直到下一个 j 或函数开头
+  只删除调用者保存的寄存器的定义, 返回值 fp sp ra 和被调用者保存的寄存器在返回时仍然活跃
+  call 读取全部参数寄存器, 改写其余调用者保存的寄存器
+*/
+std::size_t removeDeadDefs(MFunction& func) {
+  if (func.virtual_regs) {
+    return 0;
+  }
+  const Target* target = CompilerContext::current().target();
+  auto name = [&](int reg) {
+    return std::string(target->regName(reg));
+  };
+  // 调用者保存, 返回时不再使用的寄存器, RV64 的 REG_ARG0 与返回值 REG_ACC 相同
+  auto scratch = [&](int reg) {
+    bool caller_saved = reg == REG_TMP || (reg >= REG_ARG0 && reg <= REG_ARG5) ||
+                        (reg >= REG_T0 && reg <= REG_T8);
+    return caller_saved && name(reg) != name(REG_ACC);
+  };
+  const std::string ret_label = ".L.return." + func.name;
+  std::vector<MInst>& insts = func.insts;
+  std::vector<bool> dead(insts.size(), false);
+  std::set<std::string> live;
+  bool known = true;
+  std::size_t removed = 0;
+  for (std::size_t i = insts.size(); i-- > 0;) {
+    const MInst& inst = insts[i];
+    if (inst.op == MOpcode::MOP_J || inst.op == MOpcode::MOP_RET) {
+      known = inst.op == MOpcode::MOP_RET || inst.sym == ret_label;
+      live.clear();
+      continue;
+    }
+    if (inst.isBranch()) {
+      known = false;
+    }
+    if (!known) {
+      continue;
+    }
+    if (inst.op == MOpcode::MOP_CALL) {
+      live.clear();
+      for (int reg = REG_ARG0; reg <= REG_ARG5; reg++) {
+        live.insert(name(reg));
+      }
+      continue;
+    }
+    int rd = inst.def();
+    if (rd != REG_NONE && inst.op != MOpcode::MOP_POP && scratch(rd) &&
+        !live.count(name(rd))) {
+      dead[i] = true;
+      removed++;
+      continue;
+    }
+    if (rd != REG_NONE) {
+      live.erase(name(rd));
+    }
+    int regs[2];
+    std::size_t uses = inst.uses(regs);
+    for (std::size_t j = 0; j < uses; j++) {
+      if (regs[j] != REG_NONE) {
+        live.insert(name(regs[j]));
+      }
+    }
+  }
+  if (removed) {
+    std::vector<MInst> kept_insts;
+    kept_insts.reserve(insts.size() - removed);
+    for (std::size_t i = 0; i < insts.size(); i++) {
+      if (!dead[i]) {
+        kept_insts.push_back(insts[i]);
+      }
+    }
+    insts.swap(kept_insts);
+  }
+  return removed;
+}
+
+} // namespace
+
+const char* PeepholePass::name() const {
+  return "peephole";
+}
+
+PassKind PeepholePass::kind() const {
+  return PassKind::PASS_MACHINE;
+}
+
+bool PeepholePass::run(MFunction& func) const {
+  Peephole peephole(func.insts.size());
+  for (auto& inst: func.insts) {
+    peephole.append(inst);
+  }
+  PassManager& passes = CompilerContext::current().passes();
+  bool changed = false;
+  for (std::size_t i = 0; i < kRuleCount; i++) {
+    passes.addStat(this, kRules[i].name, peephole.hits[i]);
+    changed = changed || peephole.hits[i] > 0;
+  }
+  func.insts.swap(peephole.insts());
+  std::size_t dead_defs = removeDeadDefs(func);
+  passes.addStat(this, "dead-def", dead_defs);
+  return changed || dead_defs > 0;
+}
+
+const Pass* peepholePass() {
+  static const PeepholePass pass;
+  return &pass;
+}
+
+} // namespace rvcc
@@ -0,0 +1,26 @@
+#ifndef __PEEPHOLE_H
+#define __PEEPHOLE_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+窥孔优化, 在 Target 输出之前改写 MIR 中相邻的冗余指令
+  规则表中每条规则匹配末尾若干条指令 (不含注释), 匹配时替换为新的指令序列,
+  新指令重新参与匹配, 因此规则可以连锁生效
+  之后删除函数末尾直线代码中结果不再使用的定义 (dead-def)
+  每条规则的命中次数通过 PassManager::addStat 记录, --pass-stats 输出
+*/
+class PeepholePass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(MFunction& func) const override;
+};
+
+const Pass* peepholePass();
+
+} // namespace rvcc
+
+#endif
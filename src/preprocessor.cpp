@@ -0,0 +1,713 @@
+#include "preprocessor.h"
+#include "context.h"
+#include "logger.h"
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+namespace rvcc {
+
+static std::string_view tokenText(Token& tok) {
+  return std::string_view(tok.loc(), tok.len());
+}
+
+static bool isIdent(Token& tok) {
+  return tok.kind() == TokenKind::TOKEN_ID ||
+         tok.kind() == TokenKind::TOKEN_KEYWORD;
+}
+
+Token& Preprocessor::Frame::peek() {
+  if (replay) {
+    return (*replay)[pos];
+  }
+  return lexer->getCurrToken();
+}
+
+Token Preprocessor::Frame::next() {
+  Token tok = peek();
+  if (tok.kind() == TokenKind::TOKEN_EOF) {
+    return tok;
+  }
+  if (replay) {
+    pos++;
+  } else {
+    lexer->consumerToken();
+    if (cache) {
+      cache->tokens.push_back(tok);
+    }
+  }
+  return tok;
+}
+
+Preprocessor::Preprocessor(const char* buffer,
+                           const std::vector<std::string>& include_dirs):
+  Lexer(buffer), sources_(CompilerContext::current().sources()),
+  include_dirs_(include_dirs),
+  guard_skips_(0), cache_hits_(0) {
+  pushFrame(sources_.addBuffer("<input>", buffer), nullptr);
+}
+
+Preprocessor::~Preprocessor() {
+  while (!frames_.empty()) {
+    delete frames_.back()->lexer;
+    delete frames_.back();
+    frames_.pop_back();
+  }
+}
+
+SourceLocation Preprocessor::locate(const char* loc) {
+  const SourceFile* file = sources_.find(loc);
+  return file ? SourceManager::locate(file, loc) : Lexer::locate(loc);
+}
+
+void Preprocessor::setRange(const char* begin, const char* end) {
+  frames_.front()->lexer->setRange(begin, end);
+  frames_.front()->lexer->init();
+}
+
+std::size_t Preprocessor::guardSkips() const {
+  return guard_skips_;
+}
+
+std::size_t Preprocessor::cacheHits() const {
+  return cache_hits_;
+}
+
+// cache 非空且已经读取完整时回放 token, 否则词法分析并记录到 cache 中
+void Preprocessor::pushFrame(const SourceFile* file, HeaderCache* cache) {
+  if (frames_.size() > 200) {
+    FATAL("#include nested too deeply: %s", file->name.c_str());
+  }
+  Frame* frame = new Frame{file, nullptr, nullptr, 0, nullptr,
+                           conds_.size(), GuardState::GUARD_NONE, "", 0};
+  if (cache && cache->complete) {
+    frame->replay = &cache->tokens;
+  } else {
+    frame->lexer = new Lexer(file->buffer, file->name.c_str());
+    frame->lexer->init();
+    if (cache) {
+      cache->recording = true;
+      cache->tokens.clear();
+      frame->cache = cache;
+      frame->guard_state = GuardState::GUARD_START;
+    }
+  }
+  frames_.push_back(frame);
+}
+
+void Preprocessor::popFrame() {
+  Frame* frame = frames_.back();
+  if (conds_.size() != frame->cond_base) {
+    FATAL("unterminated conditional directive in %s", frame->file->name.c_str());
+  }
+  if (frame->cache) {
+    // 回放时遇到的 EOF 也要记录下来
+    frame->cache->tokens.push_back(frame->peek());
+    frame->cache->recording = false;
+    frame->cache->complete = true;
+    if (frame->guard_state == GuardState::GUARD_AFTER) {
+      frame->cache->guard = std::string(frame->guard);
+    }
+  }
+  delete frame->lexer;
+  delete frame;
+  frames_.pop_back();
+}
+
+// 从 include 栈中读取下一个未展开的 token, 头文件结束时回到上一层
+Token Preprocessor::nextRaw() {
+  for (;;) {
+    Token tok = frames_.back()->next();
+    if (tok.kind() == TokenKind::TOKEN_EOF && frames_.size() > 1) {
+      popFrame();
+      continue;
+    }
+    return tok;
+  }
+}
+
+// 优先读取宏展开的结果, 遇到 expandList 的结束标记时返回 false
+bool Preprocessor::readToken(Token& tok, bool& from_file) {
+  while (!pending_.empty()) {
+    Pending& pending = pending_.front();
+    if (pending.stop) {
+      return false;
+    }
+    if (pending.end_of) {
+      pending.end_of->active = false;
+      pending_.pop_front();
+      continue;
+    }
+    tok = pending.tok;
+    pending_.pop_front();
+    from_file = false;
+    return true;
+  }
+  tok = nextRaw();
+  from_file = true;
+  return true;
+}
+
+Token Preprocessor::nextExpanded(bool& ok) {
+  for (;;) {
+    Token tok;
+    bool from_file = false;
+    if (!readToken(tok, from_file)) {
+      ok = false;
+      return tok;
+    }
+    if (from_file) {
+      if (tok.is(PunctKind::PUNCT_HASH) && tok.bol()) {
+        std::vector<Token> line = readLine();
+        directive(line);
+        continue;
+      }
+      // #ifndef X ... #endif 之外出现了 token, 不是 include guard
+      Frame* frame = frames_.back();
+      if (frame->guard_state == GuardState::GUARD_START ||
+          frame->guard_state == GuardState::GUARD_AFTER) {
+        frame->guard_state = GuardState::GUARD_NONE;
+      }
+    }
+    if (isIdent(tok) && expandMacro(tok)) {
+      continue;
+    }
+    ok = true;
+    return tok;
+  }
+}
+
+Token Preprocessor::getNextToken() {
+  bool ok = false;
+  return nextExpanded(ok);
+}
+
+bool Preprocessor::isDefined(std::string_view name) const {
+  return macros_.count(name) != 0;
+}
+
+bool Preprocessor::expandMacro(Token& tok) {
+  if (macros_.empty() || tok.noexpand()) {
+    return false;
+  }
+  auto iter = macros_.find(tokenText(tok));
+  if (iter == macros_.end()) {
+    return false;
+  }
+  Macro& macro = iter->second;
+  if (macro.active) {
+    tok.noexpand() = true;
+    return false;
+  }
+  if (!macro.function_like) {
+    pushExpansion(macro, macro.body);
+    return true;
+  }
+  // 函数宏的名字后面不是 '(' 时不展开
+  Token next;
+  bool from_file = false;
+  if (!readToken(next, from_file)) {
+    return false;
+  }
+  if (!next.is(PunctKind::PUNCT_LPAREN)) {
+    pending_.push_front(Pending{next, nullptr, false});
+    return false;
+  }
+  std::string name(macro.name);
+  std::vector<std::vector<Token>> args(1);
+  int depth = 0;
+  for (;;) {
+    Token arg;
+    if (!readToken(arg, from_file) || arg.kind() == TokenKind::TOKEN_EOF) {
+      FATAL("unterminated argument list invoking macro %s", name.c_str());
+    }
+    if (arg.is(PunctKind::PUNCT_LPAREN)) {
+      depth++;
+    } else if (arg.is(PunctKind::PUNCT_RPAREN)) {
+      if (depth == 0) {
+        break;
+      }
+      depth--;
+    } else if (arg.is(PunctKind::PUNCT_COMMA) && depth == 0) {
+      args.emplace_back();
+      continue;
+    }
+    args.back().push_back(arg);
+  }
+  if (macro.params.empty() && args.size() == 1 && args[0].empty()) {
+    args.clear();
+  }
+  if (args.size() != macro.params.size()) {
+    FATAL("macro %s requires %d arguments, but %d given", name.c_str(),
+          static_cast<int>(macro.params.size()), static_cast<int>(args.size()));
+  }
+  // 实参先完整展开, 再替换到宏体中
+  for (auto& arg: args) {
+    expandList(arg);
+  }
+  std::vector<Token> result;
+  for (auto& body_tok: macro.body) {
+    std::size_t i = 0;
+    if (isIdent(body_tok)) {
+      for (; i < macro.params.size(); i++) {
+        if (macro.params[i] == tokenText(body_tok)) {
+          break;
+        }
+      }
+    } else {
+      i = macro.params.size();
+    }
+    if (i < macro.params.size()) {
+      result.insert(result.end(), args[i].begin(), args[i].end());
+    } else {
+      result.push_back(body_tok);
+    }
+  }
+  pushExpansion(macro, result);
+  return true;
+}
+
+void Preprocessor::pushExpansion(Macro& macro, const std::vector<Token>& tokens) {
+  macro.active = true;
+  pending_.push_front(Pending{Token(), &macro, false});
+  for (auto iter = tokens.rbegin(); iter != tokens.rend(); ++iter) {
+    Token tok = *iter;
+    tok.bol() = false;
+    pending_.push_front(Pending{tok, nullptr, false});
+  }
+}
+
+// 单独展开一段 token, 用于宏实参和 #if 表达式
+void Preprocessor::expandList(std::vector<Token>& tokens) {
+  pending_.push_front(Pending{Token(), nullptr, true});
+  for (auto iter = tokens.rbegin(); iter != tokens.rend(); ++iter) {
+    pending_.push_front(Pending{*iter, nullptr, false});
+  }
+  std::vector<Token> result;
+  for (;;) {
+    bool ok = false;
+    Token tok = nextExpanded(ok);
+    if (!ok) {
+      break;
+    }
+    result.push_back(tok);
+  }
+  pending_.pop_front();
+  tokens.swap(result);
+}
+
+// 读取当前文件中本行剩余的 token
+std::vector<Token> Preprocessor::readLine() {
+  std::vector<Token> line;
+  Frame* frame = frames_.back();
+  while (frame->peek().kind() != TokenKind::TOKEN_EOF && !frame->peek().bol()) {
+    line.push_back(frame->next());
+  }
+  return line;
+}
+
+void Preprocessor::directive(std::vector<Token>& line) {
+  if (line.empty()) {
+    return;
+  }
+  Frame* frame = frames_.back();
+  std::string_view name = tokenText(line[0]);
+  if (frame->guard_state == GuardState::GUARD_START) {
+    if (name == "ifndef" && line.size() == 2) {
+      frame->guard_state = GuardState::GUARD_IN;
+      frame->guard = tokenText(line[1]);
+      frame->guard_cond = conds_.size();
+    } else {
+      frame->guard_state = GuardState::GUARD_NONE;
+    }
+  } else if (frame->guard_state == GuardState::GUARD_AFTER) {
+    frame->guard_state = GuardState::GUARD_NONE;
+  }
+  bool guard_level = frame->guard_state == GuardState::GUARD_IN &&
+                     conds_.size() == frame->guard_cond + 1;
+
+  if (name == "include") {
+    handleInclude(line);
+  } else if (name == "define") {
+    handleDefine(line);
+  } else if (name == "undef") {
+    if (line.size() < 2 || !isIdent(line[1])) {
+      FATAL("macro name missing in #undef");
+    }
+    macros_.erase(tokenText(line[1]));
+  } else if (name == "ifdef" || name == "ifndef") {
+    if (line.size() < 2 || !isIdent(line[1])) {
+      FATAL("macro name missing in #%s", std::string(name).c_str());
+    }
+    bool value = isDefined(tokenText(line[1])) == (name == "ifdef");
+    conds_.push_back(Cond{value, false});
+    if (!value) {
+      skipBlock();
+    }
+  } else if (name == "if") {
+    bool value = evalCond(line);
+    conds_.push_back(Cond{value, false});
+    if (!value) {
+      skipBlock();
+    }
+  } else if (name == "elif" || name == "else" || name == "endif") {
+    if (conds_.size() <= frame->cond_base) {
+      FATAL("#%s without #if", std::string(name).c_str());
+    }
+    Cond& cond = conds_.back();
+    if (name == "endif") {
+      conds_.pop_back();
+      if (guard_level) {
+        frame->guard_state = GuardState::GUARD_AFTER;
+      }
+      return;
+    }
+    if (guard_level) {
+      frame->guard_state = GuardState::GUARD_NONE;
+    }
+    if (cond.in_else) {
+      FATAL("#%s after #else", std::string(name).c_str());
+    }
+    if (name == "else") {
+      cond.in_else = true;
+      if (cond.taken) {
+        skipBlock();
+      } else {
+        cond.taken = true;
+      }
+    } else if (cond.taken || !evalCond(line)) {
+      skipBlock();
+    } else {
+      cond.taken = true;
+    }
+  } else if (name == "pragma") {
+    if (line.size() == 2 && tokenText(line[1]) == "once" && frame->cache) {
+      frame->cache->once = true;
+    }
+  } else if (name == "error") {
+    std::string msg;
+    for (std::size_t i = 1; i < line.size(); i++) {
+      msg += std::string(tokenText(line[i])) + " ";
+    }
+    FATAL("#error %s", msg.c_str());
+  } else {
+    FATAL("invalid preprocessing directive #%s", std::string(name).c_str());
+  }
+}
+
+// 跳过条件为假的分支, 直到同一层的 #elif #else #endif
+void Preprocessor::skipBlock() {
+  int depth = 0;
+  Frame* frame = frames_.back();
+  for (;;) {
+    Token tok = frame->next();
+    if (tok.kind() == TokenKind::TOKEN_EOF) {
+      FATAL("unterminated conditional directive in %s", frame->file->name.c_str());
+    }
+    if (!(tok.is(PunctKind::PUNCT_HASH) && tok.bol())) {
+      continue;
+    }
+    std::vector<Token> line = readLine();
+    if (line.empty()) {
+      continue;
+    }
+    std::string_view name = tokenText(line[0]);
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+      depth++;
+    } else if (name == "endif") {
+      if (depth == 0) {
+        directive(line);
+        return;
+      }
+      depth--;
+    } else if ((name == "elif" || name == "else") && depth == 0) {
+      directive(line);
+      return;
+    }
+  }
+}
+
+void Preprocessor::handleInclude(std::vector<Token>& line) {
+  if (line.size() < 3) {
+    FATAL("#include expects \"FILENAME\" or <FILENAME>");
+  }
+  bool quoted = *line[1].loc() == '"';
+  if (!quoted && !line[1].is(PunctKind::PUNCT_LT)) {
+    FATAL("#include expects \"FILENAME\" or <FILENAME>");
+  }
+  // 头文件名直接从源码中截取, 到同一行中匹配的 " 或 > 为止
+  char close = quoted ? '"' : '>';
+  std::size_t end = 2;
+  while (end < line.size() && *line[end].loc() != close) {
+    end++;
+  }
+  if (end == line.size()) {
+    FATAL("missing terminating %c in #include", close);
+  }
+  std::string name(line[1].loc() + 1, line[end].loc() - line[1].loc() - 1);
+  std::string path = resolveInclude(name, quoted);
+  if (path.empty()) {
+    FATAL("'%s' file not found", name.c_str());
+  }
+  HeaderCache& cache = headers_[path];
+  if (cache.complete) {
+    if (cache.once) {
+      guard_skips_++;
+      return;
+    }
+    if (!cache.guard.empty() && isDefined(cache.guard)) {
+      guard_skips_++;
+      return;
+    }
+    cache_hits_++;
+    pushFrame(cache.file, &cache);
+    return;
+  }
+  if (!cache.file) {
+    cache.file = sources_.open(path);
+    if (!cache.file) {
+      FATAL("can't open include file '%s'", path.c_str());
+    }
+  }
+  // 头文件递归 include 自身时, 内层不再记录
+  pushFrame(cache.file, cache.recording ? nullptr : &cache);
+}
+
+std::string Preprocessor::resolveInclude(const std::string& name, bool quoted) {
+  const std::string& dir = frames_.back()->file->dir;
+  std::string key = (quoted ? dir : std::string("<>")) + '\n' + name;
+  auto iter = resolved_.find(key);
+  if (iter != resolved_.end()) {
+    return iter->second;
+  }
+  std::vector<std::string> candidates;
+  if (!name.empty() && name[0] == '/') {
+    candidates.push_back(name);
+  } else {
+    if (quoted) {
+      candidates.push_back(dir + name);
+    }
+    for (auto& include_dir: include_dirs_) {
+      candidates.push_back(include_dir + "/" + name);
+    }
+  }
+  std::string path;
+  for (auto& candidate: candidates) {
+    if (access(candidate.c_str(), R_OK) == 0) {
+      char real[PATH_MAX];
+      path = realpath(candidate.c_str(), real) ? std::string(real) : candidate;
+      break;
+    }
+  }
+  resolved_[key] = path;
+  return path;
+}
+
+void Preprocessor::handleDefine(std::vector<Token>& line) {
+  if (line.size() < 2 || !isIdent(line[1])) {
+    FATAL("macro name missing in #define");
+  }
+  Macro macro{tokenText(line[1]), false, {}, {}, false};
+  std::string name(macro.name);
+  std::size_t i = 2;
+  // 宏名后紧跟 '(' (中间没有空白) 时为函数宏
+  if (i < line.size() && line[i].is(PunctKind::PUNCT_LPAREN) &&
+      line[i].loc() == line[1].loc() + line[1].len()) {
+    macro.function_like = true;
+    i++;
+    while (i < line.size() && !line[i].is(PunctKind::PUNCT_RPAREN)) {
+      if (!macro.params.empty()) {
+        if (!line[i].is(PunctKind::PUNCT_COMMA)) {
+          FATAL("expected ',' in macro parameter list of %s", name.c_str());
+        }
+        i++;
+      }
+      if (i >= line.size() || !isIdent(line[i])) {
+        FATAL("invalid macro parameter in %s", name.c_str());
+      }
+      macro.params.push_back(tokenText(line[i]));
+      i++;
+    }
+    if (i >= line.size()) {
+      FATAL("missing ')' in macro parameter list of %s", name.c_str());
+    }
+    i++;
+  }
+  macro.body.assign(line.begin() + i, line.end());
+  macros_[macro.name] = macro;
+}
+
+// #if 表达式: 先替换 defined, 再展开宏, 剩余的 identifier 当作 0
+bool Preprocessor::evalCond(std::vector<Token>& line) {
+  std::vector<Token> expr;
+  for (std::size_t i = 1; i < line.size(); i++) {
+    if (!(isIdent(line[i]) && tokenText(line[i]) == "defined")) {
+      expr.push_back(line[i]);
+      continue;
+    }
+    Token tok = line[i];
+    bool paren = i + 1 < line.size() && line[i + 1].is(PunctKind::PUNCT_LPAREN);
+    std::size_t name_pos = paren ? i + 2 : i + 1;
+    if (name_pos >= line.size() || !isIdent(line[name_pos])) {
+      FATAL("macro name missing after defined");
+    }
+    tok.kind() = TokenKind::TOKEN_NUM;
+    tok.value() = isDefined(tokenText(line[name_pos])) ? 1 : 0;
+    expr.push_back(tok);
+    i = name_pos;
+    if (paren) {
+      if (i + 1 >= line.size() || !line[i + 1].is(PunctKind::PUNCT_RPAREN)) {
+        FATAL("missing ')' after defined");
+      }
+      i++;
+    }
+  }
+  expandList(expr);
+  for (auto& tok: expr) {
+    if (isIdent(tok)) {
+      tok.kind() = TokenKind::TOKEN_NUM;
+      tok.value() = 0;
+    }
+  }
+  if (expr.empty()) {
+    FATAL("#if with no expression");
+  }
+  std::size_t pos = 0;
+  long value = evalOr(expr, pos);
+  if (pos != expr.size()) {
+    FATAL("unexpected token '%s' in #if", expr[pos].content());
+  }
+  return value != 0;
+}
+
+long Preprocessor::evalOr(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalAnd(toks, pos);
+  while (pos < toks.size() && toks[pos].is(PunctKind::PUNCT_OR_OR)) {
+    pos++;
+    long rhs = evalAnd(toks, pos);
+    value = value || rhs;
+  }
+  return value;
+}
+
+long Preprocessor::evalAnd(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalEquality(toks, pos);
+  while (pos < toks.size() && toks[pos].is(PunctKind::PUNCT_AND_AND)) {
+    pos++;
+    long rhs = evalEquality(toks, pos);
+    value = value && rhs;
+  }
+  return value;
+}
+
+long Preprocessor::evalEquality(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalRelation(toks, pos);
+  while (pos < toks.size()) {
+    if (toks[pos].is(PunctKind::PUNCT_EQ)) {
+      pos++;
+      value = value == evalRelation(toks, pos);
+    } else if (toks[pos].is(PunctKind::PUNCT_NE)) {
+      pos++;
+      value = value != evalRelation(toks, pos);
+    } else {
+      break;
+    }
+  }
+  return value;
+}
+
+long Preprocessor::evalRelation(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalAdd(toks, pos);
+  while (pos < toks.size() && toks[pos].kind() == TokenKind::TOKEN_PUNCT) {
+    PunctKind punct = toks[pos].punct();
+    if (punct == PunctKind::PUNCT_LT) {
+      pos++;
+      value = value < evalAdd(toks, pos);
+    } else if (punct == PunctKind::PUNCT_LE) {
+      pos++;
+      value = value <= evalAdd(toks, pos);
+    } else if (punct == PunctKind::PUNCT_GT) {
+      pos++;
+      value = value > evalAdd(toks, pos);
+    } else if (punct == PunctKind::PUNCT_GE) {
+      pos++;
+      value = value >= evalAdd(toks, pos);
+    } else {
+      break;
+    }
+  }
+  return value;
+}
+
+long Preprocessor::evalAdd(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalMul(toks, pos);
+  while (pos < toks.size()) {
+    if (toks[pos].is(PunctKind::PUNCT_PLUS)) {
+      pos++;
+      value += evalMul(toks, pos);
+    } else if (toks[pos].is(PunctKind::PUNCT_MINUS)) {
+      pos++;
+      value -= evalMul(toks, pos);
+    } else {
+      break;
+    }
+  }
+  return value;
+}
+
+long Preprocessor::evalMul(std::vector<Token>& toks, std::size_t& pos) {
+  long value = evalUnary(toks, pos);
+  while (pos < toks.size()) {
+    if (toks[pos].is(PunctKind::PUNCT_STAR)) {
+      pos++;
+      value *= evalUnary(toks, pos);
+    } else if (toks[pos].is(PunctKind::PUNCT_SLASH)) {
+      pos++;
+      long rhs = evalUnary(toks, pos);
+      if (rhs == 0) {
+        FATAL("division by zero in #if");
+      }
+      value /= rhs;
+    } else {
+      break;
+    }
+  }
+  return value;
+}
+
+long Preprocessor::evalUnary(std::vector<Token>& toks, std::size_t& pos) {
+  if (pos >= toks.size()) {
+    FATAL("#if expression ends unexpectedly");
+  }
+  Token& tok = toks[pos];
+  if (tok.is(PunctKind::PUNCT_NOT)) {
+    pos++;
+    return !evalUnary(toks, pos);
+  }
+  if (tok.is(PunctKind::PUNCT_MINUS)) {
+    pos++;
+    return -evalUnary(toks, pos);
+  }
+  if (tok.is(PunctKind::PUNCT_PLUS)) {
+    pos++;
+    return evalUnary(toks, pos);
+  }
+  if (tok.is(PunctKind::PUNCT_LPAREN)) {
+    pos++;
+    long value = evalOr(toks, pos);
+    if (pos >= toks.size() || !toks[pos].is(PunctKind::PUNCT_RPAREN)) {
+      FATAL("missing ')' in #if expression");
+    }
+    pos++;
+    return value;
+  }
+  if (tok.kind() == TokenKind::TOKEN_NUM) {
+    pos++;
+    return tok.value();
+  }
+  FATAL("unexpected token '%s' in #if", tok.content());
+  return 0;
+}
+
+} // namespace rvcc
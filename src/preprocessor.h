@@ -0,0 +1,126 @@
+#ifndef __PREPROCESSOR_H
+#define __PREPROCESSOR_H
+
+#include "lexer.h"
+#include "source.h"
+#include "token.h"
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rvcc {
+
+struct Macro {
+  std::string_view name;
+  bool function_like;
+  std::vector<std::string_view> params;
+  std::vector<Token> body;
+  bool active;          // 正在展开中, 禁止递归展开
+};
+
+// 头文件第一次被 include 时记录下的 token, 再次 include 时直接回放
+struct HeaderCache {
+  const SourceFile* file;
+  std::vector<Token> tokens;
+  bool complete;        // 已经完整读取过一次, tokens 可以回放
+  bool recording;       // 正在第一次读取
+  bool once;            // #pragma once
+  std::string guard;    // 检测到的 include guard 宏名, 为空表示没有
+};
+
+/*
+预处理器, 位于 Lexer 和 Parser 之间
+  支持 #include #define(对象宏/函数宏) #undef #if #ifdef #ifndef #elif #else #endif
+  宏在 token 层面展开, 展开后的 token 仍然指向 mmap 的源文件 buffer
+  头文件的 token 会被缓存, 形如
+    #ifndef X
+    #define X
+    ...
+    #endif
+  的头文件会记录 guard 宏 X, 之后 X 已定义时 include 直接跳过, 不再读取文件
+*/
+class Preprocessor: public Lexer {
+  public:
+    Preprocessor(const char* buffer,
+                 const std::vector<std::string>& include_dirs = {});
+    ~Preprocessor() override;
+    SourceLocation locate(const char* loc) override;
+    // 接下来只处理输入 buffer 的 [begin, end), 之后需要重新 init
+    void setRange(const char* begin, const char* end);
+    // 因为 include guard 被跳过的 include 次数
+    std::size_t guardSkips() const;
+    // 通过缓存回放的 include 次数
+    std::size_t cacheHits() const;
+  protected:
+    Token getNextToken() override;
+  private:
+    enum class GuardState:int {
+      GUARD_START = 0,  // 还没有读到任何 token
+      GUARD_IN,         // 位于 #ifndef X 内
+      GUARD_AFTER,      // 已经读到匹配的 #endif
+      GUARD_NONE        // 不是 include guard 形式
+    };
+    struct Frame {
+      const SourceFile* file;
+      Lexer* lexer;                       // 第一次读取文件时使用
+      std::vector<Token>* replay;         // 回放缓存的 token
+      std::size_t pos;
+      HeaderCache* cache;
+      std::size_t cond_base;              // 进入文件时条件栈的深度
+      GuardState guard_state;
+      std::string_view guard;
+      std::size_t guard_cond;
+      Token& peek();
+      Token next();
+    };
+    struct Pending {
+      Token tok;
+      Macro* end_of;    // 非空表示宏 end_of 的展开到此结束
+      bool stop;        // expandList 的结束标记
+    };
+    struct Cond {
+      bool taken;       // 已经有分支被选中
+      bool in_else;
+    };
+    void pushFrame(const SourceFile* file, HeaderCache* cache);
+    void popFrame();
+    Token nextRaw();
+    bool readToken(Token& tok, bool& from_file);
+    Token nextExpanded(bool& ok);
+    bool expandMacro(Token& tok);
+    void pushExpansion(Macro& macro, const std::vector<Token>& tokens);
+    void expandList(std::vector<Token>& tokens);
+    std::vector<Token> readLine();
+    void directive(std::vector<Token>& line);
+    void skipBlock();
+    void handleInclude(std::vector<Token>& line);
+    void handleDefine(std::vector<Token>& line);
+    bool evalCond(std::vector<Token>& line);
+    long evalOr(std::vector<Token>& toks, std::size_t& pos);
+    long evalAnd(std::vector<Token>& toks, std::size_t& pos);
+    long evalEquality(std::vector<Token>& toks, std::size_t& pos);
+    long evalRelation(std::vector<Token>& toks, std::size_t& pos);
+    long evalAdd(std::vector<Token>& toks, std::size_t& pos);
+    long evalMul(std::vector<Token>& toks, std::size_t& pos);
+    long evalUnary(std::vector<Token>& toks, std::size_t& pos);
+    std::string resolveInclude(const std::string& name, bool quoted);
+    bool isDefined(std::string_view name) const;
+    SourceManager& sources_;  // 属于构造时的 CompilerContext
+    std::vector<std::string> include_dirs_;
+    std::vector<Frame*> frames_;
+    std::deque<Pending> pending_;
+    std::vector<Cond> conds_;
+    std::unordered_map<std::string_view, Macro> macros_;
+    std::map<std::string, HeaderCache> headers_;
+    std::map<std::string, std::string> resolved_;
+    std::size_t guard_skips_;
+    std::size_t cache_hits_;
+};
+
+} // namespace rvcc
+
+#endif
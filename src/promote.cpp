@@ -0,0 +1,49 @@
+#include "promote.h"
+#include "ast.h"
+#include "codegen.h"
+#include "context.h"
+#include "regalloc.h"
+#include <set>
+
+namespace rvcc {
+
+const char* PromotePass::name() const {
+  return "promote";
+}
+
+PassKind PromotePass::kind() const {
+  return PassKind::PASS_AST;
+}
+
+bool PromotePass::run(Function* func) const {
+  if (!CompilerContext::current().passes().enabled(regAllocPass())) {
+    return false;
+  }
+  std::set<Var*> address_taken = addressTakenVars(func);
+  bool changed = false;
+  int offset = 0;
+  for (auto& var: func->vars()) {
+    bool promoted = var->type()->kind() != TypeKind::TYPE_ARRAY &&
+                    !address_taken.count(var);
+    if (promoted != var->promoted()) {
+      var->promoted() = promoted;
+      changed = true;
+    }
+    if (promoted) {
+      continue;
+    }
+    if (var->offset() != offset) {
+      var->offset() = offset;
+      changed = true;
+    }
+    offset += var->type()->size();
+  }
+  return changed;
+}
+
+const Pass* promotePass() {
+  static const PromotePass pass;
+  return &pass;
+}
+
+} // namespace rvcc
@@ -0,0 +1,25 @@
+#ifndef __PROMOTE_H
+#define __PROMOTE_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+把局部标量提升到寄存器
+  没有被 & 取地址的非数组变量 (包括参数) 整个生命周期都保存在虚拟寄存器中,
+  读写变成 mv, 不再需要 addi + ld/sd; 其余变量重新紧凑地排列栈上的偏移
+  依赖虚拟寄存器, 只在 regalloc 开启时生效
+*/
+class PromotePass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(Function* func) const override;
+};
+
+const Pass* promotePass();
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,365 @@
+#include "regalloc.h"
+#include "context.h"
+#include "logger.h"
+#include "mir.h"
+#include "target.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+struct Interval {
+  int vreg;
+  long begin;           // 第一次定义或者活跃的位置
+  long end;             // 最后一次使用或者活跃的位置
+  bool across_call;
+  int reg;              // 分配的寄存器, REG_NONE 表示溢出
+};
+
+struct Block {
+  std::size_t begin;
+  std::size_t end;
+  std::vector<std::size_t> succs;
+  std::vector<bool> live_in;
+  std::vector<bool> live_out;
+};
+
+// 按 label 和跳转切分基本块
+std::vector<Block> buildBlocks(const MFunction& func) {
+  const std::vector<MInst>& insts = func.insts;
+  std::vector<Block> blocks;
+  std::map<std::string, std::size_t> labels;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i < insts.size(); i++) {
+    if (insts[i].op == MOpcode::MOP_LABEL && i != begin) {
+      blocks.push_back({begin, i, {}, {}, {}});
+      begin = i;
+    }
+    if (insts[i].op == MOpcode::MOP_LABEL) {
+      labels[insts[i].sym] = blocks.size();
+    }
+    if (insts[i].isBranch() || insts[i].op == MOpcode::MOP_RET) {
+      blocks.push_back({begin, i + 1, {}, {}, {}});
+      begin = i + 1;
+    }
+  }
+  if (begin < insts.size()) {
+    blocks.push_back({begin, insts.size(), {}, {}, {}});
+  }
+  for (std::size_t i = 0; i < blocks.size(); i++) {
+    const MInst& last = insts[blocks[i].end - 1];
+    if (last.isBranch()) {
+      auto iter = labels.find(last.sym);
+      CHECK(iter != labels.end());
+      blocks[i].succs.push_back(iter->second);
+    }
+    bool fallthrough = last.op != MOpcode::MOP_J && last.op != MOpcode::MOP_RET;
+    if (fallthrough && i + 1 < blocks.size()) {
+      blocks[i].succs.push_back(i + 1);
+    }
+  }
+  return blocks;
+}
+
+// 虚拟寄存器的活跃分析, 结果写入 live_in live_out
+void computeLiveness(const MFunction& func, std::vector<Block>& blocks, int count) {
+  std::vector<std::vector<bool>> gen(blocks.size(), std::vector<bool>(count));
+  std::vector<std::vector<bool>> kill(blocks.size(), std::vector<bool>(count));
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    blocks[b].live_in.assign(count, false);
+    blocks[b].live_out.assign(count, false);
+    for (std::size_t i = blocks[b].end; i-- > blocks[b].begin;) {
+      const MInst& inst = func.insts[i];
+      int def = inst.def();
+      if (isVirtualReg(def)) {
+        kill[b][def - kFirstVirtualReg] = true;
+        gen[b][def - kFirstVirtualReg] = false;
+      }
+      int regs[2];
+      std::size_t uses = inst.uses(regs);
+      for (std::size_t j = 0; j < uses; j++) {
+        if (isVirtualReg(regs[j])) {
+          gen[b][regs[j] - kFirstVirtualReg] = true;
+        }
+      }
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (std::size_t b = blocks.size(); b-- > 0;) {
+      Block& block = blocks[b];
+      for (auto succ: block.succs) {
+        for (int v = 0; v < count; v++) {
+          if (blocks[succ].live_in[v] && !block.live_out[v]) {
+            block.live_out[v] = true;
+          }
+        }
+      }
+      for (int v = 0; v < count; v++) {
+        bool live = gen[b][v] || (block.live_out[v] && !kill[b][v]);
+        if (live && !block.live_in[v]) {
+          block.live_in[v] = true;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+// 活跃区间取所有活跃位置的包络, 区间内的空洞也当作活跃
+std::vector<Interval> buildIntervals(const MFunction& func) {
+  int count = func.next_vreg - kFirstVirtualReg;
+  std::vector<Interval> intervals(count);
+  for (int v = 0; v < count; v++) {
+    intervals[v] = Interval{v + kFirstVirtualReg, -1, -1, false, REG_NONE};
+  }
+  auto extend = [&](int v, long pos) {
+    Interval& interval = intervals[v];
+    if (interval.begin < 0 || pos < interval.begin) {
+      interval.begin = pos;
+    }
+    interval.end = std::max(interval.end, pos);
+  };
+  std::vector<Block> blocks = buildBlocks(func);
+  computeLiveness(func, blocks, count);
+  std::vector<long> calls;
+  for (auto& block: blocks) {
+    for (int v = 0; v < count; v++) {
+      if (block.live_in[v]) {
+        extend(v, block.begin);
+      }
+      if (block.live_out[v]) {
+        extend(v, block.end - 1);
+      }
+    }
+    for (std::size_t i = block.begin; i < block.end; i++) {
+      const MInst& inst = func.insts[i];
+      if (inst.op == MOpcode::MOP_CALL) {
+        calls.push_back(i);
+      }
+      int regs[3];
+      std::size_t uses = inst.uses(regs);
+      regs[uses++] = inst.def();
+      for (std::size_t j = 0; j < uses; j++) {
+        if (isVirtualReg(regs[j])) {
+          extend(regs[j] - kFirstVirtualReg, i);
+        }
+      }
+    }
+  }
+  std::vector<Interval> result;
+  for (auto& interval: intervals) {
+    if (interval.begin < 0) {
+      continue;
+    }
+    auto call = std::upper_bound(calls.begin(), calls.end(), interval.begin);
+    interval.across_call = call != calls.end() && *call < interval.end;
+    result.push_back(interval);
+  }
+  std::sort(result.begin(), result.end(), [](const Interval& a, const Interval& b) {
+    return a.begin < b.begin;
+  });
+  return result;
+}
+
+bool usable(int reg, const Interval& interval) {
+  return !interval.across_call || isCalleeSavedReg(reg);
+}
+
+// 返回是否有区间被溢出
+bool linearScan(std::vector<Interval>& intervals, const std::vector<int>& regs) {
+  std::vector<bool> free(REG_COUNT, false);
+  for (auto reg: regs) {
+    free[reg] = true;
+  }
+  std::vector<Interval*> active;
+  bool spilled = false;
+  for (auto& current: intervals) {
+    for (auto iter = active.begin(); iter != active.end();) {
+      if ((*iter)->end <= current.begin) {
+        free[(*iter)->reg] = true;
+        iter = active.erase(iter);
+      } else {
+        iter++;
+      }
+    }
+    for (auto reg: regs) {
+      if (free[reg] && usable(reg, current)) {
+        current.reg = reg;
+        break;
+      }
+    }
+    if (current.reg != REG_NONE) {
+      free[current.reg] = false;
+      active.push_back(&current);
+      continue;
+    }
+    // 溢出终点最远的区间
+    spilled = true;
+    Interval* victim = nullptr;
+    for (auto interval: active) {
+      if (usable(interval->reg, current) &&
+          (!victim || interval->end > victim->end)) {
+        victim = interval;
+      }
+    }
+    if (victim && victim->end > current.end) {
+      current.reg = victim->reg;
+      victim->reg = REG_NONE;
+      *std::find(active.begin(), active.end(), victim) = &current;
+    }
+  }
+  return spilled;
+}
+
+// 溢出记录为优化记录, 跨过调用的区间只能使用被调用者保存的寄存器
+void remarkSpill(const MFunction& func, const Interval& interval, long slot) {
+  Remarks& remarks = CompilerContext::current().remarks();
+  if (!remarks.enabled()) {
+    return;
+  }
+  std::string vreg = "v" + std::to_string(interval.vreg - kFirstVirtualReg);
+  std::string where = "fp" + std::to_string(slot);
+  std::string reason = interval.across_call ?
+    "it crosses a call and no callee-saved register is left" : "no register is free";
+  remarks.add(RemarkKind::REMARK_MISSED, "regalloc", "Spilled", func.name, func.loc, nullptr,
+              vreg + " spilled to " + where + " because " + reason,
+              {{"vreg", vreg}, {"slot", where}, {"reason", reason}});
+}
+
+long allocSlot(MFunction& func) {
+  func.stack_size += 8;
+  return -static_cast<long>(func.stack_size);
+}
+
+// 溢出的虚拟寄存器保存在栈中, 每次使用前 ld 到新的虚拟寄存器, 定义之后 sd
+void rewriteSpills(MFunction& func, const std::map<int, long>& slots) {
+  std::vector<MInst> insts;
+  insts.reserve(func.insts.size());
+  for (auto inst: func.insts) {
+    auto rd = slots.find(inst.rd);
+    auto rs1 = slots.find(inst.rs1);
+    bool def = isVirtualReg(inst.def()) && rd != slots.end();
+    if (inst.op == MOpcode::MOP_MV && def && rs1 == slots.end()) {
+      insts.emplace_back(MOpcode::MOP_SD, REG_NONE, REG_FP, inst.rs1, rd->second);
+      continue;
+    }
+    if (inst.op == MOpcode::MOP_MV && !def && rs1 != slots.end()) {
+      insts.emplace_back(MOpcode::MOP_LD, inst.rd, REG_FP, REG_NONE, rs1->second);
+      continue;
+    }
+    int regs[2];
+    std::size_t uses = inst.uses(regs);
+    for (std::size_t j = 0; j < uses; j++) {
+      auto slot = slots.find(regs[j]);
+      if (slot == slots.end()) {
+        continue;
+      }
+      int vreg = func.newVirtualReg();
+      insts.emplace_back(MOpcode::MOP_LD, vreg, REG_FP, REG_NONE, slot->second);
+      if (inst.rs1 == regs[j]) {
+        inst.rs1 = vreg;
+      }
+      if (inst.rs2 == regs[j]) {
+        inst.rs2 = vreg;
+      }
+    }
+    if (!def) {
+      insts.push_back(inst);
+      continue;
+    }
+    long offset = rd->second;
+    inst.rd = func.newVirtualReg();
+    insts.push_back(inst);
+    insts.emplace_back(MOpcode::MOP_SD, REG_NONE, REG_FP, inst.rd, offset);
+  }
+  func.insts.swap(insts);
+}
+
+void replaceRegs(MFunction& func, const std::map<int, int>& assignment) {
+  auto replace = [&](int& reg) {
+    if (isVirtualReg(reg)) {
+      auto iter = assignment.find(reg);
+      CHECK(iter != assignment.end());
+      reg = iter->second;
+    }
+  };
+  std::vector<MInst> insts;
+  insts.reserve(func.insts.size());
+  for (auto inst: func.insts) {
+    replace(inst.rd);
+    replace(inst.rs1);
+    replace(inst.rs2);
+    if (inst.op == MOpcode::MOP_MV && inst.rd == inst.rs1) {
+      continue;
+    }
+    insts.push_back(inst);
+  }
+  func.insts.swap(insts);
+}
+
+// 用到的被调用者保存的寄存器由 prologue 保存, epilogue 恢复
+void saveCalleeSaved(MFunction& func, const std::set<int>& regs) {
+  for (auto reg: regs) {
+    func.callee_saved.emplace_back(reg, allocSlot(func));
+  }
+}
+
+} // namespace
+
+const char* RegAllocPass::name() const {
+  return "regalloc";
+}
+
+PassKind RegAllocPass::kind() const {
+  return PassKind::PASS_MACHINE;
+}
+
+bool RegAllocPass::required() const {
+  return true;
+}
+
+bool RegAllocPass::run(MFunction& func) const {
+  if (func.next_vreg == kFirstVirtualReg) {
+    return false;
+  }
+  const std::vector<int>& regs = CompilerContext::current().target()->allocatableRegs();
+  std::vector<Interval> intervals = buildIntervals(func);
+  while (linearScan(intervals, regs)) {
+    std::map<int, long> slots;
+    for (auto& interval: intervals) {
+      if (interval.reg == REG_NONE) {
+        slots[interval.vreg] = allocSlot(func);
+        remarkSpill(func, interval, slots[interval.vreg]);
+      }
+    }
+    rewriteSpills(func, slots);
+    intervals = buildIntervals(func);
+  }
+  std::map<int, int> assignment;
+  std::set<int> callee_saved;
+  for (auto& interval: intervals) {
+    assignment[interval.vreg] = interval.reg;
+    if (isCalleeSavedReg(interval.reg)) {
+      callee_saved.insert(interval.reg);
+    }
+  }
+  replaceRegs(func, assignment);
+  saveCalleeSaved(func, callee_saved);
+  func.stack_size = (func.stack_size + 16 - 1) / 16 * 16;
+  func.virtual_regs = false;
+  return true;
+}
+
+const Pass* regAllocPass() {
+  static const RegAllocPass pass;
+  return &pass;
+}
+
+} // namespace rvcc
@@ -0,0 +1,28 @@
+#ifndef __REGALLOC_H
+#define __REGALLOC_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+线性扫描寄存器分配
+  codegen 把表达式的中间结果保存在虚拟寄存器中 (见 save_ restore_),
+  按 MIR 的控制流计算活跃区间后, 按起点顺序分配 Target::allocatableRegs 中的寄存器
+  跨越 call 的区间只能使用被调用者保存的寄存器, 用到的被调用者保存的寄存器
+  在函数开头保存, 在 return 段之后恢复
+  没有空闲寄存器时溢出终点最远的区间, 改写为 fp 相对的 ld/sd 之后重新分配
+*/
+class RegAllocPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool required() const override;
+    bool run(MFunction& func) const override;
+};
+
+const Pass* regAllocPass();
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,120 @@
+#include "remarks.h"
+#include "context.h"
+#include "source.h"
+#include <cstdio>
+
+namespace rvcc {
+
+namespace {
+
+const char* kind_names[static_cast<int>(RemarkKind::REMARK_COUNT)] = {
+  "Passed", "Missed", "Analysis"
+};
+
+void appendJsonString(std::string& out, const std::string& str) {
+  out += '"';
+  for (unsigned char ch: str) {
+    switch (ch) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (ch < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", ch);
+        out += buf;
+      } else {
+        out += ch;
+      }
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+const char* Remark::kindName() const {
+  return kind_names[static_cast<int>(kind)];
+}
+
+bool& Remarks::enabled() {
+  return enabled_;
+}
+
+void Remarks::add(RemarkKind kind, const char* pass, const char* name,
+                  const std::string& function, const char* loc, const char* fallback,
+                  const std::string& message,
+                  std::vector<std::pair<std::string, std::string>> args) {
+  if (!enabled_) {
+    return;
+  }
+  Remark remark{kind, pass, name, function, "", 0, 0, message, std::move(args)};
+  const char* where = loc ? loc : fallback;
+  const SourceFile* file = where ?
+    CompilerContext::current().sources().find(where) : nullptr;
+  if (file) {
+    SourceLocation location = SourceManager::locate(file, where);
+    remark.file = location.name;
+    remark.line = location.line;
+    remark.column = location.column;
+  }
+  records_.push_back(std::move(remark));
+}
+
+const std::vector<Remark>& Remarks::records() const {
+  return records_;
+}
+
+std::string Remarks::toJson() const {
+  std::string out = "[\n";
+  for (std::size_t i = 0; i < records_.size(); i++) {
+    const Remark& remark = records_[i];
+    out += "  {\"kind\": ";
+    appendJsonString(out, remark.kindName());
+    out += ", \"pass\": ";
+    appendJsonString(out, remark.pass);
+    out += ", \"name\": ";
+    appendJsonString(out, remark.name);
+    out += ", \"function\": ";
+    appendJsonString(out, remark.function);
+    out += ",\n   \"location\": ";
+    if (remark.file.empty()) {
+      out += "null";
+    } else {
+      out += "{\"file\": ";
+      appendJsonString(out, remark.file);
+      out += ", \"line\": " + std::to_string(remark.line);
+      out += ", \"column\": " + std::to_string(remark.column) + "}";
+    }
+    out += ",\n   \"message\": ";
+    appendJsonString(out, remark.message);
+    out += ",\n   \"args\": {";
+    for (std::size_t j = 0; j < remark.args.size(); j++) {
+      out += j ? ", " : "";
+      appendJsonString(out, remark.args[j].first);
+      out += ": ";
+      appendJsonString(out, remark.args[j].second);
+    }
+    out += "}}";
+    out += i + 1 < records_.size() ? ",\n" : "\n";
+  }
+  out += "]\n";
+  return out;
+}
+
+bool Remarks::save(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  std::string json = toJson();
+  bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+  return fclose(file) == 0 && ok;
+}
+
+void Remarks::clear() {
+  records_.clear();
+}
+
+} // namespace rvcc
@@ -0,0 +1,56 @@
+#ifndef __REMARKS_H
+#define __REMARKS_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rvcc {
+
+enum class RemarkKind:int {
+  REMARK_PASSED = 0,    // 做了优化
+  REMARK_MISSED,        // 没有做优化, message 说明原因
+  REMARK_ANALYSIS,      // 分析结果
+  REMARK_COUNT
+};
+
+// 一条优化记录, 位置在记录时由 token 的 loc 解析得到
+struct Remark {
+  RemarkKind kind;
+  std::string pass;       // 产生记录的 pass
+  std::string name;       // 记录的种类, 如 StackSlot
+  std::string function;
+  std::string file;       // 无法定位时为空
+  int line;
+  int column;
+  std::string message;
+  std::vector<std::pair<std::string, std::string>> args;
+  const char* kindName() const;
+};
+
+/*
+优化记录 (-fsave-optimization-record=file)
+  各个 pass 通过 add 记录每一个决定, 编译结束后输出为 JSON
+  没有开启时 add 直接返回, 不解析位置也不格式化
+*/
+class Remarks {
+  public:
+    Remarks(): enabled_(false) {}
+    bool& enabled();
+    // loc 为 token 在输入中的位置, 为空时使用 fallback (一般是函数名的位置)
+    void add(RemarkKind kind, const char* pass, const char* name,
+             const std::string& function, const char* loc, const char* fallback,
+             const std::string& message,
+             std::vector<std::pair<std::string, std::string>> args = {});
+    const std::vector<Remark>& records() const;
+    std::string toJson() const;
+    bool save(const std::string& path) const;
+    void clear();
+  private:
+    bool enabled_;
+    std::vector<Remark> records_;
+};
+
+} // namespace rvcc
+
+#endif
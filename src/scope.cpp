@@ -0,0 +1,121 @@
+#include "scope.h"
+#include "logger.h"
+#include "utils.h"
+#include <cstring>
+
+namespace rvcc {
+
+FlatVarMap::FlatVarMap(): slots_(16, Slot{0, nullptr, 0, nullptr}), used_(0) {}
+
+std::size_t FlatVarMap::slot(const char* name, std::size_t len) {
+  // 负载因子超过 1/2 时扩容
+  if ((used_ + 1) * 2 > slots_.size()) {
+    grow();
+  }
+  std::size_t hash = getstrHash(name, len);
+  std::size_t mask = slots_.size() - 1;
+  std::size_t i = hash & mask;
+  while (slots_[i].name) {
+    if (slots_[i].hash == hash && slots_[i].len == len &&
+        std::strncmp(slots_[i].name, name, len) == 0) {
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  slots_[i] = Slot{hash, name, len, nullptr};
+  used_++;
+  return i;
+}
+
+Var* FlatVarMap::find(const char* name, std::size_t len) const {
+  std::size_t hash = getstrHash(name, len);
+  std::size_t mask = slots_.size() - 1;
+  std::size_t i = hash & mask;
+  while (slots_[i].name) {
+    if (slots_[i].hash == hash && slots_[i].len == len &&
+        std::strncmp(slots_[i].name, name, len) == 0) {
+      return slots_[i].var;
+    }
+    i = (i + 1) & mask;
+  }
+  return nullptr;
+}
+
+Var*& FlatVarMap::value(std::size_t slot) {
+  return slots_[slot].var;
+}
+
+void FlatVarMap::clear() {
+  for (auto& slot: slots_) {
+    slot = Slot{0, nullptr, 0, nullptr};
+  }
+  used_ = 0;
+}
+
+void FlatVarMap::grow() {
+  std::vector<Slot> old;
+  old.swap(slots_);
+  slots_.assign(old.size() * 2, Slot{0, nullptr, 0, nullptr});
+  std::size_t mask = slots_.size() - 1;
+  for (auto& slot: old) {
+    if (!slot.name) {
+      continue;
+    }
+    std::size_t i = slot.hash & mask;
+    while (slots_[i].name) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+  }
+}
+
+SymbolTable::SymbolTable(): tick_(0) {}
+
+void SymbolTable::enterScope() {
+  scope_marks_.push_back(undo_log_.size());
+}
+
+void SymbolTable::leaveScope() {
+  CHECK(!scope_marks_.empty());
+  std::size_t mark = scope_marks_.back();
+  scope_marks_.pop_back();
+  while (undo_log_.size() > mark) {
+    UndoEntry& entry = undo_log_.back();
+    entry.var->live_end() = tick_;
+    map_.value(map_.slot(entry.var->getName(), entry.var->name_len())) = entry.prev;
+    undo_log_.pop_back();
+  }
+  tick_++;
+}
+
+bool SymbolTable::declare(Var* var) {
+  CHECK(!scope_marks_.empty());
+  std::size_t slot = map_.slot(var->getName(), var->name_len());
+  Var*& curr = map_.value(slot);
+  if (curr && curr->scope_depth() == depth()) {
+    return false;
+  }
+  undo_log_.push_back(UndoEntry{var, curr});
+  var->scope_depth() = depth();
+  var->live_begin() = tick_++;
+  var->live_end() = -1;
+  curr = var;
+  return true;
+}
+
+Var* SymbolTable::lookup(const char* name, std::size_t len) const {
+  return map_.find(name, len);
+}
+
+int SymbolTable::depth() const {
+  return static_cast<int>(scope_marks_.size());
+}
+
+void SymbolTable::clear() {
+  map_.clear();
+  undo_log_.clear();
+  scope_marks_.clear();
+  tick_ = 0;
+}
+
+} // namespace rvcc
@@ -0,0 +1,66 @@
+#ifndef __SCOPE_H
+#define __SCOPE_H
+
+#include "ast.h"
+#include <cstddef>
+#include <vector>
+
+namespace rvcc {
+
+/*
+开放寻址 (线性探测) 的 flat hash map, key 为变量名, value 为当前可见的 Var
+变量名直接引用输入 buffer, 比较时先比较 hash 和长度, 再比较内容
+删除操作只会把 value 置空, 槽位保留给同名变量复用, 因此不需要墓碑
+*/
+class FlatVarMap {
+  public:
+    FlatVarMap();
+    // 返回 name 所在的槽位, 不存在时插入一个 value 为空的槽位
+    std::size_t slot(const char* name, std::size_t len);
+    Var* find(const char* name, std::size_t len) const;
+    Var*& value(std::size_t slot);
+    void clear();
+  private:
+    struct Slot {
+      std::size_t hash;
+      const char* name;
+      std::size_t len;
+      Var* var;
+    };
+    void grow();
+    std::vector<Slot> slots_;
+    std::size_t used_;
+};
+
+/*
+块作用域符号表
+  enterScope/leaveScope 只记录和回滚 undo log,
+  进入作用域 O(1), 离开作用域只回滚本层声明过的变量
+  每个变量记录声明时的序号 live_begin 和离开作用域时的序号 live_end,
+  两个变量的 [live_begin, live_end) 不相交时可以共用同一个栈槽
+*/
+class SymbolTable {
+  public:
+    SymbolTable();
+    void enterScope();
+    void leaveScope();
+    // 当前作用域内重复声明时返回 false
+    bool declare(Var* var);
+    Var* lookup(const char* name, std::size_t len) const;
+    int depth() const;
+    void clear();
+  private:
+    // 扩容会改变槽位编号, 因此 undo log 记录变量本身, 回滚时重新定位槽位
+    struct UndoEntry {
+      Var* var;
+      Var* prev;
+    };
+    FlatVarMap map_;
+    std::vector<UndoEntry> undo_log_;
+    std::vector<std::size_t> scope_marks_;
+    int tick_;
+};
+
+} // namespace rvcc
+
+#endif
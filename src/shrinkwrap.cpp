@@ -0,0 +1,226 @@
+#include "shrinkwrap.h"
+#include "context.h"
+#include "mir.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+struct Block {
+  std::size_t begin;
+  std::size_t end;
+  bool needs_frame;
+  std::vector<std::size_t> succs;
+  std::vector<std::size_t> preds;
+};
+
+// 调用, 压栈弹栈以及读写 fp sp ra 或者被调用者保存的寄存器的指令需要栈帧
+bool needsFrame(const MInst& inst) {
+  switch (inst.op) {
+  case MOpcode::MOP_CALL:
+  case MOpcode::MOP_PUSH:
+  case MOpcode::MOP_POP:
+    return true;
+  default:
+    break;
+  }
+  for (int reg: {inst.rd, inst.rs1, inst.rs2}) {
+    if (reg == REG_FP || reg == REG_SP || reg == REG_RA || isCalleeSavedReg(reg)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool fallsThrough(const MInst& inst) {
+  return inst.op != MOpcode::MOP_J && inst.op != MOpcode::MOP_RET;
+}
+
+// 按 label 和跳转切分基本块
+std::vector<Block> buildBlocks(const MFunction& func,
+                               std::map<std::string, std::size_t>& labels) {
+  const std::vector<MInst>& insts = func.insts;
+  std::vector<Block> blocks;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i < insts.size(); i++) {
+    if (insts[i].op == MOpcode::MOP_LABEL && i != begin) {
+      blocks.push_back({begin, i, false, {}, {}});
+      begin = i;
+    }
+    if (insts[i].op == MOpcode::MOP_LABEL) {
+      labels[insts[i].sym] = blocks.size();
+    }
+    if (insts[i].isBranch() || insts[i].op == MOpcode::MOP_RET) {
+      blocks.push_back({begin, i + 1, false, {}, {}});
+      begin = i + 1;
+    }
+  }
+  if (begin < insts.size()) {
+    blocks.push_back({begin, insts.size(), false, {}, {}});
+  }
+  for (std::size_t i = 0; i < blocks.size(); i++) {
+    Block& block = blocks[i];
+    for (std::size_t j = block.begin; j < block.end; j++) {
+      block.needs_frame = block.needs_frame || needsFrame(insts[j]);
+    }
+    const MInst& last = insts[block.end - 1];
+    if (last.isBranch()) {
+      block.succs.push_back(labels.at(last.sym));
+    }
+    if (fallsThrough(last) && i + 1 < blocks.size()) {
+      block.succs.push_back(i + 1);
+    }
+    for (auto succ: block.succs) {
+      blocks[succ].preds.push_back(i);
+    }
+  }
+  return blocks;
+}
+
+/*
+以 save 为入口, 不经过 ret 块能到达的块都在栈帧中执行, 返回这些块
+  save 在循环中, 入口块在栈帧中, 需要栈帧的块不在栈帧中,
+  或者栈帧中的块 (除了 save) 有不在栈帧中的前驱时返回空
+*/
+std::vector<bool> framedBlocks(const std::vector<Block>& blocks,
+                               std::size_t save, std::size_t ret) {
+  std::vector<bool> framed(blocks.size(), false);
+  std::vector<std::size_t> work(blocks[save].succs);
+  while (!work.empty()) {
+    std::size_t b = work.back();
+    work.pop_back();
+    if (b == ret || framed[b]) {
+      continue;
+    }
+    framed[b] = true;
+    work.insert(work.end(), blocks[b].succs.begin(), blocks[b].succs.end());
+  }
+  if (framed[save] || framed[0]) {
+    return {};
+  }
+  framed[save] = true;
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    if (blocks[b].needs_frame && !framed[b]) {
+      return {};
+    }
+    if (!framed[b] || b == save) {
+      continue;
+    }
+    for (auto pred: blocks[b].preds) {
+      if (!framed[pred]) {
+        return {};
+      }
+    }
+  }
+  return framed;
+}
+
+/*
+选择在栈帧中执行的块最少的 save 块, prologue 放在 save 块的标签之后
+  不在栈帧中的块跳转到 return 段时改为直接 ret
+  return 段只能有标签, 其中的指令在直接 ret 的路径上不会执行
+*/
+bool shrinkWrap(MFunction& func) {
+  std::map<std::string, std::size_t> labels;
+  std::vector<Block> blocks = buildBlocks(func, labels);
+  std::string ret_label = ".L.return." + func.name;
+  auto iter = labels.find(ret_label);
+  if (iter == labels.end() || iter->second + 1 != blocks.size()) {
+    return false;
+  }
+  std::size_t ret = iter->second;
+  for (std::size_t i = blocks[ret].begin; i < blocks[ret].end; i++) {
+    MOpcode op = func.insts[i].op;
+    if (op != MOpcode::MOP_LABEL && op != MOpcode::MOP_COMMENT) {
+      return false;
+    }
+  }
+  std::size_t save = 0;
+  std::vector<bool> framed;
+  std::size_t best = blocks.size();
+  for (std::size_t b = 1; b < ret; b++) {
+    std::vector<bool> candidate = framedBlocks(blocks, b, ret);
+    std::size_t count = std::count(candidate.begin(), candidate.end(), true);
+    if (candidate.empty() || count >= best) {
+      continue;
+    }
+    // 不在栈帧中的块只能无条件跳转到 return 段
+    bool ok = true;
+    for (std::size_t i = 0; i < ret && ok; i++) {
+      const MInst& last = func.insts[blocks[i].end - 1];
+      ok = candidate[i] || last.op == MOpcode::MOP_J || last.sym != ret_label;
+    }
+    if (ok) {
+      save = b;
+      framed.swap(candidate);
+      best = count;
+    }
+  }
+  if (save == 0) {
+    return false;
+  }
+  std::vector<MInst> insts;
+  insts.reserve(func.insts.size() + blocks.size());
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    const Block& block = blocks[b];
+    bool frameless = b != ret && !framed[b];
+    std::size_t i = block.begin;
+    if (b == save) {
+      if (func.insts[i].op == MOpcode::MOP_LABEL) {
+        insts.push_back(func.insts[i++]);
+      }
+      func.prologue_pos = insts.size();
+    }
+    for (; i < block.end; i++) {
+      const MInst& inst = func.insts[i];
+      if (frameless && inst.op == MOpcode::MOP_J && inst.sym == ret_label) {
+        insts.emplace_back(MOpcode::MOP_RET);
+      } else {
+        insts.push_back(inst);
+      }
+    }
+    if (frameless && b + 1 == ret && fallsThrough(insts.back())) {
+      insts.emplace_back(MOpcode::MOP_RET);
+    }
+  }
+  func.insts.swap(insts);
+  return true;
+}
+
+} // namespace
+
+const char* ShrinkWrapPass::name() const {
+  return "shrink-wrap";
+}
+
+PassKind ShrinkWrapPass::kind() const {
+  return PassKind::PASS_MACHINE;
+}
+
+bool ShrinkWrapPass::run(MFunction& func) const {
+  bool calls = false;
+  bool frame = false;
+  for (auto& inst: func.insts) {
+    calls = calls || inst.op == MOpcode::MOP_CALL;
+    frame = frame || needsFrame(inst);
+  }
+  func.frame = frame;
+  func.save_ra = calls;
+  bool wrapped = frame && shrinkWrap(func);
+  PassManager& passes = CompilerContext::current().passes();
+  passes.addStat(this, "frameless", !frame);
+  passes.addStat(this, "leaf", frame && !calls);
+  passes.addStat(this, "shrink-wrapped", wrapped);
+  return !calls || wrapped;
+}
+
+const Pass* shrinkWrapPass() {
+  static const ShrinkWrapPass pass;
+  return &pass;
+}
+
+} // namespace rvcc
@@ -0,0 +1,25 @@
+#ifndef __SHRINKWRAP_H
+#define __SHRINKWRAP_H
+
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+叶子函数和 shrink-wrapping, 在 Target 输出之前调整 prologue/epilogue
+  没有调用其他函数时不保存 ra, 没有访问栈 (fp sp) 时不建立栈帧, 直接 ret
+  需要栈帧的指令只在部分路径上时, prologue 移动到这些路径的入口块,
+  其余路径上的 return 直接 ret, 不经过 epilogue
+*/
+class ShrinkWrapPass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+    bool run(MFunction& func) const override;
+};
+
+const Pass* shrinkWrapPass();
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,149 @@
+#include "source.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rvcc {
+
+static std::string dirName(const std::string& path) {
+  std::size_t pos = path.find_last_of('/');
+  if (pos == std::string::npos) {
+    return "";
+  }
+  return path.substr(0, pos + 1);
+}
+
+bool LineIndex::built() const {
+  return built_;
+}
+
+void LineIndex::build(const char* buffer, std::size_t size) {
+  starts_.clear();
+  starts_.push_back(0);
+  const char* pos = buffer;
+  const char* end = buffer + size;
+  while (pos < end) {
+    const char* newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+    if (!newline) {
+      break;
+    }
+    pos = newline + 1;
+    starts_.push_back(pos - buffer);
+  }
+  built_ = true;
+}
+
+std::size_t LineIndex::lineOf(std::size_t offset) const {
+  return std::upper_bound(starts_.begin(), starts_.end(), offset) - starts_.begin() - 1;
+}
+
+std::size_t LineIndex::lineStart(std::size_t line) const {
+  return starts_[line];
+}
+
+std::size_t LineIndex::lineCount() const {
+  return starts_.size();
+}
+
+SourceLocation SourceManager::locate(const SourceFile* file, const char* loc) {
+  if (!file->lines.built()) {
+    file->lines.build(file->buffer, file->size);
+  }
+  std::size_t offset = loc - file->buffer;
+  std::size_t line = file->lines.lineOf(offset);
+  const char* line_begin = file->buffer + file->lines.lineStart(line);
+  const char* line_end = file->buffer + file->size;
+  if (line + 1 < file->lines.lineCount()) {
+    line_end = file->buffer + file->lines.lineStart(line + 1) - 1;
+  }
+  if (line_end > line_begin && line_end[-1] == '\r') {
+    line_end--;
+  }
+  return SourceLocation{file->name.c_str(), static_cast<int>(line + 1),
+                        static_cast<int>(loc - line_begin + 1),
+                        line_begin, static_cast<std::size_t>(line_end - line_begin)};
+}
+
+SourceManager::~SourceManager() {
+  clear();
+}
+
+void SourceManager::clear() {
+  for (auto file: files_) {
+    if (file->mapped) {
+      munmap(const_cast<char*>(file->buffer), file->size);
+    } else if (file->owned) {
+      delete[] file->buffer;
+    }
+    delete file;
+  }
+  files_.clear();
+}
+
+void SourceManager::adopt(SourceManager& other) {
+  files_.insert(files_.end(), other.files_.begin(), other.files_.end());
+  other.files_.clear();
+}
+
+const SourceFile* SourceManager::addBuffer(const std::string& name, const char* buffer) {
+  SourceFile* file = new SourceFile{name, dirName(name), buffer,
+                                    strlen(buffer), false, false};
+  files_.push_back(file);
+  return file;
+}
+
+const SourceFile* SourceManager::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+  std::size_t size = st.st_size;
+  SourceFile* file = new SourceFile{path, dirName(path), nullptr, size, false, false};
+  long page_size = sysconf(_SC_PAGESIZE);
+  // 文件大小不是页大小整数倍时, mmap 最后一页多余的部分会被填 0,
+  // 可以直接作为 '\0' 结尾的 buffer 使用; 否则退化为读入内存
+  if (size > 0 && size % page_size != 0) {
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      file->buffer = static_cast<const char*>(addr);
+      file->mapped = true;
+    }
+  }
+  if (!file->buffer) {
+    char* buffer = new char[size + 1];
+    std::size_t done = 0;
+    while (done < size) {
+      ssize_t n = read(fd, buffer + done, size - done);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    buffer[done] = '\0';
+    file->buffer = buffer;
+    file->size = done;
+    file->owned = true;
+  }
+  close(fd);
+  files_.push_back(file);
+  return file;
+}
+
+const SourceFile* SourceManager::find(const char* loc) const {
+  for (auto file: files_) {
+    if (loc >= file->buffer && loc <= file->buffer + file->size) {
+      return file;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace rvcc
@@ -0,0 +1,77 @@
+#ifndef __SOURCE_H
+#define __SOURCE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+// 源码中的一个位置, line 和 column 从 1 开始
+struct SourceLocation {
+  const char* name;
+  int line;
+  int column;
+  const char* line_begin;   // 所在行的内容, 不包含换行符
+  std::size_t line_len;
+};
+
+/*
+行首偏移表, 第一次查询时构建
+  换行符用 memchr 查找 (libc 的 memchr 是向量化的), 查询位置时二分, O(log n)
+*/
+class LineIndex {
+  public:
+    LineIndex(): built_(false) {}
+    bool built() const;
+    void build(const char* buffer, std::size_t size);
+    // offset 所在的行, 从 0 开始
+    std::size_t lineOf(std::size_t offset) const;
+    std::size_t lineStart(std::size_t line) const;
+    std::size_t lineCount() const;
+  private:
+    std::vector<std::size_t> starts_;
+    bool built_;
+};
+
+/*
+一个输入 buffer, 可能是命令行传入的源码, 也可能是 mmap 进来的头文件
+buffer 以 '\0' 结尾, token 的 loc 直接指向 buffer, 因此 SourceFile
+需要一直存活到编译结束, 因此 SourceManager 由 CompilerContext 持有,
+而不是随 Parser 一起释放
+*/
+struct SourceFile {
+  std::string name;
+  std::string dir;       // 所在目录, 用于解析 #include "..."
+  const char* buffer;
+  std::size_t size;
+  bool mapped;           // buffer 来自 mmap, 释放时需要 munmap
+  bool owned;            // buffer 由 new[] 申请
+  mutable LineIndex lines;
+};
+
+class SourceManager {
+  public:
+    SourceManager() = default;
+    SourceManager(const SourceManager&) = delete;
+    SourceManager& operator=(const SourceManager&) = delete;
+    ~SourceManager();
+    // 登记一个外部持有的 buffer, 不负责释放
+    const SourceFile* addBuffer(const std::string& name, const char* buffer);
+    // mmap 打开文件, 文件不存在时返回 nullptr
+    const SourceFile* open(const std::string& path);
+    // 返回 loc 所在的 SourceFile, 不属于任何 buffer 时返回 nullptr
+    const SourceFile* find(const char* loc) const;
+    // 将 loc 转换为文件名 行号 列号, 需要时构建该文件的行首偏移表
+    static SourceLocation locate(const SourceFile* file, const char* loc);
+    // 接管 other 的全部 buffer
+    void adopt(SourceManager& other);
+    // 释放全部 buffer
+    void clear();
+  private:
+    std::vector<SourceFile*> files_;
+};
+
+} // namespace rvcc
+
+#endif
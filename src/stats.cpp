@@ -0,0 +1,131 @@
+#include "stats.h"
+#include <cstdio>
+
+namespace rvcc {
+
+std::size_t FunctionStats::instructions() const {
+  return alu + load + store + branch + call + push + pop;
+}
+
+bool& CodegenStats::enabled() {
+  return enabled_;
+}
+
+void CodegenStats::add(const MFunction& func, const std::vector<MInst>& insts,
+                       std::size_t bytes) {
+  FunctionStats stats{func.name, 0, 0, 0, 0, 0, 0, 0, 0, func.stack_size, bytes};
+  for (auto& inst: insts) {
+    switch (inst.op) {
+    case MOpcode::MOP_LD:
+      stats.load++;
+      break;
+    case MOpcode::MOP_SD:
+      stats.store++;
+      break;
+    case MOpcode::MOP_J:
+    case MOpcode::MOP_BEQZ:
+    case MOpcode::MOP_BNEZ:
+    case MOpcode::MOP_BEQ:
+    case MOpcode::MOP_BNE:
+    case MOpcode::MOP_BLT:
+    case MOpcode::MOP_BGE:
+    case MOpcode::MOP_RET:
+      stats.branch++;
+      break;
+    case MOpcode::MOP_CALL:
+      stats.call++;
+      break;
+    case MOpcode::MOP_PUSH:
+      stats.push++;
+      break;
+    case MOpcode::MOP_POP:
+      stats.pop++;
+      break;
+    case MOpcode::MOP_LABEL:
+      stats.labels++;
+      break;
+    case MOpcode::MOP_COMMENT:
+      break;
+    default:
+      stats.alu++;
+      break;
+    }
+  }
+  functions_.push_back(stats);
+}
+
+const std::vector<FunctionStats>& CodegenStats::functions() const {
+  return functions_;
+}
+
+FunctionStats CodegenStats::total() const {
+  FunctionStats total{"total", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  for (auto& stats: functions_) {
+    total.alu += stats.alu;
+    total.load += stats.load;
+    total.store += stats.store;
+    total.branch += stats.branch;
+    total.call += stats.call;
+    total.push += stats.push;
+    total.pop += stats.pop;
+    total.labels += stats.labels;
+    total.stack_size += stats.stack_size;
+    total.bytes += stats.bytes;
+  }
+  return total;
+}
+
+namespace {
+
+std::string row(const FunctionStats& stats) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%-20s %6zu %6zu %6zu %6zu %6zu %6zu %6zu %6zu %6zu %6zu %8zu\n",
+           stats.name.c_str(), stats.instructions(), stats.alu, stats.load, stats.store,
+           stats.branch, stats.call, stats.push, stats.pop, stats.labels,
+           stats.stack_size, stats.bytes);
+  return buf;
+}
+
+std::string object(const FunctionStats& stats) {
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "{\"name\": \"%s\", \"instructions\": %zu, \"alu\": %zu, \"load\": %zu, "
+           "\"store\": %zu, \"branch\": %zu, \"call\": %zu, \"push\": %zu, \"pop\": %zu, "
+           "\"labels\": %zu, \"stack_size\": %zu, \"bytes\": %zu}",
+           stats.name.c_str(), stats.instructions(), stats.alu, stats.load, stats.store,
+           stats.branch, stats.call, stats.push, stats.pop, stats.labels,
+           stats.stack_size, stats.bytes);
+  return buf;
+}
+
+} // namespace
+
+std::string CodegenStats::table() const {
+  char header[256];
+  snprintf(header, sizeof(header), "%-20s %6s %6s %6s %6s %6s %6s %6s %6s %6s %6s %8s\n",
+           "function", "insts", "alu", "load", "store", "branch", "call",
+           "push", "pop", "labels", "frame", "bytes");
+  std::string out = header;
+  for (auto& stats: functions_) {
+    out += row(stats);
+  }
+  out += row(total());
+  return out;
+}
+
+// 函数名只包含 identifier 字符, 不需要转义
+std::string CodegenStats::toJson() const {
+  std::string out = "{\"functions\": [\n";
+  for (std::size_t i = 0; i < functions_.size(); i++) {
+    out += "  " + object(functions_[i]);
+    out += i + 1 < functions_.size() ? ",\n" : "\n";
+  }
+  out += "],\n\"total\": " + object(total()) + "}\n";
+  return out;
+}
+
+void CodegenStats::clear() {
+  functions_.clear();
+}
+
+} // namespace rvcc
@@ -0,0 +1,49 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include "mir.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+// 一个函数生成的代码的静态统计, 指令按 MInst 计数 (包含 prologue/epilogue)
+struct FunctionStats {
+  std::string name;
+  std::size_t alu;          // 算术 比较 li mv
+  std::size_t load;
+  std::size_t store;
+  std::size_t branch;       // 跳转 条件跳转 ret
+  std::size_t call;
+  std::size_t push;
+  std::size_t pop;
+  std::size_t labels;
+  std::size_t stack_size;   // 局部变量的栈空间, 见 Codegen::codegen
+  std::size_t bytes;        // 输出的汇编字节数
+  std::size_t instructions() const;
+};
+
+/*
+--stats 输出的生成代码统计
+  Target::render 输出每个函数之后调用 add, 编译结束后输出表格或者 JSON
+  不需要运行生成的程序, 可以在 CI 中跟踪代码质量的变化
+*/
+class CodegenStats {
+  public:
+    CodegenStats(): enabled_(false) {}
+    bool& enabled();
+    void add(const MFunction& func, const std::vector<MInst>& insts, std::size_t bytes);
+    const std::vector<FunctionStats>& functions() const;
+    FunctionStats total() const;
+    std::string table() const;
+    std::string toJson() const;
+    void clear();
+  private:
+    bool enabled_;
+    std::vector<FunctionStats> functions_;
+};
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,245 @@
+#include "strength.h"
+#include "codegen.h"
+#include "context.h"
+#include "instructions.h"
+#include "logger.h"
+#include "mir.h"
+#include "utils.h"
+#include <cstdint>
+#include <vector>
+
+namespace rvcc {
+
+namespace {
+
+using Sequence = std::vector<MInst>;
+
+// 顺序 in-order RV64 核心上的延迟 (周期), 其余指令为 1
+int latency(MOpcode opcode) {
+  switch (opcode) {
+  case MOpcode::MOP_MUL:
+  case MOpcode::MOP_MULH:
+    return 3;
+  case MOpcode::MOP_DIV:
+    return 34;
+  default:
+    return 1;
+  }
+}
+
+// li 展开后的指令条数
+int liCost(long imm) {
+  if (imm >= -2048 && imm < 2048) {
+    return 1;
+  }
+  if (imm >= INT32_MIN && imm <= INT32_MAX) {
+    return 2;
+  }
+  return 6;
+}
+
+int cost(const Sequence& seq, bool size) {
+  int total = 0;
+  for (auto& inst: seq) {
+    if (inst.op == MOpcode::MOP_LI) {
+      total += liCost(inst.imm);
+    } else {
+      total += size ? 1 : latency(inst.op);
+    }
+  }
+  return total;
+}
+
+MInst op(MOpcode opcode, int rd, int rs1, int rs2 = REG_NONE, long imm = 0) {
+  return MInst(opcode, rd, rs1, rs2, imm);
+}
+
+// 2^k 返回 k, 否则返回 -1
+int log2Exact(std::uint64_t value) {
+  if (value == 0 || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int k = 0;
+  while (value >>= 1) {
+    k++;
+  }
+  return k;
+}
+
+// REG_ACC 为 x, REG_TMP 可以随意使用
+void mulCandidates(long c, std::vector<Sequence>& candidates) {
+  candidates.push_back({op(MOpcode::MOP_LI, REG_TMP, REG_NONE, REG_NONE, c),
+                        op(MOpcode::MOP_MUL, REG_ACC, REG_ACC, REG_TMP)});
+  if (c == 0) {
+    candidates.push_back({op(MOpcode::MOP_LI, REG_ACC, REG_NONE, REG_NONE, 0)});
+    return;
+  }
+  std::uint64_t abs = c < 0 ? -static_cast<std::uint64_t>(c) : c;
+  Sequence neg;
+  if (c < 0) {
+    neg.push_back(op(MOpcode::MOP_NEG, REG_ACC, REG_ACC));
+  }
+  int k = log2Exact(abs);
+  if (k >= 0) {
+    Sequence seq;
+    if (k > 0) {
+      seq.push_back(op(MOpcode::MOP_SLLI, REG_ACC, REG_ACC, REG_NONE, k));
+    }
+    seq.insert(seq.end(), neg.begin(), neg.end());
+    candidates.push_back(seq);
+    return;
+  }
+  // |c| = 2^a + 2^b 或者 2^a - 2^b
+  for (int a = 1; a < 63; a++) {
+    for (int b = 0; b < a; b++) {
+      std::uint64_t high = std::uint64_t(1) << a;
+      std::uint64_t low = std::uint64_t(1) << b;
+      MOpcode combine;
+      if (high + low == abs) {
+        combine = MOpcode::MOP_ADD;
+      } else if (high - low == abs) {
+        combine = MOpcode::MOP_SUB;
+      } else {
+        continue;
+      }
+      Sequence seq{op(MOpcode::MOP_SLLI, REG_TMP, REG_ACC, REG_NONE, a)};
+      if (b > 0) {
+        seq.push_back(op(MOpcode::MOP_SLLI, REG_ACC, REG_ACC, REG_NONE, b));
+      }
+      seq.push_back(op(combine, REG_ACC, REG_TMP, REG_ACC));
+      seq.insert(seq.end(), neg.begin(), neg.end());
+      candidates.push_back(seq);
+    }
+  }
+}
+
+// 64 位有符号除法的 magic number, d 不为 0 1 -1
+void magic(std::int64_t d, std::int64_t& multiplier, int& shift) {
+  const std::uint64_t two63 = std::uint64_t(1) << 63;
+  std::uint64_t ad = d < 0 ? -static_cast<std::uint64_t>(d) : d;
+  std::uint64_t t = two63 + (static_cast<std::uint64_t>(d) >> 63);
+  std::uint64_t anc = t - 1 - t % ad;
+  int p = 63;
+  std::uint64_t q1 = two63 / anc;
+  std::uint64_t r1 = two63 - q1 * anc;
+  std::uint64_t q2 = two63 / ad;
+  std::uint64_t r2 = two63 - q2 * ad;
+  std::uint64_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  multiplier = static_cast<std::int64_t>(q2 + 1);
+  if (d < 0) {
+    multiplier = -multiplier;
+  }
+  shift = p - 64;
+}
+
+void divCandidates(long d, std::vector<Sequence>& candidates) {
+  candidates.push_back({op(MOpcode::MOP_LI, REG_TMP, REG_NONE, REG_NONE, d),
+                        op(MOpcode::MOP_DIV, REG_ACC, REG_ACC, REG_TMP)});
+  if (d == 0) {
+    return;
+  }
+  if (d == 1 || d == -1) {
+    Sequence seq;
+    if (d == -1) {
+      seq.push_back(op(MOpcode::MOP_NEG, REG_ACC, REG_ACC));
+    }
+    candidates.push_back(seq);
+    return;
+  }
+  std::uint64_t abs = d < 0 ? -static_cast<std::uint64_t>(d) : d;
+  int k = log2Exact(abs);
+  if (k > 0) {
+    // 负数加上 2^k - 1 之后再移位, 向 0 舍入
+    Sequence seq{op(MOpcode::MOP_SRAI, REG_TMP, REG_ACC, REG_NONE, 63),
+                 op(MOpcode::MOP_SRLI, REG_TMP, REG_TMP, REG_NONE, 64 - k),
+                 op(MOpcode::MOP_ADD, REG_ACC, REG_ACC, REG_TMP),
+                 op(MOpcode::MOP_SRAI, REG_ACC, REG_ACC, REG_NONE, k)};
+    if (d < 0) {
+      seq.push_back(op(MOpcode::MOP_NEG, REG_ACC, REG_ACC));
+    }
+    candidates.push_back(seq);
+    return;
+  }
+  std::int64_t multiplier;
+  int shift;
+  magic(d, multiplier, shift);
+  Sequence seq{op(MOpcode::MOP_LI, REG_TMP, REG_NONE, REG_NONE, multiplier),
+               op(MOpcode::MOP_MULH, REG_TMP, REG_ACC, REG_TMP)};
+  if (d > 0 && multiplier < 0) {
+    seq.push_back(op(MOpcode::MOP_ADD, REG_TMP, REG_TMP, REG_ACC));
+  } else if (d < 0 && multiplier > 0) {
+    seq.push_back(op(MOpcode::MOP_SUB, REG_TMP, REG_TMP, REG_ACC));
+  }
+  if (shift > 0) {
+    seq.push_back(op(MOpcode::MOP_SRAI, REG_TMP, REG_TMP, REG_NONE, shift));
+  }
+  // 商为负数时加 1, 向 0 舍入
+  seq.push_back(op(MOpcode::MOP_SRLI, REG_ACC, REG_TMP, REG_NONE, 63));
+  seq.push_back(op(MOpcode::MOP_ADD, REG_ACC, REG_TMP, REG_ACC));
+  candidates.push_back(seq);
+}
+
+} // namespace
+
+const char* StrengthReducePass::name() const {
+  return "strength-reduce";
+}
+
+PassKind StrengthReducePass::kind() const {
+  return PassKind::PASS_LOWERING;
+}
+
+const Pass* strengthReducePass() {
+  static const StrengthReducePass pass;
+  return &pass;
+}
+
+bool genMulDivByConst(Expr* node) {
+  if ((node->kind() != ExprKind::NODE_MUL && node->kind() != ExprKind::NODE_DIV) ||
+      node->getRight()->kind() != ExprKind::NODE_NUM) {
+    return false;
+  }
+  if (!CompilerContext::current().passes().lowering(strengthReducePass())) {
+    return false;
+  }
+  walkRightImpl(node->getLeft(), codegen_prev_func, codegen_mid_func, codegen_post_func);
+  genMulDivByConst(node->kind(), node->getRight()->value());
+  return true;
+}
+
+void genMulDivByConst(ExprKind kind, long value) {
+  std::vector<Sequence> candidates;
+  if (kind == ExprKind::NODE_MUL) {
+    mulCandidates(value, candidates);
+  } else {
+    divCandidates(value, candidates);
+  }
+  bool size = CompilerContext::current().passes().level() == OptLevel::OPT_OS;
+  const Sequence* best = &candidates[0];
+  for (auto& seq: candidates) {
+    if (cost(seq, size) < cost(*best, size)) {
+      best = &seq;
+    }
+  }
+  for (auto& inst: *best) {
+    append_(inst);
+  }
+}
+
+} // namespace rvcc
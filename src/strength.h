@@ -0,0 +1,33 @@
+#ifndef __STRENGTH_H
+#define __STRENGTH_H
+
+#include "ast.h"
+#include "pass_manager.h"
+
+namespace rvcc {
+
+/*
+乘除以常量的强度削弱, 在 codegen 时选择指令序列
+  x * 2^k => slli, x * (2^a +- 2^b) => 两次移位加一次 add/sub
+  x / 2^k => 按符号修正之后 srai
+  x / d   => 乘以 magic number 取高位 (mulh) 再移位, 按符号修正舍入方向 (Hacker's Delight 10-1)
+  候选序列和 li + mul/div 一起按代价表比较, -Os 按指令条数, 其余按延迟
+*/
+class StrengthReducePass: public Pass {
+  public:
+    const char* name() const override;
+    PassKind kind() const override;
+};
+
+const Pass* strengthReducePass();
+
+// 右操作数为常量的 * /: 计算左操作数并输出代价最小的序列, 结果在 REG_ACC
+// 不是这种形式时返回 false
+bool genMulDivByConst(Expr* node);
+// kind 为 NODE_MUL 或 NODE_DIV, x 已经在 REG_ACC 中, 输出 x * value 或 x / value
+// 代价最小的序列, 结果在 REG_ACC; 调用者负责检查 strength-reduce 是否启用
+void genMulDivByConst(ExprKind kind, long value);
+
+} // namespace rvcc
+
+#endif
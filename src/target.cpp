@@ -0,0 +1,173 @@
+#include "target.h"
+#include "context.h"
+#include "stats.h"
+#include "instructions.h"
+#include "logger.h"
+#include <string>
+
+namespace rvcc {
+
+void Target::render(const MFunction& func) const {
+  CompilerContext& context = CompilerContext::current();
+  if (context.emittedBytes() == 0) {
+    fileStart();
+  }
+  std::size_t begin_bytes = context.emittedBytes();
+  std::vector<MInst> insts;
+  start(func, insts);
+  // shrink-wrap 之后 prologue 之前的指令不需要栈帧
+  auto pos = func.insts.begin() + func.prologue_pos;
+  insts.insert(insts.end(), func.insts.begin(), pos);
+  prologue(func, insts);
+  insts.insert(insts.end(), pos, func.insts.end());
+  epilogue(func, insts);
+  for (auto& inst: insts) {
+    if (inst.op == MOpcode::MOP_COMMENT) {
+      emit("%s", inst.comment.c_str());
+      continue;
+    }
+    comment(inst);
+    instruction(inst);
+  }
+  if (context.stats().enabled()) {
+    context.stats().add(func, insts, context.emittedBytes() - begin_bytes);
+  }
+}
+
+void Target::fileStart() const {}
+
+void Target::start(const MFunction& func, std::vector<MInst>& insts) {
+  const std::string& name = func.name;
+  MInst inst(MOpcode::MOP_COMMENT);
+  inst.comment = "# 定义全局 " + name + " 段\n" +
+                 ".globl " + name + "\n" +
+                 "\n# =====程序开始===============\n" +
+                 "# " + name + "段标签，也是程序入口段\n" +
+                 name + ":\n";
+  insts.push_back(inst);
+}
+
+void Target::saveCalleeSaved(const MFunction& func, std::vector<MInst>& insts) {
+  for (auto& saved: func.callee_saved) {
+    insts.emplace_back(MOpcode::MOP_SD, REG_NONE, REG_FP, saved.first, saved.second);
+  }
+}
+
+void Target::restoreCalleeSaved(const MFunction& func, std::vector<MInst>& insts) {
+  for (auto& saved: func.callee_saved) {
+    insts.emplace_back(MOpcode::MOP_LD, saved.first, REG_FP, REG_NONE, saved.second);
+  }
+}
+
+void Target::comment(const MInst& inst) const {
+  if (!inst.comment.empty()) {
+    std::string text = inst.comment;
+    std::size_t pos = text.find("%s");
+    if (pos != std::string::npos) {
+      text.replace(pos, 2, regName(inst.rs1));
+    }
+    emit("  # %s\n", text.c_str());
+    return;
+  }
+  const char* rd = inst.rd == REG_NONE ? "" : regName(inst.rd);
+  const char* rs1 = inst.rs1 == REG_NONE ? "" : regName(inst.rs1);
+  const char* rs2 = inst.rs2 == REG_NONE ? "" : regName(inst.rs2);
+  switch (inst.op) {
+  case MOpcode::MOP_LI:
+    emit("  # 将%ld加载到 %s 中\n", inst.imm, rd);
+    break;
+  case MOpcode::MOP_MV:
+    emit("  # 将寄存器 %s 的值赋值给寄存器 %s\n", rs1, rd);
+    break;
+  case MOpcode::MOP_ADD:
+    emit("  # %s + %s，结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_SUB:
+    emit("  # %s - %s，结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_MUL:
+    emit("  # %s * %s，结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_DIV:
+    emit("  # %s / %s，结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_ADDI:
+    emit("  # %s + %ld，结果写入 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_XOR:
+    emit("  # %s 异或 %s 结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_XORI:
+    emit("  # %s 异或 %ld 结果写入 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_SEQZ:
+    emit("  # 寄存器 %s 和 0 相等的结果 写入寄存器 %s\n", rs1, rd);
+    break;
+  case MOpcode::MOP_SNEZ:
+    emit("  # 寄存器 %s 和 0 不相等的结果 写入寄存器 %s\n", rs1, rd);
+    break;
+  case MOpcode::MOP_SLT:
+    emit("  # 寄存器 %s 小于寄存器 %s 的结果 写入寄存器 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_NEG:
+    emit("  # 对寄存器 %s 值进行取反后写入 寄存器 %s\n", rs1, rd);
+    break;
+  case MOpcode::MOP_SLLI:
+    emit("  # %s 左移 %ld 位，结果写入 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_SRAI:
+    emit("  # %s 算术右移 %ld 位，结果写入 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_SRLI:
+    emit("  # %s 逻辑右移 %ld 位，结果写入 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_MULH:
+    emit("  # %s * %s 的高 64 位，结果写入 %s\n", rs1, rs2, rd);
+    break;
+  case MOpcode::MOP_SLTI:
+    emit("  # 寄存器 %s 小于 %ld 的结果 写入寄存器 %s\n", rs1, inst.imm, rd);
+    break;
+  case MOpcode::MOP_LD:
+    emit("  # 将地址 (%ld)%s 中的值 加载到寄存器 %s 中\n", inst.imm, rs1, rd);
+    break;
+  case MOpcode::MOP_SD:
+    emit("  # 将寄存器 %s 保存到 (%ld)%s 地址中\n", rs2, inst.imm, rs1);
+    break;
+  case MOpcode::MOP_PUSH:
+    emit("  # 将 %s 值压栈\n", rs1);
+    break;
+  case MOpcode::MOP_POP:
+    emit("  # 将 %s 值弹栈\n", rd);
+    break;
+  case MOpcode::MOP_CALL:
+    emit("  # 调用函数%s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_RET:
+    emit("  # 返回%s值给系统调用\n", regName(REG_ACC));
+    break;
+  default:
+    break;
+  }
+}
+
+const Target* Target::get(const std::string& name) {
+  static const RV64Target rv64;
+  static const X86_64Target x86_64;
+  if (name == "rv64" || name == "riscv64") {
+    return &rv64;
+  }
+  if (name == "x86-64" || name == "x86_64") {
+    return &x86_64;
+  }
+  return nullptr;
+}
+
+const Target* Target::defaultTarget() {
+  return get("rv64");
+}
+
+const char* Target::names() {
+  return "rv64, x86-64";
+}
+
+} // namespace rvcc
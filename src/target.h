@@ -0,0 +1,82 @@
+#ifndef __TARGET_H
+#define __TARGET_H
+
+#include "mir.h"
+#include <string>
+#include <vector>
+
+namespace rvcc {
+
+/*
+目标平台
+  负责寄存器命名, 调用约定, prologue/epilogue 以及把 MInst 翻译成汇编
+  codegen 只生成和平台无关的 MFunction, 由当前 context 的 Target 输出
+  Target 没有可变状态, 可以被多个线程共享
+*/
+class Target {
+  public:
+    virtual ~Target() {}
+    virtual const char* name() const = 0;
+    virtual const char* regName(int reg) const = 0;
+    // 可以分配给虚拟寄存器的 REG_T0 ~ REG_S11, 按优先顺序排列
+    virtual const std::vector<int>& allocatableRegs() const = 0;
+    // 输出整个函数: prologue, 函数体, epilogue
+    void render(const MFunction& func) const;
+    // 按名字查找, 不存在时返回 nullptr
+    static const Target* get(const std::string& name);
+    static const Target* defaultTarget();
+    // 支持的名字, 用于 usage
+    static const char* names();
+  protected:
+    // prologue/epilogue 以 MInst 的形式追加到 insts, 与函数体一起输出和统计
+    // 伪指令和段标签等使用 MOP_COMMENT 原样输出
+    // func.frame 为 false 时 prologue 为空, epilogue 只有 ret
+    virtual void prologue(const MFunction& func, std::vector<MInst>& insts) const = 0;
+    virtual void epilogue(const MFunction& func, std::vector<MInst>& insts) const = 0;
+    virtual void instruction(const MInst& inst) const = 0;
+    // 在输出的第一个函数之前输出一次文件级的伪指令, 默认没有
+    virtual void fileStart() const;
+    // 输出指令的注释
+    void comment(const MInst& inst) const;
+    // 函数开头的 .globl 和函数标签
+    static void start(const MFunction& func, std::vector<MInst>& insts);
+    // 保存和恢复 func.callee_saved 中的寄存器
+    static void saveCalleeSaved(const MFunction& func, std::vector<MInst>& insts);
+    static void restoreCalleeSaved(const MFunction& func, std::vector<MInst>& insts);
+};
+
+// RV64 lp64 调用约定, 参数 a0 ~ a5, 返回值 a0
+// 寄存器分配使用 t0 ~ t6 a6 a7 和 s1 ~ s11
+class RV64Target: public Target {
+  public:
+    const char* name() const override;
+    const char* regName(int reg) const override;
+    const std::vector<int>& allocatableRegs() const override;
+  protected:
+    void prologue(const MFunction& func, std::vector<MInst>& insts) const override;
+    void epilogue(const MFunction& func, std::vector<MInst>& insts) const override;
+    void instruction(const MInst& inst) const override;
+};
+
+// x86-64 System V 调用约定, AT&T 语法, 参数 rdi rsi rdx rcx r8 r9, 返回值 rax
+// 调用者保存的寄存器都有固定用途, 寄存器分配只使用 rbx r12 ~ r15
+class X86_64Target: public Target {
+  public:
+    const char* name() const override;
+    const char* regName(int reg) const override;
+    const std::vector<int>& allocatableRegs() const override;
+  protected:
+    void prologue(const MFunction& func, std::vector<MInst>& insts) const override;
+    void epilogue(const MFunction& func, std::vector<MInst>& insts) const override;
+    void instruction(const MInst& inst) const override;
+    void fileStart() const override;
+  private:
+    // 三地址的 rd = rs1 op rs2 翻译为两地址指令
+    void binary(const char* op, const MInst& inst, bool commutative) const;
+    // 设置 rd 的低字节之后零扩展
+    void setcc(const char* cc, int rd) const;
+};
+
+} // namespace rvcc
+
+#endif
@@ -0,0 +1,148 @@
+#include "target.h"
+#include "instructions.h"
+#include "logger.h"
+
+namespace rvcc {
+
+const char* RV64Target::name() const {
+  return "rv64";
+}
+
+const char* RV64Target::regName(int reg) const {
+  static const char* names[REG_COUNT] = {
+    "a0", "a1", "a0", "a1", "a2", "a3", "a4", "a5", "fp", "sp", "ra",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "a6", "a7",
+    "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11"
+  };
+  CHECK(reg >= 0 && reg < REG_COUNT);
+  return names[reg];
+}
+
+const std::vector<int>& RV64Target::allocatableRegs() const {
+  static const std::vector<int> regs = [] {
+    std::vector<int> result;
+    for (int reg = REG_T0; reg <= REG_S11; reg++) {
+      result.push_back(reg);
+    }
+    return result;
+  }();
+  return regs;
+}
+
+/*
+栈布局
+-------------------------------// sp
+             ra
+-------------------------------// ra = sp-8
+             fp
+-------------------------------// fp = sp-16
+            变量
+-------------------------------// sp = sp-16-StackSize
+          表达式计算
+-------------------------------//
+*/
+void RV64Target::prologue(const MFunction& func, std::vector<MInst>& insts) const {
+  if (!func.frame) {
+    return;
+  }
+  // 将ra寄存器压栈,保存ra的值
+  if (func.save_ra) {
+    insts.emplace_back(MOpcode::MOP_PUSH, REG_NONE, REG_RA);
+  }
+  insts.emplace_back(MOpcode::MOP_PUSH, REG_NONE, REG_FP);
+  insts.emplace_back(MOpcode::MOP_MV, REG_FP, REG_SP);
+  // 没有局部变量和溢出时不需要分配, prologue 在 peephole 之后生成, 这里直接省略
+  if (func.stack_size) {
+    insts.emplace_back(MOpcode::MOP_COMMENT);
+    insts.back().comment = "  # sp 配分StackSize大小的栈空间\n";
+    insts.emplace_back(MOpcode::MOP_ADDI, REG_SP, REG_SP, REG_NONE,
+                       -static_cast<long>(func.stack_size));
+  }
+  saveCalleeSaved(func, insts);
+}
+
+void RV64Target::epilogue(const MFunction& func, std::vector<MInst>& insts) const {
+  if (func.frame) {
+    restoreCalleeSaved(func, insts);
+    insts.emplace_back(MOpcode::MOP_MV, REG_SP, REG_FP);
+    insts.emplace_back(MOpcode::MOP_POP, REG_FP);
+  }
+  if (func.frame && func.save_ra) {
+    insts.emplace_back(MOpcode::MOP_POP, REG_RA);
+  }
+  insts.emplace_back(MOpcode::MOP_RET);
+}
+
+void RV64Target::instruction(const MInst& inst) const {
+  const char* op = inst.opcodeName();
+  switch (inst.op) {
+  case MOpcode::MOP_LI:
+    emit("  li %s, %ld\n", regName(inst.rd), inst.imm);
+    break;
+  case MOpcode::MOP_MV:
+  case MOpcode::MOP_SEQZ:
+  case MOpcode::MOP_SNEZ:
+  case MOpcode::MOP_NEG:
+    emit("  %s %s, %s\n", op, regName(inst.rd), regName(inst.rs1));
+    break;
+  case MOpcode::MOP_ADD:
+  case MOpcode::MOP_SUB:
+  case MOpcode::MOP_MUL:
+  case MOpcode::MOP_DIV:
+  case MOpcode::MOP_XOR:
+  case MOpcode::MOP_SLT:
+  case MOpcode::MOP_MULH:
+    emit("  %s %s, %s, %s\n", op, regName(inst.rd), regName(inst.rs1),
+         regName(inst.rs2));
+    break;
+  case MOpcode::MOP_ADDI:
+  case MOpcode::MOP_XORI:
+  case MOpcode::MOP_SLLI:
+  case MOpcode::MOP_SRAI:
+  case MOpcode::MOP_SRLI:
+  case MOpcode::MOP_SLTI:
+    emit("  %s %s, %s, %ld\n", op, regName(inst.rd), regName(inst.rs1), inst.imm);
+    break;
+  case MOpcode::MOP_LD:
+    emit("  ld %s, %ld(%s)\n", regName(inst.rd), inst.imm, regName(inst.rs1));
+    break;
+  case MOpcode::MOP_SD:
+    emit("  sd %s, %ld(%s)\n", regName(inst.rs2), inst.imm, regName(inst.rs1));
+    break;
+  case MOpcode::MOP_PUSH:
+    emit("  addi sp, sp, -8\n");
+    emit("  sd %s, 0(sp)\n", regName(inst.rs1));
+    break;
+  case MOpcode::MOP_POP:
+    emit("  ld %s, 0(sp)\n", regName(inst.rd));
+    emit("  addi sp, sp, 8\n");
+    break;
+  case MOpcode::MOP_CALL:
+    emit("  call %s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_J:
+    emit("  j %s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_BEQZ:
+  case MOpcode::MOP_BNEZ:
+    emit("  %s %s, %s\n", op, regName(inst.rs1), inst.sym.c_str());
+    break;
+  case MOpcode::MOP_BEQ:
+  case MOpcode::MOP_BNE:
+  case MOpcode::MOP_BLT:
+  case MOpcode::MOP_BGE:
+    emit("  %s %s, %s, %s\n", op, regName(inst.rs1), regName(inst.rs2),
+         inst.sym.c_str());
+    break;
+  case MOpcode::MOP_LABEL:
+    emit("%s:\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_RET:
+    emit("  ret\n");
+    break;
+  default:
+    FATAL("rv64 cant emit instruction: %s", op);
+  }
+}
+
+} // namespace rvcc
@@ -0,0 +1,269 @@
+#include "target.h"
+#include "instructions.h"
+#include "logger.h"
+#include <cstring>
+
+namespace rvcc {
+
+namespace {
+
+// 临时寄存器, 不参与 MReg 的映射
+const char* kScratch = "%r11";
+
+const char* byteName(const char* reg) {
+  static const char* names[][2] = {
+    {"%rax", "%al"}, {"%rdi", "%dil"}, {"%rsi", "%sil"}, {"%rdx", "%dl"},
+    {"%rcx", "%cl"}, {"%r8", "%r8b"}, {"%r9", "%r9b"}, {"%r10", "%r10b"},
+    {"%rbx", "%bl"}, {"%r12", "%r12b"}, {"%r13", "%r13b"}, {"%r14", "%r14b"},
+    {"%r15", "%r15b"},
+  };
+  for (auto& name: names) {
+    if (strcmp(name[0], reg) == 0) {
+      return name[1];
+    }
+  }
+  FATAL("register %s has no byte form", reg);
+  return nullptr;
+}
+
+} // namespace
+
+const char* X86_64Target::name() const {
+  return "x86-64";
+}
+
+const char* X86_64Target::regName(int reg) const {
+  // 没有 ra, 返回地址由 call 压栈
+  static const char* names[REG_COUNT] = {
+    "%rax", "%r10", "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9", "%rbp", "%rsp", nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    "%rbx", "%r12", "%r13", "%r14", "%r15", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+  };
+  CHECK(reg >= 0 && reg < REG_COUNT && names[reg] != nullptr);
+  return names[reg];
+}
+
+const std::vector<int>& X86_64Target::allocatableRegs() const {
+  static const std::vector<int> regs = {REG_S1, REG_S2, REG_S3, REG_S4, REG_S5};
+  return regs;
+}
+
+/*
+栈布局
+-------------------------------// 返回地址
+             rbp
+-------------------------------// rbp
+            变量
+-------------------------------// rsp = rbp-StackSize, 16 字节对齐
+          表达式计算
+-------------------------------//
+*/
+void X86_64Target::prologue(const MFunction& func, std::vector<MInst>& insts) const {
+  if (!func.frame) {
+    return;
+  }
+  insts.emplace_back(MOpcode::MOP_PUSH, REG_NONE, REG_FP);
+  insts.emplace_back(MOpcode::MOP_MV, REG_FP, REG_SP);
+  // 没有局部变量和溢出时不需要分配, prologue 在 peephole 之后生成, 这里直接省略
+  if (func.stack_size) {
+    insts.emplace_back(MOpcode::MOP_COMMENT);
+    insts.back().comment = "  # sp 配分StackSize大小的栈空间\n";
+    insts.emplace_back(MOpcode::MOP_ADDI, REG_SP, REG_SP, REG_NONE,
+                       -static_cast<long>(func.stack_size));
+  }
+  saveCalleeSaved(func, insts);
+}
+
+void X86_64Target::epilogue(const MFunction& func, std::vector<MInst>& insts) const {
+  if (func.frame) {
+    restoreCalleeSaved(func, insts);
+    insts.emplace_back(MOpcode::MOP_MV, REG_SP, REG_FP);
+    insts.emplace_back(MOpcode::MOP_POP, REG_FP);
+  }
+  insts.emplace_back(MOpcode::MOP_RET);
+}
+
+// 没有 .note.GNU-stack 段时链接器认为需要可执行的栈
+void X86_64Target::fileStart() const {
+  emit("  .section .note.GNU-stack,\"\",@progbits\n");
+  emit("  .text\n");
+}
+
+void X86_64Target::binary(const char* op, const MInst& inst, bool commutative) const {
+  const char* rd = regName(inst.rd);
+  const char* rs1 = regName(inst.rs1);
+  const char* rs2 = regName(inst.rs2);
+  if (inst.rd == inst.rs1) {
+    emit("  %s %s, %s\n", op, rs2, rd);
+  } else if (inst.rd == inst.rs2 && commutative) {
+    emit("  %s %s, %s\n", op, rs1, rd);
+  } else if (inst.rd == inst.rs2) {
+    emit("  mov %s, %s\n", rs2, kScratch);
+    emit("  mov %s, %s\n", rs1, rd);
+    emit("  %s %s, %s\n", op, kScratch, rd);
+  } else {
+    emit("  mov %s, %s\n", rs1, rd);
+    emit("  %s %s, %s\n", op, rs2, rd);
+  }
+}
+
+void X86_64Target::setcc(const char* cc, int rd) const {
+  const char* reg = regName(rd);
+  emit("  set%s %s\n", cc, byteName(reg));
+  emit("  movzbq %s, %s\n", byteName(reg), reg);
+}
+
+void X86_64Target::instruction(const MInst& inst) const {
+  switch (inst.op) {
+  case MOpcode::MOP_LI:
+    emit("  mov $%ld, %s\n", inst.imm, regName(inst.rd));
+    break;
+  case MOpcode::MOP_MV:
+    emit("  mov %s, %s\n", regName(inst.rs1), regName(inst.rd));
+    break;
+  case MOpcode::MOP_ADD:
+    binary("add", inst, true);
+    break;
+  case MOpcode::MOP_SUB:
+    binary("sub", inst, false);
+    break;
+  case MOpcode::MOP_MUL:
+    binary("imul", inst, true);
+    break;
+  case MOpcode::MOP_XOR:
+    binary("xor", inst, true);
+    break;
+  case MOpcode::MOP_DIV: {
+    // idiv 使用 rdx:rax, 除数不能在这两个寄存器中
+    const char* divisor = regName(inst.rs2);
+    if (inst.rs2 == REG_ACC || inst.rs2 == REG_ARG2) {
+      emit("  mov %s, %s\n", divisor, kScratch);
+      divisor = kScratch;
+    }
+    if (inst.rs1 != REG_ACC) {
+      emit("  mov %s, %%rax\n", regName(inst.rs1));
+    }
+    emit("  cqo\n");
+    emit("  idiv %s\n", divisor);
+    if (inst.rd != REG_ACC) {
+      emit("  mov %%rax, %s\n", regName(inst.rd));
+    }
+    break;
+  }
+  case MOpcode::MOP_ADDI:
+    if (inst.rd == inst.rs1) {
+      emit("  add $%ld, %s\n", inst.imm, regName(inst.rd));
+    } else {
+      emit("  lea %ld(%s), %s\n", inst.imm, regName(inst.rs1), regName(inst.rd));
+    }
+    break;
+  case MOpcode::MOP_XORI:
+    if (inst.rd != inst.rs1) {
+      emit("  mov %s, %s\n", regName(inst.rs1), regName(inst.rd));
+    }
+    emit("  xor $%ld, %s\n", inst.imm, regName(inst.rd));
+    break;
+  case MOpcode::MOP_SEQZ:
+    emit("  cmp $0, %s\n", regName(inst.rs1));
+    setcc("e", inst.rd);
+    break;
+  case MOpcode::MOP_SNEZ:
+    emit("  cmp $0, %s\n", regName(inst.rs1));
+    setcc("ne", inst.rd);
+    break;
+  case MOpcode::MOP_SLT:
+    emit("  cmp %s, %s\n", regName(inst.rs2), regName(inst.rs1));
+    setcc("l", inst.rd);
+    break;
+  case MOpcode::MOP_SLTI:
+    emit("  cmp $%ld, %s\n", inst.imm, regName(inst.rs1));
+    setcc("l", inst.rd);
+    break;
+  case MOpcode::MOP_NEG:
+    if (inst.rd != inst.rs1) {
+      emit("  mov %s, %s\n", regName(inst.rs1), regName(inst.rd));
+    }
+    emit("  neg %s\n", regName(inst.rd));
+    break;
+  case MOpcode::MOP_SLLI:
+  case MOpcode::MOP_SRAI:
+  case MOpcode::MOP_SRLI: {
+    const char* op = inst.op == MOpcode::MOP_SLLI ? "shl" :
+                     inst.op == MOpcode::MOP_SRAI ? "sar" : "shr";
+    if (inst.rd != inst.rs1) {
+      emit("  mov %s, %s\n", regName(inst.rs1), regName(inst.rd));
+    }
+    emit("  %s $%ld, %s\n", op, inst.imm, regName(inst.rd));
+    break;
+  }
+  case MOpcode::MOP_MULH: {
+    // 单操作数 imul 的结果在 rdx:rax, 这两个寄存器的值需要保留
+    emit("  mov %s, %s\n", regName(inst.rs2), kScratch);
+    emit("  push %%rax\n");
+    emit("  push %%rdx\n");
+    if (inst.rs1 != REG_ACC) {
+      emit("  mov %s, %%rax\n", regName(inst.rs1));
+    }
+    emit("  imul %s\n", kScratch);
+    emit("  mov %%rdx, %s\n", kScratch);
+    emit("  pop %%rdx\n");
+    emit("  pop %%rax\n");
+    emit("  mov %s, %s\n", kScratch, regName(inst.rd));
+    break;
+  }
+  case MOpcode::MOP_LD:
+    emit("  mov %ld(%s), %s\n", inst.imm, regName(inst.rs1), regName(inst.rd));
+    break;
+  case MOpcode::MOP_SD:
+    emit("  mov %s, %ld(%s)\n", regName(inst.rs2), inst.imm, regName(inst.rs1));
+    break;
+  case MOpcode::MOP_PUSH:
+    emit("  push %s\n", regName(inst.rs1));
+    break;
+  case MOpcode::MOP_POP:
+    emit("  pop %s\n", regName(inst.rd));
+    break;
+  case MOpcode::MOP_CALL:
+    // prologue 之后 rsp 16 字节对齐, 表达式栈深度为奇数时需要补齐
+    if (inst.imm % 2) {
+      emit("  sub $8, %%rsp\n");
+      emit("  call %s\n", inst.sym.c_str());
+      emit("  add $8, %%rsp\n");
+    } else {
+      emit("  call %s\n", inst.sym.c_str());
+    }
+    break;
+  case MOpcode::MOP_J:
+    emit("  jmp %s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_BEQZ:
+    emit("  cmp $0, %s\n", regName(inst.rs1));
+    emit("  je %s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_BNEZ:
+    emit("  cmp $0, %s\n", regName(inst.rs1));
+    emit("  jne %s\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_BEQ:
+  case MOpcode::MOP_BNE:
+  case MOpcode::MOP_BLT:
+  case MOpcode::MOP_BGE: {
+    const char* cc = inst.op == MOpcode::MOP_BEQ ? "e" :
+                     inst.op == MOpcode::MOP_BNE ? "ne" :
+                     inst.op == MOpcode::MOP_BLT ? "l" : "ge";
+    emit("  cmp %s, %s\n", regName(inst.rs2), regName(inst.rs1));
+    emit("  j%s %s\n", cc, inst.sym.c_str());
+    break;
+  }
+  case MOpcode::MOP_LABEL:
+    emit("%s:\n", inst.sym.c_str());
+    break;
+  case MOpcode::MOP_RET:
+    emit("  ret\n");
+    break;
+  default:
+    FATAL("x86-64 cant emit instruction: %s", inst.opcodeName());
+  }
+}
+
+} // namespace rvcc
@@ -5,7 +5,7 @@
 
 namespace rvcc {
 
-char Token::buffer[128]{0};
+thread_local char Token::buffer[128]{0};
 
 const char* Token::kind_names[static_cast<int>(TokenKind::TOKEN_COUNT)] {
   "TOKEN_ID",
@@ -16,19 +16,72 @@ const char* Token::kind_names[static_cast<int>(TokenKind::TOKEN_COUNT)] {
   "TOKEN_ILLEGAL"
 };
 
+const char* Token::punct_names[static_cast<int>(PunctKind::PUNCT_COUNT)] {
+  "==",
+  "!=",
+  "<=",
+  ">=",
+  "<",
+  ">",
+  "=",
+  "+",
+  "-",
+  "*",
+  "/",
+  "&",
+  "(",
+  ")",
+  "{",
+  "}",
+  "[",
+  "]",
+  ",",
+  ";",
+  "!",
+  "&&",
+  "||",
+  "#",
+  "punct"
+};
+
+const char* Token::keyword_names[static_cast<int>(KeywordKind::KEYWORD_COUNT)] {
+  "return",
+  "if",
+  "else",
+  "for",
+  "while",
+  "int",
+  "sizeof"
+};
+
 Token::Token() {
   kind_ = TokenKind::TOKEN_ILLEGAL;
   val_ = 0;
   loc_ = nullptr;
+  len_ = 0;
+  punct_ = PunctKind::PUNCT_OTHER;
+  keyword_ = KeywordKind::KEYWORD_COUNT;
+  bol_ = false;
+  noexpand_ = false;
 }
 
 Token::Token(TokenKind kind, int val, char* loc, int len): 
-  kind_(kind),val_(val), loc_(loc), len_(len) {}
+  kind_(kind),val_(val), loc_(loc), len_(len),
+  punct_(PunctKind::PUNCT_OTHER), keyword_(KeywordKind::KEYWORD_COUNT),
+  bol_(false), noexpand_(false) {}
 
 const char* Token::kindName() const {
   return kind_names[static_cast<int>(kind_)];
 }
 
+const char* Token::punctName(PunctKind punct) {
+  return punct_names[static_cast<int>(punct)];
+}
+
+const char* Token::keywordName(KeywordKind keyword) {
+  return keyword_names[static_cast<int>(keyword)];
+}
+
 const char* Token::content() {
   memset(buffer, 0, 128);
   memcpy(buffer, loc_, std::min(static_cast<std::size_t>(127), len_));
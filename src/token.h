@@ -18,6 +18,47 @@ enum class TokenKind:int{
   TOKEN_COUNT
 };
 
+// 标点符号在 lexer 阶段识别一次, parser 直接按枚举值 switch
+enum class PunctKind:int{
+  PUNCT_EQ = 0,         // ==
+  PUNCT_NE,             // !=
+  PUNCT_LE,             // <=
+  PUNCT_GE,             // >=
+  PUNCT_LT,             // <
+  PUNCT_GT,             // >
+  PUNCT_ASSIGN,         // =
+  PUNCT_PLUS,           // +
+  PUNCT_MINUS,          // -
+  PUNCT_STAR,           // *
+  PUNCT_SLASH,          // /
+  PUNCT_AMP,            // &
+  PUNCT_LPAREN,         // (
+  PUNCT_RPAREN,         // )
+  PUNCT_LBRACE,         // {
+  PUNCT_RBRACE,         // }
+  PUNCT_LBRACKET,       // [
+  PUNCT_RBRACKET,       // ]
+  PUNCT_COMMA,          // ,
+  PUNCT_SEMI,           // ;
+  PUNCT_NOT,            // !
+  PUNCT_AND_AND,        // &&
+  PUNCT_OR_OR,          // ||
+  PUNCT_HASH,           // # 预处理指令
+  PUNCT_OTHER,          // 其他暂不支持的标点
+  PUNCT_COUNT
+};
+
+enum class KeywordKind:int{
+  KEYWORD_RETURN = 0,
+  KEYWORD_IF,
+  KEYWORD_ELSE,
+  KEYWORD_FOR,
+  KEYWORD_WHILE,
+  KEYWORD_INT,
+  KEYWORD_SIZEOF,
+  KEYWORD_COUNT
+};
+
 class Token {
   public:
     Token();
@@ -34,15 +75,43 @@ class Token {
     std::size_t& len() {
       return len_;
     }
+    PunctKind& punct() {
+      return punct_;
+    }
+    KeywordKind& keyword() {
+      return keyword_;
+    }
+    bool is(PunctKind punct) const {
+      return kind_ == TokenKind::TOKEN_PUNCT && punct_ == punct;
+    }
+    bool is(KeywordKind keyword) const {
+      return kind_ == TokenKind::TOKEN_KEYWORD && keyword_ == keyword;
+    }
+    // token 是否位于行首, 预处理指令 # 只能出现在行首
+    bool& bol() {
+      return bol_;
+    }
+    // 宏展开时被禁止再次展开的 identifier
+    bool& noexpand() {
+      return noexpand_;
+    }
     const char* content();
     const char* kindName() const;
+    static const char* punctName(PunctKind punct);
+    static const char* keywordName(KeywordKind keyword);
   private:
     TokenKind kind_;
     int val_;
     char* loc_;
     std::size_t len_;
+    PunctKind punct_;
+    KeywordKind keyword_;
+    bool bol_;
+    bool noexpand_;
     static const char* kind_names[static_cast<int>(TokenKind::TOKEN_COUNT)];
-    static char buffer[128];
+    static const char* punct_names[static_cast<int>(PunctKind::PUNCT_COUNT)];
+    static const char* keyword_names[static_cast<int>(KeywordKind::KEYWORD_COUNT)];
+    static thread_local char buffer[128];
 };
 
 }
@@ -13,7 +13,9 @@ const char* Type::kind_names[static_cast<int>(TypeKind::TYPE_COUNT)] {
   "TYPE_ILLEGAL"
 };
 
-Type* Type::typeInt = ObjectManager::getInst().alloc_type<Type>(TypeKind::TYPE_INT, 8);
+// int 类型被所有 CompilerContext 共享, 不由 ObjectManager 管理
+static Type type_int(TypeKind::TYPE_INT, 8);
+Type* Type::typeInt = &type_int;
 
 Type::Type(TypeKind kind, std::size_t size):kind_(kind), size_(size) {}
 
@@ -1,6 +1,7 @@
-#include <atomic>
 #include <cstdint>
+#include <string>
 #include "ast.h"
+#include "context.h"
 #include "logger.h"
 #include "hash.h"
 #include "utils.h"
@@ -22,32 +23,35 @@ void ident(std::ostringstream& oss, int& ident_num) {
 }
 
 uint32_t uniqueId() {
-  static std::atomic_uint32_t unique_id{0};
-  unique_id += 1;
-  return unique_id;
+  return CompilerContext::current().uniqueId();
+}
+
+void printErrorAt(const char* message, const char* loc, Lexer& lexer) {
+  // 只打印出错的一行, 大文件出错时不会输出整个 buffer
+  SourceLocation location = lexer.locate(loc);
+  FATAL("%s\n%s:%d:%d\n %.*s\n%*s", message,
+        location.name, location.line, location.column,
+        static_cast<int>(location.line_len), location.line_begin,
+        location.column + 1, "^");
 }
 
 void printErrorInof(const char* kind_name, const char* expect, Lexer& lexer) {
-  int pos = lexer.getCurrToken().loc() - lexer.getBuf() + 1;
-  FATAL("parser %s failed  expect current token is "
-        "'%s'\n %s\n%*s", kind_name, expect, lexer.getBuf(), pos, "^");
+  std::string message = std::string("parser ") + kind_name +
+                        " failed  expect current token is '" + expect + "'";
+  printErrorAt(message.c_str(), lexer.getCurrToken().loc(), lexer);
 }
 
-bool startWithStr(const char* str, Lexer& lexer) {
-  if ((lexer.getCurrToken().kind() == TokenKind::TOKEN_PUNCT || 
-       lexer.getCurrToken().kind() == TokenKind::TOKEN_KEYWORD) &&
-      Lexer::startWith(lexer.getCurrToken().loc(), str) &&
-      lexer.getCurrToken().len() == strlen(str)) {
-    return true;
-  }
-  return false;
+bool isPunct(PunctKind punct, Lexer& lexer) {
+  return lexer.getCurrToken().is(punct);
+}
+
+bool isKeyword(KeywordKind keyword, Lexer& lexer) {
+  return lexer.getCurrToken().is(keyword);
 }
 
-bool startWithStr(const char* str, const char* kind_name, Lexer& lexer) {
-  if (!(lexer.getCurrToken().kind() == TokenKind::TOKEN_PUNCT &&
-        Lexer::startWith(lexer.getCurrToken().loc(), str) &&
-        lexer.getCurrToken().len() == strlen(str))) {
-    printErrorInof(kind_name, str, lexer);
+bool expectPunct(PunctKind punct, const char* kind_name, Lexer& lexer) {
+  if (!lexer.getCurrToken().is(punct)) {
+    printErrorInof(kind_name, Token::punctName(punct), lexer);
   }
   return true;
 }
@@ -100,4 +104,23 @@ void walkRightImpl(
 }
 
 
+void forEachNode(Expr* curr_node, const std::function<void(Expr*)>& func) {
+  for (; curr_node; curr_node = curr_node->getNext()) {
+    func(curr_node);
+    Expr* children[] = {
+      curr_node->getLeft(), curr_node->getRight(), curr_node->getInit(),
+      curr_node->getCond(), curr_node->getThen(), curr_node->getEls(),
+      curr_node->getInc(), curr_node->getStmts()
+    };
+    for (auto child: children) {
+      forEachNode(child, func);
+    }
+    if (curr_node->kind() == ExprKind::NODE_CALL) {
+      for (auto arg: static_cast<CallExpr*>(curr_node)->args()) {
+        forEachNode(arg, func);
+      }
+    }
+  }
+}
+
 } // end namespace rvcc
\ No newline at end of file
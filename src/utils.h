@@ -10,9 +10,11 @@ namespace rvcc {
 std::size_t getstrHash(const char* str, int len);
 void ident(std::ostringstream& oss, int& ident_num);
 uint32_t uniqueId();
+void printErrorAt(const char* message, const char* loc, Lexer& lexer);
 void printErrorInof(const char* kind_name, const char* expect, Lexer& lexer);
-bool startWithStr(const char* str, Lexer& lexer);
-bool startWithStr(const char* str, const char* kind_name, Lexer& lexer);
+bool isPunct(PunctKind punct, Lexer& lexer);
+bool isKeyword(KeywordKind keyword, Lexer& lexer);
+bool expectPunct(PunctKind punct, const char* kind_name, Lexer& lexer);
 
 // 如果返回值为ture 者认为该节点为非叶子节点，
 // 后续此节点继续继续递归，
@@ -32,6 +34,9 @@ void walkRightImpl(
   Func mid_func=nullptr,
   Func post_func=nullptr);
 
+// 先序访问以 curr_node 为根的全部节点, 包括语句链表, 语句的各个分支和调用参数
+void forEachNode(Expr* curr_node, const std::function<void(Expr*)>& func);
+
 } // end namespace rvcc
 
 #endif
\ No newline at end of file
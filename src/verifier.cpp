@@ -0,0 +1,312 @@
+#include "verifier.h"
+#include "ir_analysis.h"
+#include "utils.h"
+#include <algorithm>
+#include <set>
+
+namespace rvcc {
+
+namespace {
+
+std::string describe(Expr* node) {
+  return std::string(node->kindName()) + " (id " + std::to_string(node->id()) + ")";
+}
+
+std::string describe(IrInst* inst) {
+  std::string name = inst->type == IrType::IR_VOID ? "" : "%" + std::to_string(inst->id) + " ";
+  return name + "(" + inst->opcodeName() + ") in bb" + std::to_string(inst->block->id);
+}
+
+// 操作数和目标块的个数, -1 为任意个
+void irArity(IrOpcode op, int& ops, int& blocks) {
+  blocks = 0;
+  switch (op) {
+  case IrOpcode::IR_CONST:
+  case IrOpcode::IR_PARAM:
+  case IrOpcode::IR_ALLOCA:
+    ops = 0;
+    break;
+  case IrOpcode::IR_NEG:
+  case IrOpcode::IR_LOAD:
+  case IrOpcode::IR_RET:
+    ops = 1;
+    break;
+  case IrOpcode::IR_BR:
+    ops = 1;
+    blocks = 2;
+    break;
+  case IrOpcode::IR_JMP:
+    ops = 0;
+    blocks = 1;
+    break;
+  case IrOpcode::IR_CALL:
+  case IrOpcode::IR_PHI:
+    ops = -1;
+    blocks = -1;
+    break;
+  default:
+    ops = 2;
+    break;
+  }
+}
+
+// 地址和指针运算的操作数类型: load store 的地址为 ptr, ptr +- i64 为 ptr,
+// ptr - ptr 为 i64, 其余算术运算的操作数都是 i64
+bool operandTypesMatch(const IrInst* inst) {
+  auto isPtr = [&](std::size_t i) { return inst->ops[i]->type == IrType::IR_PTR; };
+  bool ptr = inst->type == IrType::IR_PTR;
+  switch (inst->op) {
+  case IrOpcode::IR_LOAD:
+    return isPtr(0);
+  case IrOpcode::IR_STORE:
+    return isPtr(1);
+  case IrOpcode::IR_ADD:
+    return ptr ? isPtr(0) != isPtr(1) : !isPtr(0) && !isPtr(1);
+  case IrOpcode::IR_SUB:
+    return ptr ? isPtr(0) && !isPtr(1) : isPtr(0) == isPtr(1);
+  case IrOpcode::IR_MUL:
+  case IrOpcode::IR_DIV:
+    return !ptr && !isPtr(0) && !isPtr(1);
+  case IrOpcode::IR_NEG:
+    return !ptr && !isPtr(0);
+  default:
+    return true;
+  }
+}
+
+} // namespace
+
+bool verifyFunction(Function* func, std::string& error) {
+  std::set<Var*> vars(func->vars().begin(), func->vars().end());
+  error.clear();
+  forEachNode(func->body(), [&](Expr* node) {
+    if (!error.empty()) {
+      return;
+    }
+    switch (node->kind()) {
+    case ExprKind::NODE_NUM:
+      break;
+    case ExprKind::NODE_ID: {
+      Var* var = static_cast<IdentityExpr*>(node)->var();
+      if (!var || !vars.count(var)) {
+        error = describe(node) + " refers to a variable of another function";
+      } else if (var->promoted() && var->type()->kind() == TypeKind::TYPE_ARRAY) {
+        error = describe(node) + " refers to a promoted array";
+      }
+      break;
+    }
+    case ExprKind::NODE_ADDR:
+      if (node->getLeft() && node->getLeft()->kind() == ExprKind::NODE_ID &&
+          static_cast<IdentityExpr*>(node->getLeft())->var()->promoted()) {
+        error = describe(node) + " takes the address of a promoted variable";
+        break;
+      }
+      // fall through
+    case ExprKind::NODE_NEG:
+    case ExprKind::NODE_DEREF:
+    case ExprKind::NODE_RETURN:
+      if (!node->getLeft()) {
+        error = describe(node) + " has no operand";
+      }
+      break;
+    case ExprKind::NODE_CALL:
+      if (static_cast<CallExpr*>(node)->args().size() >
+          static_cast<std::size_t>(kArgRegCount)) {
+        error = describe(node) + " has too many arguments";
+      }
+      break;
+    case ExprKind::NODE_ADD:
+    case ExprKind::NODE_SUB:
+    case ExprKind::NODE_MUL:
+    case ExprKind::NODE_DIV:
+    case ExprKind::NODE_EQ:
+    case ExprKind::NODE_NE:
+    case ExprKind::NODE_LT:
+    case ExprKind::NODE_LE:
+      if (!node->getLeft() || !node->getRight()) {
+        error = describe(node) + " has no operand";
+      }
+      break;
+    case ExprKind::NODE_ASSIGN:
+      if (!node->getLeft() || !node->getRight()) {
+        error = describe(node) + " has no operand";
+      } else if (node->getLeft()->kind() != ExprKind::NODE_ID &&
+                 node->getLeft()->kind() != ExprKind::NODE_DEREF) {
+        error = describe(node) + " assigns to " + node->getLeft()->kindName();
+      }
+      break;
+    case ExprKind::NODE_IF:
+      if (!node->getCond() || !node->getThen()) {
+        error = describe(node) + " has no cond or then";
+      }
+      break;
+    case ExprKind::NODE_WHILE:
+      if (!node->getCond()) {
+        error = describe(node) + " has no cond";
+      }
+      break;
+    case ExprKind::NODE_STMT:
+    case ExprKind::NODE_COMPOUND:
+    case ExprKind::NODE_FOR:
+      break;
+    default:
+      error = describe(node) + " is not a valid node";
+    }
+    if (error.empty() && node->kind() < ExprKind::NODE_STMT && !node->getType()) {
+      error = describe(node) + " has no type";
+    }
+  });
+  return error.empty();
+}
+
+bool verifyMachineFunction(const MFunction& func, std::string& error) {
+  std::set<std::string> labels;
+  for (auto& inst: func.insts) {
+    if (inst.op == MOpcode::MOP_LABEL && !labels.insert(inst.sym).second) {
+      error = "label " + inst.sym + " is defined twice";
+      return false;
+    }
+  }
+  long depth = 0;
+  for (std::size_t i = 0; i < func.insts.size(); i++) {
+    const MInst& inst = func.insts[i];
+    std::string where = "instruction " + std::to_string(i) + " (" + inst.opcodeName() + ")";
+    int regs[3];
+    std::size_t count = inst.uses(regs);
+    int def = inst.def();
+    if (def != REG_NONE) {
+      regs[count++] = def;
+    }
+    for (std::size_t j = 0; j < count; j++) {
+      if (regs[j] < 0 || (regs[j] >= REG_COUNT && !isVirtualReg(regs[j]))) {
+        error = where + " uses invalid register " + std::to_string(regs[j]);
+        return false;
+      }
+    }
+    if (inst.isBranch() && !labels.count(inst.sym)) {
+      error = where + " jumps to undefined label " + inst.sym;
+      return false;
+    }
+    if (inst.op == MOpcode::MOP_PUSH) {
+      depth++;
+    } else if (inst.op == MOpcode::MOP_POP && --depth < 0) {
+      error = where + " pops an empty stack";
+      return false;
+    }
+  }
+  if (depth != 0) {
+    error = std::to_string(depth) + " values are left on the stack";
+    return false;
+  }
+  return true;
+}
+
+bool verifyIrFunction(IrFunction& func, std::string& error) {
+  error.clear();
+  if (func.blocks().empty()) {
+    error = "function has no blocks";
+    return false;
+  }
+  DominatorTree dom(func);
+  if (!func.entry()->preds.empty()) {
+    error = "entry block bb0 has predecessors";
+    return false;
+  }
+  std::set<IrBlock*> blocks(func.blocks().begin(), func.blocks().end());
+  for (auto block: func.blocks()) {
+    std::string where = "bb" + std::to_string(block->id);
+    if (!block->terminator()) {
+      error = where + " does not end with a terminator";
+      return false;
+    }
+    bool phis = true;
+    for (auto inst: block->insts) {
+      if (inst->block != block) {
+        error = where + " contains an instruction of another block";
+        return false;
+      }
+      std::string what = describe(inst);
+      if (inst->isTerminator() && inst != block->insts.back()) {
+        error = what + " is not at the end of the block";
+        return false;
+      }
+      if (inst->op == IrOpcode::IR_PHI && !phis) {
+        error = what + " is not at the start of the block";
+        return false;
+      }
+      phis = inst->op == IrOpcode::IR_PHI;
+      if ((inst->op == IrOpcode::IR_PARAM || inst->op == IrOpcode::IR_ALLOCA) &&
+          block != func.entry()) {
+        error = what + " is not in the entry block";
+        return false;
+      }
+      if (inst->op == IrOpcode::IR_PARAM && (inst->imm < 0 || inst->imm >= kArgRegCount)) {
+        error = what + " reads parameter " + std::to_string(inst->imm) + ", only " +
+                std::to_string(kArgRegCount) + " are passed in registers";
+        return false;
+      }
+      bool valued = !inst->hasSideEffects() || inst->op == IrOpcode::IR_CALL;
+      if (valued != (inst->type != IrType::IR_VOID) ||
+          (inst->op == IrOpcode::IR_ALLOCA && inst->type != IrType::IR_PTR)) {
+        error = what + " has type " + irTypeName(inst->type);
+        return false;
+      }
+      int ops = 0;
+      int targets = 0;
+      irArity(inst->op, ops, targets);
+      if ((ops >= 0 && inst->ops.size() != static_cast<std::size_t>(ops)) ||
+          (targets >= 0 && inst->blocks.size() != static_cast<std::size_t>(targets)) ||
+          (inst->op == IrOpcode::IR_CALL && (!inst->blocks.empty() ||
+                                             inst->ops.size() > static_cast<std::size_t>(kArgRegCount))) ||
+          (inst->op == IrOpcode::IR_PHI && inst->ops.size() != inst->blocks.size())) {
+        error = what + " has " + std::to_string(inst->ops.size()) + " operands and " +
+                std::to_string(inst->blocks.size()) + " blocks";
+        return false;
+      }
+      for (auto target: inst->blocks) {
+        if (!blocks.count(target)) {
+          error = what + " refers to a block of another function";
+          return false;
+        }
+      }
+      if (inst->op == IrOpcode::IR_PHI && dom.reachable(block)) {
+        std::vector<IrBlock*> from(inst->blocks);
+        std::vector<IrBlock*> preds(block->preds);
+        std::sort(from.begin(), from.end());
+        std::sort(preds.begin(), preds.end());
+        if (from != preds) {
+          error = what + " incoming blocks do not match the predecessors";
+          return false;
+        }
+      }
+      for (std::size_t i = 0; i < inst->ops.size(); i++) {
+        IrInst* op = inst->ops[i];
+        if (!op || !op->block || !blocks.count(op->block)) {
+          error = what + " uses a deleted value";
+          return false;
+        }
+        if (op->type == IrType::IR_VOID) {
+          error = what + " uses " + describe(op) + " which has no value";
+          return false;
+        }
+        // phi 的值在来源块的末尾使用, 不可达的块中 (以及来自这些块的) 使用不检查
+        IrBlock* at = inst->op == IrOpcode::IR_PHI ? inst->blocks[i] : block;
+        if (dom.reachable(at) && !dom.dominates(op, inst, i)) {
+          error = what + " uses %" + std::to_string(op->id) + " which does not dominate it";
+          return false;
+        }
+      }
+      if (!operandTypesMatch(inst)) {
+        std::string types;
+        for (auto op: inst->ops) {
+          types += std::string(types.empty() ? "" : ", ") + irTypeName(op->type);
+        }
+        error = what + " of type " + irTypeName(inst->type) + " has operands of type " + types;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace rvcc
@@ -0,0 +1,23 @@
+#ifndef __VERIFIER_H
+#define __VERIFIER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "mir.h"
+#include <string>
+
+namespace rvcc {
+
+// 检查 pass 之后函数是否仍然合法, 不合法时返回 false 并在 error 中说明原因
+// AST: 节点的子节点和类型齐全, 变量属于该函数, 赋值的左边可以取地址
+bool verifyFunction(Function* func, std::string& error);
+// MIR: 寄存器合法, 标签唯一且跳转目标存在, push/pop 配对
+bool verifyMachineFunction(const MFunction& func, std::string& error);
+// IR: 每个块以终结指令结束, phi 在块首且来源块与前驱一致, 操作数个数和类型正确
+//     (地址为 ptr, 指针运算见 operandTypesMatch), param 的下标在参数寄存器范围内,
+//     值的定义支配所有使用
+bool verifyIrFunction(IrFunction& func, std::string& error);
+
+} // namespace rvcc
+
+#endif
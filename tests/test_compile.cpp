@@ -0,0 +1,156 @@
+#include "../src/context.h"
+#include "../src/target.h"
+#include <atomic>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace rvcc;
+
+// 多个线程并发调用 CompilerContext::compile, 结果与单线程编译相同,
+// 错误通过 diagnostics 返回而不退出进程, 整个过程不写 stdout/stderr
+
+namespace {
+
+struct Case {
+  const char* what;
+  const char* source;
+  CompileOptions options;
+  bool ok;
+};
+
+std::vector<Case> cases() {
+  CompileOptions o1;
+  o1.opt_flags = {"-O1"};
+  CompileOptions stream;
+  stream.stream = true;
+  CompileOptions x86;
+  x86.target = Target::get("x86-64");
+  x86.opt_flags = {"-O1"};
+  CompileOptions remarks;
+  remarks.save_remarks = true;
+  remarks.stats = true;
+  remarks.opt_flags = {"-O2"};
+  CompileOptions bisect;
+  bisect.opt_flags = {"-O1", "-opt-bisect-limit=1"};
+  CompileOptions unknown;
+  unknown.opt_flags = {"-fno-such-pass"};
+  const char* fib =
+    "int main() { return fib(9); } int fib(int x) { if (x<=1) return 1; return fib(x-1) + fib(x-2); }";
+  const char* loop =
+    "int main() { int a[4]; int i; int s=0; for (i=0; i<4; i=i+1) a[i]=i*3; return s+a[3]; }";
+  return {
+    {"fib -O0", fib, {}, true},
+    {"fib -O1", fib, o1, true},
+    {"loop --stream", loop, stream, true},
+    {"loop x86-64 -O1", loop, x86, true},
+    {"loop remarks stats -O2", loop, remarks, true},
+    {"fib -O1 -opt-bisect-limit=1", fib, bisect, true},
+    {"syntax error", "int main() {\n  return 1 +;\n}", {}, false},
+    {"redefined variable", "int main() { int x; int x; return 0; }", o1, false},
+    {"redefined function in --stream",
+     "int f() { return 1; } int f() { return 2; } int main() { return f(); }", stream, false},
+    {"unknown option", loop, unknown, false},
+  };
+}
+
+struct Output {
+  bool ok;
+  std::string asm_buffer;
+  std::string diagnostics;
+  std::string remarks;
+  std::string stats;
+  bool operator==(const Output& other) const {
+    return ok == other.ok && asm_buffer == other.asm_buffer &&
+           diagnostics == other.diagnostics && remarks == other.remarks && stats == other.stats;
+  }
+};
+
+Output compile(CompilerContext& context, const Case& c) {
+  static const std::regex time("[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9]{2}:[0-9]{2}:[0-9]{2}");
+  CompileResult result = context.compile(c.source, c.options);
+  return {result.ok, result.asm_buffer, std::regex_replace(result.diagnostics, time, ""),
+          result.remarks, result.stats};
+}
+
+int failures = 0;
+
+void expect(bool cond, const std::string& what) {
+  if (!cond) {
+    fprintf(stderr, "FAILED: %s\n", what.c_str());
+    failures++;
+  }
+}
+
+} // namespace
+
+int main() {
+  const int kThreads = 8;
+  const int kRounds = 20;
+  std::vector<Case> all = cases();
+
+  // stdout 和 stderr 重定向到临时文件, 编译结束后应该都是空的
+  fflush(stdout);
+  fflush(stderr);
+  FILE* captured = tmpfile();
+  int saved_stdout = dup(STDOUT_FILENO);
+  int saved_stderr = dup(STDERR_FILENO);
+  dup2(fileno(captured), STDOUT_FILENO);
+  dup2(fileno(captured), STDERR_FILENO);
+
+  std::vector<Output> expected;
+  {
+    CompilerContext context;
+    for (auto& c: all) {
+      expected.push_back(compile(context, c));
+    }
+  }
+  std::atomic<int> mismatches{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      CompilerContext context;
+      for (int round = 0; round < kRounds; round++) {
+        // 每个线程以不同的顺序编译, 同一个 context 反复使用
+        for (std::size_t i = 0; i < all.size(); i++) {
+          std::size_t index = (i + t + round) % all.size();
+          if (!(compile(context, all[index]) == expected[index])) {
+            mismatches++;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+  long written = ftell(captured) > 0 ? ftell(captured) : lseek(fileno(captured), 0, SEEK_END);
+  fclose(captured);
+
+  for (std::size_t i = 0; i < all.size(); i++) {
+    std::string what = all[i].what;
+    expect(expected[i].ok == all[i].ok, what + ": ok is " + (expected[i].ok ? "true" : "false"));
+    expect(all[i].ok ? !expected[i].asm_buffer.empty() : !expected[i].diagnostics.empty(),
+           what + ": " + (all[i].ok ? "no assembly" : "no diagnostics"));
+  }
+  expect(!expected[4].remarks.empty() && !expected[4].stats.empty(), "remarks and stats returned");
+  expect(expected[5].diagnostics.find("BISECT: ") != std::string::npos, "BISECT lines in diagnostics");
+  expect(mismatches == 0, std::to_string(mismatches) + " concurrent compiles differ");
+  expect(written == 0, std::to_string(written) + " bytes written to stdout/stderr");
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("%d threads x %d rounds match single-threaded compile\n", kThreads, kRounds);
+  return 0;
+}
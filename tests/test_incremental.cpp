@@ -0,0 +1,157 @@
+#include "../src/ast.h"
+#include "../src/incremental.h"
+#include "../src/logger.h"
+#include "../src/type.h"
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+
+using namespace rvcc;
+
+// 每次 edit 之后的结果与对修改后的源码完整解析的结果比较:
+// 函数 (名字 参数 局部变量 语句树), 是否成功, 诊断信息 (去掉时间戳)
+
+namespace {
+
+void dumpExpr(Expr* node, std::string& out) {
+  for (; node; node = node->getNext()) {
+    out += "(";
+    out += node->kindName();
+    if (node->kind() == ExprKind::NODE_NUM) {
+      out += " " + std::to_string(node->value());
+    } else if (node->kind() == ExprKind::NODE_ID) {
+      Var* var = static_cast<IdentityExpr*>(node)->var();
+      out += " " + std::string(var->getName(), var->name_len());
+    } else if (node->kind() == ExprKind::NODE_CALL) {
+      CallExpr* call = static_cast<CallExpr*>(node);
+      out += " " + call->getFuncName();
+      for (auto arg: call->args()) {
+        dumpExpr(arg, out);
+      }
+    }
+    if (node->getType()) {
+      out += std::string(" : ") + node->getType()->kindName();
+    }
+    for (Expr* child: {node->getLeft(), node->getRight(), node->getInit(), node->getCond(),
+                       node->getInc(), node->getThen(), node->getEls(), node->getStmts()}) {
+      if (child) {
+        out += " ";
+        dumpExpr(child, out);
+      }
+    }
+    out += ")";
+  }
+}
+
+std::string dumpAst(Ast* ast) {
+  std::string out;
+  for (auto& elem: ast->functions()) {
+    Function* func = elem.second;
+    out += std::string(func->name(), func->name_len()) + "(";
+    for (auto param: func->parameters()) {
+      out += std::string(param->getName(), param->name_len()) + " ";
+    }
+    out += ") vars " + std::to_string(func->vars().size()) + " ";
+    dumpExpr(func->body(), out);
+    out += "\n";
+  }
+  return out;
+}
+
+std::string stripTime(const std::string& diagnostics) {
+  static const std::regex time("[0-9]{4}-[0-9]{2}-[0-9]{2} [0-9]{2}:[0-9]{2}:[0-9]{2}");
+  return std::regex_replace(diagnostics, time, "");
+}
+
+int failures = 0;
+
+void expect(bool cond, const char* what) {
+  if (!cond) {
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+// 在 incremental 上执行 edit, 与完整解析比较
+void editAndCompare(IncrementalParser& incremental, const char* what, std::size_t offset,
+                    std::size_t removed, const std::string& text) {
+  incremental.edit(offset, removed, text);
+  IncrementalParser full;
+  full.parse(incremental.source());
+  bool same = dumpAst(incremental.ast()) == dumpAst(full.ast()) &&
+              incremental.ok() == full.ok() &&
+              stripTime(incremental.diagnostics()) == stripTime(full.diagnostics());
+  if (!same) {
+    fprintf(stderr, "%s\nsource:\n%s\nincremental (%s):\n%s%s\nfull (%s):\n%s%s\n", what,
+            incremental.source().c_str(),
+            incremental.ok() ? "ok" : "error", dumpAst(incremental.ast()).c_str(),
+            incremental.diagnostics().c_str(),
+            full.ok() ? "ok" : "error", dumpAst(full.ast()).c_str(), full.diagnostics().c_str());
+  }
+  expect(same, what);
+}
+
+std::size_t find(IncrementalParser& incremental, const std::string& text) {
+  std::size_t pos = incremental.source().find(text);
+  if (pos == std::string::npos) {
+    fprintf(stderr, "'%s' not found\n", text.c_str());
+    exit(1);
+  }
+  return pos;
+}
+
+} // namespace
+
+int main() {
+  Logger::getInst().level() = Logger::LogLevel::ERROR;
+  const std::string source =
+    "int f(int x) {\n  return x+1;\n}\n"
+    "int g(int *p, int n) {\n  int s=0;\n  int i;\n"
+    "  for (i=0; i<n; i=i+1) { s=s+p[i]; }\n  return s;\n}\n"
+    "int h() {\n  int a[2];\n  a[0]=1;\n  return g(a, 1);\n}\n"
+    "int main() {\n  return f(h());\n}\n";
+  IncrementalParser incremental;
+  incremental.parse(source);
+  expect(incremental.ok(), "initial parse");
+  std::size_t regions = incremental.regionCount();
+
+  // 函数体内的修改只重新解析该函数所在的段
+  editAndCompare(incremental, "edit inside a function body",
+                 find(incremental, "x+1"), 3, "x*2+7");
+  expect(incremental.reparsedRegions() == 1, "body edit reparses one region");
+  expect(incremental.regionCount() == regions, "body edit keeps the regions");
+
+  // 删除一个 '}' 使括号不匹配, 再补回来
+  std::size_t brace = find(incremental, "}\n  return s;");
+  editAndCompare(incremental, "edit that unbalances a brace", brace, 1, "");
+  expect(!incremental.ok(), "unbalanced brace is an error");
+  editAndCompare(incremental, "edit that repairs the brace", brace, 0, "}");
+  expect(incremental.ok(), "repaired brace parses");
+  expect(incremental.regionCount() == regions, "repaired brace restores the regions");
+
+  // 把 h 改名为 f, 与第一个函数重名, 再改回来
+  std::size_t name = find(incremental, "int h()") + 4;
+  editAndCompare(incremental, "edit that introduces a duplicate function", name, 1, "f");
+  expect(!incremental.ok(), "duplicate function is an error");
+  editAndCompare(incremental, "edit that removes the duplicate function", name, 1, "h");
+  expect(incremental.ok(), "renamed function parses");
+
+  // 后面的函数有错误时, 前面插入的换行使错误的行号后移
+  editAndCompare(incremental, "edit that introduces an error",
+                 find(incremental, "f(h())"), 6, "f(h() +)");
+  expect(!incremental.ok(), "syntax error is an error");
+  std::string before = stripTime(incremental.diagnostics());
+  editAndCompare(incremental, "edit that shifts later error lines",
+                 find(incremental, "  return x*2+7;"), 0, "\n\n\n");
+  expect(stripTime(incremental.diagnostics()) != before, "error line moves");
+  editAndCompare(incremental, "edit that shifts later error lines back",
+                 find(incremental, "\n\n\n  return x*2+7;"), 2, "");
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("incremental parse matches full parse\n");
+  return 0;
+}